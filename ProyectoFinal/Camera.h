@@ -19,6 +19,13 @@ enum Camera_Movement
 	RIGHT
 };
 
+// View frustum as six planes (xyz = inward normal, w = distance): left, right, bottom, top, near, far.
+// A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0.
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
 // Default camera values
 const GLfloat YAW = -90.0f;
 const GLfloat PITCH = 0.0f;
@@ -56,6 +63,34 @@ public:
 		return glm::lookAt(this->position, this->position + this->front, this->up);
 	}
 
+	// Extracts the frustum planes from a combined projection * view matrix (Gribb/Hartmann), normalized so
+	// that plane distances are in world units and can be compared directly against sphere radii
+	static Frustum ExtractFrustum(const glm::mat4 &projView)
+	{
+		Frustum f;
+		glm::vec4 row0(projView[0][0], projView[1][0], projView[2][0], projView[3][0]);
+		glm::vec4 row1(projView[0][1], projView[1][1], projView[2][1], projView[3][1]);
+		glm::vec4 row2(projView[0][2], projView[1][2], projView[2][2], projView[3][2]);
+		glm::vec4 row3(projView[0][3], projView[1][3], projView[2][3], projView[3][3]);
+		f.planes[0] = row3 + row0;
+		f.planes[1] = row3 - row0;
+		f.planes[2] = row3 + row1;
+		f.planes[3] = row3 - row1;
+		f.planes[4] = row3 + row2;
+		f.planes[5] = row3 - row2;
+		for (int i = 0; i < 6; i++)
+		{
+			f.planes[i] /= glm::length(glm::vec3(f.planes[i]));
+		}
+		return f;
+	}
+
+	// Frustum of this camera for the given projection
+	Frustum GetFrustum(const glm::mat4 &projection)
+	{
+		return ExtractFrustum(projection * this->GetViewMatrix());
+	}
+
 	// Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
 	void ProcessKeyboard(Camera_Movement direction, GLfloat deltaTime)
 	{
@@ -0,0 +1,315 @@
+#pragma once
+// Forward por clusters: el frustum se parte en CLUSTER_X x CLUSTER_Y celdas de pantalla y
+// CLUSTER_Z cortes de profundidad exponenciales. Cada cuadro la CPU reparte las luces (la esfera
+// que envuelve a cada una) entre los clusters que tocan y sube tres texture buffers: las luces,
+// el (inicio, cantidad) de cada cluster y la lista de indices. lighting.frag busca el cluster de
+// su fragmento y solo recorre esas luces, asi que el costo depende de las luces cercanas y no
+// del total. Texture buffers y no un SSBO: son de GL 3.3 y sirven con lighting.vs y
+// lighting_indirect.vs por igual.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "GLState.h"
+#include "Shader.h"
+#include "TextureArrays.h"
+
+#define CLUSTER_X 16                // igual que CLUSTERS en lighting.frag
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define CLUSTER_LIGHTS_UNIT  (TEXTURE_ARRAY_UNIT + 1)   // samplerBuffer uLights
+#define CLUSTER_GRID_UNIT    (TEXTURE_ARRAY_UNIT + 2)   // usamplerBuffer uClusters
+#define CLUSTER_INDEX_UNIT   (TEXTURE_ARRAY_UNIT + 3)   // usamplerBuffer uLightIndices
+#define CLUSTER_MAX_REFERENCES 65536    // minimo garantizado de GL_MAX_TEXTURE_BUFFER_SIZE
+#define LIGHT_TEXELS 5                  // vec4 por luz en uLights (igual que en lighting.frag)
+#define LIGHT_SHADOW_TILES 16           // casillas del atlas de sombras (ShadowAtlas.h; SHADOW_TILES en lighting.frag)
+
+// Foco, o luz puntual con cosOuter = -1. La atenuacion de siempre se lleva suave a cero al
+// llegar a range: la luz tiene un alcance finito y solo entra en los clusters que toca.
+// shadow es la casilla del foco en el atlas de sombras, o -1 si no proyecta sombra.
+struct Light {
+    glm::vec3 position{ 0.0f };
+    float range = 10.0f;
+    glm::vec3 direction{ 0.0f, -1.0f, 0.0f };
+    float cosInner = -1.0f, cosOuter = -1.0f;
+    glm::vec3 ambient{ 0.0f }, diffuse{ 1.0f };
+    float constant = 1.0f, linear = 0.045f, quadratic = 0.0075f;
+    int shadow = -1;
+};
+
+// Foco que apunta de `from` a `to` con conos en grados
+static inline Light MakeSpotLight(const glm::vec3& from, const glm::vec3& to, const glm::vec3& ambient,
+    const glm::vec3& diffuse, float cutOffDeg, float outerCutOffDeg, float range) {
+    Light l;
+    l.position = from;
+    l.direction = glm::normalize(to - from);
+    l.ambient = ambient; l.diffuse = diffuse;
+    l.cosInner = glm::cos(glm::radians(cutOffDeg));
+    l.cosOuter = glm::cos(glm::radians(outerCutOffDeg));
+    l.range = range;
+    return l;
+}
+
+static inline Light MakePointLight(const glm::vec3& position, const glm::vec3& ambient, const glm::vec3& diffuse, float range) {
+    Light l;
+    l.position = position;
+    l.ambient = ambient; l.diffuse = diffuse;
+    l.range = range;
+    return l;
+}
+
+// Esfera que envuelve el alcance de la luz. En un foco, la del cono: con apertura de mas de 45
+// grados la centrada en la base, si no la que pasa por la punta y el borde de la base.
+static inline glm::vec4 LightBounds(const Light& l) {
+    if (l.cosOuter <= -1.0f) return glm::vec4(l.position, l.range);
+    float c = std::max(l.cosOuter, 1e-4f);
+    if (c < 0.70710678f) return glm::vec4(l.position + l.direction * (l.range * c), l.range * std::sqrt(1.0f - c * c));
+    float r = l.range / (2.0f * c);
+    return glm::vec4(l.position + l.direction * r, r);
+}
+
+struct ClusterStats {
+    int lights = 0, visible = 0;    // visibles: las que tocaron algun cluster
+    int clusters = 0;               // clusters con al menos una luz
+    int maxPerCluster = 0;
+    size_t references = 0;          // indices en la lista
+    size_t dropped = 0;             // los que no cupieron en CLUSTER_MAX_REFERENCES
+    double ms = 0.0;                // reparto y subida en CPU
+
+    float Average() const { return clusters ? (float)references / clusters : 0.0f; }
+};
+
+class ClusteredLights {
+public:
+    static ClusteredLights& Instance() { static ClusteredLights c; return c; }
+
+    // Crea los buffers y sus texturas. Llamar con el contexto listo.
+    void Init() {
+        createBuffer(lightBuffer, lightTexture, GL_RGBA32F);
+        createBuffer(gridBuffer, gridTexture, GL_RG32UI);
+        createBuffer(indexBuffer, indexTexture, GL_R32UI);
+        lightsDirty = true;
+    }
+
+    // Samplers del programa; una vez, despues de compilarlo
+    static void Attach(const Shader& s) {
+        glUseProgram(s.Program);
+        s.SetInt(UNIFORM("uLights"), CLUSTER_LIGHTS_UNIT);
+        s.SetInt(UNIFORM("uClusters"), CLUSTER_GRID_UNIT);
+        s.SetInt(UNIFORM("uLightIndices"), CLUSTER_INDEX_UNIT);
+        glUseProgram(0);
+    }
+
+    void SetLights(const std::vector<Light>& l) { lights = l; lightsDirty = true; }
+    const std::vector<Light>& Lights() const { return lights; }
+    // Una luz que se mueve o cambia; se vuelve a subir en el proximo Update
+    void SetLight(size_t i, const Light& l) {
+        if (i >= lights.size() || std::memcmp(&lights[i], &l, sizeof(Light)) == 0) return;
+        lights[i] = l;
+        lightsDirty = true;
+    }
+
+    // Una vez por cuadro, antes de dibujar: reparte las luces con la camara del cuadro, sube lo
+    // que cambio y deja los buffers en sus unidades
+    void Update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, int width, int height) {
+        auto t0 = std::chrono::steady_clock::now();
+        if (projection != gridProjection || width != gridWidth || height != gridHeight) buildGrid(projection, zNear, zFar, width, height);
+        bin(view);
+        upload(gridBuffer, grid.data(), grid.size() * sizeof(glm::uvec2));
+        if (indices.empty()) indices.push_back(0);
+        upload(indexBuffer, indices.data(), indices.size() * sizeof(GLuint));
+
+        GLState& gl = GLState::Instance();
+        gl.ActiveTexture(CLUSTER_GRID_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        gl.ActiveTexture(CLUSTER_INDEX_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        BindLights();
+        stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    // Sube las luces si cambiaron y las deja en CLUSTER_LIGHTS_UNIT. Update ya lo hace; el camino
+    // diferido (DeferredRenderer.h) solo necesita esto, porque ilumina luz por luz.
+    void BindLights() {
+        if (lightsDirty) {
+            packed.resize(std::max<size_t>(lights.size(), 1) * LIGHT_TEXELS, glm::vec4(0.0f));
+            for (size_t i = 0; i < lights.size(); i++) pack(lights[i], &packed[i * LIGHT_TEXELS]);
+            upload(lightBuffer, packed.data(), packed.size() * sizeof(glm::vec4));
+            lightsDirty = false;
+        }
+        GLState::Instance().ActiveTexture(CLUSTER_LIGHTS_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+    }
+
+    // Tamano de las celdas y cortes del cuadro; debug colorea por cantidad de luces del cluster
+    void Apply(const Shader& s, bool debug) const {
+        GLState::Instance().UseProgram(s.Program);
+        s.SetVec4(UNIFORM("uClusterScale"), scale);
+        s.SetInt(UNIFORM("uLightDebug"), debug ? 1 : 0);
+    }
+
+    const ClusterStats& Stats() const { return stats; }
+
+    void Shutdown() {
+        GLuint b[3] = { lightBuffer, gridBuffer, indexBuffer }, t[3] = { lightTexture, gridTexture, indexTexture };
+        glDeleteBuffers(3, b);
+        glDeleteTextures(3, t);
+        lightBuffer = gridBuffer = indexBuffer = lightTexture = gridTexture = indexTexture = 0;
+    }
+
+private:
+    std::vector<Light> lights;
+    bool lightsDirty = true;
+    GLuint lightBuffer = 0, gridBuffer = 0, indexBuffer = 0;
+    GLuint lightTexture = 0, gridTexture = 0, indexTexture = 0;
+
+    // Cajas de los clusters en vista (z positiva hacia adentro); se rehacen si cambia la proyeccion
+    glm::mat4 gridProjection{ 0.0f };
+    int gridWidth = 0, gridHeight = 0;
+    float nearZ = 0.5f, farZ = 50.0f;
+    std::vector<glm::vec3> boxMin, boxMax;
+    glm::vec4 scale{ 0.0f };        // xy: clusters por pixel; zw: corte = log(z) * z + w
+
+    std::vector<glm::vec4> packed;
+    std::vector<glm::uvec2> grid;   // inicio y cantidad de cada cluster
+    std::vector<GLuint> indices;
+    std::vector<glm::uvec2> pairs;  // (cluster, luz) del cuadro
+    std::vector<GLuint> fill;
+    ClusterStats stats;
+
+    static void createBuffer(GLuint& buffer, GLuint& texture, GLenum format) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Huerfana el buffer: la textura sigue apuntando al mismo nombre
+    static void upload(GLuint buffer, const void* data, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Igual que CalcLight en lighting.frag
+    static void pack(const Light& l, glm::vec4* t) {
+        t[0] = glm::vec4(l.position, l.range);
+        t[1] = glm::vec4(l.direction, l.cosOuter);
+        t[2] = glm::vec4(l.diffuse, l.cosInner);
+        t[3] = glm::vec4(l.ambient, (float)l.shadow);
+        t[4] = glm::vec4(l.constant, l.linear, l.quadratic, 0.0f);
+    }
+
+    float sliceDepth(int k) const { return nearZ * std::pow(farZ / nearZ, (float)k / CLUSTER_Z); }
+    int slice(float z) const {
+        int k = (int)std::floor(std::log(z) * scale.z + scale.w);
+        return std::min(std::max(k, 0), CLUSTER_Z - 1);
+    }
+    static int index(int x, int y, int z) { return (z * CLUSTER_Y + y) * CLUSTER_X + x; }
+
+    void buildGrid(const glm::mat4& projection, float zNear, float zFar, int width, int height) {
+        gridProjection = projection;
+        gridWidth = width; gridHeight = height;
+        nearZ = zNear; farZ = zFar;
+        float logRatio = std::log(zFar / zNear);
+        scale = glm::vec4((float)CLUSTER_X / std::max(width, 1), (float)CLUSTER_Y / std::max(height, 1),
+            CLUSTER_Z / logRatio, -CLUSTER_Z * std::log(zNear) / logRatio);
+        boxMin.resize(CLUSTER_COUNT);
+        boxMax.resize(CLUSTER_COUNT);
+        // En vista, a la profundidad d: x = (ndc + P[2][0]) * d / P[0][0] (y igual con la fila 1)
+        for (int z = 0; z < CLUSTER_Z; z++) {
+            float d0 = sliceDepth(z), d1 = sliceDepth(z + 1);
+            for (int y = 0; y < CLUSTER_Y; y++) {
+                float y0 = -1.0f + 2.0f * y / CLUSTER_Y, y1 = -1.0f + 2.0f * (y + 1) / CLUSTER_Y;
+                for (int x = 0; x < CLUSTER_X; x++) {
+                    float x0 = -1.0f + 2.0f * x / CLUSTER_X, x1 = -1.0f + 2.0f * (x + 1) / CLUSTER_X;
+                    glm::vec3 lo(1e30f), hi(-1e30f);
+                    for (float d : { d0, d1 })
+                        for (float nx : { x0, x1 })
+                            for (float ny : { y0, y1 }) {
+                                glm::vec3 p((nx + projection[2][0]) * d / projection[0][0], (ny + projection[2][1]) * d / projection[1][1], d);
+                                lo = glm::min(lo, p); hi = glm::max(hi, p);
+                            }
+                    boxMin[index(x, y, z)] = lo;
+                    boxMax[index(x, y, z)] = hi;
+                }
+            }
+        }
+    }
+
+    // Celdas que puede cubrir la caja de la esfera (centro c en vista) entre las profundidades
+    // da y db: x / d es monotono, asi que los extremos salen de las esquinas
+    void tiles(const glm::vec3& c, float r, float da, float db, glm::ivec2& lo, glm::ivec2& hi) const {
+        const glm::mat4& p = gridProjection;
+        glm::vec2 nMin(1e30f), nMax(-1e30f);
+        for (float d : { da, db })
+            for (float sx : { -r, r }) {
+                glm::vec2 n(((c.x + sx) * p[0][0]) / d - p[2][0], ((c.y + sx) * p[1][1]) / d - p[2][1]);
+                nMin = glm::min(nMin, n); nMax = glm::max(nMax, n);
+            }
+        glm::vec2 dims((float)CLUSTER_X, (float)CLUSTER_Y);
+        lo = glm::clamp(glm::ivec2(glm::floor((nMin + 1.0f) * 0.5f * dims)), glm::ivec2(0), glm::ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+        hi = glm::clamp(glm::ivec2(glm::floor((nMax + 1.0f) * 0.5f * dims)), glm::ivec2(0), glm::ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    }
+
+    // Cada luz entra en los clusters cuya caja corta su esfera; luego se ordena por cluster
+    void bin(const glm::mat4& view) {
+        stats = ClusterStats();
+        stats.lights = (int)lights.size();
+        pairs.clear();
+        grid.assign(CLUSTER_COUNT, glm::uvec2(0));
+        for (size_t i = 0; i < lights.size(); i++) {
+            glm::vec4 s = LightBounds(lights[i]);
+            glm::vec3 c = glm::vec3(view * glm::vec4(glm::vec3(s), 1.0f));
+            c.z = -c.z;
+            float r = s.w;
+            if (c.z + r < nearZ || c.z - r > farZ) continue;
+            int k0 = slice(std::max(c.z - r, nearZ)), k1 = slice(std::min(c.z + r, farZ));
+            bool any = false;
+            for (int z = k0; z <= k1; z++) {
+                // Solo las celdas bajo la caja de la esfera proyectada en este corte
+                float da = std::max(std::max(sliceDepth(z), c.z - r), nearZ), db = std::min(sliceDepth(z + 1), c.z + r);
+                glm::ivec2 lo, hi;
+                tiles(c, r, da, std::max(da, db), lo, hi);
+                for (int y = lo.y; y <= hi.y; y++)
+                    for (int x = lo.x; x <= hi.x; x++) {
+                        int e = index(x, y, z);
+                        glm::vec3 q = glm::clamp(c, boxMin[e], boxMax[e]) - c;
+                        if (glm::dot(q, q) > r * r) continue;
+                        pairs.push_back(glm::uvec2((GLuint)e, (GLuint)i));
+                        grid[e].y++;
+                        any = true;
+                    }
+            }
+            if (any) stats.visible++;
+        }
+        // Inicio de cada cluster; lo que pase del tope se corta
+        GLuint offset = 0;
+        for (auto& g : grid) {
+            g.x = offset;
+            if (offset + g.y > CLUSTER_MAX_REFERENCES) {
+                stats.dropped += offset + g.y - CLUSTER_MAX_REFERENCES;
+                g.y = CLUSTER_MAX_REFERENCES - offset;
+            }
+            offset += g.y;
+            if (g.y) stats.clusters++;
+            stats.maxPerCluster = std::max(stats.maxPerCluster, (int)g.y);
+        }
+        stats.references = offset;
+        indices.resize(offset);
+        fill.assign(CLUSTER_COUNT, 0);
+        for (const glm::uvec2& p : pairs) {
+            const glm::uvec2& g = grid[p.x];
+            if (fill[p.x] < g.y) indices[g.x + fill[p.x]++] = p.y;
+        }
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+// Texturas precocinadas por TextureCooker: <imagen>.dds junto a la original, BC1 si es
+// opaca o BC3 si tiene alfa, con la cadena completa de mipmaps. El hash del archivo
+// fuente va en los campos reservados del encabezado, asi la cache de texturas identifica
+// el contenido sin leer la imagen original. No depende de GL (lo usa tambien el cooker).
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "MappedFile.h"
+extern "C" {
+#include "SOIL2/image_DXT.h"
+}
+
+#define COOKED_TEXTURE_TAG 0x4B4F4350u     // "PCOK" en dwReserved1[0]
+#define DDS_FOURCC(a, b, c, d) ((unsigned)(a) | ((unsigned)(b) << 8) | ((unsigned)(c) << 16) | ((unsigned)(d) << 24))
+
+struct CookedLevel {
+    int width = 0, height = 0;
+    size_t offset = 0, size = 0;        // dentro del archivo
+};
+
+struct CookedTextureInfo {
+    bool alpha = false;                 // BC3 (DXT5) en vez de BC1 (DXT1)
+    uint64_t sourceHash = 0;            // 0 si el .dds no lo genero el cooker
+    std::vector<CookedLevel> levels;
+};
+
+static inline std::string CookedTexturePath(const std::string& source) { return source + ".dds"; }
+
+// Hay version cocinada y no es mas vieja que la imagen fuente
+static inline bool CookedTextureFresh(const std::string& source) {
+    uint64_t cooked = FileModifiedTime(CookedTexturePath(source));
+    return cooked != 0 && cooked >= FileModifiedTime(source);
+}
+
+static inline size_t CookedLevelSize(int width, int height, bool alpha) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * (alpha ? 16 : 8);
+}
+
+static inline bool ParseCookedTexture(const unsigned char* data, size_t size, CookedTextureInfo& out) {
+    out = CookedTextureInfo{};
+    if (!data || size < sizeof(DDS_header)) return false;
+    DDS_header h;
+    std::memcpy(&h, data, sizeof(h));
+    if (h.dwMagic != DDS_FOURCC('D', 'D', 'S', ' ') || h.dwSize != 124) return false;
+    if (!(h.sPixelFormat.dwFlags & DDPF_FOURCC)) return false;
+    if (h.sPixelFormat.dwFourCC == DDS_FOURCC('D', 'X', 'T', '5')) out.alpha = true;
+    else if (h.sPixelFormat.dwFourCC != DDS_FOURCC('D', 'X', 'T', '1')) return false;
+    if (h.dwReserved1[0] == COOKED_TEXTURE_TAG) out.sourceHash = (uint64_t)h.dwReserved1[1] | ((uint64_t)h.dwReserved1[2] << 32);
+
+    unsigned count = (h.dwFlags & DDSD_MIPMAPCOUNT) && h.dwMipMapCount > 0 ? h.dwMipMapCount : 1;
+    size_t offset = sizeof(DDS_header);
+    int w = (int)h.dwWidth, ht = (int)h.dwHeight;
+    for (unsigned i = 0; i < count; i++) {
+        CookedLevel l;
+        l.width = w > 0 ? w : 1; l.height = ht > 0 ? ht : 1;
+        l.offset = offset; l.size = CookedLevelSize(l.width, l.height, out.alpha);
+        if (offset + l.size > size) return false;
+        out.levels.push_back(l);
+        offset += l.size;
+        w /= 2; ht /= 2;
+    }
+    return !out.levels.empty();
+}
+
+static inline bool WriteCookedTexture(const std::string& path, int width, int height, bool alpha, uint64_t sourceHash,
+    const std::vector<std::vector<unsigned char>>& levels) {
+    DDS_header h;
+    std::memset(&h, 0, sizeof(h));
+    h.dwMagic = DDS_FOURCC('D', 'D', 'S', ' ');
+    h.dwSize = 124;
+    h.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
+    h.dwWidth = width; h.dwHeight = height;
+    h.dwPitchOrLinearSize = levels.empty() ? 0 : (unsigned)levels[0].size();
+    h.dwMipMapCount = (unsigned)levels.size();
+    h.dwReserved1[0] = COOKED_TEXTURE_TAG;
+    h.dwReserved1[1] = (unsigned)(sourceHash & 0xFFFFFFFFu);
+    h.dwReserved1[2] = (unsigned)(sourceHash >> 32);
+    h.sPixelFormat.dwSize = 32;
+    h.sPixelFormat.dwFlags = DDPF_FOURCC;
+    h.sPixelFormat.dwFourCC = alpha ? DDS_FOURCC('D', 'X', 'T', '5') : DDS_FOURCC('D', 'X', 'T', '1');
+    h.sCaps.dwCaps1 = DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    FILE* f = nullptr;
+#ifdef _WIN32
+    fopen_s(&f, path.c_str(), "wb");
+#else
+    f = fopen(path.c_str(), "wb");
+#endif
+    if (!f) return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (auto& l : levels) ok = ok && fwrite(l.data(), 1, l.size(), f) == l.size();
+    fclose(f);
+    if (!ok) std::remove(path.c_str());
+    return ok;
+}
+
+// Voltea en Y un nivel BC1/BC3 sin descomprimir: invierte las filas dentro de cada bloque
+// y el orden de las filas de bloques. Falla si la altura no es multiplo de 4 (salvo 1 y 2).
+static inline bool FlipCookedLevelY(unsigned char* blocks, int width, int height, bool alpha) {
+    if (height > 4 && height % 4 != 0) return false;
+    int rows = height < 4 ? height : 4;
+    int bw = (width + 3) / 4, bh = (height + 3) / 4, bs = alpha ? 16 : 8;
+    for (int i = 0; i < bw * bh; i++) {
+        unsigned char* b = blocks + (size_t)i * bs;
+        if (alpha) {
+            // 16 indices de alfa de 3 bits: 12 bits por fila
+            uint64_t bits = 0, out = 0;
+            for (int k = 0; k < 6; k++) bits |= (uint64_t)b[2 + k] << (8 * k);
+            for (int r = 0; r < 4; r++) {
+                int src = r < rows ? rows - 1 - r : r;
+                out |= ((bits >> (12 * src)) & 0xFFF) << (12 * r);
+            }
+            for (int k = 0; k < 6; k++) b[2 + k] = (unsigned char)(out >> (8 * k));
+            b += 8;
+        }
+        // Indices de color: un byte por fila
+        unsigned char idx[4] = { b[4], b[5], b[6], b[7] };
+        for (int r = 0; r < rows; r++) b[4 + r] = idx[rows - 1 - r];
+    }
+    std::vector<unsigned char> tmp((size_t)bw * bs);
+    for (int y = 0; y < bh / 2; y++) {
+        unsigned char* a = blocks + (size_t)y * bw * bs;
+        unsigned char* c = blocks + (size_t)(bh - 1 - y) * bw * bs;
+        std::memcpy(tmp.data(), a, tmp.size()); std::memcpy(a, c, tmp.size()); std::memcpy(c, tmp.data(), tmp.size());
+    }
+    return true;
+}
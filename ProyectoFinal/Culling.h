@@ -0,0 +1,90 @@
+#pragma once
+// Culling contra el frustum de la camara por esferas en espacio mundo. Las esferas se guardan
+// en arreglos separados (x, y, z, radio) para probar cuatro a la vez con SSE contra los seis
+// planos; sin SSE se hace lo mismo de una en una.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Camera.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// Draws y triangulos de un cuadro: los que se mandaron a la cola y los que se descartaron
+// (portal*/occluded*: de los descartados, los que quito la visibilidad por salas y la oclusion)
+struct CullStats {
+    int draws = 0, culledDraws = 0, portalDraws = 0, occludedDraws = 0;
+    size_t triangles = 0, culledTriangles = 0, portalTriangles = 0, occludedTriangles = 0;
+    int visibleCells = 0, cells = 0;
+};
+
+// Esfera de la malla llevada a mundo: el radio se escala por el eje mas estirado
+static inline glm::vec4 TransformSphere(const glm::vec4& s, const glm::mat4& m) {
+    glm::vec3 c = glm::vec3(m * glm::vec4(glm::vec3(s), 1.0f));
+    float sx = glm::dot(glm::vec3(m[0]), glm::vec3(m[0]));
+    float sy = glm::dot(glm::vec3(m[1]), glm::vec3(m[1]));
+    float sz = glm::dot(glm::vec3(m[2]), glm::vec3(m[2]));
+    return glm::vec4(c, s.w * glm::sqrt(glm::max(sx, glm::max(sy, sz))));
+}
+
+// AABB de la malla llevada a mundo (centro transformado + extension por los valores absolutos)
+static inline void TransformBox(const glm::vec3& lo, const glm::vec3& hi, const glm::mat4& m, glm::vec3& outLo, glm::vec3& outHi) {
+    glm::vec3 c = glm::vec3(m * glm::vec4((lo + hi) * 0.5f, 1.0f));
+    glm::vec3 e = (hi - lo) * 0.5f;
+    glm::vec3 r = glm::abs(glm::vec3(m[0])) * e.x + glm::abs(glm::vec3(m[1])) * e.y + glm::abs(glm::vec3(m[2])) * e.z;
+    outLo = c - r; outHi = c + r;
+}
+
+// Prueba suelta de una esfera, para las que hay que revisar contra otro frustum
+static inline bool SphereInFrustum(const Frustum& f, const glm::vec4& s) {
+    for (int p = 0; p < 6; p++)
+        if (glm::dot(glm::vec3(f.planes[p]), glm::vec3(s)) + f.planes[p].w < -s.w) return false;
+    return true;
+}
+
+class SphereCuller {
+public:
+    // Las esferas nuevas quedan en el origen con radio 0 hasta que se les de valor
+    void Resize(size_t n) {
+        count = n;
+        size_t padded = (n + 3) & ~size_t(3);
+        x.assign(padded, 0.0f); y.assign(padded, 0.0f); z.assign(padded, 0.0f); r.assign(padded, 0.0f);
+    }
+    size_t Size() const { return count; }
+
+    void Set(size_t i, const glm::vec4& sphere) { x[i] = sphere.x; y[i] = sphere.y; z[i] = sphere.z; r[i] = sphere.w; }
+    glm::vec4 Get(size_t i) const { return glm::vec4(x[i], y[i], z[i], r[i]); }
+
+    // visible[i] = 1 si la esfera i toca el frustum
+    void Cull(const Frustum& f, uint8_t* visible) const {
+#ifdef CULLING_SSE
+        __m128 px[6], py[6], pz[6], pw[6];
+        for (int p = 0; p < 6; p++) {
+            px[p] = _mm_set1_ps(f.planes[p].x); py[p] = _mm_set1_ps(f.planes[p].y);
+            pz[p] = _mm_set1_ps(f.planes[p].z); pw[p] = _mm_set1_ps(f.planes[p].w);
+        }
+        const __m128 zero = _mm_setzero_ps();
+        for (size_t i = 0; i < count; i += 4) {
+            __m128 cx = _mm_loadu_ps(&x[i]), cy = _mm_loadu_ps(&y[i]), cz = _mm_loadu_ps(&z[i]);
+            __m128 negR = _mm_sub_ps(zero, _mm_loadu_ps(&r[i]));
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (int p = 0; p < 6; p++) {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)),
+                    _mm_add_ps(_mm_mul_ps(pz[p], cz), pw[p]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for (size_t k = 0; k < 4 && i + k < count; k++) visible[i + k] = (uint8_t)((mask >> k) & 1);
+        }
+#else
+        for (size_t i = 0; i < count; i++) visible[i] = SphereInFrustum(f, Get(i)) ? 1 : 0;
+#endif
+    }
+
+private:
+    size_t count = 0;
+    std::vector<float> x, y, z, r;     // con relleno hasta multiplo de 4
+};
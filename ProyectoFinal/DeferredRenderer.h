@@ -0,0 +1,280 @@
+#pragma once
+// Camino diferido, a elegir al arrancar (--deferred) para compararlo con el forward por clusters
+// en el mismo recorrido. La cola dibuja la geometria a un G-buffer compacto: difusa + marca de
+// emision (RGBA8), normal octaedrica (RGB10_A2), emision (R11F_G11F_B10F) y profundidad, de la que
+// se reconstruye la posicion. Luego, en una imagen aparte con una copia de esa profundidad, va
+// un pase a pantalla completa con la luz direccional y la emision, y un volumen por luz (cono
+// para los focos, esfera para las puntuales) sumado con blending, que solo sombrea los pixeles
+// cuya superficie queda dentro. Lo forward (lampara, skybox) se dibuja encima y Present copia
+// el resultado a la ventana.
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Camera.h"
+#include "ClusteredLights.h"
+#include "Culling.h"
+#include "GLState.h"
+#include "Shader.h"
+#include "ShadowAtlas.h"
+#include "UniformBuffers.h"
+
+#define DEFERRED_CONE_SEGMENTS 24
+#define DEFERRED_SPHERE_SLICES 16
+#define DEFERRED_SPHERE_STACKS 8
+
+struct DeferredStats {
+    int volumes = 0, culled = 0;    // volumenes dibujados y luces fuera del frustum
+};
+
+class DeferredRenderer {
+public:
+    // Programas de luz, volumenes y G-buffer; false si el driver no acepta los framebuffers
+    bool Init(int width, int height) {
+        ambient.reset(new Shader("Shader/deferred_quad.vs", "Shader/deferred_ambient.frag"));
+        light.reset(new Shader("Shader/deferred_volume.vs", "Shader/deferred_light.frag"));
+        UniformBuffers::Attach(*light);
+        ShadowAtlas::Attach(*light);
+        for (Shader* s : { ambient.get(), light.get() }) {
+            glUseProgram(s->Program);
+            s->SetInt(UNIFORM("gAlbedo"), 0);
+            s->SetInt(UNIFORM("gNormal"), 1);
+            s->SetInt(UNIFORM("gEmission"), 2);
+            s->SetInt(UNIFORM("gDepth"), 3);
+        }
+        light->SetInt(UNIFORM("uLights"), CLUSTER_LIGHTS_UNIT);
+        glUseProgram(0);
+        glGenVertexArrays(1, &emptyVao);
+        buildCone();
+        buildSphere();
+        return Resize(width, height);
+    }
+
+    // Rehace los framebuffers si cambio el tamano
+    bool Resize(int w, int h) {
+        if (w == width && h == height && gbuffer) return true;
+        destroyTargets();
+        width = w; height = h;
+        glGenFramebuffers(1, &gbuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, gbuffer);
+        albedo = target(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT0);
+        normal = target(GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, GL_COLOR_ATTACHMENT1);
+        emission = target(GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, GL_COLOR_ATTACHMENT2);
+        depth = target(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, GL_DEPTH_STENCIL_ATTACHMENT);
+        GLenum buffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers(3, buffers);
+        bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        // Imagen final: mismo formato de profundidad para poder copiarla con glBlitFramebuffer
+        glGenFramebuffers(1, &composite);
+        glBindFramebuffer(GL_FRAMEBUFFER, composite);
+        glGenRenderbuffers(2, compositeBuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, compositeBuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, compositeBuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, compositeBuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, compositeBuffers[1]);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        ok = ok && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!ok) std::cout << "G-buffer incompleto; se queda el camino forward" << std::endl;
+        return ok;
+    }
+
+    // Antes de la cola: todo lo opaco va al G-buffer
+    void BeginGeometry() {
+        glBindFramebuffer(GL_FRAMEBUFFER, gbuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // Despues de la cola y de las consultas de oclusion (que prueban contra esta profundidad).
+    // Las luces ya deben estar en CLUSTER_LIGHTS_UNIT (ClusteredLights::BindLights), en el
+    // mismo orden que lights. Deja enlazada la imagen final, con la profundidad de la escena.
+    void Shade(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+        const Frustum& frustum, const glm::vec3& background) {
+        GLState& gl = GLState::Instance();
+        stats = DeferredStats();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gbuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, composite);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, composite);
+        glClearColor(background.r, background.g, background.b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        gl.BindTexture2D(0, albedo);
+        gl.BindTexture2D(1, normal);
+        gl.BindTexture2D(2, emission);
+        gl.BindTexture2D(3, depth);
+
+        // Direccional y emision en todo lo que tiene geometria
+        glDisable(GL_DEPTH_TEST);
+        gl.UseProgram(ambient->Program);
+        gl.BindVertexArray(emptyVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        gl.CountDraw();
+
+        // Caras traseras del volumen que quedan detras de la superficie: solo los pixeles cuya
+        // superficie esta dentro (o delante) del volumen, tambien con la camara adentro
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_GEQUAL);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        gl.UseProgram(light->Program);
+        light->SetMat4(UNIFORM("uInvViewProj"), glm::inverse(projection * view));
+        light->SetVec2(UNIFORM("uScreenSize"), glm::vec2((float)width, (float)height));
+        for (size_t i = 0; i < lights.size(); i++) {
+            const Light& l = lights[i];
+            if (!SphereInFrustum(frustum, LightBounds(l))) { stats.culled++; continue; }
+            bool cone = l.cosOuter > 0.2f;      // aperturas de hasta ~78 grados; mas abiertas, esfera
+            const Volume& v = cone ? coneVolume : sphereVolume;
+            light->SetMat4(UNIFORM("model"), cone ? coneMatrix(l) : glm::scale(glm::translate(glm::mat4(1.0f), l.position), glm::vec3(l.range)));
+            light->SetInt(UNIFORM("uLight"), (GLint)i);
+            gl.BindVertexArray(v.vao);
+            glDrawElements(GL_TRIANGLES, v.count, GL_UNSIGNED_SHORT, nullptr);
+            gl.CountDraw();
+            stats.volumes++;
+        }
+        glDisable(GL_BLEND);
+        glDisable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+    // Al final del cuadro: la imagen final a la ventana
+    void Present() {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, composite);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    const DeferredStats& Stats() const { return stats; }
+
+    void Shutdown() {
+        destroyTargets();
+        for (Volume* v : { &coneVolume, &sphereVolume }) {
+            glDeleteVertexArrays(1, &v->vao);
+            glDeleteBuffers(1, &v->vbo);
+            glDeleteBuffers(1, &v->ebo);
+            *v = Volume();
+        }
+        glDeleteVertexArrays(1, &emptyVao);
+        emptyVao = 0;
+    }
+
+private:
+    struct Volume {
+        GLuint vao = 0, vbo = 0, ebo = 0;
+        GLsizei count = 0;
+    };
+
+    std::unique_ptr<Shader> ambient, light;
+    GLuint gbuffer = 0, composite = 0, compositeBuffers[2] = { 0, 0 };
+    GLuint albedo = 0, normal = 0, emission = 0, depth = 0;
+    GLuint emptyVao = 0;
+    Volume coneVolume, sphereVolume;
+    int width = 0, height = 0;
+    DeferredStats stats;
+
+    GLuint target(GLenum internalFormat, GLenum format, GLenum type, GLenum attachment) const {
+        GLuint t;
+        glGenTextures(1, &t);
+        glBindTexture(GL_TEXTURE_2D, t);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, t, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        // La cache cree que la unidad activa tiene otra textura
+        GLState::Instance().Invalidate();
+        return t;
+    }
+
+    void destroyTargets() {
+        GLuint textures[4] = { albedo, normal, emission, depth };
+        glDeleteTextures(4, textures);
+        glDeleteRenderbuffers(2, compositeBuffers);
+        GLuint fbos[2] = { gbuffer, composite };
+        glDeleteFramebuffers(2, fbos);
+        albedo = normal = emission = depth = gbuffer = composite = compositeBuffers[0] = compositeBuffers[1] = 0;
+    }
+
+    // Cono unitario: punta en el origen, base de radio 1 en z = 1
+    glm::mat4 coneMatrix(const Light& l) const {
+        glm::vec3 z = l.direction;
+        glm::vec3 up = std::fabs(z.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 x = glm::normalize(glm::cross(up, z)), y = glm::cross(z, x);
+        // La base es un poligono inscrito: se agranda para que contenga al circulo
+        float radius = l.range * std::sqrt(1.0f - l.cosOuter * l.cosOuter) / l.cosOuter / std::cos(glm::pi<float>() / DEFERRED_CONE_SEGMENTS);
+        return glm::mat4(glm::vec4(x * radius, 0.0f), glm::vec4(y * radius, 0.0f), glm::vec4(z * l.range, 0.0f), glm::vec4(l.position, 1.0f));
+    }
+
+    void buildCone() {
+        std::vector<glm::vec3> v{ glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f) };
+        std::vector<GLushort> idx;
+        for (int i = 0; i < DEFERRED_CONE_SEGMENTS; i++) {
+            float a = 2.0f * glm::pi<float>() * i / DEFERRED_CONE_SEGMENTS;
+            v.push_back(glm::vec3(std::cos(a), std::sin(a), 1.0f));
+        }
+        for (int i = 0; i < DEFERRED_CONE_SEGMENTS; i++) {
+            GLushort a = (GLushort)(2 + i), b = (GLushort)(2 + (i + 1) % DEFERRED_CONE_SEGMENTS);
+            idx.insert(idx.end(), { 0, a, b, 1, a, b });
+        }
+        upload(coneVolume, v, idx, glm::vec3(0.0f, 0.0f, 0.5f));
+    }
+
+    // Esfera de radio algo mayor que 1 para que las caras planas no la recorten
+    void buildSphere() {
+        float grow = 1.0f / (std::cos(glm::pi<float>() / DEFERRED_SPHERE_SLICES) * std::cos(glm::pi<float>() / (2 * DEFERRED_SPHERE_STACKS)));
+        std::vector<glm::vec3> v;
+        std::vector<GLushort> idx;
+        for (int s = 0; s <= DEFERRED_SPHERE_STACKS; s++) {
+            float t = glm::pi<float>() * s / DEFERRED_SPHERE_STACKS;
+            for (int i = 0; i < DEFERRED_SPHERE_SLICES; i++) {
+                float p = 2.0f * glm::pi<float>() * i / DEFERRED_SPHERE_SLICES;
+                v.push_back(grow * glm::vec3(std::sin(t) * std::cos(p), std::cos(t), std::sin(t) * std::sin(p)));
+            }
+        }
+        for (int s = 0; s < DEFERRED_SPHERE_STACKS; s++)
+            for (int i = 0; i < DEFERRED_SPHERE_SLICES; i++) {
+                GLushort a = (GLushort)(s * DEFERRED_SPHERE_SLICES + i), b = (GLushort)(s * DEFERRED_SPHERE_SLICES + (i + 1) % DEFERRED_SPHERE_SLICES);
+                GLushort c = (GLushort)(a + DEFERRED_SPHERE_SLICES), d = (GLushort)(b + DEFERRED_SPHERE_SLICES);
+                if (s > 0) idx.insert(idx.end(), { a, b, c });
+                if (s < DEFERRED_SPHERE_STACKS - 1) idx.insert(idx.end(), { b, d, c });
+            }
+        upload(sphereVolume, v, idx, glm::vec3(0.0f));
+    }
+
+    // Deja cada triangulo mirando hacia afuera de center (el culling depende de eso)
+    static void upload(Volume& vol, const std::vector<glm::vec3>& v, std::vector<GLushort>& idx, const glm::vec3& center) {
+        for (size_t i = 0; i + 2 < idx.size(); i += 3) {
+            const glm::vec3 &a = v[idx[i]], &b = v[idx[i + 1]], &c = v[idx[i + 2]];
+            if (glm::dot(glm::cross(b - a, c - a), (a + b + c) / 3.0f - center) < 0.0f) std::swap(idx[i + 1], idx[i + 2]);
+        }
+        glGenVertexArrays(1, &vol.vao);
+        glGenBuffers(1, &vol.vbo);
+        glGenBuffers(1, &vol.ebo);
+        glBindVertexArray(vol.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vol.vbo);
+        glBufferData(GL_ARRAY_BUFFER, v.size() * sizeof(glm::vec3), v.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vol.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(GLushort), idx.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        vol.count = (GLsizei)idx.size();
+        GLState::Instance().Invalidate();
+    }
+};
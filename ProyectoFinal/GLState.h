@@ -0,0 +1,100 @@
+#pragma once
+// Cache del estado GL que mas se repite al dibujar: programa, texturas 2D y arreglos de texturas
+// por unidad y VAO.
+// Cada llamada pedida se cuenta, y solo se manda a GL si cambia algo (o siempre, con la
+// cache apagada, para medir el camino de antes). Quien toque ese estado por fuera debe
+// llamar Invalidate().
+#include <cstring>
+#include <GL/glew.h>
+
+#define GL_STATE_TEXTURE_UNITS 16
+
+// Llamadas GL de un cuadro: pedidas por el codigo y realmente emitidas
+struct GLCallStats {
+    int programs = 0, textures = 0, activeTextures = 0, vaos = 0, draws = 0;
+    int requested = 0;
+    int instances = 0;      // dibujadas con draws instanciados
+    int indirect = 0;       // mallas dibujadas dentro de un glMultiDrawElementsIndirect
+
+    int Issued() const { return programs + textures + activeTextures + vaos + draws; }
+};
+
+class GLState {
+public:
+    static GLState& Instance() { static GLState s; return s; }
+
+    // false: todas las llamadas llegan a GL (sirve para comparar contra la cache)
+    void SetCaching(bool on) { caching = on; Invalidate(); }
+    bool Caching() const { return caching; }
+
+    // Olvida lo que creia saber del contexto
+    void Invalidate() {
+        program = vao = ~0u;
+        activeUnit = ~0u;
+        std::memset(textures, 0xFF, sizeof(textures));
+        std::memset(arrays, 0xFF, sizeof(arrays));
+    }
+
+    void UseProgram(GLuint p) {
+        stats.requested++;
+        if (caching && p == program) return;
+        glUseProgram(p);
+        program = p;
+        stats.programs++;
+    }
+
+    void ActiveTexture(GLuint unit) {
+        stats.requested++;
+        if (caching && unit == activeUnit) return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        stats.activeTextures++;
+    }
+
+    // Solo GL_TEXTURE_2D; la unidad activa se cambia nada mas si hace falta bindear
+    void BindTexture2D(GLuint unit, GLuint tex) {
+        if (unit >= GL_STATE_TEXTURE_UNITS) { ActiveTexture(unit); glBindTexture(GL_TEXTURE_2D, tex); stats.textures++; return; }
+        stats.requested++;
+        if (caching && textures[unit] == tex) return;
+        ActiveTexture(unit);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        textures[unit] = tex;
+        stats.textures++;
+    }
+
+    // GL_TEXTURE_2D_ARRAY; se cuenta junto con las 2D
+    void BindTexture2DArray(GLuint unit, GLuint tex) {
+        if (unit >= GL_STATE_TEXTURE_UNITS) { ActiveTexture(unit); glBindTexture(GL_TEXTURE_2D_ARRAY, tex); stats.textures++; return; }
+        stats.requested++;
+        if (caching && arrays[unit] == tex) return;
+        ActiveTexture(unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+        arrays[unit] = tex;
+        stats.textures++;
+    }
+
+    void BindVertexArray(GLuint v) {
+        stats.requested++;
+        if (caching && v == vao) return;
+        glBindVertexArray(v);
+        vao = v;
+        stats.vaos++;
+    }
+
+    void CountDraw(int instances = 0) { stats.requested++; stats.draws++; stats.instances += instances; }
+    // Un multi-draw cuenta como un draw
+    void CountMultiDraw(int meshes) { stats.requested++; stats.draws++; stats.indirect += meshes; }
+
+    // Contadores del cuadro en curso; FrameStats() los devuelve y empieza de cero
+    const GLCallStats& Stats() const { return stats; }
+    GLCallStats FrameStats() { GLCallStats s = stats; stats = GLCallStats(); return s; }
+
+private:
+    bool caching = true;
+    GLuint program = ~0u, vao = ~0u, activeUnit = ~0u;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+    GLuint arrays[GL_STATE_TEXTURE_UNITS];
+    GLCallStats stats;
+
+    GLState() { Invalidate(); }
+};
@@ -0,0 +1,144 @@
+#pragma once
+// Multi-draw indirecto para la geometria estatica iluminada. Las mallas que manda la cola se
+// juntan por cubeta (formato de la arena, tipo de indice y arreglo de texturas o textura 2D de la
+// difusa) y cada cubeta sale en un glMultiDrawElementsIndirect. Matriz, matriz normal, emision y
+// capa de cada draw van en un SSBO que lighting_indirect.vs lee con gl_DrawIDARB.
+// Necesita GL 4.3 (los dos shaders son #version 430) y ARB_shader_draw_parameters; sin eso, o si
+// no enlazan, la cola dibuja malla por malla como siempre.
+// Con depthOnly (prepase de profundidad, depth_indirect.vs) las cubetas son solo de formato: se
+// dibuja el flujo de posiciones de la arena y se respeta el orden de cerca a lejos de la cola.
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "GLState.h"
+#include "Mesh.h"
+#include "MeshArena.h"
+#include "Shader.h"
+#include "TextureArrays.h"
+
+#define INDIRECT_SSBO_BINDING 0     // igual que binding en lighting_indirect.vs
+
+// Lo que lee glMultiDrawElementsIndirect por draw
+struct IndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Un draw en el SSBO (std430, igual que DrawData en lighting_indirect.vs)
+struct IndirectDrawData {
+    glm::mat4 model;
+    glm::vec4 normal[3];
+    glm::vec4 emissive;     // rgb * intensidad
+    glm::vec4 posScale;
+    glm::vec4 posBias;
+    glm::ivec4 material;    // x: capa de la difusa o -1
+};
+
+class IndirectRenderer {
+public:
+    static bool Supported() {
+        return GLEW_VERSION_4_3 && GLEW_ARB_shader_draw_parameters;
+    }
+
+    bool Empty() const { return entries.empty(); }
+
+    // normal puede ser nullptr: se calcula aqui
+    void Add(const Mesh& mesh, const glm::mat4& model, const glm::mat3* normal, const glm::vec4& emissive) {
+        Entry e;
+        e.mesh = &mesh;
+        e.array = mesh.DiffuseArray();
+        e.texture = e.array ? 0 : mesh.DiffuseTexture();
+        IndirectDrawData& d = e.data;
+        glm::mat3 n = normal ? *normal : glm::transpose(glm::inverse(glm::mat3(model)));
+        d.model = model;
+        for (int c = 0; c < 3; c++) d.normal[c] = glm::vec4(n[c], 0.0f);
+        d.emissive = glm::vec4(glm::vec3(emissive) * emissive.w, 0.0f);
+        d.posScale = glm::vec4(mesh.PosScale(), 0.0f);
+        d.posBias = glm::vec4(mesh.PosBias(), 0.0f);
+        d.material = glm::ivec4(mesh.DiffuseLayer(), 0, 0, 0);
+        entries.push_back(e);
+    }
+
+    // Con el programa ya puesto; deja la cola vacia
+    void Flush(const Shader& shader, bool depthOnly = false) {
+        if (entries.empty()) return;
+        GLState& gl = GLState::Instance();
+        // Sin texturas que bindear las cubetas quedan solo por formato
+        if (depthOnly) for (Entry& e : entries) e.array = e.texture = 0;
+        // Orden estable: dentro de cada cubeta se respeta el de la cola
+        std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            const MeshRange& ra = a.mesh->Range();
+            const MeshRange& rb = b.mesh->Range();
+            if (ra.pool != rb.pool) return ra.pool < rb.pool;
+            if (ra.indexType != rb.indexType) return ra.indexType < rb.indexType;
+            if (a.array != b.array) return a.array < b.array;
+            return a.texture < b.texture;
+        });
+        draws.clear();
+        commands.clear();
+        for (const Entry& e : entries) {
+            const MeshRange& r = e.mesh->Range();
+            draws.push_back(e.data);
+            commands.push_back(IndirectCommand{ (GLuint)r.indexCount, 1, r.FirstIndex(), r.baseVertex, 0 });
+        }
+        upload(GL_SHADER_STORAGE_BUFFER, ssbo, ssboCapacity, draws.data(), draws.size() * sizeof(IndirectDrawData));
+        upload(GL_DRAW_INDIRECT_BUFFER, indirect, indirectCapacity, commands.data(), commands.size() * sizeof(IndirectCommand));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDIRECT_SSBO_BINDING, ssbo);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect);
+
+        if (!depthOnly) {
+            shader.SetInt(UNIFORM("texture_diffuse1"), 0);
+            shader.SetInt(UNIFORM("texture_diffuse_array"), TEXTURE_ARRAY_UNIT);
+        }
+        const MeshArena& arena = MeshArena::Instance();
+        for (size_t i = 0; i < entries.size(); ) {
+            const Entry& first = entries[i];
+            const MeshRange& r = first.mesh->Range();
+            size_t n = 1;
+            while (i + n < entries.size() && sameBucket(first, entries[i + n])) n++;
+            gl.BindVertexArray(depthOnly ? arena.DepthVertexArray(r.pool) : arena.VertexArray(r.pool));
+            if (!depthOnly) {
+                if (first.array) gl.BindTexture2DArray(TEXTURE_ARRAY_UNIT, first.array);
+                else gl.BindTexture2D(0, first.texture);
+            }
+            shader.SetInt(UNIFORM("uDrawBase"), (GLint)i);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, r.indexType, (void*)(i * sizeof(IndirectCommand)), (GLsizei)n, 0);
+            gl.CountMultiDraw((int)n);
+            i += n;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        entries.clear();
+    }
+
+private:
+    struct Entry {
+        const Mesh* mesh;
+        GLuint array, texture;
+        IndirectDrawData data;
+    };
+    std::vector<Entry> entries;
+    std::vector<IndirectDrawData> draws;
+    std::vector<IndirectCommand> commands;
+    GLuint ssbo = 0, indirect = 0;
+    size_t ssboCapacity = 0, indirectCapacity = 0;
+
+    static bool sameBucket(const Entry& a, const Entry& b) {
+        return a.mesh->Range().pool == b.mesh->Range().pool && a.mesh->Range().indexType == b.mesh->Range().indexType &&
+            a.array == b.array && a.texture == b.texture;
+    }
+
+    // Huerfana el buffer en cada cuadro para no esperar a que la GPU termine con el anterior
+    static void upload(GLenum target, GLuint& buffer, size_t& capacity, const void* data, size_t bytes) {
+        if (!buffer) glGenBuffers(1, &buffer);
+        capacity = std::max(capacity, bytes);
+        glBindBuffer(target, buffer);
+        glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(target, 0, bytes, data);
+        glBindBuffer(target, 0);
+    }
+};
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <cmath>
 #include <cstring>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -18,6 +19,14 @@
 #include "Shader.h"
 #include "Camera.h"
 #include "Model.h"
+#include "ModelLoader.h"
+#include "UniformBuffers.h"
+#include "ClusteredLights.h"
+#include "DeferredRenderer.h"
+#include "PassQuery.h"
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "ShadowAtlas.h"
 
 // ====== SHADERS EMBEBIDOS ======
 static const char* SKIN_VS_SRC = R"(#version 330 core
@@ -26,8 +35,16 @@ layout (location=1) in vec3 aNormal;
 layout (location=2) in vec2 aTex;
 layout (location=5) in ivec4 aBoneIDs;
 layout (location=6) in vec4  aWeights;
-uniform mat4 model, view, projection;
+uniform mat4 model;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 uniform mat4 bones[100];
+uniform vec3 uPosScale = vec3(1.0);
+uniform vec3 uPosBias  = vec3(0.0);
 out vec2 TexCoords;
 out vec3 NormalWS;
 out vec3 PosWS;
@@ -40,7 +57,7 @@ void main(){
                aWeights.z*bones[aBoneIDs.z] +
                aWeights.w*bones[aBoneIDs.w];
     }
-    vec4 worldPos = model * (skin * vec4(aPos,1.0));
+    vec4 worldPos = model * (skin * vec4(aPos*uPosScale + uPosBias,1.0));
     PosWS = worldPos.xyz;
     mat3 nrmMat = mat3(transpose(inverse(model))) * mat3(skin);
     NormalWS = normalize(nrmMat * aNormal);
@@ -54,11 +71,14 @@ out vec4 FragColor;
 in vec2 TexCoords;
 in vec3 NormalWS;
 uniform sampler2D texture_diffuse1;
+uniform sampler2DArray texture_diffuse_array;
+uniform int uDiffuseLayer = -1;
 uniform vec3 dirLight_direction = vec3(-0.2,-1.0,-0.3);
 uniform vec3 dirLight_ambient   = vec3(0.6,0.6,0.6);
 uniform vec3 dirLight_diffuse   = vec3(0.6,0.6,0.6);
 void main(){
-    vec3 base = texture(texture_diffuse1, TexCoords).rgb;
+    vec3 base = uDiffuseLayer >= 0 ? texture(texture_diffuse_array, vec3(TexCoords, float(uDiffuseLayer))).rgb
+                                   : texture(texture_diffuse1, TexCoords).rgb;
     if(base == vec3(0.0)) base = vec3(0.6);
     vec3 n = normalize(NormalWS);
     float ndl = max(dot(n, normalize(-dirLight_direction)), 0.0);
@@ -71,7 +91,13 @@ void main(){
 static const char* COLOR_VS_SRC = R"(#version 330 core
 layout (location=0) in vec3 aPos;
 layout (location=1) in vec3 aNormal;
-uniform mat4 model, view, projection;
+uniform mat4 model;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 out vec3 NormalWS;
 void main(){
     mat3 nrmMat = mat3(transpose(inverse(model)));
@@ -100,7 +126,13 @@ static const char* QUAD_VS_SRC = R"(#version 330 core
 layout (location=0) in vec3 aPos;
 layout (location=1) in vec3 aNormal;
 layout (location=2) in vec2 aTex;
-uniform mat4 model, view, projection;
+uniform mat4 model;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 out vec2 vUV;
 void main(){
     vUV = aTex;
@@ -122,8 +154,12 @@ void main(){
 static const char* SKYBOX_VS_SRC = R"(#version 330 core
 layout (location=0) in vec3 aPos;
 out vec3 TexDir;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 void main(){
     mat4 viewNoT = mat4(mat3(view));
     vec4 pos = projection * viewNoT * vec4(aPos,1.0);
@@ -278,6 +314,17 @@ int dogAnim = 0; float FLegs = 0, RLegs = 0, head = 0, tail = 0; glm::vec3 dogPo
 bool pikachuAnim = false; bool toadAnim = false;
 float toadTime = 0.0f; float crashTime = 0.0f;
 bool crashAnim = false; float consoleRotation = 0.0f;
+bool immediateRender = false;   // R: camino inmediato sin ordenar ni cache de estado, para comparar
+int statsFrames = 0;            // cuadros desde el ultimo cambio de camino; en el 2o se imprimen las llamadas GL
+bool frustumCulling = true;     // F: descartar lo que queda fuera de la camara
+bool portalCulling = true;      // P: descartar las salas que no se ven por las puertas
+bool occlusionCulling = true;   // O: descartar lo que las consultas de oclusion dieron por tapado
+bool multiDraw = true;          // M: geometria estatica iluminada en multi-draws indirectos (si el driver puede)
+bool staticBatching = true;     // B: colocaciones static unidas en lotes ya en mundo
+bool lightDebug = false;        // L: colorea por cantidad de luces en cada cluster
+bool shadowsOn = true;          // H: sombras de los focos con shadow en la escena
+bool depthPrepass = true;       // Z: profundidad de lo opaco antes del color, que luego va con GL_EQUAL
+int measureFrames = 0;          // X: cuadros que faltan de la medicion sin y con prepase
 float limite = 2.2f;
 GLfloat deltaTime = 0.0f, lastFrame = 0.0f;
 
@@ -299,6 +346,35 @@ static GLuint LoadCubemapSOIL(
     const char* py, const char* ny,
     const char* pz, const char* nz)
 {
+    // Caras cocinadas por TextureCooker: se suben directo, sin mipmapear ni comprimir
+    const char* faces[6] = { px, nx, py, ny, pz, nz };
+    bool cooked = true;
+    for (const char* f : faces) cooked = cooked && CookedTextureFresh(f);
+    if (cooked) {
+        GLuint cube; glGenTextures(1, &cube);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cube);
+        GLint maxLevel = 1000;
+        for (int i = 0; i < 6 && cooked; i++) {
+            MappedFile f;
+            CookedTextureInfo info;
+            cooked = f.Open(CookedTexturePath(faces[i])) && ParseCookedTexture(f.Data(), f.Size(), info) &&
+                UploadCookedLevels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, f.Data(), info, false);
+            maxLevel = std::min(maxLevel, (GLint)info.levels.size() - 1);
+        }
+        if (cooked) {
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, maxLevel);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+            return cube;
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        glDeleteTextures(1, &cube);
+    }
+
     GLuint id = SOIL_load_OGL_cubemap(
         px, nx, py, ny, pz, nz,
         SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID,
@@ -324,7 +400,11 @@ static glm::vec3 ForwardFromYaw(float deg) {
     return glm::normalize(glm::vec3(std::sin(r), 0.0f, -std::cos(r)));
 }
 
-int main() {
+int main(int argc, char** argv) {
+    // --deferred: camino diferido en vez del forward por clusters (se elige al arrancar)
+    bool deferred = false;
+    for (int i = 1; i < argc; i++) if (std::strcmp(argv[i], "--deferred") == 0) deferred = true;
+
     glfwInit();
     glfwWindowHint(GLFW_DEPTH_BITS, 24);
     GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Proyecto Final", nullptr, nullptr);
@@ -358,74 +438,112 @@ int main() {
     Shader colorShader("Shader/_color_runtime.vs", "Shader/_color_runtime.frag");
     Shader quadShader("Shader/_quad_runtime.vs", "Shader/_quad_runtime.frag");
     Shader skyShader("Shader/_skybox_runtime.vs", "Shader/_skybox_runtime.frag");
+    // view/projection llegan por un UBO compartido (bloque Frame); las luces, por clusters
+    UniformBuffers::Instance().Init();
+    for (Shader* s : { &lightingShader, &lampShader, &skinnedShader, &colorShader, &quadShader, &skyShader })
+        UniformBuffers::Attach(*s);
+    ClusteredLights::Instance().Init();
+    ClusteredLights::Attach(lightingShader);
+    // Atlas de sombras de los focos; los programas de luz leen su capa viva
+    ShadowAtlas& shadows = ShadowAtlas::Instance();
+    shadows.Init();
+    ShadowAtlas::Attach(lightingShader);
+    // Variante de lightingShader para glMultiDrawElementsIndirect; sin GL 4.3 se queda el camino por malla
+    std::unique_ptr<Shader> lightingIndirect;
+    // Un programa indirecto que no enlaza se descarta y su pase queda malla por malla
+    auto dropUnlinked = [](std::unique_ptr<Shader>& s, const char* name) {
+        if (s && !s->Linked()) {
+            std::cout << "Sin multi-draw indirecto en " << name << ": el programa no enlazo\n";
+            s.reset();
+        }
+    };
+    if (IndirectRenderer::Supported()) {
+        lightingIndirect.reset(new Shader("Shader/lighting_indirect.vs", "Shader/lighting.frag"));
+        dropUnlinked(lightingIndirect, "lighting");
+    }
+    if (lightingIndirect) {
+        UniformBuffers::Attach(*lightingIndirect);
+        ClusteredLights::Attach(*lightingIndirect);
+        ShadowAtlas::Attach(*lightingIndirect);
+    }
+    else if (!IndirectRenderer::Supported())
+        std::cout << "Sin multi-draw indirecto (hace falta GL 4.3 y ARB_shader_draw_parameters)\n";
+    // Camino diferido: las mismas colocaciones, pero la cola las dibuja al G-buffer con estos programas
+    DeferredRenderer deferredPath;
+    std::unique_ptr<Shader> gbufferShader, gbufferIndirect, gbufferSkinned;
+    if (deferred) {
+        gbufferShader.reset(new Shader("Shader/lighting.vs", "Shader/gbuffer.frag"));
+        gbufferSkinned.reset(new Shader("Shader/_skin_runtime.vs", "Shader/gbuffer_skin.frag"));
+        if (lightingIndirect) gbufferIndirect.reset(new Shader("Shader/lighting_indirect.vs", "Shader/gbuffer.frag"));
+        dropUnlinked(gbufferIndirect, "gbuffer");
+        for (Shader* s : { gbufferShader.get(), gbufferSkinned.get(), gbufferIndirect.get() })
+            if (s) UniformBuffers::Attach(*s);
+        deferred = deferredPath.Init(SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+    std::cout << "Camino de luz: " << (deferred ? "diferido" : "forward por clusters") << std::endl;
+    const Shader& opaqueShader = deferred ? *gbufferShader : lightingShader;
+    const Shader* opaqueIndirect = deferred ? gbufferIndirect.get() : lightingIndirect.get();
+    // Prepase de profundidad: solo el flujo de posiciones, con o sin multi-draw como el color
+    Shader depthShader("Shader/depth.vs", "Shader/depth.frag");
+    UniformBuffers::Attach(depthShader);
+    std::unique_ptr<Shader> depthIndirect;
+    if (lightingIndirect) {
+        depthIndirect.reset(new Shader("Shader/depth_indirect.vs", "Shader/depth.frag"));
+        dropUnlinked(depthIndirect, "depth");
+    }
+    if (depthIndirect) {
+        UniformBuffers::Attach(*depthIndirect);
+    }
+    PassQuery prepassQuery, colorQuery;
     skyShader.Use();
-    glUniform1i(glGetUniformLocation(skyShader.Program, "skybox"), 0);
-
-    // Modelos
-
-    //Modelo de la galeria
-    Model escenario((char*)"Models/wip-gallery-v0003/source/GalleryModel_v0003/GalleryModel_v0007.obj");
-	Model halcon((char*)"Models/sala3/Spaceship_Adventure_1113032035_texture.obj");
-	Model nave((char*)"Models/sala3/Spaceship_Adventures_1113032023_texture.obj");
-
-    //Sala 1
-    Model arc1((char*)"Models/arcade_machine.obj");
-    Model arc2((char*)"Models/game_machine_0000001.obj");
-    Model arc3((char*)"Models/Super_Famicom_Console_1105070442_texture.obj");
-    Model arc4((char*)"Models/GameBoy_1105065316_texture.obj");
-    Model arc5((char*)"Models/Atari_Console_Classic_1105064245_texture.obj");
-    Model arc7((char*)"Models/Hay_un_cuadro_de_pint_1106084744_texture.obj");
-    Model arc8((char*)"Models/bench.obj");
-    Model arc9((char*)"Models/pacman_model.obj");
-    Model arc10((char*)"Models/mario_model.obj");
-    Model arc11((char*)"Models/petit.obj");
-    Model arc12((char*)"Models/dkstatue.obj");
-
-    //Sala 2F
-    Model CuboBase1((char*)"Models/Sala2/Cubo/_1108054346_texture.obj");
-    Model CuboBase2((char*)"Models/Sala2/Cubo/_1108054346_texture.obj");
-    Model CuboBase3((char*)"Models/Sala2/Cubo/_1108054346_texture.obj");
-    Model crash((char*)"Models/Sala2/CrashBandicoot/Animation_Crawl_and_Look_Back_withSkin.fbx");  // Tu archivo FBX de Crash
-    Model xboxSX((char*)"Models/Sala2/XboxSeriesX/_1106040925_texture.obj");
-    Model Nswitch((char*)"Models/Sala2/nintendo-switch/_1106051703_texture.obj");
-    Model PS5((char*)"Models/Sala2/ps5/PS5/_1112073936_texture.obj");
-    Model XboxLogo((char*)"Models/Sala2/XboxLogo/Screenshot_2025_11_07_1108045114_texture.obj");
-    Model NswitchLogo((char*)"Models/Sala2/NintendoLogo/_1108052044_texture.obj");
-    Model PS5Logo((char*)"Models/Sala2/PlayStationLogo/PS_1108045851_texture.obj");
-    Model xboxControl("Models/Sala2/xboxcco/source/xboxcco/xboxcco/xboxcc.obj");
-    Model ps5Control("Models/Sala2/PS5C/_1111070337_texture_obj/_1111070337_texture.obj");
-
-
-             // Modelos de Pikachu
-        Model pikachu("Models//Pikachu/Pikachu.obj");
-        Model banquito("Models/Pikachu/banquito.obj");
-        Model cola("Models/Pikachu/Cola.obj");
-
-        // Modelos de Toad
-        Model toadCuerpo((char*)"Models/Sala2/Toad/toad_cuerpo.obj");
-        Model toadBrazoIzq((char*)"Models/Sala2/Toad/toad_b_izq.obj");
-        Model toadBrazoDer((char*)"Models/Sala2/Toad/toad_b_der.obj");
-
-
-
-
-    //Sala3 
-    Model game((char*)"Models/sala3/Game_ready_3D_prop_a_1110045024_texture.obj");
-    Model vr((char*)"Models/sala3/VR_headset_with_two_m_1105231651_texture.obj");
-    Model warrior((char*)"Models/sala3/Animation_Walking_withSkin.fbx");
-    Model console((char*)"Models/sala3/Game_ready_3D_prop_a_1110065502_texture.obj");
-	Model controller((char*)"Models/sala3/Game_Controllers_Disp_1110071455_texture.obj");
-	Model yoda((char*)"Models/sala3/Animation_Alert_withSkin.fbx");
-	Model truper((char*)"Models/sala3/Animation_Forward_Roll_and_Fire_withSkin.fbx");
-	Model wall((char*)"Models/sala3/wall_acoustic_pane_1112003419_texture.obj");
-    Model ceiling((char*)"Models/sala3/ceiling_track_light__1112003755_texture.obj");
-    Model ceiling2((char*)"Models/sala3/ceiling_track_light__1112003755_texture.obj");
-    Model ceiling3((char*)"Models/sala3/ceiling_track_light__1112003755_texture.obj");
-	Model astro((char*)"Models/sala3/Animation_Agree_Gesture_withSkin.fbx");
-	Model kratos((char*)"Models/sala3/Animation_Axe_Spin_Attack_withSkin.fbx");
-	Model link((char*)"Models/sala3/Animation_Big_Wave_Hello_withSkin.fbx");
-    Model CuboBase4((char*)"Models/Sala2/Cubo/_1108054346_texture.obj");
-    Model CuboBase5((char*)"Models/Sala2/Cubo/_1108054346_texture.obj");
+    skyShader.SetInt(UNIFORM("skybox"), 0);
+
+    // Modelos: la importacion corre en paralelo y loader.Finish() sube todo a GL.
+    // Las texturas llegan despues en streaming: maximo 2 ms y 4 MB de subidas por cuadro.
+    TextureStreamer::Instance().SetBudget(2.0, 4 * 1024 * 1024);
+    // Vertices empaquetados (normales 10:10:10, UV half, indices de 16 bits). quantizePositions
+    // tambien pasa las posiciones a 16 bits, pero puede abrir grietas entre mallas vecinas.
+    Mesh::Format().packed = true;
+    // Sin copias en CPU de las mallas una vez subidas; un Model(loader, ruta, true) conserva las suyas
+    Mesh::LeanResidency() = true;
+    ModelLoader loader;
+
+    // La galeria (modelos, transformaciones, shader, emision y animacion) se declara en
+    // Scene/galeria.scene; el texto se compila a galeria.scene.bin y solo se reinterpreta si cambia
+    Scene scene;
+    if (scene.Load("Scene/galeria.scene", { { "FLOOR_Y", FLOOR_Y }, { "LIFT", LIFT } }))
+        std::cout << "Escena: " << scene.Size() << " colocaciones, " << scene.Cells().Rooms().size() << " salas y "
+            << scene.Cells().Portals().size() << " puertas y " << scene.Lights().size() << " luces ("
+            << (scene.FromBinary() ? "binaria" : "interpretada del texto") << ")\n";
+    ClusteredLights::Instance().SetLights(scene.Lights());
+    shadows.SetLights(scene.Lights());
+    scene.BindShader("lighting", opaqueShader);
+    scene.BindShader("skinned", deferred ? *gbufferSkinned : skinnedShader);
+    scene.CreateModels(loader);
+
+    loader.Finish();
+
+    // Lo que no se mueve, unido por material y sala (o leido de galeria.scene.batch)
+    scene.BakeStatic();
+    {
+        const StaticBatchStats& sb = scene.StaticStats();
+        std::cout << "Lotes estaticos: " << sb.batches << " con " << sb.sources << " mallas (" << sb.triangles / 1000 << "k tris), "
+            << (sb.cached ? "leidos de la cache" : "horneados") << " en " << sb.ms << " ms; "
+            << sb.releasedBytes / 1024 << " KB de mallas de origen fuera de la GPU\n";
+    }
+
+    // Comparar arranque en frio (sin .meshcache) contra arranque en caliente
+    std::cout << "Modelos cargados en " << MeshCache::Stats().wallMs << " ms con " << loader.Threads()
+        << " hilos (trabajo acumulado " << MeshCache::Stats().loadMs << " ms; cache: "
+        << MeshCache::Stats().hits << " en caliente, " << MeshCache::Stats().misses << " importados con Assimp)\n";
+    std::cout << ModelRegistry::Stats().instances << " instancias de " << ModelRegistry::Stats().assets << " modelos unicos ("
+        << ModelRegistry::Stats().byPath << " por ruta, " << ModelRegistry::Stats().byContent << " por contenido identico)\n";
+    Model::PrintMemory("Total de mallas", Mesh::Totals());
+    {
+        const MeshArenaStats& ar = MeshArena::Instance().Stats();
+        std::cout << "Arena de mallas: " << ar.meshes << " mallas en " << ar.pools << " formatos, " << ar.bytes / (1024 * 1024)
+            << " MB reservados (" << ar.freeBytes / 1024 << " KB en huecos)\n";
+    }
 
     // VAO cubo debug
     glGenVertexArrays(1, &lampVAO);
@@ -471,21 +589,21 @@ int main() {
 
     // Samplers
     lightingShader.Use();
-    glUniform1i(glGetUniformLocation(lightingShader.Program, "material.diffuse"), 0);
-    glUniform1i(glGetUniformLocation(lightingShader.Program, "material.specular"), 1);
-    glUniform1f(glGetUniformLocation(lightingShader.Program, "material.shininess"), 16.0f);
-    glUniform1i(glGetUniformLocation(lightingShader.Program, "transparency"), 0);
+    lightingShader.SetInt(UNIFORM("material.diffuse"), 0);
+    lightingShader.SetInt(UNIFORM("material.specular"), 1);
+    lightingShader.SetFloat(UNIFORM("material.shininess"), 16.0f);
+    lightingShader.SetInt(UNIFORM("transparency"), 0);
 
     skinnedShader.Use();
-    glUniform1i(glGetUniformLocation(skinnedShader.Program, "texture_diffuse1"), 0);
+    skinnedShader.SetInt(UNIFORM("texture_diffuse1"), 0);
 
     // Texturas 2D
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    texSign = SOIL_load_OGL_texture("Models/sala3/vr_sign.png", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
-    texArrows = SOIL_load_OGL_texture("Models/sala3/floor_arrows.png", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
-    texWoodFloor = SOIL_load_OGL_texture("Models/sala3/wood_floor.jpg", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
-    texWall = SOIL_load_OGL_texture("Models/sala3/wall_concrete.jpg", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
-    texPedestal = SOIL_load_OGL_texture("Models/sala3/pedestal_charcoal.png", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
+    texSign = TextureCache::Instance().LoadSOIL("Models/sala3/vr_sign.png", SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
+    texArrows = TextureCache::Instance().LoadSOIL("Models/sala3/floor_arrows.png", SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
+    texWoodFloor = TextureCache::Instance().LoadSOIL("Models/sala3/wood_floor.jpg", SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
+    texWall = TextureCache::Instance().LoadSOIL("Models/sala3/wall_concrete.jpg", SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
+    texPedestal = TextureCache::Instance().LoadSOIL("Models/sala3/pedestal_charcoal.png", SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_COMPRESS_TO_DXT);
 
     if (!texSign)      std::cout << "No se cargo Models/sala3/vr_sign.png\n";
     if (!texArrows)    std::cout << "No se cargo Models/sala3/floor_arrows.png\n";
@@ -523,10 +641,7 @@ int main() {
     // (MUEVE SOLO ESTOS VALORES)w
     // ===============================
 
-    // Headset VR
-    glm::vec3 VR_HEADSET_POS = glm::vec3(-32.0f, 4.5f, -13.0f);
-    float     VR_HEADSET_YAW = 360.0f;   // grados sobre Y
-    float     VR_HEADSET_SCL = 10.0f;
+    // Headset VR: colocacion "vr" en Scene/galeria.scene
 
     // Pedestal (para que "asiente" en el piso, usa Y = FLOOR_Y + (alto/2))
     glm::vec3 PEDESTAL_POS = glm::vec3(-32.0f, FLOOR_Y + 0.30f, -10.0f);
@@ -558,641 +673,56 @@ int main() {
     // ===============================
 
     static double t0 = glfwGetTime();
+    bool memoryReported = false;
+    std::vector<glm::mat4> bonePalette;     // se reutiliza entre personajes y cuadros, sin reservar memoria
+    RenderQueue queue;
+    // Colocaciones dyn de la escena que se mueven desde aqui
+    const int dynXbox = scene.Find("xboxSX"), dynSwitch = scene.Find("switch"), dynPS5 = scene.Find("ps5");
+    const int dynPikachu = scene.Find("pikachu"), dynCola = scene.Find("cola");
+    const int dynToadCuerpo = scene.Find("toadCuerpo"), dynToadBrazoIzq = scene.Find("toadBrazoIzq"), dynToadBrazoDer = scene.Find("toadBrazoDer");
+    const int dynCrash = scene.Find("crash");
+    GLState& gl = GLState::Instance();
+    float lastTitle = 0.0f;
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = (float)glfwGetTime(); deltaTime = currentFrame - lastFrame; lastFrame = currentFrame;
         glfwPollEvents(); DoMovement(); Animation();
-
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.GetZoom()), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.5f, 50.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-
-        // ====== MODELOS Y ESCENARIO ======
-        lightingShader.Use();
-        GLint modelLoc = glGetUniformLocation(lightingShader.Program, "model");
-        GLint viewLoc = glGetUniformLocation(lightingShader.Program, "view");
-        GLint projLoc = glGetUniformLocation(lightingShader.Program, "projection");
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        // ===== CONFIGURAR SPOTLIGHTS =====
-// Spotlight 0: Xbox (VERDE)
-        {
-            glm::vec3 xboxLogoPos = glm::vec3(2.20f, FLOOR_Y + LIFT + 3.5f, 3.0f);
-            glm::vec3 xboxConsolePos = glm::vec3(5.0f, FLOOR_Y + LIFT + 1.30f, 3.0f);
-            glm::vec3 spotDir = glm::normalize(xboxConsolePos - xboxLogoPos);
-
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[0].position"),
-                xboxLogoPos.x, xboxLogoPos.y, xboxLogoPos.z);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[0].direction"),
-                spotDir.x, spotDir.y, spotDir.z);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[0].ambient"),
-                0.1f, 0.3f, 0.1f);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[0].diffuse"),
-                0.5f, 2.0f, 0.5f);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[0].specular"),
-                0.2f, 0.8f, 0.2f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[0].cutOff"),
-                glm::cos(glm::radians(15.5f)));
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[0].outerCutOff"),
-                glm::cos(glm::radians(20.5f)));
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[0].constant"), 1.0f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[0].linear"), 0.045f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[0].quadratic"), 0.0075f);
-        }
-
-        // Spotlight 1: Nintendo (ROJO)
-        {
-            glm::vec3 nintendoLogoPos = glm::vec3(2.20f, FLOOR_Y + LIFT + 3.5f, 15.0f);
-            glm::vec3 nintendoConsolePos = glm::vec3(5.0f, FLOOR_Y + LIFT + 1.10f, 15.0f);
-            glm::vec3 spotDir = glm::normalize(nintendoConsolePos - nintendoLogoPos);
-
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[1].position"),
-                nintendoLogoPos.x, nintendoLogoPos.y, nintendoLogoPos.z);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[1].direction"),
-                spotDir.x, spotDir.y, spotDir.z);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[1].ambient"),
-                0.3f, 0.1f, 0.1f);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[1].diffuse"),
-                2.0f, 0.5f, 0.5f);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[1].specular"),
-                0.8f, 0.2f, 0.2f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[1].cutOff"),
-                glm::cos(glm::radians(15.5f)));
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[1].outerCutOff"),
-                glm::cos(glm::radians(20.5f)));
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[1].constant"), 1.0f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[1].linear"), 0.045f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[1].quadratic"), 0.0075f);
-        }
-
-        // Spotlight 2: PS5 (AZUL)
-        {
-            glm::vec3 ps5LogoPos = glm::vec3(2.20f, FLOOR_Y + LIFT + 3.5f, 26.0f);
-            glm::vec3 ps5ConsolePos = glm::vec3(5.0f, FLOOR_Y + LIFT + 0.90f, 26.0f);
-            glm::vec3 spotDir = glm::normalize(ps5ConsolePos - ps5LogoPos);
-
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[2].position"),
-                ps5LogoPos.x, ps5LogoPos.y, ps5LogoPos.z);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[2].direction"),
-                spotDir.x, spotDir.y, spotDir.z);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[2].ambient"),
-                0.1f, 0.1f, 0.3f);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[2].diffuse"),
-                0.5f, 0.8f, 2.5f);
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "spotLights[2].specular"),
-                0.2f, 0.4f, 1.0f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[2].cutOff"),
-                glm::cos(glm::radians(15.5f)));
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[2].outerCutOff"),
-                glm::cos(glm::radians(20.5f)));
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[2].constant"), 1.0f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[2].linear"), 0.045f);
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "spotLights[2].quadratic"), 0.0075f);
-        }
-        // ===== FIN SPOTLIGHTS =====
-
-        // Escenario
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(4.0f, FLOOR_Y - LIFT, -16.0f));
-            m = glm::scale(m, glm::vec3(0.02f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            escenario.Draw(lightingShader);
-        }
-
-        // Son los modelos de la sala 1
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-23.0f, FLOOR_Y + LIFT, 29.0f));
-            m = glm::scale(m, glm::vec3(1.1f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc1.Draw(lightingShader);
-        }
-
-		// Maquina de arcade azul
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-19.0f, FLOOR_Y + LIFT, 29.0f));
-            m = glm::scale(m, glm::vec3(0.07f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc2.Draw(lightingShader);
-        }
-
-		// Super Nintendo
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-29.0f, FLOOR_Y + 3.29f, 32.0f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(1.1f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc3.Draw(lightingShader);
-        }
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-29.0f, FLOOR_Y + 2.1, 32.0f));
-            m = glm::scale(m, glm::vec3(0.9f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase1.Draw(lightingShader);
-        }
-
-		// GameBoy
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-29.0f, FLOOR_Y + 3.9f, 36.0f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.9f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc4.Draw(lightingShader);
-        }
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-29.0f, FLOOR_Y + 2.1, 36.0f));
-            m = glm::scale(m, glm::vec3(0.9f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase1.Draw(lightingShader);
-        }
-
-		// Atari
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-18.0f, FLOOR_Y + 3.5, 49.0f));
-            m = glm::rotate(m, glm::radians(25.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(1.1f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc5.Draw(lightingShader);
-        }
-
-        // Mesa blanca
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-18.0f, FLOOR_Y + 2.1, 49.0f));
-            m = glm::scale(m, glm::vec3(0.9f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase1.Draw(lightingShader);
-        }
-
-        // Atari con television
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-29.0f, FLOOR_Y + 3.32, 28.0f));
-            m = glm::rotate(m, glm::radians(25.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(1.1f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc7.Draw(lightingShader);
-        }
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-29.0f, FLOOR_Y + 2.1, 28.0f));
-            m = glm::scale(m, glm::vec3(0.9f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase1.Draw(lightingShader);
-        }
-
-        // Banca retro
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-24.0f, FLOOR_Y + 2.0, 39.0f));
-            m = glm::rotate(m, glm::radians(180.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(1.6f, 2.0f, 1.5f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc8.Draw(lightingShader);
-        }
-
-        //Pacman
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-19.5f, FLOOR_Y + LIFT, 55.0f));
-            m = glm::rotate(m, glm::radians(180.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.3f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc9.Draw(lightingShader);
-        }
-
-        //Mario Bros
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-26.0f, FLOOR_Y + LIFT, 54.0f));
-            m = glm::rotate(m, glm::radians(155.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.03f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc10.Draw(lightingShader);
-        }
-
-
-        // Fantasmita
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-29.0f, FLOOR_Y + 3.0f, 50.0f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.8f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc11.Draw(lightingShader);
-        }
-
-        // Estatua Donkey Kong
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-27.0f, FLOOR_Y + LIFT, 45.0f));
-            m = glm::rotate(m, glm::radians(25.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.2f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            arc12.Draw(lightingShader);
-        }
-
-
-
-        
-
-
-
-// Cubo base 1
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(5.0f, FLOOR_Y + LIFT + 1.2f - 0.55f, 3.0f));
-            m = glm::scale(m, glm::vec3(0.8f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase1.Draw(lightingShader);
-        }
-        // Cubo base 2
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(5.0f, FLOOR_Y + LIFT + 1.2f - 0.55f, 15.0f));
-            m = glm::scale(m, glm::vec3(0.8f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase2.Draw(lightingShader);
-        }
-        // Cubo base 3
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(5.0f, FLOOR_Y + LIFT + 1.2f - 0.55f, 26.0f));
-            m = glm::scale(m, glm::vec3(0.8f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase3.Draw(lightingShader);
-        }
-        // Xbox SX - con rotación
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(5.0f, FLOOR_Y + LIFT + 1.30f+1.2f - 0.55f, 3.0f));
-            m = glm::rotate(m, glm::radians(consoleRotation), glm::vec3(0, 1, 0)); // Rotación sobre Y
-            m = glm::scale(m, glm::vec3(0.5f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            xboxSX.Draw(lightingShader);
-        }
-        // Control Xbox en CuboBase1
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(5.5f, FLOOR_Y + LIFT + 2.5f - 0.95f, 3.6f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            m = glm::rotate(m, glm::radians(-80.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            m = glm::scale(m, glm::vec3(0.9f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            xboxControl.Draw(lightingShader);
-        }
-
-
-        // Switch - con rotación
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(5.0f, FLOOR_Y + LIFT + 1.10f + 1.2f - 0.55f, 15.0f));
-            m = glm::rotate(m, glm::radians(consoleRotation), glm::vec3(0, 1, 0)); // Rotación sobre Y
-            m = glm::scale(m, glm::vec3(0.5f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            Nswitch.Draw(lightingShader);
-        }
-
-        // PS5 - con rotación
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(5.0f, FLOOR_Y + LIFT + 1.40f + 1.2f -0.62f, 26.0f));
-            m = glm::rotate(m, glm::radians(consoleRotation), glm::vec3(0, 1, 0)); // Rotación sobre Y
-            m = glm::scale(m, glm::vec3(0.5f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            PS5.Draw(lightingShader);
-        }
-
-        // Control PS5 en CuboBase3
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(5.4f, FLOOR_Y + LIFT + 2.5f - 0.95f, 26.5f));
-            m = glm::rotate(m, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-            m = glm::scale(m, glm::vec3(0.25f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            ps5Control.Draw(lightingShader);
-        }
-
-
-
-        // XboxLogo - CON EMISIÓN VERDE
-        {
-            // Activar emisión verde brillante
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "emissiveColor"),
-                0.2f, 1.0f, 0.2f); // Verde brillante
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "emissiveStrength"),
-                3.0f); // Intensidad alta
-
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(2.20f, FLOOR_Y + LIFT + 3.5f, 3.0f));
-            m = glm::scale(m, glm::vec3(1.5f));
-            m = glm::rotate(m, glm::radians(-90.0f), glm::vec3(0, 1, 0));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            XboxLogo.Draw(lightingShader);
-
-            // Desactivar emisión después de dibujar
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "emissiveStrength"), 0.0f);
-        }
-
-        // NswitchLogo - CON EMISIÓN ROJA
-        {
-            // Activar emisión roja brillante
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "emissiveColor"),
-                1.0f, 0.2f, 0.2f); // Rojo brillante
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "emissiveStrength"),
-                3.0f); // Intensidad alta
-
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(2.20f, FLOOR_Y + LIFT + 3.5f, 14.8f));
-            m = glm::scale(m, glm::vec3(3.0f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0, 1, 0));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            NswitchLogo.Draw(lightingShader);
-
-            // Desactivar emisión después de dibujar
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "emissiveStrength"), 0.0f);
-        }
-
-        // PS5Logo - CON EMISIÓN AZUL
-        {
-            // Activar emisión azul brillante
-            glUniform3f(glGetUniformLocation(lightingShader.Program, "emissiveColor"),
-                0.3f, 0.5f, 1.5f); // Azul brillante
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "emissiveStrength"),
-                1.0f); // Intensidad alta
-
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(2.20f, FLOOR_Y + LIFT + 3.5f, 26.0f));
-            m = glm::scale(m, glm::vec3(1.5f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0, 1, 0));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            PS5Logo.Draw(lightingShader);
-
-            // Desactivar emisión después de dibujar
-            glUniform1f(glGetUniformLocation(lightingShader.Program, "emissiveStrength"), 0.0f);
-        }
-
-
-        //termina sala 2
-
-        
-
-
-
-
-        //Sala 3
-
-
-
-        // ====== VR HEADSET (posición separada) ======
-        {
-            lightingShader.Use();
-            GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model");
-            glm::mat4 m(1.0f);
-            m = glm::translate(m, VR_HEADSET_POS);
-            m = glm::rotate(m, glm::radians(VR_HEADSET_YAW), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(VR_HEADSET_SCL));
-            glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m));
-            vr.Draw(lightingShader);
-        }
-        //Cubo base 4
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-32.0f, FLOOR_Y + LIFT+.8, -13.0f));
-            m = glm::scale(m, glm::vec3(0.9f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase4.Draw(lightingShader);
-        }
-
-        // ====== Guerrero skinned ======
-        skinnedShader.Use();
-        GLint sModelLoc = glGetUniformLocation(skinnedShader.Program, "model");
-        GLint sViewLoc = glGetUniformLocation(skinnedShader.Program, "view");
-        GLint sProjLoc = glGetUniformLocation(skinnedShader.Program, "projection");
-        glUniformMatrix4fv(sViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(sProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
-        {
-            double t = glfwGetTime() - t0;
-            warrior.UpdateAnimation(t);
-            std::vector<glm::mat4> bones; warrior.GetBoneMatrices(bones, 100);
-            GLint bonesLoc = glGetUniformLocation(skinnedShader.Program, "bones");
-            if (bonesLoc >= 0 && !bones.empty())
-                glUniformMatrix4fv(bonesLoc, (GLsizei)bones.size(), GL_FALSE, &bones[0][0][0]);
-
-            glm::mat4 m(1.0f);
-            m = glm::translate(m, glm::vec3(-22.0f, FLOOR_Y + LIFT, 8.5f));
-            m = glm::rotate(m, glm::radians(180.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.02f));
-            glUniformMatrix4fv(sModelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            warrior.Draw(skinnedShader);
-        }
-
-        // ====== Yoda animacion ======
-        skinnedShader.Use();
-        
-        {
-            double t = glfwGetTime() - t0;
-            yoda.UpdateAnimation(t);
-            std::vector<glm::mat4> bones; yoda.GetBoneMatrices(bones, 100);
-            GLint bonesLoc = glGetUniformLocation(skinnedShader.Program, "bones");
-            if (bonesLoc >= 0 && !bones.empty())
-                glUniformMatrix4fv(bonesLoc, (GLsizei)bones.size(), GL_FALSE, &bones[0][0][0]);
-
-            glm::mat4 m(1.0f);
-            m = glm::translate(m, glm::vec3(-25.0f, FLOOR_Y + LIFT, 0.5f));
-            m = glm::rotate(m, glm::radians(360.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.02f));
-            glUniformMatrix4fv(sModelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            yoda.Draw(skinnedShader);
-        }
-
-        // ====== truper animacion ======
-        skinnedShader.Use();
-
-        {
-            double t = glfwGetTime() - t0;
-            truper.UpdateAnimation(t);
-            std::vector<glm::mat4> bones; truper.GetBoneMatrices(bones, 100);
-            GLint bonesLoc = glGetUniformLocation(skinnedShader.Program, "bones");
-            if (bonesLoc >= 0 && !bones.empty())
-                glUniformMatrix4fv(bonesLoc, (GLsizei)bones.size(), GL_FALSE, &bones[0][0][0]);
-
-            glm::mat4 m(1.0f);
-            m = glm::translate(m, glm::vec3(-25.0f, FLOOR_Y + LIFT, 21.0f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.02f));
-            glUniformMatrix4fv(sModelLoc, 1, GL_FALSE, glm::value_ptr(m));
-           truper.Draw(skinnedShader);
-        }
-
-
-        // ====== Astro animacion ======
-        skinnedShader.Use();
-
-        {
-            double t = glfwGetTime() - t0;
-            astro.UpdateAnimation(t);
-            std::vector<glm::mat4> bones; astro.GetBoneMatrices(bones, 100);
-            GLint bonesLoc = glGetUniformLocation(skinnedShader.Program, "bones");
-            if (bonesLoc >= 0 && !bones.empty())
-                glUniformMatrix4fv(bonesLoc, (GLsizei)bones.size(), GL_FALSE, &bones[0][0][0]);
-
-            glm::mat4 m(1.0f);
-            m = glm::translate(m, glm::vec3(-25.0f, FLOOR_Y + LIFT, 12.0f));
-            m = glm::rotate(m, glm::radians(360.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.02f));
-            glUniformMatrix4fv(sModelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            astro.Draw(skinnedShader);
-        }
-
-        // ====== Kratos animacion ======
-        skinnedShader.Use();
-
-        {
-            double t = glfwGetTime() - t0;
-            kratos.UpdateAnimation(t);
-            std::vector<glm::mat4> bones; kratos.GetBoneMatrices(bones, 100);
-            GLint bonesLoc = glGetUniformLocation(skinnedShader.Program, "bones");
-            if (bonesLoc >= 0 && !bones.empty())
-                glUniformMatrix4fv(bonesLoc, (GLsizei)bones.size(), GL_FALSE, &bones[0][0][0]);
-
-            glm::mat4 m(1.0f);
-            m = glm::translate(m, glm::vec3(-25.0f, FLOOR_Y + LIFT-.25, -12.0f));
-            m = glm::rotate(m, glm::radians(360.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.025f));
-            glUniformMatrix4fv(sModelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            kratos.Draw(skinnedShader);
-        }
-
-        // ====== link animacion ======
-        skinnedShader.Use();
-
-        {
-            double t = glfwGetTime() - t0;
-            link.UpdateAnimation(t);
-            std::vector<glm::mat4> bones; link.GetBoneMatrices(bones, 100);
-            GLint bonesLoc = glGetUniformLocation(skinnedShader.Program, "bones");
-            if (bonesLoc >= 0 && !bones.empty())
-                glUniformMatrix4fv(bonesLoc, (GLsizei)bones.size(), GL_FALSE, &bones[0][0][0]);
-
-            glm::mat4 m(1.0f);
-            m = glm::translate(m, glm::vec3(-25.0f, FLOOR_Y + LIFT-.38, -5.0f));
-            m = glm::rotate(m, glm::radians(180.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(0.025f));
-            glUniformMatrix4fv(sModelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            link.Draw(skinnedShader);
-        }
-
-        // ====== game (prop de sala) — CORREGIDO translate ======
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(-18.0f, 4.2, 2.5f)); 
-            m = glm::rotate(m, glm::radians(270.0f), glm::vec3(0, 1, 0)); 
-            m = glm::scale(m, glm::vec3(1.5f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m)); 
-            game.Draw(lightingShader); 
-        }
-
-        //Cubo base 4
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(-18.0f, FLOOR_Y + LIFT+.8, 2.5f));
-            m = glm::scale(m, glm::vec3(0.9f));
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(m));
-            CuboBase5.Draw(lightingShader);
-        }
-
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(-20.0f, 5.0f , -13.0f)); 
-            m = glm::rotate(m, glm::radians(360.0f), glm::vec3(0, 1, 0)); 
-            m = glm::scale(m, glm::vec3(2.0f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m)); 
-            console.Draw(lightingShader); 
-        }
-
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(-20.0f, FLOOR_Y + LIFT+1.8, 13.0f));
-            m = glm::rotate(m, glm::radians(360.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(2.0f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m));
-            controller.Draw(lightingShader);
-        }
-
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(-35.0f, 6.0f, 17.0f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(2.0f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m));
-            wall.Draw(lightingShader);
-        }
-
-        //Lampara 1
-
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(-25.0f, 8.3f, 22.0f));
-            m = glm::rotate(m, glm::radians(360.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(2.0f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m));
-            ceiling.Draw(lightingShader);
-        }
-
-        //Lampara 2
-
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(-25.0f, 8.3f, 9.0f));
-            m = glm::rotate(m, glm::radians(360.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(2.0f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m));
-            ceiling2.Draw(lightingShader);
-        }
-
-        //Lampara 3
-
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(-25.0f, 8.3f, -4.0f));
-            m = glm::rotate(m, glm::radians(360.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(2.0f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m));
-            ceiling3.Draw(lightingShader);
-        }
-
-        //Halcon milenario 
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(40.0f, 4.2, -15.0f));
-            m = glm::rotate(m, glm::radians(90.0f), glm::vec3(0, 1, .5));
-            m = glm::scale(m, glm::vec3(6.0f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m));
-            halcon.Draw(lightingShader);
+        TextureStreamer::Instance().Pump();     // texturas que van llegando, con presupuesto por cuadro
+        // Resumen de memoria en cuanto las texturas terminan de llegar (antes medirian el marcador de 1x1)
+        if (!memoryReported && TextureStreamer::Instance().Pending() == 0) {
+            ModelRegistry::Instance().PrintMemory();
+            memoryReported = true;
         }
 
-
-		//Nave Rick y Morty 
-        {
-            lightingShader.Use(); GLint modelLocVR = glGetUniformLocation(lightingShader.Program, "model"); glm::mat4 m(1.0f); // *** FIX: pasar matriz base y vec3; usar FLOOR_Y + LIFT para asentar en el piso 
-            m = glm::translate(m, glm::vec3(40.0f, 4.2, 20.0f));
-            m = glm::rotate(m, glm::radians(270.0f), glm::vec3(0, 1, 0));
-            m = glm::scale(m, glm::vec3(3.5f)); glUniformMatrix4fv(modelLocVR, 1, GL_FALSE, glm::value_ptr(m));
-            nave.Draw(lightingShader);
+        const float zNear = 0.5f, zFar = 50.0f;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.GetZoom()), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, zNear, zFar);
+        glm::mat4 view = camera.GetViewMatrix();
+        UniformBuffers::Instance().SetFrame(view, projection, camera.GetPosition(), (float)glfwGetTime());
+
+        // SetCaching tambien invalida la cache: la carga y el streaming tocan GL directo
+        gl.SetCaching(!immediateRender);
+        // Luces repartidas en los clusters de esta camara; el diferido solo necesita la lista
+        ClusteredLights& lights = ClusteredLights::Instance();
+        if (deferred) lights.BindLights();
+        else {
+            lights.Update(view, projection, zNear, zFar, SCREEN_WIDTH, SCREEN_HEIGHT);
+            lights.Apply(lightingShader, lightDebug);
+            if (lightingIndirect) lights.Apply(*lightingIndirect, lightDebug);
         }
+        queue.Begin(view, zFar);
+        queue.SetIndirect(opaqueShader, multiDraw ? opaqueIndirect : nullptr);
+        // Al medir, el primer cuadro va sin prepase y el segundo con el
+        const bool measuring = measureFrames > 0 && !immediateRender;
+        const bool prepassOn = (measuring ? measureFrames == 1 : depthPrepass) && !immediateRender;
+        queue.SetDepthPrepass(opaqueShader, prepassOn ? &depthShader : nullptr, depthIndirect.get());
 
+        // ====== MODELOS Y ESCENARIO ======
+        // Todo sale de la escena con sus matrices ya calculadas; aqui solo se mueve lo dinamico
 
-
+        // Consolas giratorias
+        glm::mat4 consoleSpin = glm::rotate(glm::mat4(1.0f), glm::radians(consoleRotation), glm::vec3(0, 1, 0)); // Rotación sobre Y
+        scene.SetDynamic(dynXbox, consoleSpin);
+        scene.SetDynamic(dynSwitch, consoleSpin);
+        scene.SetDynamic(dynPS5, consoleSpin);
 
         // ===== ANIMACIÓN PIKACHU POR KEYFRAMES =====
         // Keyframes de Pikachu (salto del banco)
@@ -1215,58 +745,22 @@ int main() {
         // Movimiento de la cola (oscilación sinusoidal)
         float tailSwing = glm::sin(pikachuTime * 5.0f) * 30.0f;
 
-        lightingShader.Use();
-        GLint modelLocPika = glGetUniformLocation(lightingShader.Program, "model");
-
-        // Dibujar banco
-
-        {
-            glm::mat4 m(1);
-            m = glm::translate(m, glm::vec3(10.0f, FLOOR_Y + LIFT + 0.2f, 3.0f)); // Subir un poco
-            m = glm::rotate(m, glm::radians(-90.0f), glm::vec3(1, 0, 0));
-            m = glm::scale(m, glm::vec3(0.1f, 0.1f, 0.1f)); // Aumentar escala
-            glUniformMatrix4fv(modelLocPika, 1, GL_FALSE, glm::value_ptr(m));
-            banquito.Draw(lightingShader);
-        }
-
-
-
-        // Dibujar Pikachu (cuerpo principal)
-
-        {
-
-            
-                glm::mat4 m(1);
-                m = glm::translate(m, pikachuPos);
-                m = glm::rotate(m, glm::radians(0.0f + pikachuRot), glm::vec3(0, 1, 0)); // +90 grados extra
-                m = glm::rotate(m, glm::radians(-90.0f), glm::vec3(1, 0, 0));
-                m = glm::scale(m, glm::vec3(0.15f));
 
-            glUniformMatrix4fv(modelLocPika, 1, GL_FALSE, glm::value_ptr(m));
-            pikachu.Draw(lightingShader);
-        }
-
-
-        // Dibujar cola con movimiento (adherida al cuerpo)
+        // Pikachu; la cola va adherida al cuerpo
         {
             glm::mat4 m(1);
             m = glm::translate(m, pikachuPos);
             m = glm::rotate(m, glm::radians(0.0f + pikachuRot), glm::vec3(0, 1, 0)); // +90 grados extra
+            scene.SetDynamic(dynPikachu, m);
+
             m = glm::rotate(m, glm::radians(-90.0f), glm::vec3(1, 0, 0));
             m = glm::translate(m, glm::vec3(0.0f, 0.05f, 0.25f)); // Cola más cerca del cuerpo (X reducido)
             m = glm::rotate(m, glm::radians(tailSwing), glm::vec3(0, 0, 1));
-            m = glm::scale(m, glm::vec3(0.15f));
-            glUniformMatrix4fv(modelLocPika, 1, GL_FALSE, glm::value_ptr(m));
-            cola.Draw(lightingShader);
+            scene.SetDynamic(dynCola, m);
         }
 
 
         // ===== TOAD CON ANIMACIÓN POR KEYFRAMES =====
-        lightingShader.Use();
-
-        glm::vec3 toadBasePos(10.0f, FLOOR_Y + LIFT, 15.0f);
-
-
 
         float armRotLeft = 70.0f, armRotRight = 70.0f;
         float armWaveLeft = 0.0f, armWaveRight = 0.0f;
@@ -1308,103 +802,154 @@ int main() {
 
         }
 
-        glm::vec3 toadPos = toadBasePos + glm::vec3(0, bodyY, 0);
-
-        glm::mat4 mToadCuerpo(1.0f);
-        mToadCuerpo = glm::translate(mToadCuerpo, toadPos);
-        mToadCuerpo = glm::rotate(mToadCuerpo, glm::radians(bodyRotY + 90.0f), glm::vec3(0, 1, 0));
-        mToadCuerpo = glm::scale(mToadCuerpo, glm::vec3(0.28f));
-
-        GLint toadModelLoc = glGetUniformLocation(lightingShader.Program, "model");
-        glUniformMatrix4fv(toadModelLoc, 1, GL_FALSE, glm::value_ptr(mToadCuerpo));
-        toadCuerpo.Draw(lightingShader);
+        // Relativo a la base de Toad en la escena
+        glm::mat4 mToad(1.0f);
+        mToad = glm::translate(mToad, glm::vec3(0, bodyY, 0));
+        mToad = glm::rotate(mToad, glm::radians(bodyRotY + 90.0f), glm::vec3(0, 1, 0));
+        scene.SetDynamic(dynToadCuerpo, mToad);
 
-        glm::mat4 mToadBrazoIzq(1.0f);
-        mToadBrazoIzq = glm::translate(mToadBrazoIzq, toadPos);
-        mToadBrazoIzq = glm::rotate(mToadBrazoIzq, glm::radians(bodyRotY + 90.0f), glm::vec3(0, 1, 0));
-        mToadBrazoIzq = glm::translate(mToadBrazoIzq, glm::vec3(0.4f, 0.6f, 0));
+        glm::mat4 mToadBrazoIzq = glm::translate(mToad, glm::vec3(0.4f, 0.6f, 0));
         mToadBrazoIzq = glm::rotate(mToadBrazoIzq, glm::radians(-(armRotLeft + armWaveLeft)), glm::vec3(1, 0, 0));
         mToadBrazoIzq = glm::translate(mToadBrazoIzq, glm::vec3(-0.4f, 0.0f, 0));
-        mToadBrazoIzq = glm::scale(mToadBrazoIzq, glm::vec3(0.35f));
-
-        glUniformMatrix4fv(toadModelLoc, 1, GL_FALSE, glm::value_ptr(mToadBrazoIzq));
-        toadBrazoIzq.Draw(lightingShader);
-        
-        glm::mat4 mToadBrazoDer(1.0f);
-        mToadBrazoDer = glm::translate(mToadBrazoDer, toadPos);
-        mToadBrazoDer = glm::rotate(mToadBrazoDer, glm::radians(bodyRotY + 90.0f), glm::vec3(0, 1, 0));
-        mToadBrazoDer = glm::translate(mToadBrazoDer, glm::vec3(-0.4f, 0.6f, 0));
+        scene.SetDynamic(dynToadBrazoIzq, mToadBrazoIzq);
+
+        glm::mat4 mToadBrazoDer = glm::translate(mToad, glm::vec3(-0.4f, 0.6f, 0));
         mToadBrazoDer = glm::rotate(mToadBrazoDer, glm::radians(-(armRotRight + armWaveRight)), glm::vec3(1, 0, 0));
         mToadBrazoDer = glm::translate(mToadBrazoDer, glm::vec3(0.4f, 0.0f, 0));
-        mToadBrazoDer = glm::scale(mToadBrazoDer, glm::vec3(0.35f));
-
-        glUniformMatrix4fv(toadModelLoc, 1, GL_FALSE, glm::value_ptr(mToadBrazoDer));
-        toadBrazoDer.Draw(lightingShader);
-
+        scene.SetDynamic(dynToadBrazoDer, mToadBrazoDer);
 
 
         // ===== CRASH DE A A B CON ANIMACIÓN =====
         float travelTime = 10.0f;
         float t = fmod(crashTime, travelTime) / travelTime;
-        float crashX = 7.5f + (4.65f * t);
-
-        glm::vec3 crashPos(crashX, FLOOR_Y + LIFT, 26.0f);
-
-        skinnedShader.Use();
-        crash.UpdateAnimation(glfwGetTime());
-
-        std::vector<glm::mat4> bones(100, glm::mat4(1.0f));
-        crash.GetBoneMatrices(bones, 100);
-
-        GLint bonesLoc = glGetUniformLocation(skinnedShader.Program, "bones");
-        glUniformMatrix4fv(bonesLoc, 100, GL_FALSE, &bones[0][0][0]);
-
-        glm::mat4 mCrash(1.0f);
-        mCrash = glm::translate(mCrash, crashPos);
-        mCrash = glm::rotate(mCrash, 1.5708f, glm::vec3(0, 1, 0));
-        mCrash = glm::scale(mCrash, glm::vec3(0.02f));
+        scene.SetDynamic(dynCrash, glm::translate(glm::mat4(1.0f), glm::vec3(4.65f * t, 0.0f, 0.0f)));
+
+        // Personajes con animacion esqueletica y todo lo de la escena a la cola
+        scene.Animate(glfwGetTime() - t0);
+        Frustum frustum = camera.GetFrustum(projection);
+        if (portalCulling) scene.Cells().Update(projection * view, camera.GetPosition());
+        scene.SetOcclusion(occlusionCulling);
+        scene.SetStaticBatching(staticBatching);
+        scene.Enqueue(queue, bonePalette, frustumCulling ? &frustum : nullptr, portalCulling ? &scene.Cells() : nullptr);
+
+        // Sombras de los focos que se ven: solo se redibuja lo que se movio dentro de cada uno
+        shadows.Update(scene, frustum, bonePalette);
+
+        const glm::vec3 background(0.1f);
+        if (deferred) deferredPath.BeginGeometry();
+        else {
+            glClearColor(background.r, background.g, background.b, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
-        GLint crashModelLoc = glGetUniformLocation(skinnedShader.Program, "model");
-        glUniformMatrix4fv(crashModelLoc, 1, GL_FALSE, glm::value_ptr(mCrash));
+        // Profundidad de cerca a lejos y despues todo lo agregado arriba, ordenado por programa,
+        // material y profundidad
+        if (measuring && prepassOn) prepassQuery.Begin();
+        size_t prepassed = queue.DepthPrepass();
+        if (measuring && prepassOn) prepassQuery.End();
+        if (measuring) colorQuery.Begin();
+        queue.Flush(!immediateRender);
+        if (measuring) {
+            colorQuery.End();
+            const char* unit = PassQuery::Invocations() ? " invocaciones" : " muestras";
+            PassMeasure color = colorQuery.Read();
+            std::cout << "Prepase " << (prepassOn ? "ON" : "OFF") << ": " << color.fragments << unit
+                << " del fragment shader en la cola (" << color.Ms() << " ms)";
+            if (prepassOn) {
+                PassMeasure pre = prepassQuery.Read();
+                std::cout << " + " << pre.fragments << unit << " en el prepase de " << prepassed << " mallas ("
+                    << pre.Ms() << " ms)";
+            }
+            std::cout << std::endl;
+            measureFrames--;
+        }
 
-        crash.Draw(skinnedShader);
+        // Cajas de lo que entro, contra la profundidad de este cuadro; se leen en el siguiente
+        scene.TestOcclusion(lampShader, camera.GetPosition());
 
+        // Diferido: luces sobre el G-buffer; lo que sigue se dibuja encima de la imagen ya iluminada
+        if (deferred) deferredPath.Shade(lights.Lights(), view, projection, frustum, background);
 
         // ====== Cubo lámpara (debug) ======
-        lampShader.Use();
-        GLint ml = glGetUniformLocation(lampShader.Program, "model");
-        GLint vl = glGetUniformLocation(lampShader.Program, "view");
-        GLint pl = glGetUniformLocation(lampShader.Program, "projection");
-        glUniformMatrix4fv(vl, 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(pl, 1, GL_FALSE, glm::value_ptr(projection));
+        gl.UseProgram(lampShader.Program);
         glm::mat4 lampM(1.0f);
         lampM = glm::translate(lampM, lightPos);
         lampM = glm::scale(lampM, glm::vec3(0.2f));
-        glUniformMatrix4fv(ml, 1, GL_FALSE, glm::value_ptr(lampM));
-        glBindVertexArray(lampVAO);
+        lampShader.SetMat4(UNIFORM("model"), lampM);
+        gl.BindVertexArray(lampVAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        gl.CountDraw();
 
         // ====== SKYBOX ======
         glDepthFunc(GL_LEQUAL);
         glDepthMask(GL_FALSE);
-        skyShader.Use();
-        glm::mat4 viewNoT = glm::mat4(glm::mat3(view));
-        GLint sv = glGetUniformLocation(skyShader.Program, "view");
-        GLint sp = glGetUniformLocation(skyShader.Program, "projection");
-        glUniformMatrix4fv(sv, 1, GL_FALSE, glm::value_ptr(viewNoT));
-        glUniformMatrix4fv(sp, 1, GL_FALSE, glm::value_ptr(projection));
-        glActiveTexture(GL_TEXTURE0);
+        gl.UseProgram(skyShader.Program);     // el shader quita la traslacion de la vista del bloque Frame
+        gl.ActiveTexture(0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, texSkybox);
-        glBindVertexArray(skyVAO);
+        gl.BindVertexArray(skyVAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        gl.CountDraw();
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        gl.BindVertexArray(0);
         glDepthMask(GL_TRUE);
         glDepthFunc(GL_LESS);
+        if (deferred) deferredPath.Present();
+
+        // Llamadas GL del cuadro (el primero tras cambiar de camino aun arrastra estado viejo)
+        GLCallStats calls = gl.FrameStats();
+        if (++statsFrames == 2) {
+            std::cout << "Cuadro " << (immediateRender ? "inmediato" : "con cola") << ": " << calls.draws << " draws, "
+                << calls.Issued() << " llamadas GL de " << calls.requested << " pedidas (programas " << calls.programs
+                << ", texturas " << calls.textures << ", glActiveTexture " << calls.activeTextures
+                << ", VAOs " << calls.vaos << ", instancias " << calls.instances << ", mallas en multi-draw " << calls.indirect << ")" << std::endl;
+            const CullStats& cull = scene.LastCull();
+            std::cout << "Culling " << (frustumCulling ? "ON" : "OFF") << ", salas " << (portalCulling ? "ON" : "OFF") << ": "
+                << cull.draws << " mallas y " << cull.triangles << " triangulos a la cola, " << cull.culledDraws << " mallas y "
+                << cull.culledTriangles << " triangulos descartados (" << cull.portalDraws << " y " << cull.portalTriangles
+                << " por salas; celdas visibles " << cull.visibleCells << " de " << cull.cells << ")" << std::endl;
+            const OcclusionStats& occ = scene.Occlusion();
+            std::cout << "Oclusion " << (occlusionCulling ? "ON" : "OFF") << ": " << cull.occludedDraws << " mallas y "
+                << cull.occludedTriangles << " triangulos tapados, " << occ.queries << " consultas, " << occ.results
+                << " resultados leidos, " << occ.pending << " pendientes" << std::endl;
+            if (deferred)
+                std::cout << "Diferido: " << deferredPath.Stats().volumes << " volumenes de luz, " << deferredPath.Stats().culled
+                    << " luces fuera de camara" << std::endl;
+            else {
+                const ClusterStats& cl = lights.Stats();
+                std::cout << "Luces: " << cl.visible << " de " << cl.lights << " en " << cl.clusters << " de " << CLUSTER_COUNT
+                    << " clusters (max " << cl.maxPerCluster << ", promedio " << cl.Average() << " por cluster, " << cl.references
+                    << " indices" << (cl.dropped ? ", " + std::to_string(cl.dropped) + " sin lugar" : std::string()) << ") en "
+                    << cl.ms << " ms" << std::endl;
+            }
+            std::cout << "Prepase " << (prepassOn ? "ON" : "OFF") << ": " << prepassed << " mallas de " << queue.Size()
+                << " solo con profundidad" << std::endl;
+            const ShadowStats& sh = shadows.Stats();
+            std::cout << "Sombras " << (shadowsOn ? "ON" : "OFF") << ": " << sh.tiles << " focos, " << sh.updated << " refrescados ("
+                << sh.baked << " horneados), " << sh.waiting << " sin presupuesto, " << sh.idle << " sin costo, " << sh.draws
+                << " draws en " << sh.ms << " ms" << std::endl;
+        }
+        // Culling del cuadro en el titulo, dos veces por segundo
+        if (currentFrame - lastTitle > 0.5f) {
+            const CullStats& cull = scene.LastCull();
+            std::string title = "Proyecto Final - " + std::to_string(cull.draws) + " mallas (" + std::to_string(cull.triangles / 1000) +
+                "k tris), descartadas " + std::to_string(cull.culledDraws) + " (" + std::to_string(cull.culledTriangles / 1000) + "k tris)" +
+                (portalCulling && cull.cells ? ", salas " + std::to_string(cull.visibleCells) + "/" + std::to_string(cull.cells) : std::string()) +
+                (occlusionCulling ? ", tapadas " + std::to_string(cull.occludedDraws) : std::string()) +
+                (frustumCulling ? "" : " [culling apagado]");
+            glfwSetWindowTitle(window, title.c_str());
+            lastTitle = currentFrame;
+        }
 
         glfwSwapBuffers(window);
     }
+    TextureStreamer::Instance().Shutdown();
+    UniformBuffers::Instance().Shutdown();
+    ClusteredLights::Instance().Shutdown();
+    ShadowAtlas::Instance().Shutdown();
+    prepassQuery.Release();
+    colorQuery.Release();
+    deferredPath.Shutdown();
+    TextureCache::Instance().Shutdown();
     glfwTerminate();
     return 0;
 }
@@ -1436,6 +981,76 @@ void KeyCallback(GLFWwindow* window, int key, int, int action, int)
             }
 
 
+            // R: alterna cola de render / camino inmediato e imprime las llamadas GL de cada uno
+            if (key == GLFW_KEY_R) {
+                immediateRender = !immediateRender;
+                statsFrames = 0;
+            }
+
+            // F: culling por frustum encendido/apagado
+            if (key == GLFW_KEY_F) {
+                frustumCulling = !frustumCulling;
+                statsFrames = 0;
+                std::cout << "Culling por frustum: " << (frustumCulling ? "ON" : "OFF") << std::endl;
+            }
+
+            // P: visibilidad por salas y puertas encendida/apagada
+            if (key == GLFW_KEY_P) {
+                portalCulling = !portalCulling;
+                statsFrames = 0;
+                std::cout << "Visibilidad por salas: " << (portalCulling ? "ON" : "OFF") << std::endl;
+            }
+
+            // O: culling por oclusion encendido/apagado
+            if (key == GLFW_KEY_O) {
+                occlusionCulling = !occlusionCulling;
+                statsFrames = 0;
+                std::cout << "Culling por oclusion: " << (occlusionCulling ? "ON" : "OFF") << std::endl;
+            }
+
+            // M: multi-draw indirecto encendido/apagado
+            if (key == GLFW_KEY_M) {
+                multiDraw = !multiDraw;
+                statsFrames = 0;
+                std::cout << "Multi-draw indirecto: " << (multiDraw && IndirectRenderer::Supported() ? "ON" : "OFF") << std::endl;
+            }
+
+            // B: lotes estaticos encendidos/apagados
+            if (key == GLFW_KEY_B) {
+                staticBatching = !staticBatching;
+                statsFrames = 0;
+                std::cout << "Lotes estaticos: " << (staticBatching ? "ON" : "OFF") << std::endl;
+            }
+
+            // L: vista de luces por cluster
+            if (key == GLFW_KEY_L) {
+                lightDebug = !lightDebug;
+                statsFrames = 0;
+                std::cout << "Luces por cluster: " << (lightDebug ? "ON" : "OFF") << std::endl;
+            }
+
+            // H: sombras de los focos encendidas/apagadas
+            if (key == GLFW_KEY_H) {
+                shadowsOn = !shadowsOn;
+                ShadowAtlas::Instance().SetEnabled(shadowsOn);
+                statsFrames = 0;
+                std::cout << "Sombras: " << (shadowsOn ? "ON" : "OFF") << std::endl;
+            }
+
+            // Z: prepase de profundidad encendido/apagado
+            if (key == GLFW_KEY_Z) {
+                depthPrepass = !depthPrepass;
+                statsFrames = 0;
+                std::cout << "Prepase de profundidad: " << (depthPrepass ? "ON" : "OFF") << std::endl;
+            }
+
+            // X: mide el fragment shader de la cola un cuadro sin prepase y otro con el
+            if (key == GLFW_KEY_X && measureFrames == 0) {
+                measureFrames = 2;
+                if (!PassQuery::Invocations())
+                    std::cout << "Sin ARB_pipeline_statistics_query: se cuentan muestras que pasan la profundidad" << std::endl;
+            }
+
             // Activar animación de Crash con tecla C
             if (key == GLFW_KEY_C) {
                 crashAnim = !crashAnim;
@@ -1,9 +1,18 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 #include "Shader.h"
+#include "GLState.h"
+#include "TextureArrays.h"
+#include "MeshArena.h"
 #include <assimp/scene.h>
 
 struct Vertex {
@@ -23,6 +32,81 @@ struct VertexBoneData {
     }
 };
 
+// Huesos empaquetados: 8 bytes en vez de 32 (IDs < 256, pesos unorm8)
+struct PackedBoneData {
+    GLubyte IDs[MAX_BONE_INFLUENCE] = { 0,0,0,0 };
+    GLubyte Weights[MAX_BONE_INFLUENCE] = { 0,0,0,0 };
+};
+
+// Formato de los vertices en GPU. Por defecto el de siempre (todo float, indices de 32 bits).
+// Con packed se empaqueta al subir: normal GL_INT_2_10_10_10_REV, UV en half, huesos en bytes
+// e indices de 16 bits si la malla tiene menos de 65536 vertices. La cache en disco no cambia.
+struct MeshFormat {
+    bool packed = false;
+    bool quantizePositions = false;     // posiciones unorm16 contra el AABB de cada malla
+};
+
+// UVs mas alla de este valor (texturas repetidas) pierden demasiada precision en half: se quedan en float
+#define MESH_HALF_UV_LIMIT 4.0f
+
+// Bytes en GPU de una o varias mallas y lo que ocuparian con el formato completo
+struct MeshMemory {
+    size_t vertices = 0;
+    size_t vertexBytes = 0, indexBytes = 0;
+    size_t fullVertexBytes = 0, fullIndexBytes = 0;
+
+    size_t Bytes() const { return vertexBytes + indexBytes; }
+    size_t FullBytes() const { return fullVertexBytes + fullIndexBytes; }
+    MeshMemory& operator+=(const MeshMemory& o) {
+        vertices += o.vertices;
+        vertexBytes += o.vertexBytes; indexBytes += o.indexBytes;
+        fullVertexBytes += o.fullVertexBytes; fullIndexBytes += o.fullIndexBytes;
+        return *this;
+    }
+    MeshMemory& operator-=(const MeshMemory& o) {
+        vertices -= o.vertices;
+        vertexBytes -= o.vertexBytes; indexBytes -= o.indexBytes;
+        fullVertexBytes -= o.fullVertexBytes; fullIndexBytes -= o.fullIndexBytes;
+        return *this;
+    }
+};
+
+// Normal en 2_10_10_10 con signo (w = 0)
+static inline GLuint PackNormal1010102(const glm::vec3& n) {
+    GLuint out = 0;
+    for (int i = 0; i < 3; i++) {
+        int q = (int)std::lround(glm::clamp(n[i], -1.0f, 1.0f) * 511.0f);
+        out |= (GLuint)(q & 0x3FF) << (10 * i);
+    }
+    return out;
+}
+
+// Volumen envolvente en espacio de la malla: AABB y esfera (centro xyz, radio w).
+// Se calcula al importar y viaja en la cache de mallas.
+struct MeshBounds {
+    glm::vec3 min{ 0.0f }, max{ 0.0f };
+    glm::vec4 sphere{ 0.0f };
+
+    // Esfera centrada en el AABB con el radio justo para el vertice mas lejano
+    static MeshBounds FromVertices(const Vertex* v, size_t n) {
+        MeshBounds b;
+        if (n == 0) return b;
+        b.min = b.max = v[0].Position;
+        for (size_t i = 1; i < n; i++) {
+            b.min = glm::min(b.min, v[i].Position);
+            b.max = glm::max(b.max, v[i].Position);
+        }
+        glm::vec3 c = (b.min + b.max) * 0.5f;
+        float r2 = 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            glm::vec3 d = v[i].Position - c;
+            r2 = std::max(r2, glm::dot(d, d));
+        }
+        b.sphere = glm::vec4(c, std::sqrt(r2));
+        return b;
+    }
+};
+
 struct Texture {
     GLuint id{};
     std::string type;
@@ -36,65 +120,307 @@ public:
     std::vector<Texture> textures;
     std::vector<VertexBoneData> bones;
 
+    // Con LeanResidency() las copias en CPU se sueltan al subir, salvo que se pida keepCpuData
     Mesh(const std::vector<Vertex>& v,
         const std::vector<GLuint>& idx,
         const std::vector<Texture>& tex,
-        const std::vector<VertexBoneData>& b = {})
-        : vertices(v), indices(idx), textures(tex), bones(b) {
-        setupMesh();
+        const std::vector<VertexBoneData>& b = {},
+        bool keepCpuData = false)
+        : vertices(v), indices(idx), textures(tex), bones(b), bounds(MeshBounds::FromVertices(v.data(), v.size())) {
+        nameSamplers();
+        setupMesh(vertices.data(), vertices.size(), indices.data(), indices.size(), bones.data(), bones.size());
+        if (LeanResidency() && !keepCpuData) {
+            std::vector<Vertex>().swap(vertices);
+            std::vector<GLuint>().swap(indices);
+            std::vector<VertexBoneData>().swap(bones);
+        }
     }
 
-    void Draw(Shader& shader) {
-        GLuint diffuseNr = 1, specularNr = 1;
+    // Sube directo desde buffers externos (p. ej. la cache mapeada) sin copiarlos
+    Mesh(const Vertex* v, size_t nv, const GLuint* idx, size_t ni,
+        const VertexBoneData* b, size_t nb, const std::vector<Texture>& tex, const MeshBounds& bounds)
+        : textures(tex), bounds(bounds) {
+        nameSamplers();
+        setupMesh(v, nv, idx, ni, b, nb);
+    }
+
+    // Solo una malla es duena de su rango: al moverla la original ya no lo devuelve
+    Mesh(Mesh&&) noexcept = default;
+    Mesh& operator=(Mesh&&) = delete;
+    ~Mesh() { releaseRange(); }
+
+    // Suelta los vertices e indices de la arena; texturas y volumen se quedan. Una malla sin
+    // geometria no dibuja nada hasta que Upload la vuelve a subir (p. ej. desde la cache).
+    void ReleaseGeometry() { releaseRange(); }
+    void Upload(const Vertex* v, size_t nv, const GLuint* idx, size_t ni, const VertexBoneData* b, size_t nb) {
+        releaseRange();
+        setupMesh(v, nv, idx, ni, b, nb);
+    }
+    bool HasGeometry() const { return owner.owns; }
+
+    // Formato con el que se suben las mallas nuevas; se ajusta antes de cargar modelos
+    static MeshFormat& Format() { static MeshFormat f; return f; }
+    // Soltar los vertices/indices en CPU una vez subidos (los modelos los retienen aparte si se pide)
+    static bool& LeanResidency() { static bool lean = false; return lean; }
+    // Acumulado de todas las mallas subidas
+    static MeshMemory& Totals() { static MeshMemory m; return m; }
+
+    const MeshMemory& Memory() const { return memory; }
+    size_t CpuBytes() const {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(GLuint) +
+            bones.capacity() * sizeof(VertexBoneData) + textures.capacity() * sizeof(Texture);
+    }
+
+    // Texturas de la malla reducidas a 16 bits, para agrupar por material en la cola de render.
+    // Con la difusa en un arreglo cuenta el arreglo, no la textura: todas sus capas van juntas.
+    uint16_t MaterialKey() const { resolveLayer(); return materialKey; }
+    const MeshBounds& Bounds() const { return bounds; }
+    GLsizei Triangles() const { return range.indexCount / 3; }
+    // Numero de malla (se repite despues de 65536): junta en la cola las copias de la misma malla
+    uint16_t Id() const { return meshId; }
+
+    // Rango en la arena compartida y lo que hace falta para dibujarla sin Submit (IndirectDraw.h)
+    const MeshRange& Range() const { return range; }
+    const glm::vec3& PosScale() const { return posScale; }
+    const glm::vec3& PosBias() const { return posBias; }
+    GLuint DiffuseTexture() const { return diffuseIndex >= 0 ? textures[diffuseIndex].id : 0; }
+    GLuint DiffuseArray() const { resolveLayer(); return diffuseArray; }
+    int DiffuseLayer() const { resolveLayer(); return diffuseLayer; }
+
+    // Buffer de instancias compartido por todos los VAOs de la arena
+    static GLuint InstanceBuffer() { return MeshArena::InstanceBuffer(); }
+
+    // Instancias del siguiente Submit instanciado. Se huerfana el buffer en cada lote para no
+    // esperar a que la GPU termine con el anterior.
+    static void UploadInstances(const InstanceData* data, size_t count) {
+        static size_t capacity = sizeof(InstanceData);
+        capacity = std::max(capacity, count * sizeof(InstanceData));
+        glBindBuffer(GL_ARRAY_BUFFER, InstanceBuffer());
+        glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), data);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Camino inmediato de siempre: bindea, dibuja y deja todo desbindeado
+    void Draw(const Shader& shader) const {
+        GLState& gl = GLState::Instance();
+        Submit(shader);
+        gl.BindVertexArray(0);
+        for (GLuint i = 0; i < textures.size(); ++i) gl.BindTexture2D(i, 0);
+        if (diffuseArray) gl.BindTexture2DArray(TEXTURE_ARRAY_UNIT, 0);
+    }
+
+    // Dibuja sin desbindear; lo que ya este puesto lo salta la cache de GLState.
+    // Con instances > 0 dibuja esa cantidad de instancias de UploadInstances.
+    void Submit(const Shader& shader, GLsizei instances = 0) const {
+        GLState& gl = GLState::Instance();
+        resolveLayer();
         for (GLuint i = 0; i < textures.size(); ++i) {
-            glActiveTexture(GL_TEXTURE0 + i);
-            std::string name = textures[i].type;
-            std::string number = (name == "texture_diffuse")
-                ? std::to_string(diffuseNr++)
-                : std::to_string(specularNr++);
-            glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if ((int)i == diffuseIndex && diffuseArray) continue;
+            shader.SetInt(samplerNames[i], (GLint)i);
+            gl.BindTexture2D(i, textures[i].id);
         }
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        for (GLuint i = 0; i < textures.size(); ++i) { glActiveTexture(GL_TEXTURE0 + i); glBindTexture(GL_TEXTURE_2D, 0); }
+        // Difusa en un arreglo: capa por draw (-1 lee texture_diffuse1). El sampler del arreglo
+        // se fija siempre para que no quede en la unidad 0 junto al sampler2D.
+        shader.SetInt(UNIFORM("texture_diffuse_array"), TEXTURE_ARRAY_UNIT);
+        shader.SetInt(UNIFORM("uDiffuseLayer"), diffuseLayer);
+        if (diffuseArray) gl.BindTexture2DArray(TEXTURE_ARRAY_UNIT, diffuseArray);
+        // Posiciones cuantizadas: el shader las reconstruye con aPos * uPosScale + uPosBias
+        shader.SetVec3(UNIFORM("uPosScale"), posScale);
+        shader.SetVec3(UNIFORM("uPosBias"), posBias);
+        gl.BindVertexArray(MeshArena::Instance().VertexArray(range.pool));
+        void* first = (void*)range.indexOffset;
+        if (instances > 0) glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, first, instances, range.baseVertex);
+        else glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, first, range.baseVertex);
+        gl.CountDraw(instances);
+    }
+
+    // Solo profundidad: el flujo de posiciones de la arena, sin texturas (Shader/depth.vs)
+    void SubmitDepth(const Shader& shader, GLsizei instances = 0) const {
+        shader.SetVec3(UNIFORM("uPosScale"), posScale);
+        shader.SetVec3(UNIFORM("uPosBias"), posBias);
+        GLState::Instance().BindVertexArray(MeshArena::Instance().DepthVertexArray(range.pool));
+        void* first = (void*)range.indexOffset;
+        if (instances > 0) glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, first, instances, range.baseVertex);
+        else glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, range.indexType, first, range.baseVertex);
+        GLState::Instance().CountDraw(instances);
     }
 
 private:
-    GLuint VAO = 0, VBO = 0, EBO = 0, VBO_bones = 0;
-
-    void setupMesh() {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
-
-        // position
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
-        // normal
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // texcoords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-        if (!bones.empty()) {
-            glGenBuffers(1, &VBO_bones);
-            glBindBuffer(GL_ARRAY_BUFFER, VBO_bones);
-            glBufferData(GL_ARRAY_BUFFER, bones.size() * sizeof(VertexBoneData), bones.data(), GL_STATIC_DRAW);
-            glEnableVertexAttribArray(5);
-            glVertexAttribIPointer(5, 4, GL_INT, sizeof(VertexBoneData), (void*)offsetof(VertexBoneData, IDs));
-            glEnableVertexAttribArray(6);
-            glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(VertexBoneData), (void*)offsetof(VertexBoneData, Weights));
+    struct RangeOwner {
+        bool owns = false;
+        RangeOwner() = default;
+        RangeOwner(RangeOwner&& o) noexcept : owns(o.owns) { o.owns = false; }
+    };
+
+    MeshRange range;
+    RangeOwner owner;
+    glm::vec3 posScale{ 1.0f }, posBias{ 0.0f };
+    MeshMemory memory;
+    MeshBounds bounds;
+    std::vector<uint32_t> samplerNames;     // hash de texture_diffuseN / texture_specularN por textura
+    int diffuseIndex = -1;                  // textura que lee texture_diffuse1
+    // Capa de la difusa en TextureArrays; se vuelve a buscar cuando cambia su Generation()
+    mutable uint32_t layerGeneration = ~0u;
+    mutable GLuint diffuseArray = 0;
+    mutable int diffuseLayer = -1;
+    mutable uint16_t materialKey = 0;
+    uint16_t meshId = newMeshId();
+
+    static uint16_t newMeshId() { static uint16_t n = 0; return n++; }
+
+    // Los nombres de los samplers se arman una sola vez, no en cada Draw. Los ids de textura
+    // no cambian al terminar el streaming; la llave solo cambia cuando la difusa pasa a su capa.
+    void nameSamplers() {
+        GLuint diffuseNr = 1, specularNr = 1;
+        samplerNames.clear();
+        for (size_t i = 0; i < textures.size(); i++) {
+            const Texture& t = textures[i];
+            bool diffuse = t.type == "texture_diffuse";
+            if (diffuse && diffuseNr == 1) diffuseIndex = (int)i;
+            std::string number = diffuse ? std::to_string(diffuseNr++) : std::to_string(specularNr++);
+            samplerNames.push_back(UniformHash((t.type + number).c_str()));
+        }
+        resolveLayer();
+    }
+
+    void resolveLayer() const {
+        const TextureArrays& arrays = TextureArrays::Instance();
+        if (layerGeneration == arrays.Generation()) return;
+        layerGeneration = arrays.Generation();
+        diffuseArray = 0;
+        diffuseLayer = -1;
+        if (diffuseIndex >= 0 && !arrays.Resident(textures[diffuseIndex].id, diffuseArray, diffuseLayer)) {
+            diffuseArray = 0;
+            diffuseLayer = -1;
+        }
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < textures.size(); i++)
+            h = (h ^ ((int)i == diffuseIndex && diffuseArray ? diffuseArray | 0x80000000u : textures[i].id)) * 16777619u;
+        materialKey = textures.empty() ? 0 : (uint16_t)(h ^ (h >> 16));
+    }
+
+    // Arma vertices, huesos e indices en el formato de Format() y los copia a la arena
+    void setupMesh(const Vertex* v, size_t nv, const GLuint* idx, size_t ni, const VertexBoneData* b, size_t nb) {
+        const MeshFormat& fmt = Format();
+        MeshLayout layout;
+        layout.packed = fmt.packed;
+        std::vector<unsigned char> packedVertices;
+        const void* vertexData = v;
+        if (fmt.packed) {
+            packVertices(v, nv, fmt.quantizePositions, layout, packedVertices);
+            vertexData = packedVertices.data();
+        }
+
+        std::vector<GLushort> idx16;
+        const void* indexData = idx;
+        GLenum indexType = GL_UNSIGNED_INT;
+        if (fmt.packed && nv < 65536) {
+            idx16.assign(idx, idx + ni);
+            indexData = idx16.data();
+            indexType = GL_UNSIGNED_SHORT;
+        }
+
+        // La arena espera un hueso por vertice
+        std::vector<VertexBoneData> fullBones;
+        std::vector<PackedBoneData> packedBones;
+        const void* boneData = nullptr;
+        if (nb > 0) {
+            if (nb < nv) { fullBones.assign(b, b + nb); fullBones.resize(nv); b = fullBones.data(); }
+            if (fmt.packed && bonesFitInBytes(b, nv)) {
+                packBones(b, nv, packedBones);
+                boneData = packedBones.data();
+                layout.bones = MESH_BONES_PACKED;
+            }
+            else {
+                boneData = b;
+                layout.bones = MESH_BONES_FULL;
+            }
+        }
+        range = MeshArena::Instance().Add(layout, vertexData, nv, boneData, indexData, ni, indexType);
+        owner.owns = true;
+
+        memory.vertices = nv;
+        // Cuenta tambien el flujo de solo posiciones de la arena, en los dos formatos
+        memory.vertexBytes = nv * layout.VertexBytes();
+        memory.indexBytes = ni * (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+        memory.fullVertexBytes = nv * (sizeof(Vertex) + sizeof(glm::vec3)) + nb * sizeof(VertexBoneData);
+        memory.fullIndexBytes = ni * sizeof(GLuint);
+        Totals() += memory;
+    }
+
+    // Devuelve el rango a la arena y lo descuenta de Totals()
+    void releaseRange() {
+        if (!owner.owns) return;
+        MeshArena::Instance().Free(range);
+        Totals() -= memory;
+        owner.owns = false;
+        range = MeshRange();
+        memory = MeshMemory();
+    }
+
+    // Posicion float o unorm16 (x,y,z + relleno), normal 2_10_10_10 y UV half o float: 16 a 24 bytes
+    void packVertices(const Vertex* v, size_t nv, bool quantize, MeshLayout& layout, std::vector<unsigned char>& data) {
+        glm::vec3 lo(0.0f), hi(0.0f);
+        float uvMax = 0.0f;
+        if (nv > 0) lo = hi = v[0].Position;
+        for (size_t i = 0; i < nv; i++) {
+            lo = glm::min(lo, v[i].Position);
+            hi = glm::max(hi, v[i].Position);
+            uvMax = std::max(uvMax, std::max(std::fabs(v[i].TexCoords.x), std::fabs(v[i].TexCoords.y)));
+        }
+        glm::vec3 extent = hi - lo;
+        for (int c = 0; c < 3; c++) if (extent[c] <= 0.0f) extent[c] = 1.0f;
+        layout.quantized = quantize;
+        layout.halfUV = uvMax <= MESH_HALF_UV_LIMIT;
+        if (quantize) {
+            posScale = extent;
+            posBias = lo;
+        }
+
+        const size_t posBytes = layout.PositionBytes(), uvOffset = layout.UVOffset(), stride = layout.Stride();
+        data.assign(nv * stride, 0);
+        for (size_t i = 0; i < nv; i++) {
+            unsigned char* p = &data[i * stride];
+            if (quantize) {
+                glm::vec3 t = (v[i].Position - lo) / extent;
+                GLushort q[4] = { glm::packUnorm1x16(t.x), glm::packUnorm1x16(t.y), glm::packUnorm1x16(t.z), 0 };
+                memcpy(p, q, sizeof(q));
+            }
+            else memcpy(p, &v[i].Position, sizeof(glm::vec3));
+            GLuint n = PackNormal1010102(v[i].Normal);
+            memcpy(p + posBytes, &n, sizeof(n));
+            if (layout.halfUV) {
+                GLushort uv[2] = { glm::packHalf1x16(v[i].TexCoords.x), glm::packHalf1x16(v[i].TexCoords.y) };
+                memcpy(p + uvOffset, uv, sizeof(uv));
+            }
+            else memcpy(p + uvOffset, &v[i].TexCoords, sizeof(glm::vec2));
+        }
+    }
+
+    static bool bonesFitInBytes(const VertexBoneData* b, size_t nb) {
+        for (size_t i = 0; i < nb; i++)
+            for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+                if (b[i].IDs[k] < 0 || b[i].IDs[k] > 255) return false;
+        return true;
+    }
+
+    // Pesos a unorm8 conservando su suma: el redondeo sobrante va al peso mayor
+    static void packBones(const VertexBoneData* b, size_t nb, std::vector<PackedBoneData>& packed) {
+        packed.assign(nb, PackedBoneData());
+        for (size_t i = 0; i < nb; i++) {
+            float sum = 0.0f;
+            int total = 0, biggest = 0;
+            for (int k = 0; k < MAX_BONE_INFLUENCE; k++) {
+                float w = glm::clamp(b[i].Weights[k], 0.0f, 1.0f);
+                packed[i].IDs[k] = (GLubyte)b[i].IDs[k];
+                packed[i].Weights[k] = (GLubyte)std::lround(w * 255.0f);
+                sum += w;
+                total += packed[i].Weights[k];
+                if (b[i].Weights[k] > b[i].Weights[biggest]) biggest = k;
+            }
+            int fixedW = packed[i].Weights[biggest] + (int)std::lround(std::min(sum, 1.0f) * 255.0f) - total;
+            packed[i].Weights[biggest] = (GLubyte)glm::clamp(fixedW, 0, 255);
         }
-        glBindVertexArray(0);
     }
 };
@@ -0,0 +1,373 @@
+#pragma once
+// Arena de vertices e indices compartida por todas las mallas. Cada formato de vertice
+// (MeshLayout) tiene un VBO, un buffer de huesos si hace falta, un EBO y un VAO; una malla es un
+// rango dentro de ellos y se dibuja con glDrawElementsBaseVertex, asi que mallas distintas del
+// mismo formato se pueden mandar juntas en una sola llamada (IndirectDraw.h). Si algo nuevo no
+// cabe, el buffer se duplica y lo anterior se copia en la GPU con glCopyBufferSubData.
+// Free devuelve el rango de una malla a listas de huecos por formato (vertices e indices) que Add
+// reutiliza antes de crecer; Trim encoge los buffers que quedaron muy vacios.
+// Cada formato guarda ademas sus posiciones solas, juntas, con un segundo VAO para los pases que
+// solo escriben profundidad (RenderQueue::DepthPrepass), que leen 8 o 12 bytes por vertice.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Datos por instancia para glDrawElementsInstanced: matriz de modelo (atributos 7-10) y
+// matriz normal ya calculada (11-13)
+#define INSTANCE_ATTRIB_MODEL   7
+#define INSTANCE_ATTRIB_NORMAL  11
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normal;
+};
+
+#define MESH_ARENA_MIN_VERTICES (64 * 1024)     // capacidad inicial de cada formato
+#define MESH_ARENA_MIN_INDEX_BYTES (1u << 20)
+
+enum MeshBoneFormat : uint8_t { MESH_BONES_NONE = 0, MESH_BONES_FULL, MESH_BONES_PACKED };
+
+// Formato de un vertice en GPU (ver Mesh::setupMesh)
+struct MeshLayout {
+    bool packed = false;            // normal 2_10_10_10; si no, Vertex tal cual
+    bool quantized = false;         // posicion unorm16 (solo empaquetado)
+    bool halfUV = false;            // UV en half (solo empaquetado)
+    MeshBoneFormat bones = MESH_BONES_NONE;
+
+    // La posicion va primero en los dos formatos; el flujo de solo posiciones usa este mismo stride
+    size_t PositionBytes() const { return quantized ? 4 * sizeof(GLushort) : 3 * sizeof(float); }
+    size_t UVOffset() const { return PositionBytes() + sizeof(GLuint); }
+    size_t Stride() const {
+        if (!packed) return 8 * sizeof(float);
+        return UVOffset() + (halfUV ? 2 * sizeof(GLushort) : 2 * sizeof(float));
+    }
+    size_t BoneStride() const { return bones == MESH_BONES_FULL ? 8 * 4 : bones == MESH_BONES_PACKED ? 8 : 0; }
+    // Lo que ocupa un vertice entre VBO, huesos y flujo de posiciones
+    size_t VertexBytes() const { return Stride() + BoneStride() + PositionBytes(); }
+    bool operator==(const MeshLayout& o) const {
+        return packed == o.packed && quantized == o.quantized && halfUV == o.halfUV && bones == o.bones;
+    }
+};
+
+// Lugar de una malla en la arena
+struct MeshRange {
+    int pool = -1;
+    GLint baseVertex = 0;
+    size_t indexOffset = 0;         // en bytes dentro del EBO
+    GLsizei indexCount = 0;
+    GLsizei vertexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    GLuint FirstIndex() const { return (GLuint)(indexOffset / (indexType == GL_UNSIGNED_SHORT ? 2 : 4)); }
+};
+
+struct MeshArenaStats {
+    int pools = 0, meshes = 0, grows = 0, shrinks = 0;
+    size_t bytes = 0;               // capacidad reservada en GPU
+    size_t freeBytes = 0;           // de esa capacidad, huecos que dejaron mallas liberadas
+};
+
+class MeshArena {
+public:
+    static MeshArena& Instance() { static MeshArena a; return a; }
+
+    // Buffer de instancias compartido por todos los VAOs (atributos 7-13 con divisor 1)
+    static GLuint InstanceBuffer() {
+        static GLuint vbo = 0;
+        if (!vbo) {
+            InstanceData first{ glm::mat4(1.0f), glm::mat3(1.0f) };
+            glGenBuffers(1, &vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData), &first, GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        return vbo;
+    }
+
+    // Copia los vertices (con stride layout.Stride()), los huesos si el formato los lleva y los
+    // indices a la arena: en el primer hueco donde quepan o al final. Los rangos de indices
+    // ocupan multiplos de 4 bytes, asi que los de 32 bits quedan alineados.
+    MeshRange Add(const MeshLayout& layout, const void* vertices, size_t nv, const void* bones,
+        const void* indices, size_t ni, GLenum indexType) {
+        int p = poolFor(layout);
+        Pool& pool = pools[p];
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        size_t indexSpan = indexSpanBytes(ni, indexType);
+        size_t base = take(pool.freeVertices, nv);
+        size_t indexOffset = take(pool.freeIndices, indexSpan);
+        if (base == NO_SPAN) base = pool.vertices;
+        if (indexOffset == NO_SPAN) indexOffset = pool.indexBytes;
+        reserve(pool, std::max(pool.vertices, base + nv), std::max(pool.indexBytes, indexOffset + indexSpan));
+
+        size_t stride = layout.Stride(), boneStride = layout.BoneStride();
+        upload(pool.vbo, base * stride, nv * stride, vertices);
+        if (boneStride) upload(pool.bones, base * boneStride, nv * boneStride, bones);
+        size_t positionBytes = layout.PositionBytes();
+        positions.resize(nv * positionBytes);
+        for (size_t i = 0; i < nv; i++)
+            memcpy(&positions[i * positionBytes], (const unsigned char*)vertices + i * stride, positionBytes);
+        upload(pool.positions, base * positionBytes, positions.size(), positions.data());
+        upload(pool.ebo, indexOffset, ni * indexSize, indices);
+
+        MeshRange r;
+        r.pool = p;
+        r.baseVertex = (GLint)base;
+        r.indexOffset = indexOffset;
+        r.indexCount = (GLsizei)ni;
+        r.vertexCount = (GLsizei)nv;
+        r.indexType = indexType;
+        pool.vertices = std::max(pool.vertices, base + nv);
+        pool.indexBytes = std::max(pool.indexBytes, indexOffset + indexSpan);
+        stats.meshes++;
+        countFree();
+        return r;
+    }
+
+    // Devuelve los vertices (con sus huesos y posiciones) y los indices de r a los huecos de su
+    // formato. No toca GL, asi que sirve tambien al destruir mallas despues del contexto.
+    void Free(const MeshRange& r) {
+        if (r.pool < 0 || r.pool >= (int)pools.size()) return;
+        Pool& pool = pools[r.pool];
+        release(pool.freeVertices, pool.vertices, (size_t)r.baseVertex, (size_t)r.vertexCount);
+        release(pool.freeIndices, pool.indexBytes, r.indexOffset, indexSpanBytes((size_t)r.indexCount, r.indexType));
+        stats.meshes--;
+        countFree();
+    }
+
+    // Encoge a la mitad los buffers que quedaron usados a menos de un cuarto tras Free. Solo
+    // recorta lo que hay despues del ultimo rango vivo; los huecos de en medio se reutilizan.
+    void Trim() {
+        for (Pool& p : pools) {
+            bool changed = false;
+            size_t vertexCap = p.vertexCapacity;
+            while (vertexCap / 2 >= MESH_ARENA_MIN_VERTICES && p.vertices * 4 <= vertexCap) vertexCap /= 2;
+            if (vertexCap < p.vertexCapacity) {
+                p.vbo = grow(p.vbo, p.vertices * p.layout.Stride(), vertexCap * p.layout.Stride());
+                if (p.layout.BoneStride()) p.bones = grow(p.bones, p.vertices * p.layout.BoneStride(), vertexCap * p.layout.BoneStride());
+                p.positions = grow(p.positions, p.vertices * p.layout.PositionBytes(), vertexCap * p.layout.PositionBytes());
+                stats.bytes -= (p.vertexCapacity - vertexCap) * p.layout.VertexBytes();
+                p.vertexCapacity = vertexCap;
+                changed = true;
+            }
+            size_t indexCap = p.indexCapacity;
+            while (indexCap / 2 >= MESH_ARENA_MIN_INDEX_BYTES && p.indexBytes * 4 <= indexCap) indexCap /= 2;
+            if (indexCap < p.indexCapacity) {
+                p.ebo = grow(p.ebo, p.indexBytes, indexCap);
+                stats.bytes -= p.indexCapacity - indexCap;
+                p.indexCapacity = indexCap;
+                changed = true;
+            }
+            if (changed) {
+                stats.shrinks++;
+                setupVertexArray(p);
+                setupDepthVertexArray(p);
+            }
+        }
+    }
+
+    GLuint VertexArray(int pool) const { return pools[pool].vao; }
+    // Solo posicion (atributo 0) y matriz de instancia, mismos indices y baseVertex que VertexArray
+    GLuint DepthVertexArray(int pool) const { return pools[pool].depthVao; }
+    const MeshLayout& Layout(int pool) const { return pools[pool].layout; }
+    const MeshArenaStats& Stats() const { return stats; }
+
+private:
+    // Hueco libre: en vertices para el VBO (y huesos y posiciones), en bytes para el EBO
+    struct Span {
+        size_t offset, size;
+    };
+    static const size_t NO_SPAN = ~size_t(0);
+
+    struct Pool {
+        MeshLayout layout;
+        GLuint vao = 0, vbo = 0, bones = 0, ebo = 0;
+        GLuint depthVao = 0, positions = 0;
+        size_t vertices = 0, vertexCapacity = 0;    // vertices: fin del ultimo rango vivo
+        size_t indexBytes = 0, indexCapacity = 0;
+        std::vector<Span> freeVertices, freeIndices;    // ordenados por offset y sin vecinos contiguos
+    };
+    std::vector<Pool> pools;
+    MeshArenaStats stats;
+    std::vector<unsigned char> positions;   // se reutiliza entre Add
+
+    int poolFor(const MeshLayout& layout) {
+        for (size_t i = 0; i < pools.size(); i++) if (pools[i].layout == layout) return (int)i;
+        Pool p;
+        p.layout = layout;
+        glGenVertexArrays(1, &p.vao);
+        glGenVertexArrays(1, &p.depthVao);
+        pools.push_back(p);
+        stats.pools++;
+        return (int)pools.size() - 1;
+    }
+
+    static size_t indexSpanBytes(size_t ni, GLenum indexType) {
+        return (ni * (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)) + 3) & ~size_t(3);
+    }
+
+    // Primer hueco con lugar para size; lo que sobra queda libre. NO_SPAN si ninguno alcanza.
+    static size_t take(std::vector<Span>& spans, size_t size) {
+        if (!size) return NO_SPAN;
+        for (size_t i = 0; i < spans.size(); i++) {
+            if (spans[i].size < size) continue;
+            size_t offset = spans[i].offset;
+            spans[i].offset += size;
+            spans[i].size -= size;
+            if (!spans[i].size) spans.erase(spans.begin() + i);
+            return offset;
+        }
+        return NO_SPAN;
+    }
+
+    // Une [offset, offset+size) con sus vecinos; si toca el final, baja end en vez de guardar el hueco
+    static void release(std::vector<Span>& spans, size_t& end, size_t offset, size_t size) {
+        if (!size) return;
+        auto it = std::lower_bound(spans.begin(), spans.end(), offset, [](const Span& s, size_t o) { return s.offset < o; });
+        it = spans.insert(it, Span{ offset, size });
+        if (it + 1 != spans.end() && it->offset + it->size == (it + 1)->offset) {
+            it->size += (it + 1)->size;
+            spans.erase(it + 1);
+        }
+        if (it != spans.begin() && (it - 1)->offset + (it - 1)->size == it->offset) {
+            (it - 1)->size += it->size;
+            it = spans.erase(it) - 1;
+        }
+        if (it->offset + it->size == end) {
+            end = it->offset;
+            spans.erase(it);
+        }
+    }
+
+    void countFree() {
+        stats.freeBytes = 0;
+        for (const Pool& p : pools) {
+            for (const Span& s : p.freeVertices) stats.freeBytes += s.size * p.layout.VertexBytes();
+            for (const Span& s : p.freeIndices) stats.freeBytes += s.size;
+        }
+    }
+
+    // Agranda al doble (o a lo que haga falta) y vuelve a apuntar el VAO
+    void reserve(Pool& p, size_t vertices, size_t indexBytes) {
+        bool changed = false;
+        if (vertices > p.vertexCapacity) {
+            size_t cap = std::max(std::max(vertices, p.vertexCapacity * 2), (size_t)MESH_ARENA_MIN_VERTICES);
+            p.vbo = grow(p.vbo, p.vertices * p.layout.Stride(), cap * p.layout.Stride());
+            if (p.layout.BoneStride()) p.bones = grow(p.bones, p.vertices * p.layout.BoneStride(), cap * p.layout.BoneStride());
+            p.positions = grow(p.positions, p.vertices * p.layout.PositionBytes(), cap * p.layout.PositionBytes());
+            stats.bytes += (cap - p.vertexCapacity) * p.layout.VertexBytes();
+            p.vertexCapacity = cap;
+            changed = true;
+        }
+        if (indexBytes > p.indexCapacity) {
+            size_t cap = std::max(std::max(indexBytes, p.indexCapacity * 2), (size_t)MESH_ARENA_MIN_INDEX_BYTES);
+            p.ebo = grow(p.ebo, p.indexBytes, cap);
+            stats.bytes += cap - p.indexCapacity;
+            p.indexCapacity = cap;
+            changed = true;
+        }
+        if (changed) {
+            stats.grows++;
+            setupVertexArray(p);
+            setupDepthVertexArray(p);
+        }
+    }
+
+    // Buffer nuevo de `bytes` con los primeros `used` del anterior
+    GLuint grow(GLuint old, size_t used, size_t bytes) {
+        GLuint id;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+        if (old) {
+            if (used) {
+                glBindBuffer(GL_COPY_READ_BUFFER, old);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &old);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return id;
+    }
+
+    static void upload(GLuint buffer, size_t offset, size_t bytes, const void* data) {
+        if (!bytes) return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // Atributos 0-2 de vertice, 5-6 de huesos y 7-13 de instancia
+    static void setupVertexArray(const Pool& p) {
+        const MeshLayout& l = p.layout;
+        GLsizei stride = (GLsizei)l.Stride();
+        glBindVertexArray(p.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, p.vbo);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        if (!l.packed) {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+        }
+        else {
+            if (l.quantized) glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+            else glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)l.PositionBytes());
+            glVertexAttribPointer(2, 2, l.halfUV ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, stride, (void*)l.UVOffset());
+        }
+        if (l.bones != MESH_BONES_NONE) {
+            GLsizei bs = (GLsizei)l.BoneStride();
+            glBindBuffer(GL_ARRAY_BUFFER, p.bones);
+            glEnableVertexAttribArray(5);
+            glEnableVertexAttribArray(6);
+            if (l.bones == MESH_BONES_FULL) {
+                glVertexAttribIPointer(5, 4, GL_INT, bs, (void*)0);
+                glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, bs, (void*)(4 * sizeof(int)));
+            }
+            else {
+                glVertexAttribIPointer(5, 4, GL_UNSIGNED_BYTE, bs, (void*)0);
+                glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, bs, (void*)4);
+            }
+        }
+        instanceAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, p.ebo);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Atributo 0 del flujo de posiciones y 7-13 de instancia
+    static void setupDepthVertexArray(const Pool& p) {
+        const MeshLayout& l = p.layout;
+        glBindVertexArray(p.depthVao);
+        glBindBuffer(GL_ARRAY_BUFFER, p.positions);
+        glEnableVertexAttribArray(0);
+        if (l.quantized) glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, (GLsizei)l.PositionBytes(), (void*)0);
+        else glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)l.PositionBytes(), (void*)0);
+        instanceAttributes();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, p.ebo);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Sin instanciar el shader no los lee
+    static void instanceAttributes() {
+        glBindBuffer(GL_ARRAY_BUFFER, InstanceBuffer());
+        for (GLuint c = 0; c < 4; c++) {
+            glEnableVertexAttribArray(INSTANCE_ATTRIB_MODEL + c);
+            glVertexAttribPointer(INSTANCE_ATTRIB_MODEL + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                (void*)(offsetof(InstanceData, model) + c * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_ATTRIB_MODEL + c, 1);
+        }
+        for (GLuint c = 0; c < 3; c++) {
+            glEnableVertexAttribArray(INSTANCE_ATTRIB_NORMAL + c);
+            glVertexAttribPointer(INSTANCE_ATTRIB_NORMAL + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                (void*)(offsetof(InstanceData, normal) + c * sizeof(glm::vec3)));
+            glVertexAttribDivisor(INSTANCE_ATTRIB_NORMAL + c, 1);
+        }
+    }
+};
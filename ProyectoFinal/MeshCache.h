@@ -0,0 +1,264 @@
+#pragma once
+// Cache binaria de mallas: guarda junto a cada modelo (<ruta>.meshcache) los
+// arreglos finales de processMesh para que un arranque en caliente no pase por Assimp.
+// El archivo se mapea en memoria y los vertices/indices/huesos se suben directo a GL.
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "MappedFile.h"
+#include "Mesh.h"
+
+// Subir este numero cada vez que cambie Vertex, VertexBoneData, MeshBounds o el formato de abajo
+#define MESH_CACHE_VERSION 2u
+
+// ---- Datos de modelo independientes de Assimp ----
+struct TextureRef {
+    std::string type;     // texture_diffuse / texture_specular
+    std::string path;     // tal como viene en el material
+    int embedded = -1;    // indice en ModelData::embedded si es "*N"
+};
+
+struct EmbeddedTexture {
+    unsigned width = 0, height = 0;     // height == 0 -> comprimida (png/jpg), width = bytes
+    std::vector<unsigned char> bytes;
+};
+
+struct VecKey { double time; glm::vec3 value; };
+struct QuatKey { double time; glm::quat value; };
+struct NodeAnim {
+    std::vector<VecKey> positions;
+    std::vector<QuatKey> rotations;
+    std::vector<VecKey> scales;
+};
+
+// Jerarquia aplanada en preorden: el padre siempre aparece antes que sus hijos
+struct NodeData {
+    std::string name;
+    glm::mat4 transform{ 1.0f };
+    int parent = -1;
+    int channel = -1;     // canal de animacion que mueve este nodo
+    int bone = -1;        // hueso asociado a este nodo
+};
+
+struct AnimationData {
+    double duration = 0.0;
+    double ticksPerSecond = 25.0;
+    std::vector<NodeAnim> channels;
+};
+
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<VertexBoneData> bones;
+    std::vector<TextureRef> textures;
+    MeshBounds bounds;
+};
+
+// Vista de una malla lista para setupMesh (apunta a MeshData o al archivo mapeado)
+struct MeshView {
+    const Vertex* vertices = nullptr; size_t numVertices = 0;
+    const GLuint* indices = nullptr;  size_t numIndices = 0;
+    const VertexBoneData* bones = nullptr; size_t numBones = 0;
+    std::vector<TextureRef> textures;
+    MeshBounds bounds;
+};
+
+struct ModelData {
+    std::vector<MeshData> meshes;
+    std::vector<MeshView> views;
+    std::vector<EmbeddedTexture> embedded;
+    std::vector<std::string> boneNames;
+    std::vector<glm::mat4> boneOffsets;
+    std::vector<NodeData> nodes;
+    std::vector<AnimationData> animations;
+    glm::mat4 globalInverse{ 1.0f };
+};
+
+// Escritura/lectura de las caches binarias (mallas, escena). Los arreglos grandes se
+// alinean a 16 bytes para poder usarlos directo desde el mapeo.
+struct CacheWriter {
+    std::vector<char> buf;
+    void Raw(const void* p, size_t n) { const char* c = static_cast<const char*>(p); buf.insert(buf.end(), c, c + n); }
+    void U32(uint32_t v) { Raw(&v, 4); }
+    void Str(const std::string& s) { U32((uint32_t)s.size()); Raw(s.data(), s.size()); }
+    void Align() { while (buf.size() % 16) buf.push_back(0); }
+    template <class T> void Array(const T* p, size_t n) { Align(); Raw(p, n * sizeof(T)); }
+    template <class T> void Vec(const std::vector<T>& v) { U32((uint32_t)v.size()); Array(v.data(), v.size()); }
+};
+
+struct CacheReader {
+    const unsigned char* base; size_t size; size_t pos; bool ok;
+    bool Need(size_t n) { if (!ok || n > size - pos) ok = false; return ok; }
+    // Una cantidad leida del archivo: cada elemento ocupa al menos minBytes en lo que queda.
+    // Con un conteo corrupto falla aqui, antes de reservar nada.
+    bool Fits(size_t count, size_t minBytes) { if (!ok || pos > size || count > (size - pos) / minBytes) ok = false; return ok; }
+    void Raw(void* dst, size_t n) { if (Need(n)) { std::memcpy(dst, base + pos, n); pos += n; } }
+    uint32_t U32() { uint32_t v = 0; Raw(&v, 4); return v; }
+    std::string Str() { uint32_t n = U32(); if (!Need(n)) return {}; std::string s((const char*)base + pos, n); pos += n; return s; }
+    void Align() { pos = (pos + 15) & ~size_t(15); if (pos > size) ok = false; }
+    template <class T> const T* Array(size_t n) {
+        Align();
+        if (!Fits(n, sizeof(T)) || !Need(n * sizeof(T))) return nullptr;
+        const T* p = reinterpret_cast<const T*>(base + pos); pos += n * sizeof(T); return p;
+    }
+    template <class T> void Vec(std::vector<T>& v) { uint32_t n = U32(); const T* p = Array<T>(n); if (p) v.assign(p, p + n); }
+};
+
+struct MeshCacheStats {
+    int hits = 0, misses = 0;
+    double loadMs = 0.0;    // trabajo acumulado (CPU + GL) de todos los modelos
+    double wallMs = 0.0;    // tiempo real de pared de la carga
+};
+
+class MeshCache {
+public:
+    static MeshCacheStats& Stats() { static MeshCacheStats s; return s; }
+
+    static std::string CachePath(const std::string& source) { return source + ".meshcache"; }
+
+    // Hash del contenido del modelo fuente (0 si no se puede leer)
+    static uint64_t HashSource(const std::string& source) {
+        MappedFile f;
+        if (!f.Open(source)) return 0;
+        return HashBytes(f.Data(), f.Size());
+    }
+
+    // Abre la cache y llena `out.views` apuntando dentro de `file`. Falla si la version,
+    // el hash del fuente o los flags de importacion no coinciden.
+    static bool Load(const std::string& source, uint64_t sourceHash, unsigned flags, MappedFile& file, ModelData& out) {
+        if (!sourceHash || !file.Open(CachePath(source))) return false;
+        Reader r{ file.Data(), file.Size(), 0, true };
+
+        Header h{};
+        r.Raw(&h, sizeof(h));
+        if (!r.ok || std::memcmp(h.magic, "PFMESH\0", 8) != 0 || h.version != MESH_CACHE_VERSION ||
+            h.importFlags != flags || h.sourceHash != sourceHash) {
+            file.Close(); return false;
+        }
+        std::memcpy(&out.globalInverse, h.globalInverse, sizeof(h.globalInverse));
+        auto fail = [&]() { out = ModelData{}; file.Close(); return false; };
+
+        if (!r.Fits(h.numMeshes, 4 * sizeof(uint32_t) + sizeof(MeshBounds))) return fail();
+        out.views.resize(h.numMeshes);
+        for (auto& v : out.views) {
+            uint32_t nv = r.U32(), ni = r.U32(), nb = r.U32(), nt = r.U32();
+            r.Raw(&v.bounds, sizeof(MeshBounds));
+            if (!r.Fits(nt, 3 * sizeof(uint32_t))) return fail();
+            for (uint32_t t = 0; t < nt && r.ok; t++) {
+                TextureRef ref; ref.type = r.Str(); ref.path = r.Str(); ref.embedded = (int)r.U32();
+                v.textures.push_back(ref);
+            }
+            v.vertices = r.Array<Vertex>(nv); v.numVertices = nv;
+            v.indices = r.Array<GLuint>(ni);  v.numIndices = ni;
+            v.bones = r.Array<VertexBoneData>(nb); v.numBones = nb;
+        }
+
+        if (!r.Fits(h.numEmbedded, 3 * sizeof(uint32_t))) return fail();
+        out.embedded.resize(h.numEmbedded);
+        for (auto& e : out.embedded) {
+            e.width = r.U32(); e.height = r.U32();
+            uint32_t n = r.U32();
+            const unsigned char* p = r.Array<unsigned char>(n);
+            if (p) e.bytes.assign(p, p + n);
+        }
+
+        if (!r.Fits(h.numBones, sizeof(uint32_t) + sizeof(glm::mat4))) return fail();
+        out.boneNames.resize(h.numBones); out.boneOffsets.resize(h.numBones);
+        for (uint32_t i = 0; i < h.numBones; i++) { out.boneNames[i] = r.Str(); r.Raw(&out.boneOffsets[i], sizeof(glm::mat4)); }
+
+        if (!r.Fits(h.numNodes, 4 * sizeof(uint32_t) + sizeof(glm::mat4))) return fail();
+        out.nodes.resize(h.numNodes);
+        for (auto& n : out.nodes) {
+            n.name = r.Str(); r.Raw(&n.transform, sizeof(glm::mat4));
+            n.parent = (int)r.U32(); n.channel = (int)r.U32(); n.bone = (int)r.U32();
+        }
+
+        if (!r.Fits(h.numAnimations, 2 * sizeof(double) + sizeof(uint32_t))) return fail();
+        out.animations.resize(h.numAnimations);
+        for (auto& a : out.animations) {
+            r.Raw(&a.duration, sizeof(double)); r.Raw(&a.ticksPerSecond, sizeof(double));
+            uint32_t channels = r.U32();
+            if (!r.Fits(channels, 3 * sizeof(uint32_t))) return fail();
+            a.channels.resize(channels);
+            for (auto& c : a.channels) {
+                r.Vec(c.positions); r.Vec(c.rotations); r.Vec(c.scales);
+            }
+        }
+
+        if (!r.ok) return fail();
+        return true;
+    }
+
+    // Escribe la cache a partir de los datos recien importados (a un .tmp y luego rename)
+    static bool Store(const std::string& source, uint64_t sourceHash, unsigned flags, const ModelData& data) {
+        if (!sourceHash) return false;
+        Writer w;
+        Header h{};
+        std::memcpy(h.magic, "PFMESH\0", 8);
+        h.version = MESH_CACHE_VERSION; h.importFlags = flags; h.sourceHash = sourceHash;
+        h.numMeshes = (uint32_t)data.meshes.size(); h.numEmbedded = (uint32_t)data.embedded.size();
+        h.numBones = (uint32_t)data.boneNames.size(); h.numNodes = (uint32_t)data.nodes.size();
+        h.numAnimations = (uint32_t)data.animations.size();
+        std::memcpy(h.globalInverse, &data.globalInverse, sizeof(h.globalInverse));
+        w.Raw(&h, sizeof(h));
+
+        for (auto& m : data.meshes) {
+            w.U32((uint32_t)m.vertices.size()); w.U32((uint32_t)m.indices.size());
+            w.U32((uint32_t)m.bones.size()); w.U32((uint32_t)m.textures.size());
+            w.Raw(&m.bounds, sizeof(MeshBounds));
+            for (auto& t : m.textures) { w.Str(t.type); w.Str(t.path); w.U32((uint32_t)t.embedded); }
+            w.Array(m.vertices.data(), m.vertices.size());
+            w.Array(m.indices.data(), m.indices.size());
+            w.Array(m.bones.data(), m.bones.size());
+        }
+        for (auto& e : data.embedded) {
+            w.U32(e.width); w.U32(e.height); w.U32((uint32_t)e.bytes.size());
+            w.Array(e.bytes.data(), e.bytes.size());
+        }
+        for (size_t i = 0; i < data.boneNames.size(); i++) { w.Str(data.boneNames[i]); w.Raw(&data.boneOffsets[i], sizeof(glm::mat4)); }
+        for (auto& n : data.nodes) {
+            w.Str(n.name); w.Raw(&n.transform, sizeof(glm::mat4));
+            w.U32((uint32_t)n.parent); w.U32((uint32_t)n.channel); w.U32((uint32_t)n.bone);
+        }
+        for (auto& a : data.animations) {
+            w.Raw(&a.duration, sizeof(double)); w.Raw(&a.ticksPerSecond, sizeof(double));
+            w.U32((uint32_t)a.channels.size());
+            for (auto& c : a.channels) { w.Vec(c.positions); w.Vec(c.rotations); w.Vec(c.scales); }
+        }
+
+        // .tmp unico por hilo: varios hilos pueden estar importando el mismo archivo
+        std::string dst = CachePath(source);
+        std::string tmp = dst + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        FILE* f = nullptr;
+#ifdef _WIN32
+        fopen_s(&f, tmp.c_str(), "wb");
+#else
+        f = fopen(tmp.c_str(), "wb");
+#endif
+        if (!f) return false;
+        bool ok = fwrite(w.buf.data(), 1, w.buf.size(), f) == w.buf.size();
+        fclose(f);
+        if (!ok) { std::remove(tmp.c_str()); return false; }
+        std::remove(dst.c_str());
+        return std::rename(tmp.c_str(), dst.c_str()) == 0;
+    }
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version, importFlags;
+        uint64_t sourceHash;
+        uint32_t numMeshes, numEmbedded, numBones, numNodes, numAnimations, reserved;
+        float globalInverse[16];
+    };
+
+    using Writer = CacheWriter;
+    using Reader = CacheReader;
+};
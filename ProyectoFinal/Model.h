@@ -4,6 +4,10 @@
 #include <unordered_map>
 #include <iostream>
 #include <cstdlib>         // atoi
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -15,6 +19,9 @@
 #include <assimp/config.h>
 
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
 #include "Shader.h"
 
 // ---- Compatibilidad con versiones antiguas de Assimp ----
@@ -24,12 +31,12 @@
 #define HAS_BASE_COLOR 1
 #endif
 
-static inline const aiTexture* GetEmbeddedTextureCompat(const aiScene* sc, const aiString& str) {
+static inline int GetEmbeddedTextureCompat(const aiScene* sc, const aiString& str) {
     if (str.length > 0 && str.C_Str()[0] == '*') {
         int idx = std::atoi(str.C_Str() + 1);
-        if (idx >= 0 && idx < (int)sc->mNumTextures) return sc->mTextures[idx];
+        if (idx >= 0 && idx < (int)sc->mNumTextures) return idx;
     }
-    return nullptr;
+    return -1;
 }
 
 static inline glm::mat4 AiToGlm(const aiMatrix4x4& m) {
@@ -39,100 +46,386 @@ static inline glm::mat4 AiToGlm(const aiMatrix4x4& m) {
         m.a4, m.b4, m.c4, m.d4);
 }
 
-struct BoneInfo { glm::mat4 offset{ 1.0f }; glm::mat4 finalTransform{ 1.0f }; };
-
-GLint TextureFromFile(const char* path, std::string directory) {
-    std::string filename = std::string(path);
-    filename = directory + '/' + filename;
-    GLuint id; glGenTextures(1, &id);
-    int w, h, ch;
-    unsigned char* img = SOIL_load_image(filename.c_str(), &w, &h, &ch, SOIL_LOAD_AUTO);
-    if (!img) { std::cout << "SOIL fail: " << filename << "\n"; return 0; }
-    GLenum fmt = (ch == 4) ? GL_RGBA : GL_RGB;
-    glBindTexture(GL_TEXTURE_2D, id);
-    glTexImage2D(GL_TEXTURE_2D, 0, fmt, w, h, 0, fmt, GL_UNSIGNED_BYTE, img);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SOIL_free_image_data(img);
-    return id;
-}
+// Resultado de la etapa CPU de un modelo (importacion o cache + imagenes identificadas).
+// No toca GL, asi que se puede construir en un hilo de trabajo.
+struct PreparedModel {
+    std::string path, directory;
+    uint64_t hash = 0;
+    bool ok = false, cached = false;
+    bool shared = false;    // mismo contenido que otro modelo: no se importo, se reutiliza su asset
+    MappedFile cacheFile;
+    ModelData data;
+    std::unordered_map<std::string, std::shared_ptr<const ImageSource>> images;   // llave: TextureRef::path
+    double cpuMs = 0.0;
+    bool keepCpuData = false;   // alguna instancia pidio retener vertices/indices en CPU
+};
 
-// Textura embebida en memoria (*0,*1…) o BGRA crudo
-static GLuint TextureFromEmbedded(const aiTexture* tex) {
-    if (!tex) return 0;
-    int w = 0, h = 0, ch = 0;
-    if (tex->mHeight == 0) {
-        const unsigned char* data = reinterpret_cast<const unsigned char*>(tex->pcData);
-        int len = tex->mWidth;
-        unsigned char* img = SOIL_load_image_from_memory(data, len, &w, &h, &ch, SOIL_LOAD_AUTO);
-        if (!img) return 0;
-        GLuint id; glGenTextures(1, &id);
-        GLenum fmt = (ch == 4) ? GL_RGBA : GL_RGB;
-        glBindTexture(GL_TEXTURE_2D, id);
-        glTexImage2D(GL_TEXTURE_2D, 0, fmt, w, h, 0, fmt, GL_UNSIGNED_BYTE, img);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        SOIL_free_image_data(img);
-        return id;
-    }
-    else {
-        w = tex->mWidth; h = tex->mHeight;
-        const unsigned char* data = reinterpret_cast<const unsigned char*>(tex->pcData);
-        GLuint id; glGenTextures(1, &id);
-        glBindTexture(GL_TEXTURE_2D, id);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_BGRA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        return id;
+// Memoria de un modelo: lo que queda en RAM, buffers de vertices/indices en GPU y texturas
+struct ModelMemoryStats {
+    size_t cpuBytes = 0, gpuBufferBytes = 0, textureBytes = 0;
+    ModelMemoryStats& operator+=(const ModelMemoryStats& o) {
+        cpuBytes += o.cpuBytes; gpuBufferBytes += o.gpuBufferBytes; textureBytes += o.textureBytes;
+        return *this;
+    }
+};
+
+// Datos inmutables de un modelo ya subido a GL. Todas las instancias con la misma ruta
+// o con el mismo contenido comparten uno solo (buffers, texturas, huesos y animaciones).
+struct ModelAsset {
+    std::string path, directory;
+    uint64_t hash = 0;
+    std::vector<Mesh> meshes;
+    std::vector<GLuint> textureRefs;    // referencias tomadas de TextureCache
+    std::vector<glm::mat4> boneOffsets;
+    std::vector<NodeData> nodes;
+    std::vector<AnimationData> animations;
+    glm::mat4 globalInverse{ 1.0f };
+    MeshMemory memory;                  // suma de los buffers de sus mallas
+    // Copia en CPU de las mallas: solo si alguna instancia la pidio (picking, colisiones)
+    // o si no esta activo Mesh::LeanResidency()
+    std::vector<MeshData> cpuMeshes;
+    bool cpuRetained = false;
+    bool geometryReleased = false;      // sus mallas no estan en la arena (Model::ReleaseGeometry)
+
+    ModelAsset() = default;
+    ModelAsset(const ModelAsset&) = delete;
+    ModelAsset& operator=(const ModelAsset&) = delete;
+    ~ModelAsset() { for (GLuint id : textureRefs) TextureCache::Instance().Release(id); }
+
+    size_t CpuBytes() const {
+        size_t n = sizeof(ModelAsset) + path.capacity() + directory.capacity() + meshes.capacity() * sizeof(Mesh) +
+            textureRefs.capacity() * sizeof(GLuint) + boneOffsets.capacity() * sizeof(glm::mat4) +
+            nodes.capacity() * sizeof(NodeData) + animations.capacity() * sizeof(AnimationData) +
+            cpuMeshes.capacity() * sizeof(MeshData);
+        for (auto& m : meshes) n += m.CpuBytes();
+        for (auto& nd : nodes) n += nd.name.capacity();
+        for (auto& a : animations) {
+            n += a.channels.capacity() * sizeof(NodeAnim);
+            for (auto& c : a.channels)
+                n += (c.positions.capacity() + c.scales.capacity()) * sizeof(VecKey) + c.rotations.capacity() * sizeof(QuatKey);
+        }
+        for (auto& m : cpuMeshes)
+            n += m.vertices.capacity() * sizeof(Vertex) + m.indices.capacity() * sizeof(GLuint) +
+                m.bones.capacity() * sizeof(VertexBoneData) + m.textures.capacity() * sizeof(TextureRef);
+        return n;
+    }
+
+    // Texturas distintas que usa (varias mallas pueden compartir la misma id)
+    void CollectTextures(std::unordered_set<GLuint>& out) const { out.insert(textureRefs.begin(), textureRefs.end()); }
+
+    ModelMemoryStats Memory() const {
+        ModelMemoryStats s;
+        s.cpuBytes = CpuBytes();
+        s.gpuBufferBytes = memory.Bytes();
+        std::unordered_set<GLuint> tex;
+        CollectTextures(tex);
+        for (GLuint id : tex) s.textureBytes += TextureCache::Instance().Bytes(id);
+        return s;
+    }
+};
+
+struct ModelRegistryStats {
+    int instances = 0, assets = 0;
+    int byPath = 0, byContent = 0;      // instancias que reutilizaron un asset en vez de importarlo
+};
+
+// Registro global de assets por ruta normalizada y por hash del archivo fuente.
+// Guarda weak_ptr: el asset vive mientras alguna instancia lo use.
+class ModelRegistry {
+public:
+    static ModelRegistry& Instance() { static ModelRegistry r; return r; }
+    static ModelRegistryStats& Stats() { static ModelRegistryStats s; return s; }
+
+    std::shared_ptr<ModelAsset> FindPath(const std::string& path) {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = byPath.find(TextureCache::NormalizePath(path));
+        return it != byPath.end() ? it->second.lock() : nullptr;
+    }
+
+    std::shared_ptr<ModelAsset> FindContent(uint64_t hash) {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = byHash.find(hash);
+        return it != byHash.end() ? it->second.lock() : nullptr;
+    }
+
+    // Etapa CPU: true si quien llama debe importar este contenido. False si ya esta
+    // cargado o si otro hilo lo esta importando; se resuelve despues con FindContent.
+    bool Claim(uint64_t hash) {
+        if (!hash) return true;
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = byHash.find(hash);
+        if (it != byHash.end() && !it->second.expired()) return false;
+        return pending.insert(hash).second;
+    }
+
+    void Unclaim(uint64_t hash) {
+        std::lock_guard<std::mutex> lk(mtx);
+        pending.erase(hash);
+    }
+
+    // Etapa GL: registra un asset recien subido bajo su ruta y su contenido
+    void Add(const std::shared_ptr<ModelAsset>& asset) {
+        std::lock_guard<std::mutex> lk(mtx);
+        pending.erase(asset->hash);
+        byPath[TextureCache::NormalizePath(asset->path)] = asset;
+        if (asset->hash) byHash[asset->hash] = asset;
+        Stats().assets++;
+    }
+
+    // Otra ruta con los mismos bytes apunta al mismo asset
+    void Alias(const std::string& path, const std::shared_ptr<ModelAsset>& asset) {
+        std::lock_guard<std::mutex> lk(mtx);
+        byPath[TextureCache::NormalizePath(path)] = asset;
     }
-}
 
+    // Resumen de todos los assets vivos; las texturas compartidas entre modelos cuentan una vez
+    void PrintMemory() {
+        std::unordered_set<const ModelAsset*> seen;
+        std::vector<std::shared_ptr<ModelAsset>> live;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            for (auto& kv : byPath) {
+                auto a = kv.second.lock();
+                if (a && seen.insert(a.get()).second) live.push_back(a);
+            }
+        }
+        ModelMemoryStats total;
+        std::unordered_set<GLuint> tex;
+        int retained = 0;
+        for (auto& a : live) {
+            total.cpuBytes += a->CpuBytes();
+            total.gpuBufferBytes += a->memory.Bytes();
+            a->CollectTextures(tex);
+            if (a->cpuRetained) retained++;
+        }
+        for (GLuint id : tex) total.textureBytes += TextureCache::Instance().Bytes(id);
+        const double MB = 1024.0 * 1024.0;
+        std::cout << "Memoria de " << live.size() << " modelos: CPU " << total.cpuBytes / MB << " MB, buffers GPU "
+            << total.gpuBufferBytes / MB << " MB, texturas " << total.textureBytes / MB << " MB ("
+            << retained << " con copia en CPU)\n";
+    }
+
+private:
+    std::mutex mtx;
+    std::unordered_map<std::string, std::weak_ptr<ModelAsset>> byPath;
+    std::unordered_map<uint64_t, std::weak_ptr<ModelAsset>> byHash;
+    std::unordered_set<uint64_t> pending;
+};
+
+class ModelLoader;
+
+// Instancia ligera: apunta a un ModelAsset compartido y solo guarda su propia pose
 class Model {
 public:
-    Model(const char* path) { loadModel(path); }
-    void Draw(Shader& shader) { for (auto& m : meshes) m.Draw(shader); }
+    // keepCpuData: conservar vertices/indices en CPU aunque este activo Mesh::LeanResidency()
+    Model(const char* path, bool keepCpuData = false) { loadModel(path, keepCpuData); }
+    // Carga diferida: la etapa CPU corre en el pool del loader y la GL en ModelLoader::Finish
+    Model(ModelLoader& loader, const char* path, bool keepCpuData = false);
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    void Draw(Shader& shader) { if (asset) for (auto& m : asset->meshes) m.Draw(shader); }
+
+    void Attach(const std::shared_ptr<ModelAsset>& a) {
+        asset = a;
+        m_BoneTransforms.assign(a ? a->boneOffsets.size() : 0, glm::mat4(1.0f));
+        nodeGlobals.clear();
+        if (a) ModelRegistry::Stats().instances++;
+    }
+    const ModelAsset* Asset() const { return asset.get(); }
+    // Instancias que comparten el asset, esta incluida
+    long AssetUsers() const { return asset.use_count(); }
+
+    // Saca de la GPU los vertices e indices del asset, compartido con las demas instancias (p. ej.
+    // cuando todas ya estan horneadas en lotes estaticos). RestoreGeometry los vuelve a subir
+    // desde la cache de mallas; mientras tanto el modelo no dibuja nada.
+    void ReleaseGeometry() {
+        if (!asset || asset->geometryReleased) return;
+        for (auto& m : asset->meshes) m.ReleaseGeometry();
+        asset->memory = MeshMemory();
+        asset->geometryReleased = true;
+    }
+
+    bool RestoreGeometry() {
+        if (!asset || !asset->geometryReleased) return true;
+        MappedFile f;
+        ModelData d;
+        if (!ReadCpuData(*asset, f, d) || d.views.size() != asset->meshes.size()) {
+            std::cout << "No se pudieron volver a subir las mallas de " << asset->path << "\n";
+            return false;
+        }
+        for (size_t i = 0; i < d.views.size(); i++) {
+            const MeshView& v = d.views[i];
+            asset->meshes[i].Upload(v.vertices, v.numVertices, v.indices, v.numIndices, v.bones, v.numBones);
+            asset->memory += asset->meshes[i].Memory();
+        }
+        asset->geometryReleased = false;
+        return true;
+    }
+    // Mallas en CPU para picking o colisiones; nullptr si el modelo no las retuvo
+    const std::vector<MeshData>* CpuMeshes() const { return asset && asset->cpuRetained ? &asset->cpuMeshes : nullptr; }
+
+    // Memoria del asset (compartida con otras instancias) mas la pose propia de esta instancia
+    ModelMemoryStats MemoryStats() const {
+        ModelMemoryStats s;
+        if (asset) s = asset->Memory();
+        s.cpuBytes += sizeof(Model) + (m_BoneTransforms.capacity() + nodeGlobals.capacity()) * sizeof(glm::mat4);
+        return s;
+    }
 
     void UpdateAnimation(double t) {
-        if (!scene || scene->mNumAnimations == 0) return;
-        const aiAnimation* a = scene->mAnimations[0];
-        double tps = (a->mTicksPerSecond != 0.0) ? a->mTicksPerSecond : 25.0;
-        double ticks = fmod(t * tps, a->mDuration);
-        ReadNodeHierarchy(ticks, scene->mRootNode, glm::mat4(1.0f), a);
+        if (!asset || asset->animations.empty()) return;
+        const AnimationData& a = asset->animations[0];
+        double tps = (a.ticksPerSecond != 0.0) ? a.ticksPerSecond : 25.0;
+        double ticks = fmod(t * tps, a.duration);
+        ReadNodeHierarchy(ticks, a);
     }
     void GetBoneMatrices(std::vector<glm::mat4>& out, size_t maxBones = 100) const {
         out.assign(maxBones, glm::mat4(1.0f));
-        for (size_t i = 0; i < m_BoneInfo.size() && i < maxBones; i++) out[i] = m_BoneInfo[i].finalTransform;
+        for (size_t i = 0; i < m_BoneTransforms.size() && i < maxBones; i++) out[i] = m_BoneTransforms[i];
     }
 
-private:
-    std::vector<Mesh> meshes;
-    std::vector<Texture> textures_loaded;
-    std::string directory;
-
-    Assimp::Importer importer;
-    const aiScene* scene = nullptr;
-    std::unordered_map<std::string, int> m_BoneMapping;
-    std::vector<BoneInfo> m_BoneInfo;
-    glm::mat4 m_GlobalInverseTransform{ 1.0f };
-
-    void loadModel(const std::string& path) {
-        unsigned flags =
-            aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_LimitBoneWeights |
+    // AABB de la pose actual en espacio del modelo: articulaciones (huesos y sus hijos directos,
+    // que suelen ser las puntas) mas un margen relativo para la piel. false si aun no hay pose.
+    bool PoseBounds(glm::vec3& lo, glm::vec3& hi, float margin = 0.25f) const {
+        if (!asset || nodeGlobals.size() != asset->nodes.size()) return false;
+        const std::vector<NodeData>& nodes = asset->nodes;
+        bool any = false;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            bool joint = nodes[i].bone >= 0 || (nodes[i].parent >= 0 && nodes[nodes[i].parent].bone >= 0);
+            if (!joint) continue;
+            glm::vec3 p = glm::vec3(asset->globalInverse * nodeGlobals[i][3]);
+            if (!any) { lo = hi = p; any = true; }
+            else { lo = glm::min(lo, p); hi = glm::max(hi, p); }
+        }
+        if (!any) return false;
+        glm::vec3 e = hi - lo;
+        float pad = margin * std::max(e.x, std::max(e.y, e.z));
+        lo -= glm::vec3(pad); hi += glm::vec3(pad);
+        return true;
+    }
+
+    // Flags de post-proceso; forman parte de la llave de la cache de mallas
+    static unsigned ImportFlags() {
+        return aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_LimitBoneWeights |
             aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality | aiProcess_SortByPType |
             aiProcess_CalcTangentSpace | aiProcess_GenUVCoords | aiProcess_ValidateDataStructure | aiProcess_FlipUVs;
+    }
 
+private:
+    std::shared_ptr<ModelAsset> asset;
+    std::vector<glm::mat4> m_BoneTransforms;
+    std::vector<glm::mat4> nodeGlobals;
+
+    void loadModel(const std::string& path, bool keepCpuData) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::shared_ptr<ModelAsset> a = ModelRegistry::Instance().FindPath(path);
+        if (a) ModelRegistry::Stats().byPath++;
+        else {
+            auto prepared = Prepare(path);
+            if (prepared->shared && (a = ModelRegistry::Instance().FindContent(prepared->hash))) {
+                ModelRegistry::Instance().Alias(path, a);
+                ModelRegistry::Stats().byContent++;
+            }
+            else {
+                prepared->keepCpuData = keepCpuData;
+                a = Upload(*prepared);
+            }
+        }
+        if (a && keepCpuData) RetainCpuData(*a);
+        Attach(a);
+        MeshCache::Stats().wallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+public:
+    // Etapa CPU: cache o Assimp, processMesh y hash de las imagenes. Segura para hilos.
+    static std::unique_ptr<PreparedModel> Prepare(const std::string& path) {
+        auto t0 = std::chrono::steady_clock::now();
+        auto p = std::make_unique<PreparedModel>();
+        p->path = path;
+        p->directory = path.substr(0, path.find_last_of('/'));
+        unsigned flags = ImportFlags();
+
+        uint64_t hash = MeshCache::HashSource(path);
+        p->hash = hash;
+        // Los mismos bytes ya estan cargados (o en camino) desde otra ruta: no se importa de nuevo
+        if (!ModelRegistry::Instance().Claim(hash)) {
+            p->shared = p->ok = true;
+            return p;
+        }
+
+        // En caliente: la cache mapeada trae los arreglos finales y no se toca Assimp
+        p->cached = MeshCache::Load(path, hash, flags, p->cacheFile, p->data);
+        if (!p->cached) {
+            if (!importModel(path, flags, p->data)) { ModelRegistry::Instance().Unclaim(hash); return p; }
+            MeshCache::Store(path, hash, flags, p->data);
+        }
+
+        for (auto& v : p->data.views) {
+            for (auto& ref : v.textures) {
+                if (p->images.count(ref.path)) continue;
+                std::shared_ptr<const ImageSource> img;
+                if (ref.embedded >= 0 && ref.embedded < (int)p->data.embedded.size()) {
+                    const EmbeddedTexture& e = p->data.embedded[ref.embedded];
+                    img = TextureCache::Instance().LocateEmbedded(e.bytes.data(), e.bytes.size(), e.width, e.height);
+                }
+                else img = TextureCache::Instance().LocateFile(p->directory + '/' + ref.path);
+                if (img) p->images.emplace(ref.path, img);
+            }
+        }
+        p->ok = true;
+        p->cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        return p;
+    }
+
+    // Etapa GL: solo sube buffers e imagenes ya preparados y registra el asset.
+    // Debe correr en el hilo del contexto.
+    static std::shared_ptr<ModelAsset> Upload(PreparedModel& p) {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!p.ok || p.shared) return nullptr;
+        auto a = std::make_shared<ModelAsset>();
+        a->path = p.path; a->directory = p.directory; a->hash = p.hash;
+        setupAsset(*a, p.data, p.images);
+        if (p.keepCpuData || !Mesh::LeanResidency()) copyCpuData(*a, p.data);
+        ModelRegistry::Instance().Add(a);
+        if (Mesh::Format().packed) PrintMemory(a->path, a->memory);
+
+        MeshCacheStats& st = MeshCache::Stats();
+        (p.cached ? st.hits : st.misses)++;
+        st.loadMs += p.cpuMs + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        return a;
+    }
+
+    // Un asset ya subido sin copia en CPU: se vuelve a leer de la cache (o de Assimp)
+    static void RetainCpuData(ModelAsset& a) {
+        if (a.cpuRetained) return;
+        MappedFile f;
+        ModelData d;
+        if (!ReadCpuData(a, f, d)) {
+            std::cout << "No se pudieron retener en CPU las mallas de " << a.path << "\n";
+            return;
+        }
+        copyCpuData(a, d);
+    }
+
+    // Mallas de un asset ya subido en d.views, sin retenerlas: apuntan a file (cache) o a d.meshes
+    static bool ReadCpuData(const ModelAsset& a, MappedFile& file, ModelData& d) {
+        unsigned flags = ImportFlags();
+        return MeshCache::Load(a.path, a.hash, flags, file, d) || importModel(a.path, flags, d);
+    }
+
+    // VRAM de vertices+indices y bytes leidos por vertice, empaquetado contra el formato completo
+    static void PrintMemory(const std::string& name, const MeshMemory& m) {
+        if (!m.vertices || !m.FullBytes()) return;
+        double saved = 100.0 * (1.0 - (double)m.Bytes() / m.FullBytes());
+        std::cout << name << ": " << m.Bytes() / 1024 << " KB en GPU (completo " << m.FullBytes() / 1024
+            << " KB, -" << (int)(saved + 0.5) << "%), " << m.vertexBytes / m.vertices << " B por vertice en vez de "
+            << m.fullVertexBytes / m.vertices << "\n";
+    }
+
+private:
+    // ---- Etapa de importacion (Assimp -> ModelData) ----
+    static bool importModel(const std::string& path, unsigned flags, ModelData& out) {
+        Assimp::Importer importer;
 #ifdef AI_CONFIG_IMPORT_FBX_READ_ANIMATIONS
         importer.SetPropertyBool(AI_CONFIG_IMPORT_FBX_READ_ANIMATIONS, true);
 #endif
@@ -146,81 +439,122 @@ private:
         importer.SetPropertyBool(AI_CONFIG_IMPORT_FBX_PRESERVE_PIVOTS, false);
 #endif
 
-        scene = importer.ReadFile(path, flags);
+        const aiScene* scene = importer.ReadFile(path, flags);
         if (!scene || !scene->mRootNode) {
-            std::cout << "ASSIMP ERROR: " << importer.GetErrorString() << "\n"; return;
+            std::cout << "ASSIMP ERROR: " << importer.GetErrorString() << "\n"; return false;
+        }
+        out.globalInverse = glm::inverse(AiToGlm(scene->mRootNode->mTransformation));
+
+        std::unordered_map<std::string, int> boneMapping;
+        processNode(scene->mRootNode, scene, out, boneMapping);
+        for (auto& m : out.meshes) {
+            out.views.push_back(MeshView{ m.vertices.data(), m.vertices.size(), m.indices.data(), m.indices.size(),
+                m.bones.data(), m.bones.size(), m.textures, m.bounds });
+        }
+
+        for (unsigned i = 0; i < scene->mNumTextures; i++) {
+            const aiTexture* t = scene->mTextures[i];
+            EmbeddedTexture e; e.width = t->mWidth; e.height = t->mHeight;
+            size_t bytes = (t->mHeight == 0) ? t->mWidth : (size_t)t->mWidth * t->mHeight * 4;
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(t->pcData);
+            e.bytes.assign(p, p + bytes);
+            out.embedded.push_back(std::move(e));
+        }
+
+        // Animacion: se copia a estructuras propias para no depender del aiScene
+        for (unsigned i = 0; i < scene->mNumAnimations; i++) {
+            const aiAnimation* a = scene->mAnimations[i];
+            AnimationData ad; ad.duration = a->mDuration; ad.ticksPerSecond = a->mTicksPerSecond;
+            for (unsigned c = 0; c < a->mNumChannels; c++) {
+                const aiNodeAnim* ch = a->mChannels[c];
+                NodeAnim na;
+                for (unsigned k = 0; k < ch->mNumPositionKeys; k++) { auto& v = ch->mPositionKeys[k]; na.positions.push_back({ v.mTime, { v.mValue.x, v.mValue.y, v.mValue.z } }); }
+                for (unsigned k = 0; k < ch->mNumRotationKeys; k++) { auto& q = ch->mRotationKeys[k]; na.rotations.push_back({ q.mTime, glm::quat(q.mValue.w, q.mValue.x, q.mValue.y, q.mValue.z) }); }
+                for (unsigned k = 0; k < ch->mNumScalingKeys; k++) { auto& v = ch->mScalingKeys[k]; na.scales.push_back({ v.mTime, { v.mValue.x, v.mValue.y, v.mValue.z } }); }
+                ad.channels.push_back(std::move(na));
+            }
+            out.animations.push_back(std::move(ad));
         }
-        directory = path.substr(0, path.find_last_of('/'));
-        m_GlobalInverseTransform = glm::inverse(AiToGlm(scene->mRootNode->mTransformation));
-        processNode(scene->mRootNode, scene);
+
+        flattenNodes(scene->mRootNode, -1, out);
+        const aiAnimation* anim = scene->mNumAnimations > 0 ? scene->mAnimations[0] : nullptr;
+        for (auto& n : out.nodes) {
+            auto it = boneMapping.find(n.name);
+            if (it != boneMapping.end()) n.bone = it->second;
+            if (anim) n.channel = FindNodeAnim(anim, n.name);
+        }
+        return true;
     }
 
-    void processNode(aiNode* node, const aiScene* sc) {
+    static void processNode(aiNode* node, const aiScene* sc, ModelData& out, std::unordered_map<std::string, int>& boneMapping) {
         for (unsigned i = 0; i < node->mNumMeshes; i++) {
             aiMesh* m = sc->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(m, sc));
+            out.meshes.push_back(processMesh(m, sc, out, boneMapping));
         }
-        for (unsigned i = 0; i < node->mNumChildren; i++) processNode(node->mChildren[i], sc);
+        for (unsigned i = 0; i < node->mNumChildren; i++) processNode(node->mChildren[i], sc, out, boneMapping);
+    }
+
+    static void flattenNodes(const aiNode* node, int parent, ModelData& out) {
+        NodeData n; n.name = node->mName.C_Str(); n.transform = AiToGlm(node->mTransformation); n.parent = parent;
+        int self = (int)out.nodes.size();
+        out.nodes.push_back(n);
+        for (unsigned i = 0; i < node->mNumChildren; i++) flattenNodes(node->mChildren[i], self, out);
     }
 
-    int GetBoneIndex(const std::string& name) {
-        auto it = m_BoneMapping.find(name);
-        if (it != m_BoneMapping.end()) return it->second;
-        int idx = (int)m_BoneInfo.size();
-        m_BoneMapping[name] = idx; m_BoneInfo.push_back(BoneInfo{});
+    static int GetBoneIndex(const std::string& name, ModelData& out, std::unordered_map<std::string, int>& boneMapping) {
+        auto it = boneMapping.find(name);
+        if (it != boneMapping.end()) return it->second;
+        int idx = (int)out.boneNames.size();
+        boneMapping[name] = idx; out.boneNames.push_back(name); out.boneOffsets.push_back(glm::mat4(1.0f));
         return idx;
     }
 
-    const aiNodeAnim* FindNodeAnim(const aiAnimation* a, const std::string& node) {
+    static int FindNodeAnim(const aiAnimation* a, const std::string& node) {
         for (unsigned i = 0; i < a->mNumChannels; i++) {
             const aiNodeAnim* ch = a->mChannels[i];
-            if (node == ch->mNodeName.C_Str()) return ch;
+            if (node == ch->mNodeName.C_Str()) return (int)i;
         }
-        return nullptr;
-    }
-    static unsigned FindKey(double t, unsigned n, const aiVectorKey* k) { for (unsigned i = 0; i < n - 1; i++) if (t < k[i + 1].mTime) return i; return n - 1; }
-    static unsigned FindKey(double t, unsigned n, const aiQuatKey* k) { for (unsigned i = 0; i < n - 1; i++) if (t < k[i + 1].mTime) return i; return n - 1; }
-
-    glm::vec3 InterpPos(const aiNodeAnim* ch, double t) {
-        if (ch->mNumPositionKeys == 1) { auto& v = ch->mPositionKeys[0].mValue; return { v.x,v.y,v.z }; }
-        unsigned i = FindKey(t, ch->mNumPositionKeys, ch->mPositionKeys), j = i + 1;
-        double dt = ch->mPositionKeys[j].mTime - ch->mPositionKeys[i].mTime; float f = dt > 0 ? float((t - ch->mPositionKeys[i].mTime) / dt) : 0.f;
-        aiVector3D a = ch->mPositionKeys[i].mValue, b = ch->mPositionKeys[j].mValue; aiVector3D r = a + (b - a) * f; return { r.x,r.y,r.z };
-    }
-    glm::quat InterpRot(const aiNodeAnim* ch, double t) {
-        if (ch->mNumRotationKeys == 1) { auto q = ch->mRotationKeys[0].mValue; return { q.w,q.x,q.y,q.z }; }
-        unsigned i = FindKey(t, ch->mNumRotationKeys, ch->mRotationKeys), j = i + 1;
-        double dt = ch->mRotationKeys[j].mTime - ch->mRotationKeys[i].mTime; float f = dt > 0 ? float((t - ch->mRotationKeys[i].mTime) / dt) : 0.f;
-        aiQuaternion qa = ch->mRotationKeys[i].mValue, qb = ch->mRotationKeys[j].mValue, qr; aiQuaternion::Interpolate(qr, qa, qb, f); qr.Normalize();
-        return { qr.w,qr.x,qr.y,qr.z };
-    }
-    glm::vec3 InterpScale(const aiNodeAnim* ch, double t) {
-        if (ch->mNumScalingKeys == 1) { auto& v = ch->mScalingKeys[0].mValue; return { v.x,v.y,v.z }; }
-        unsigned i = FindKey(t, ch->mNumScalingKeys, ch->mScalingKeys), j = i + 1;
-        double dt = ch->mScalingKeys[j].mTime - ch->mScalingKeys[i].mTime; float f = dt > 0 ? float((t - ch->mScalingKeys[i].mTime) / dt) : 0.f;
-        aiVector3D a = ch->mScalingKeys[i].mValue, b = ch->mScalingKeys[j].mValue; aiVector3D r = a + (b - a) * f; return { r.x,r.y,r.z };
-    }
-
-    void ReadNodeHierarchy(double t, const aiNode* node, const glm::mat4& parent, const aiAnimation* a) {
-        std::string name(node->mName.C_Str());
-        glm::mat4 nodeT = AiToGlm(node->mTransformation);
-        if (const aiNodeAnim* ch = FindNodeAnim(a, name)) {
-            nodeT = glm::translate(glm::mat4(1), InterpPos(ch, t)) * glm::mat4_cast(InterpRot(ch, t)) * glm::scale(glm::mat4(1), InterpScale(ch, t));
-        }
-        glm::mat4 global = parent * nodeT;
-        auto it = m_BoneMapping.find(name);
-        if (it != m_BoneMapping.end()) {
-            int idx = it->second;
-            m_BoneInfo[idx].finalTransform = m_GlobalInverseTransform * global * m_BoneInfo[idx].offset;
+        return -1;
+    }
+    static unsigned FindKey(double t, const std::vector<VecKey>& k) { for (size_t i = 0; i + 1 < k.size(); i++) if (t < k[i + 1].time) return (unsigned)i; return (unsigned)k.size() - 1; }
+    static unsigned FindKey(double t, const std::vector<QuatKey>& k) { for (size_t i = 0; i + 1 < k.size(); i++) if (t < k[i + 1].time) return (unsigned)i; return (unsigned)k.size() - 1; }
+
+    static glm::vec3 InterpVec(const std::vector<VecKey>& keys, double t) {
+        if (keys.size() == 1) return keys[0].value;
+        unsigned i = FindKey(t, keys), j = i + 1;
+        double dt = keys[j].time - keys[i].time; float f = dt > 0 ? float((t - keys[i].time) / dt) : 0.f;
+        return keys[i].value + (keys[j].value - keys[i].value) * f;
+    }
+    static glm::quat InterpRot(const std::vector<QuatKey>& keys, double t) {
+        if (keys.size() == 1) return keys[0].value;
+        unsigned i = FindKey(t, keys), j = i + 1;
+        double dt = keys[j].time - keys[i].time; float f = dt > 0 ? float((t - keys[i].time) / dt) : 0.f;
+        return glm::normalize(glm::slerp(keys[i].value, keys[j].value, f));
+    }
+
+    // Los nodos estan en preorden, asi que basta un recorrido lineal
+    void ReadNodeHierarchy(double t, const AnimationData& a) {
+        const std::vector<NodeData>& nodes = asset->nodes;
+        nodeGlobals.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const NodeData& n = nodes[i];
+            glm::mat4 nodeT = n.transform;
+            if (n.channel >= 0 && n.channel < (int)a.channels.size()) {
+                const NodeAnim& ch = a.channels[n.channel];
+                nodeT = glm::translate(glm::mat4(1), InterpVec(ch.positions, t)) * glm::mat4_cast(InterpRot(ch.rotations, t)) * glm::scale(glm::mat4(1), InterpVec(ch.scales, t));
+            }
+            glm::mat4 global = (n.parent >= 0 ? nodeGlobals[n.parent] : glm::mat4(1.0f)) * nodeT;
+            nodeGlobals[i] = global;
+            if (n.bone >= 0 && n.bone < (int)m_BoneTransforms.size())
+                m_BoneTransforms[n.bone] = asset->globalInverse * global * asset->boneOffsets[n.bone];
         }
-        for (unsigned i = 0; i < node->mNumChildren; i++) ReadNodeHierarchy(t, node->mChildren[i], global, a);
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* sc) {
-        std::vector<Vertex> verts; verts.reserve(mesh->mNumVertices);
-        std::vector<GLuint> idx;
-        std::vector<Texture> tex;
-        std::vector<VertexBoneData> bonesData; bonesData.resize(mesh->mNumVertices);
+    static MeshData processMesh(aiMesh* mesh, const aiScene* sc, ModelData& out, std::unordered_map<std::string, int>& boneMapping) {
+        MeshData md;
+        std::vector<Vertex>& verts = md.vertices; verts.reserve(mesh->mNumVertices);
+        std::vector<GLuint>& idx = md.indices;
+        std::vector<VertexBoneData>& bonesData = md.bones; bonesData.resize(mesh->mNumVertices);
 
         for (unsigned i = 0; i < mesh->mNumVertices; i++) {
             Vertex v{};
@@ -230,6 +564,7 @@ private:
             else                         v.TexCoords = { 0.f,0.f };
             verts.push_back(v);
         }
+        md.bounds = MeshBounds::FromVertices(verts.data(), verts.size());
         for (unsigned i = 0; i < mesh->mNumFaces; i++) {
             const aiFace& f = mesh->mFaces[i];
             for (unsigned j = 0; j < f.mNumIndices; j++) idx.push_back(f.mIndices[j]);
@@ -238,8 +573,8 @@ private:
         if (mesh->mMaterialIndex >= 0) {
             aiMaterial* material = sc->mMaterials[mesh->mMaterialIndex];
             auto addTex = [&](aiTextureType t, const char* name) {
-                auto list = loadMaterialTextures(material, t, name);
-                tex.insert(tex.end(), list.begin(), list.end());
+                auto list = materialTextureRefs(material, sc, t, name);
+                md.textures.insert(md.textures.end(), list.begin(), list.end());
                 };
             // Diffuse clásico
             addTex(aiTextureType_DIFFUSE, "texture_diffuse");
@@ -254,8 +589,8 @@ private:
         if (mesh->mNumBones > 0) {
             for (unsigned b = 0; b < mesh->mNumBones; b++) {
                 aiBone* ab = mesh->mBones[b];
-                int boneIndex = GetBoneIndex(ab->mName.C_Str());
-                m_BoneInfo[boneIndex].offset = AiToGlm(ab->mOffsetMatrix);
+                int boneIndex = GetBoneIndex(ab->mName.C_Str(), out, boneMapping);
+                out.boneOffsets[boneIndex] = AiToGlm(ab->mOffsetMatrix);
                 for (unsigned w = 0; w < ab->mNumWeights; w++) {
                     unsigned vId = ab->mWeights[w].mVertexId;
                     float weight = ab->mWeights[w].mWeight;
@@ -263,30 +598,62 @@ private:
                 }
             }
         }
-        return Mesh(verts, idx, tex, bonesData);
+        return md;
     }
 
-    std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
-        std::vector<Texture> textures;
+    static std::vector<TextureRef> materialTextureRefs(aiMaterial* mat, const aiScene* sc, aiTextureType type, const char* typeName) {
+        std::vector<TextureRef> refs;
         unsigned count = mat->GetTextureCount(type);
         for (unsigned i = 0; i < count; i++) {
             aiString str; mat->GetTexture(type, i, &str);
-            bool skip = false;
-            for (auto& t : textures_loaded) { if (t.path == str) { textures.push_back(t); skip = true; break; } }
-            if (skip) continue;
+            TextureRef ref; ref.type = typeName; ref.path = str.C_Str();
+            // Detectar embebidas en versiones antiguas (*0,*1...)
+            ref.embedded = GetEmbeddedTextureCompat(sc, str);
+            refs.push_back(ref);
+        }
+        return refs;
+    }
 
-            Texture texture{}; texture.type = typeName; texture.path = str;
+    // ---- Etapa GL: texturas, buffers y huesos ----
+    static void setupAsset(ModelAsset& a, const ModelData& data, const std::unordered_map<std::string, std::shared_ptr<const ImageSource>>& images) {
+        a.meshes.reserve(data.views.size());
+        for (auto& v : data.views) {
+            std::vector<Texture> tex = loadMaterialTextures(a, v.textures, images);
+            a.meshes.emplace_back(v.vertices, v.numVertices, v.indices, v.numIndices, v.bones, v.numBones, tex, v.bounds);
+            a.memory += a.meshes.back().Memory();
+        }
+        a.boneOffsets = data.boneOffsets;
+        a.nodes = data.nodes;
+        a.animations = data.animations;
+        a.globalInverse = data.globalInverse;
+    }
 
-            // Detectar embebidas en versiones antiguas (*0,*1...)
-            if (const aiTexture* emb = GetEmbeddedTextureCompat(scene, str)) {
-                texture.id = TextureFromEmbedded(emb);
-            }
-            else {
-                texture.id = TextureFromFile(str.C_Str(), directory);
-            }
+    // Las vistas pueden apuntar al archivo mapeado, que se cierra al terminar la carga
+    static void copyCpuData(ModelAsset& a, const ModelData& data) {
+        a.cpuMeshes.clear();
+        a.cpuMeshes.reserve(data.views.size());
+        for (auto& v : data.views) {
+            MeshData m;
+            m.vertices.assign(v.vertices, v.vertices + v.numVertices);
+            m.indices.assign(v.indices, v.indices + v.numIndices);
+            m.bones.assign(v.bones, v.bones + v.numBones);
+            m.textures = v.textures;
+            m.bounds = v.bounds;
+            a.cpuMeshes.push_back(std::move(m));
+        }
+        a.cpuRetained = true;
+    }
 
-            if (texture.id) { textures.push_back(texture); textures_loaded.push_back(texture); }
+    static std::vector<Texture> loadMaterialTextures(ModelAsset& a, const std::vector<TextureRef>& refs, const std::unordered_map<std::string, std::shared_ptr<const ImageSource>>& images) {
+        std::vector<Texture> textures;
+        for (auto& ref : refs) {
+            auto it = images.find(ref.path);
+            if (it == images.end()) continue;
+            Texture texture{}; texture.type = ref.type; texture.path = aiString(ref.path);
+            // Las difusas piden capa en un arreglo de su tamano; los shaders no leen la specular
+            texture.id = TextureStreamer::Instance().Acquire(it->second, ref.type == "texture_diffuse");
+            if (texture.id) { textures.push_back(texture); a.textureRefs.push_back(texture.id); }
         }
         return textures;
     }
-};
+};
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+// Carga de modelos en paralelo: la etapa CPU (cache/Assimp, processMesh, hash de las
+// imagenes) corre en un pool de hilos y la etapa GL (subir buffers) se hace en el hilo del
+// contexto conforme cada modelo va quedando listo. Las texturas llegan despues por TextureStreamer,
+// las difusas agrupadas en los arreglos que Finish crea al terminar (TextureArrays).
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Model.h"
+
+class ModelLoader {
+public:
+    explicit ModelLoader(unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+        : t0(std::chrono::steady_clock::now()), pool(threads) {}
+
+    // Lo llama Model(ModelLoader&, path); el modelo no debe moverse hasta Finish().
+    // Una ruta ya cargada o ya encolada no vuelve a importarse: la instancia se cuelga del mismo asset.
+    // keepCpuData en cualquiera de las instancias hace que el asset retenga sus mallas en CPU.
+    void Enqueue(Model* model, const std::string& path, bool keepCpuData = false) {
+        if (auto asset = ModelRegistry::Instance().FindPath(path)) {
+            if (keepCpuData) Model::RetainCpuData(*asset);
+            model->Attach(asset);
+            ModelRegistry::Stats().byPath++;
+            return;
+        }
+        std::string key = TextureCache::NormalizePath(path);
+        auto it = slotOf.find(key);
+        if (it != slotOf.end()) {
+            slots[it->second].models.push_back(model);
+            slots[it->second].keepCpuData |= keepCpuData;
+            ModelRegistry::Stats().byPath++;
+            return;
+        }
+        size_t slot = slots.size();
+        slotOf[key] = slot;
+        slots.push_back(Slot{ { model }, keepCpuData });
+        pool.Submit([this, slot, path] {
+            auto prepared = Model::Prepare(path);
+            { std::lock_guard<std::mutex> lk(readyMtx); ready.emplace_back(slot, std::move(prepared)); }
+            readyCv.notify_one();
+        });
+    }
+
+    // Sube a GL cada modelo en cuanto termina su etapa CPU. Llamar en el hilo del contexto.
+    void Finish() {
+        std::vector<std::pair<size_t, std::unique_ptr<PreparedModel>>> shared;
+        size_t done = 0;
+        while (done < slots.size()) {
+            std::pair<size_t, std::unique_ptr<PreparedModel>> item;
+            {
+                std::unique_lock<std::mutex> lk(readyMtx);
+                readyCv.wait(lk, [&] { return !ready.empty(); });
+                item = std::move(ready.front()); ready.pop_front();
+            }
+            if (item.second->shared) shared.push_back(std::move(item));
+            else {
+                item.second->keepCpuData = slots[item.first].keepCpuData;
+                attach(item.first, Model::Upload(*item.second));
+            }
+            done++;
+        }
+        // Archivos identicos a otro: se resuelven cuando el original ya se subio
+        for (auto& item : shared) {
+            auto asset = ModelRegistry::Instance().FindContent(item.second->hash);
+            if (asset) {
+                ModelRegistry::Instance().Alias(item.second->path, asset);
+                ModelRegistry::Stats().byContent++;
+                if (slots[item.first].keepCpuData) Model::RetainCpuData(*asset);
+            }
+            else std::cout << "No se encontro el asset compartido de " << item.second->path << "\n";
+            attach(item.first, asset);
+        }
+        slots.clear();
+        slotOf.clear();
+        // Ya se pidieron todas las texturas: se crean los arreglos antes de que empiece el streaming
+        TextureArrays::Instance().Commit();
+        MeshCache::Stats().wallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    unsigned Threads() const { return pool.Size(); }
+    ThreadPool& Pool() { return pool; }
+
+private:
+    std::chrono::steady_clock::time_point t0;
+    struct Slot {
+        std::vector<Model*> models;     // instancias que esperan esta ruta
+        bool keepCpuData = false;
+    };
+    std::vector<Slot> slots;
+    std::unordered_map<std::string, size_t> slotOf;
+    std::deque<std::pair<size_t, std::unique_ptr<PreparedModel>>> ready;
+    std::mutex readyMtx;
+    std::condition_variable readyCv;
+    ThreadPool pool;    // al final: se destruye primero y espera a los hilos
+
+    void attach(size_t slot, const std::shared_ptr<ModelAsset>& asset) {
+        for (Model* m : slots[slot].models) m->Attach(asset);
+    }
+};
+
+inline Model::Model(ModelLoader& loader, const char* path, bool keepCpuData) { loader.Enqueue(this, path, keepCpuData); }
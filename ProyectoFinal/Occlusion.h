@@ -0,0 +1,133 @@
+#pragma once
+// Culling por oclusion con consultas de hardware. Despues de dibujar los opacos se dibuja la caja
+// de cada malla candidata (sin escribir color ni profundidad) dentro de una consulta; al cuadro
+// siguiente se leen los resultados que ya esten listos, sin esperar a la GPU, y las que no
+// pasaron ni una muestra se saltan. Lo que se salta se sigue probando cada cuadro, asi que
+// reaparece con un cuadro de retraso. Usa GL_ANY_SAMPLES_PASSED (3.3) o GL_SAMPLES_PASSED.
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "GLState.h"
+#include "Shader.h"
+
+#define OCCLUSION_BOX_PAD 0.05f     // la caja se agranda para no chocar con la superficie que envuelve
+#define OCCLUSION_NEAR_PAD 0.6f     // con la camara a esta distancia de la caja no se prueba (plano cercano 0.5)
+
+struct OcclusionStats {
+    int queries = 0;        // cajas dibujadas este cuadro
+    int results = 0;        // resultados leidos este cuadro
+    int pending = 0;        // consultas que la GPU aun no termina
+};
+
+class OcclusionCuller {
+public:
+    // Una consulta por entrada; todas empiezan visibles. Las consultas se crean al primer uso y
+    // se sueltan aqui, no en un destructor: la escena vive mas que el contexto GL.
+    void Resize(size_t n) {
+        release();
+        queries.assign(n, 0);
+        pending.assign(n, 0);
+        occluded.assign(n, 0);
+    }
+
+    // Resultados que ya llegaron; los demas conservan el anterior
+    void Collect() {
+        stats = OcclusionStats();
+        for (size_t i = 0; i < queries.size(); i++) {
+            if (!pending[i]) continue;
+            GLuint ready = 0;
+            glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &ready);
+            if (!ready) { stats.pending++; continue; }
+            GLuint samples = 0;
+            glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &samples);
+            occluded[i] = samples == 0;
+            pending[i] = 0;
+            stats.results++;
+        }
+    }
+
+    bool Occluded(size_t i) const { return occluded[i] != 0; }
+    // Fuera de la camara: cuando vuelva a entrar se dibuja antes de volver a probarse
+    void Reset(size_t i) { occluded[i] = 0; }
+
+    // Deja el estado para dibujar cajas: sin color ni profundidad, con LEQUAL
+    void Begin(const Shader& boxShader, const glm::vec3& eye) {
+        this->boxShader = &boxShader;
+        this->eye = eye;
+        if (!cubeVao) createCube();
+        GLState& gl = GLState::Instance();
+        gl.UseProgram(boxShader.Program);
+        gl.BindVertexArray(cubeVao);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+    }
+
+    // Caja en mundo de la entrada i; si la camara esta encima se da por visible sin consultar
+    void Test(size_t i, const glm::vec3& lo, const glm::vec3& hi) {
+        if (pending[i]) return;
+        glm::vec3 pad = (hi - lo) * 0.02f + glm::vec3(OCCLUSION_BOX_PAD);
+        glm::vec3 a = lo - pad, b = hi + pad;
+        if (glm::all(glm::greaterThan(eye, a - OCCLUSION_NEAR_PAD)) && glm::all(glm::lessThan(eye, b + OCCLUSION_NEAR_PAD))) {
+            occluded[i] = 0;
+            return;
+        }
+        if (!queries[i]) glGenQueries(1, &queries[i]);
+        glm::mat4 m = glm::translate(glm::mat4(1.0f), (a + b) * 0.5f);
+        m = glm::scale(m, (b - a) * 0.5f);
+        boxShader->SetMat4(UNIFORM("model"), m);
+        glBeginQuery(target(), queries[i]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+        glEndQuery(target());
+        GLState::Instance().CountDraw();
+        pending[i] = 1;
+        stats.queries++;
+    }
+
+    void End() {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        GLState::Instance().BindVertexArray(0);
+    }
+
+    const OcclusionStats& Stats() const { return stats; }
+
+private:
+    std::vector<GLuint> queries;
+    std::vector<uint8_t> pending, occluded;
+    GLuint cubeVao = 0, cubeVbo = 0, cubeEbo = 0;
+    const Shader* boxShader = nullptr;
+    glm::vec3 eye{ 0.0f };
+    OcclusionStats stats;
+
+    static GLenum target() {
+        static GLenum t = (GLEW_VERSION_3_3 || GLEW_ARB_occlusion_query2) ? GL_ANY_SAMPLES_PASSED : GL_SAMPLES_PASSED;
+        return t;
+    }
+
+    // Cubo de -1 a 1 con indices de 8 bits
+    void createCube() {
+        const float v[] = { -1,-1,-1,  1,-1,-1,  1,1,-1,  -1,1,-1,  -1,-1,1,  1,-1,1,  1,1,1,  -1,1,1 };
+        const GLubyte idx[] = { 0,1,2, 2,3,0,  4,6,5, 6,4,7,  0,3,7, 7,4,0,  1,5,6, 6,2,1,  0,4,5, 5,1,0,  3,2,6, 6,7,3 };
+        glGenVertexArrays(1, &cubeVao);
+        glGenBuffers(1, &cubeVbo);
+        glGenBuffers(1, &cubeEbo);
+        glBindVertexArray(cubeVao);
+        glBindBuffer(GL_ARRAY_BUFFER, cubeVbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(v), v, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEbo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(idx), idx, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+        GLState::Instance().Invalidate();
+    }
+
+    void release() {
+        for (GLuint q : queries) if (q) glDeleteQueries(1, &q);
+        queries.clear();
+    }
+};
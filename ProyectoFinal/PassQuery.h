@@ -0,0 +1,48 @@
+#pragma once
+// Medicion de un tramo del cuadro con consultas de GPU: invocaciones del fragment shader
+// (ARB_pipeline_statistics_query o GL 4.6) y tiempo. Sin la extension cuenta las muestras que
+// pasaron la prueba de profundidad (GL_SAMPLES_PASSED), que con early-z se acerca a lo sombreado.
+// Read espera a la GPU: es para el modo de medicion, no para cada cuadro. No se anida con las
+// consultas de oclusion (tambien GL_SAMPLES_PASSED).
+#include <GL/glew.h>
+
+struct PassMeasure {
+    GLuint64 fragments = 0;     // invocaciones o muestras, segun PassQuery::Invocations()
+    GLuint64 ns = 0;            // tiempo de GPU
+    double Ms() const { return ns / 1.0e6; }
+};
+
+class PassQuery {
+public:
+    static bool Invocations() { return GLEW_VERSION_4_6 || GLEW_ARB_pipeline_statistics_query; }
+
+    void Begin() {
+        if (!queries[0]) glGenQueries(2, queries);
+        glBeginQuery(target(), queries[0]);
+        glBeginQuery(GL_TIME_ELAPSED, queries[1]);
+    }
+
+    void End() {
+        glEndQuery(GL_TIME_ELAPSED);
+        glEndQuery(target());
+    }
+
+    PassMeasure Read() const {
+        PassMeasure m;
+        if (!queries[0]) return m;
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &m.fragments);
+        glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &m.ns);
+        return m;
+    }
+
+    // Las consultas se sueltan aqui, con el contexto todavia vivo
+    void Release() {
+        if (queries[0]) glDeleteQueries(2, queries);
+        queries[0] = queries[1] = 0;
+    }
+
+private:
+    GLuint queries[2] = { 0, 0 };
+
+    static GLenum target() { return Invocations() ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED; }
+};
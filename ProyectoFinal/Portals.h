@@ -0,0 +1,193 @@
+#pragma once
+// Visibilidad por celdas y portales. Cada sala es una caja (en los ejes del mundo) y cada puerta
+// un rectangulo plano que une dos celdas; lo que no cae en ninguna sala es el exterior. Por cuadro
+// se parte de la celda de la camara y se cruzan los portales que se ven, recortando en pantalla el
+// rectangulo por el que se mira a la siguiente. Cada celda alcanzada guarda el frustum de ese
+// rectangulo para descartar lo que tiene adentro y no asoma por la puerta.
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Camera.h"
+#include "Culling.h"
+
+#define PORTAL_MAX_DEPTH 8      // salas encadenadas que se siguen desde la de la camara
+#define ROOM_SLACK 0.5f         // cuanto puede salirse de la caja una esfera para contar como de la sala
+
+struct Room {
+    std::string name;
+    glm::vec3 min{ 0.0f }, max{ 0.0f };
+};
+
+struct Portal {
+    int a = 0, b = 0;           // celdas que une (puede ser la del exterior)
+    glm::vec3 corners[4];       // en orden alrededor del rectangulo
+};
+
+// Rectangulo en coordenadas normalizadas de pantalla
+struct PortalRect {
+    float x0 = -1.0f, y0 = -1.0f, x1 = 1.0f, y1 = 1.0f;
+    bool Empty() const { return x0 >= x1 || y0 >= y1; }
+    bool Contains(const PortalRect& r) const { return r.x0 >= x0 && r.y0 >= y0 && r.x1 <= x1 && r.y1 <= y1; }
+};
+
+class PortalVisibility {
+public:
+    // Celda de lo que no esta en ninguna sala; siempre la ultima
+    int Exterior() const { return (int)rooms.size(); }
+    int Cells() const { return (int)rooms.size() + 1; }
+    bool Empty() const { return rooms.empty(); }
+
+    int AddRoom(const std::string& name, const glm::vec3& a, const glm::vec3& b) {
+        Room r;
+        r.name = name; r.min = glm::min(a, b); r.max = glm::max(a, b);
+        rooms.push_back(r);
+        return (int)rooms.size() - 1;
+    }
+
+    // "exterior" o el nombre de una sala; -1 si no existe
+    int FindCell(const std::string& name) const {
+        if (name == "exterior") return Exterior();
+        for (size_t i = 0; i < rooms.size(); i++) if (rooms[i].name == name) return (int)i;
+        return -1;
+    }
+
+    // La caja de dos esquinas tiene que ser plana en un eje
+    bool AddPortal(int a, int b, const glm::vec3& p, const glm::vec3& q) {
+        glm::vec3 lo = glm::min(p, q), hi = glm::max(p, q);
+        Portal portal;
+        portal.a = a; portal.b = b;
+        if (hi.x - lo.x < 1e-4f) {
+            portal.corners[0] = glm::vec3(lo.x, lo.y, lo.z); portal.corners[1] = glm::vec3(lo.x, lo.y, hi.z);
+            portal.corners[2] = glm::vec3(lo.x, hi.y, hi.z); portal.corners[3] = glm::vec3(lo.x, hi.y, lo.z);
+        }
+        else if (hi.z - lo.z < 1e-4f) {
+            portal.corners[0] = glm::vec3(lo.x, lo.y, lo.z); portal.corners[1] = glm::vec3(hi.x, lo.y, lo.z);
+            portal.corners[2] = glm::vec3(hi.x, hi.y, lo.z); portal.corners[3] = glm::vec3(lo.x, hi.y, lo.z);
+        }
+        else if (hi.y - lo.y < 1e-4f) {
+            portal.corners[0] = glm::vec3(lo.x, lo.y, lo.z); portal.corners[1] = glm::vec3(hi.x, lo.y, lo.z);
+            portal.corners[2] = glm::vec3(hi.x, lo.y, hi.z); portal.corners[3] = glm::vec3(lo.x, lo.y, hi.z);
+        }
+        else return false;
+        portals.push_back(portal);
+        return true;
+    }
+
+    void AddPortal(const Portal& p) { portals.push_back(p); }
+
+    const std::vector<Room>& Rooms() const { return rooms; }
+    const std::vector<Portal>& Portals() const { return portals; }
+
+    int CellAt(const glm::vec3& p) const {
+        for (size_t i = 0; i < rooms.size(); i++)
+            if (glm::all(glm::greaterThanEqual(p, rooms[i].min)) && glm::all(glm::lessThanEqual(p, rooms[i].max))) return (int)i;
+        return Exterior();
+    }
+
+    // Celda de una esfera en mundo: la sala que la contiene (con ROOM_SLACK), el exterior si no
+    // toca ninguna, o -1 si cruza paredes y hay que tratarla aparte (el edificio mismo, p. ej.)
+    int Classify(const glm::vec4& s) const {
+        glm::vec3 c(s);
+        bool touches = false;
+        for (size_t i = 0; i < rooms.size(); i++) {
+            const Room& r = rooms[i];
+            if (glm::all(glm::greaterThanEqual(c - s.w, r.min - ROOM_SLACK)) && glm::all(glm::lessThanEqual(c + s.w, r.max + ROOM_SLACK)))
+                return (int)i;
+            glm::vec3 d = glm::max(r.min - c, glm::max(glm::vec3(0.0f), c - r.max));
+            if (glm::dot(d, d) < s.w * s.w) touches = true;
+        }
+        return touches ? -1 : Exterior();
+    }
+
+    // Recorre los portales desde la celda de la camara
+    void Update(const glm::mat4& projView, const glm::vec3& eye) {
+        this->projView = projView;
+        visible.assign(Cells(), 0);
+        rects.assign(Cells(), PortalRect());
+        frustums.resize(Cells());
+        camera = CellAt(eye);
+        visible[camera] = 1;
+        visit(camera, PortalRect(), 0);
+        visibleCount = 0;
+        for (int c = 0; c < Cells(); c++) {
+            if (!visible[c]) continue;
+            frustums[c] = rectFrustum(rects[c]);
+            visibleCount++;
+        }
+    }
+
+    bool Visible(int cell) const { return cell >= 0 && cell < (int)visible.size() && visible[cell]; }
+    const Frustum& CellFrustum(int cell) const { return frustums[cell]; }
+    int CameraCell() const { return camera; }
+    int VisibleCells() const { return visibleCount; }
+
+private:
+    std::vector<Room> rooms;
+    std::vector<Portal> portals;
+    glm::mat4 projView{ 1.0f };
+    std::vector<uint8_t> visible;
+    std::vector<PortalRect> rects;      // union de lo que se ve de cada celda
+    std::vector<Frustum> frustums;
+    int camera = 0, visibleCount = 0;
+
+    void visit(int cell, const PortalRect& through, int depth) {
+        for (auto& p : portals) {
+            if (p.a != cell && p.b != cell) continue;
+            int other = p.a == cell ? p.b : p.a;
+            PortalRect r;
+            if (!screenRect(p, through, r)) continue;
+            if (visible[other]) {
+                if (rects[other].Contains(r)) continue;
+                PortalRect& acc = rects[other];
+                acc.x0 = std::min(acc.x0, r.x0); acc.y0 = std::min(acc.y0, r.y0);
+                acc.x1 = std::max(acc.x1, r.x1); acc.y1 = std::max(acc.y1, r.y1);
+            }
+            else {
+                rects[other] = r;
+                visible[other] = 1;
+            }
+            if (depth < PORTAL_MAX_DEPTH) visit(other, r, depth + 1);
+        }
+    }
+
+    // Rectangulo del portal recortado contra `through`; false si no se ve. Si alguna esquina
+    // queda detras de la camara (se esta cruzando la puerta) se usa `through` entero.
+    bool screenRect(const Portal& p, const PortalRect& through, PortalRect& out) const {
+        PortalRect r{ 1.0f, 1.0f, -1.0f, -1.0f };
+        int behind = 0;
+        bool outside[6] = { true, true, true, true, true, true };
+        for (const glm::vec3& c : p.corners) {
+            glm::vec4 h = projView * glm::vec4(c, 1.0f);
+            // Todas las esquinas fuera del mismo plano del frustum: no se ve
+            outside[0] &= h.x < -h.w; outside[1] &= h.x > h.w;
+            outside[2] &= h.y < -h.w; outside[3] &= h.y > h.w;
+            outside[4] &= h.z < -h.w; outside[5] &= h.z > h.w;
+            if (h.w <= 1e-4f) { behind++; continue; }
+            r.x0 = std::min(r.x0, h.x / h.w); r.y0 = std::min(r.y0, h.y / h.w);
+            r.x1 = std::max(r.x1, h.x / h.w); r.y1 = std::max(r.y1, h.y / h.w);
+        }
+        for (bool o : outside) if (o) return false;
+        if (behind > 0) { out = through; return true; }
+        out.x0 = std::max(r.x0, through.x0); out.y0 = std::max(r.y0, through.y0);
+        out.x1 = std::min(r.x1, through.x1); out.y1 = std::min(r.y1, through.y1);
+        return !out.Empty();
+    }
+
+    // Frustum de la camara limitado al rectangulo (mismos planos cercano y lejano)
+    Frustum rectFrustum(const PortalRect& r) const {
+        glm::vec4 row0(projView[0][0], projView[1][0], projView[2][0], projView[3][0]);
+        glm::vec4 row1(projView[0][1], projView[1][1], projView[2][1], projView[3][1]);
+        glm::vec4 row2(projView[0][2], projView[1][2], projView[2][2], projView[3][2]);
+        glm::vec4 row3(projView[0][3], projView[1][3], projView[2][3], projView[3][3]);
+        Frustum f;
+        f.planes[0] = row0 - r.x0 * row3;
+        f.planes[1] = r.x1 * row3 - row0;
+        f.planes[2] = row1 - r.y0 * row3;
+        f.planes[3] = r.y1 * row3 - row1;
+        f.planes[4] = row3 + row2;
+        f.planes[5] = row3 - row2;
+        for (auto& p : f.planes) p /= glm::length(glm::vec3(p));
+        return f;
+    }
+};
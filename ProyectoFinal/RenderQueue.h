@@ -0,0 +1,280 @@
+#pragma once
+// Cola de dibujo del cuadro: cada bloque de main agrega lo que quiere dibujar (programa,
+// modelo, transformacion y uniforms propios del draw) y Flush lo ordena por una llave de
+// 64 bits antes de mandarlo a GL a traves de GLState. Las copias seguidas de una misma malla
+// (mismo programa y uniforms, sin huesos) salen en un solo glDrawElementsInstanced.
+// Con SetIndirect, lo que no tiene huesos de un programa se junta en multi-draws (IndirectDraw.h).
+// Con SetDepthPrepass, DepthPrepass escribe antes la profundidad de lo opaco de ese programa, de
+// cerca a lejos y solo con posiciones; Flush lo dibuja despues con GL_EQUAL y sin escribir
+// profundidad, asi que el fragment shader corre una vez por pixel visible. Esas mallas salen
+// una por una (o por multi-draw en los dos pases), no instanciadas.
+//
+// Llave: pase (4 bits) | programa (12) | material (16) | malla (16) | profundidad (16)
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "GLState.h"
+#include "IndirectDraw.h"
+#include "Model.h"
+
+#define INSTANCE_MIN_BATCH 2    // copias seguidas a partir de las cuales se instancia
+
+enum RenderPass { RENDER_PASS_OPAQUE = 0 };
+
+struct DrawItem {
+    const Shader* shader = nullptr;
+    const Mesh* mesh = nullptr;
+    uint32_t call = 0;              // Add que lo genero: sus mallas comparten transformacion y uniforms
+    glm::mat4 transform{ 1.0f };
+    const glm::mat3* normal = nullptr;  // matriz normal precalculada (Scene); si no, se calcula al instanciar
+    glm::vec4 emissive{ 0.0f };     // rgb + intensidad; solo en programas que declaren emissiveStrength
+    int bones = -1;                 // paleta del cuadro (AddBones) o -1
+};
+
+class RenderQueue {
+public:
+    // Al empezar el cuadro; la vista da la profundidad y farPlane la escala de la llave
+    void Begin(const glm::mat4& view, float farPlane) {
+        this->view = view;
+        this->farPlane = farPlane;
+        items.clear();
+        palettes.clear();
+        bones.clear();
+        calls = 0;
+        prepassDone = false;
+    }
+
+    // Copia la paleta de huesos al cuadro; el indice devuelto se pasa a Add
+    int AddBones(const std::vector<glm::mat4>& palette) {
+        palettes.push_back(std::make_pair((uint32_t)bones.size(), (uint32_t)palette.size()));
+        bones.insert(bones.end(), palette.begin(), palette.end());
+        return (int)palettes.size() - 1;
+    }
+
+    // Una entrada por malla del modelo; con visible (uno por malla) se saltan las que esten en 0
+    void Add(const Model& model, const Shader& shader, const glm::mat4& transform,
+        const glm::vec4& emissive = glm::vec4(0.0f), int palette = -1, RenderPass pass = RENDER_PASS_OPAQUE,
+        const glm::mat3* normal = nullptr, const uint8_t* visible = nullptr) {
+        const ModelAsset* a = model.Asset();
+        if (!a || a->geometryReleased) return;     // sin mallas en la GPU (Model::ReleaseGeometry)
+        uint64_t depth = depthBits(transform);
+        for (size_t k = 0; k < a->meshes.size(); k++)
+            if (!visible || visible[k]) push(a->meshes[k], shader, transform, emissive, palette, pass, normal, depth);
+        calls++;
+    }
+
+    // Una malla suelta (p. ej. un lote estatico, ya en mundo)
+    void AddMesh(const Mesh& mesh, const Shader& shader, const glm::mat4& transform,
+        const glm::vec4& emissive = glm::vec4(0.0f), RenderPass pass = RENDER_PASS_OPAQUE, const glm::mat3* normal = nullptr) {
+        push(mesh, shader, transform, emissive, -1, pass, normal, depthBits(transform));
+        calls++;
+    }
+
+    // Solo profundidad de lo que SetDepthPrepass marco, ordenado por la distancia de cada malla a
+    // la camara. Va despues de limpiar la profundidad y antes de Flush; devuelve cuantas mallas dibujo.
+    size_t DepthPrepass() {
+        prepassDone = false;
+        if (!prepassShader) return 0;
+        prepassOrder.clear();
+        for (uint32_t i = 0; i < items.size(); i++) {
+            const DrawItem& it = items[i];
+            if (!inPrepass(it)) continue;
+            glm::vec4 center = it.transform * glm::vec4(glm::vec3(it.mesh->Bounds().sphere), 1.0f);
+            prepassOrder.push_back(std::make_pair(-(view * center).z, i));
+        }
+        if (prepassOrder.empty()) return 0;
+        std::sort(prepassOrder.begin(), prepassOrder.end());
+
+        GLState& gl = GLState::Instance();
+        const Shader& s = *prepassShader;
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        gl.UseProgram(s.Program);
+        if (s.Location(UNIFORM("uInstanced")) >= 0) s.SetInt(UNIFORM("uInstanced"), 0);
+        uint32_t lastCall = ~0u;
+        for (const std::pair<float, uint32_t>& p : prepassOrder) {
+            const DrawItem& it = items[p.second];
+            // Lo que el color manda por multi-draw, tambien aqui: misma posicion con el mismo shader
+            if (prepassIndirect && indirectShader && it.shader == indirectFor) {
+                depthIndirect.Add(*it.mesh, it.transform, it.normal, it.emissive);
+                continue;
+            }
+            if (it.call != lastCall) {
+                s.SetMat4(UNIFORM("model"), it.transform);
+                lastCall = it.call;
+            }
+            it.mesh->SubmitDepth(s);
+        }
+        if (!depthIndirect.Empty()) {
+            gl.UseProgram(prepassIndirect->Program);
+            depthIndirect.Flush(*prepassIndirect, true);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        prepassDone = true;
+        return prepassOrder.size();
+    }
+
+    // sorted = false dibuja en el orden en que se agrego, como el camino inmediato de antes
+    void Flush(bool sorted = true) {
+        GLState& gl = GLState::Instance();
+        if (sorted) std::sort(order.begin(), order.end());
+        bool equalDepth = false;    // lo del prepase: GL_EQUAL sin escribir profundidad
+
+        const Shader* current = nullptr;
+        uint32_t lastCall = ~0u;
+        int lastBones = -1;
+        bool emissiveKnown = false;
+        int instanced = -1;     // valor de uInstanced en el programa actual; -1 sin saber
+        glm::vec4 lastEmissive(0.0f);
+        for (size_t i = 0; i < order.size(); ) {
+            const DrawItem& it = items[order[i].second];
+            if (sorted && indirectShader && it.shader == indirectFor && it.bones < 0) {
+                indirect.Add(*it.mesh, it.transform, it.normal, it.emissive);
+                i++;
+                continue;
+            }
+            const Shader& s = *it.shader;
+            bool newProgram = it.shader != current;
+            // Sin ordenar se repite el glUseProgram de cada bloque, como antes
+            if (newProgram || (!sorted && it.call != lastCall)) gl.UseProgram(s.Program);
+            if (newProgram) {
+                current = it.shader;
+                lastCall = ~0u;
+                lastBones = -1;
+                emissiveKnown = false;
+                instanced = -1;
+            }
+            size_t run = sorted ? batchLength(i) : 1;
+            bool prepassed = prepassDone && inPrepass(it);
+            if (prepassed != equalDepth) {
+                depthEqual(prepassed);
+                equalDepth = prepassed;
+            }
+            bool useInstancing = run >= INSTANCE_MIN_BATCH;
+            if (instanced != (useInstancing ? 1 : 0) && s.Location(UNIFORM("uInstanced")) >= 0) {
+                s.SetInt(UNIFORM("uInstanced"), useInstancing ? 1 : 0);
+                instanced = useInstancing ? 1 : 0;
+            }
+            if (!useInstancing && it.call != lastCall) {
+                s.SetMat4(UNIFORM("model"), it.transform);
+                lastCall = it.call;
+            }
+            if (s.Location(UNIFORM("emissiveStrength")) >= 0 && (!emissiveKnown || it.emissive != lastEmissive)) {
+                s.SetVec3(UNIFORM("emissiveColor"), glm::vec3(it.emissive));
+                s.SetFloat(UNIFORM("emissiveStrength"), it.emissive.w);
+                lastEmissive = it.emissive;
+                emissiveKnown = true;
+            }
+            if (it.bones >= 0 && it.bones != lastBones) {
+                const std::pair<uint32_t, uint32_t>& p = palettes[it.bones];
+                s.SetMat4Array(UNIFORM("bones"), bones.data() + p.first, (GLsizei)p.second);
+                lastBones = it.bones;
+            }
+            if (useInstancing) {
+                instances.clear();
+                for (size_t k = i; k < i + run; k++) {
+                    const DrawItem& c = items[order[k].second];
+                    instances.push_back(InstanceData{ c.transform, c.normal ? *c.normal : glm::transpose(glm::inverse(glm::mat3(c.transform))) });
+                }
+                Mesh::UploadInstances(instances.data(), instances.size());
+                it.mesh->Submit(s, (GLsizei)run);
+            }
+            else if (sorted) it.mesh->Submit(s);
+            else it.mesh->Draw(s);
+            i += run;
+        }
+        if (!indirect.Empty()) {
+            bool prepassed = prepassDone && prepassShader && indirectFor == prepassFor;
+            if (prepassed != equalDepth) {
+                depthEqual(prepassed);
+                equalDepth = prepassed;
+            }
+            gl.UseProgram(indirectShader->Program);
+            indirect.Flush(*indirectShader);
+        }
+        if (equalDepth) depthEqual(false);
+        order.clear();
+        prepassDone = false;
+    }
+
+    // Lo que se agregue con forShader y sin huesos sale por multi-draw con indirect (su version
+    // de lighting_indirect.vs); nullptr lo apaga. Solo aplica al Flush ordenado.
+    void SetIndirect(const Shader& forShader, const Shader* indirect) {
+        indirectFor = &forShader;
+        indirectShader = indirect;
+    }
+
+    // Lo que se agregue con forShader y sin huesos pasa por DepthPrepass con depth (Shader/depth.vs);
+    // depthIndirect (depth_indirect.vs) toma lo que el color manda por multi-draw. nullptr lo apaga.
+    void SetDepthPrepass(const Shader& forShader, const Shader* depth, const Shader* depthIndirect) {
+        prepassFor = &forShader;
+        prepassShader = depth;
+        prepassIndirect = depth ? depthIndirect : nullptr;
+    }
+
+    size_t Size() const { return items.size(); }
+
+private:
+    glm::mat4 view{ 1.0f };
+    float farPlane = 1.0f;
+    std::vector<DrawItem> items;
+    std::vector<std::pair<uint64_t, uint32_t>> order;      // llave e indice en items
+    std::vector<std::pair<uint32_t, uint32_t>> palettes;   // inicio y cantidad en bones
+    std::vector<glm::mat4> bones;
+    std::vector<InstanceData> instances;
+    uint32_t calls = 0;
+    const Shader* indirectFor = nullptr;
+    const Shader* indirectShader = nullptr;
+    IndirectRenderer indirect;
+    const Shader* prepassFor = nullptr;
+    const Shader* prepassShader = nullptr;
+    const Shader* prepassIndirect = nullptr;
+    bool prepassDone = false;                               // DepthPrepass ya escribio la profundidad de este cuadro
+    std::vector<std::pair<float, uint32_t>> prepassOrder;   // distancia e indice en items
+    IndirectRenderer depthIndirect;
+
+    bool inPrepass(const DrawItem& it) const { return prepassShader && it.shader == prepassFor && it.bones < 0; }
+
+    static void depthEqual(bool on) {
+        glDepthFunc(on ? GL_EQUAL : GL_LESS);
+        glDepthMask(on ? GL_FALSE : GL_TRUE);
+    }
+
+    void push(const Mesh& mesh, const Shader& shader, const glm::mat4& transform, const glm::vec4& emissive,
+        int palette, RenderPass pass, const glm::mat3* normal, uint64_t depth) {
+        DrawItem it;
+        it.shader = &shader;
+        it.mesh = &mesh;
+        it.call = calls;
+        it.transform = transform;
+        it.normal = normal;
+        it.emissive = emissive;
+        it.bones = palette;
+        uint64_t key = ((uint64_t)pass << 60) | ((uint64_t)(shader.Program & 0xFFF) << 48) |
+            ((uint64_t)mesh.MaterialKey() << 32) | ((uint64_t)mesh.Id() << 16) | depth;
+        order.push_back(std::make_pair(key, (uint32_t)items.size()));
+        items.push_back(it);
+    }
+
+    // Cuantos items desde order[i] se pueden dibujar instanciados juntos. Lo que paso por el
+    // prepase no se instancia: GL_EQUAL necesita la misma matriz por el mismo camino (uniform
+    // model, uInstanced = 0) que en depth.vs, no la de aInstanceModel.
+    size_t batchLength(size_t i) const {
+        const DrawItem& first = items[order[i].second];
+        if (first.bones >= 0 || (prepassDone && inPrepass(first)) || first.shader->Location(UNIFORM("uInstanced")) < 0) return 1;
+        size_t n = 1;
+        while (i + n < order.size()) {
+            const DrawItem& it = items[order[i + n].second];
+            if (it.shader != first.shader || it.mesh != first.mesh || it.bones >= 0 || it.emissive != first.emissive) break;
+            n++;
+        }
+        return n;
+    }
+
+    // Distancia a la camara del origen del modelo, de cerca a lejos (opacos)
+    uint64_t depthBits(const glm::mat4& transform) const {
+        float z = -(view * transform[3]).z / farPlane;
+        return (uint64_t)(glm::clamp(z, 0.0f, 1.0f) * 0xFFFF);
+    }
+};
@@ -13,6 +13,28 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "image_parallel.h"
+
+/*	SSE2 is always there on x64 and with /arch:SSE2 (the MSVC default)	*/
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#define DXT_HAS_SSE2 1
+	#include <emmintrin.h>
+#endif
+/*	AVX2 gets compiled in anyway and only runs if the CPU has it	*/
+#if DXT_HAS_SSE2 && defined(_MSC_VER) && (_MSC_VER >= 1800)
+	#define DXT_HAS_AVX2 1
+	#define DXT_AVX2_TARGET
+	#include <immintrin.h>
+	#include <intrin.h>
+#elif DXT_HAS_SSE2 && (defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+	#define DXT_HAS_AVX2 1
+	#define DXT_AVX2_TARGET __attribute__((target("avx2")))
+	#include <immintrin.h>
+#endif
+
+/*	the row-parallel driver never splits an image in chunks smaller than this	*/
+#define DXT_MIN_BLOCKS_PER_THREAD	1024
+
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
 	overall, except on the infintesimal chance that the power
@@ -37,6 +59,36 @@ void compress_DDS_color_block(
 void compress_DDS_alpha_block(
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
+/*
+	Second half of compress_DDS_color_block: stores the 565 master
+	colors and projects each pixel on the line between them.
+*/
+void compress_DDS_color_indices(
+				int enc_c0, int enc_c1,
+				int channels,
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
+/*
+	Slower block encoders for SOIL_DXT_HIGH_QUALITY: refined master
+	colors and the nearest palette entry for every pixel.
+*/
+static void compress_DDS_color_block_HQ(
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
+static void compress_DDS_alpha_block_HQ(
+				const unsigned char *const uncompressed,
+				unsigned char compressed[8] );
+/*
+	Compresses a whole image, splitting the rows of blocks among
+	threads and using the vector encoder when there is one.
+*/
+static unsigned char* DXT_encode_image(
+				const unsigned char *const uncompressed,
+				int width, int height, int channels,
+				int dxt5, int mode, int threads,
+				int *out_size );
+/*	0 = scalar, 1 = SSE2, 2 = AVX2	*/
+static int DXT_simd_level( void );
 
 /********* Actual Exposed Functions *********/
 int
@@ -103,80 +155,8 @@ unsigned char* convert_image_to_DXT1(
 		int width, int height, int channels,
 		int *out_size )
 {
-	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*3];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || (channels > 4) )
-	{
-		return NULL;
-	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
-	if( channels < 3 )
-	{
-		chan_step = 0;
-	}
-	/*	get the RAM for the compressed image
-		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
-	{
-		for( i = 0; i < width; i += 4 )
-		{
-			/*	copy this block into a new one	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			/*	compress the block	*/
-			++block_count;
-			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-		}
-	}
-	return compressed;
+	return convert_image_to_DXT1_ex( uncompressed, width, height, channels,
+			SOIL_DXT_COMPATIBLE, 0, out_size );
 }
 
 unsigned char* convert_image_to_DXT5(
@@ -184,94 +164,39 @@ unsigned char* convert_image_to_DXT5(
 		int width, int height, int channels,
 		int *out_size )
 {
-	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*4];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || ( channels > 4) )
-	{
-		return NULL;
-	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
-	if( channels < 3 )
+	return convert_image_to_DXT5_ex( uncompressed, width, height, channels,
+			SOIL_DXT_COMPATIBLE, 0, out_size );
+}
+
+unsigned char* convert_image_to_DXT1_ex(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int mode, int threads,
+		int *out_size )
+{
+	return DXT_encode_image( uncompressed, width, height, channels, 0, mode, threads, out_size );
+}
+
+unsigned char* convert_image_to_DXT5_ex(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int mode, int threads,
+		int *out_size )
+{
+	return DXT_encode_image( uncompressed, width, height, channels, 1, mode, threads, out_size );
+}
+
+const char* get_DXT_encoder_SIMD( void )
+{
+	switch( DXT_simd_level() )
 	{
-		chan_step = 0;
+	case 2:
+		return "AVX2";
+	case 1:
+		return "SSE2";
+	default:
+		return "none";
 	}
-	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
-	has_alpha = 1 - (channels & 1);
-	/*	get the RAM for the compressed image
-		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
-	{
-		for( i = 0; i < width; i += 4 )
-		{
-			/*	local variables, and my block counter	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-					ublock[idx++] =
-						has_alpha * uncompressed[(j+y)*width*channels+(i+x)*channels+channels-1]
-						+ (1-has_alpha)*255;
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			/*	now compress the alpha block	*/
-			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-		}
-	}
-	return compressed;
 }
 
 /********* Helper Functions *********/
@@ -504,18 +429,30 @@ void
 		const unsigned char *const uncompressed,
 		unsigned char compressed[8]
 	)
+{
+	int enc_c0, enc_c1;
+	/*	get the master colors	*/
+	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
+	compress_DDS_color_indices( enc_c0, enc_c1, channels, uncompressed, compressed );
+}
+
+void
+	compress_DDS_color_indices
+	(
+		int enc_c0, int enc_c1,
+		int channels,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8]
+	)
 {
 	/*	variables	*/
 	int i;
 	int next_bit;
-	int enc_c0, enc_c1;
 	int c0[4], c1[4];
 	float color_line[] = { 0.0f, 0.0f, 0.0f, 0.0f };
 	float vec_len2 = 0.0f, dot_offset = 0.0f;
 	/*	stupid order	*/
 	int swizzle4[] = { 0, 2, 3, 1 };
-	/*	get the master colors	*/
-	LSE_master_colors_max_min( &enc_c0, &enc_c1, channels, uncompressed );
 	/*	store the 565 color 0 and color 1	*/
 	compressed[0] = (enc_c0 >> 0) & 255;
 	compressed[1] = (enc_c0 >> 8) & 255;
@@ -630,3 +567,665 @@ void
 	}
 	/*	done compressing to DXT1	*/
 }
+
+/********* Vector encoders *********/
+#if DXT_HAS_SSE2
+#define DXT_W	4
+#define DXT_FN( name )	DXT_##name##_sse2
+#define DXT_TARGET
+#define DXT_END()
+#define VF	__m128
+#define VI	__m128i
+#define VF_SET1	_mm_set1_ps
+#define VF_ADD	_mm_add_ps
+#define VF_SUB	_mm_sub_ps
+#define VF_MUL	_mm_mul_ps
+#define VF_DIV	_mm_div_ps
+#define VF_MIN	_mm_min_ps
+#define VF_MAX	_mm_max_ps
+#define VF_GT_MASK( a, b )	_mm_castps_si128( _mm_cmpgt_ps( a, b ) )
+#define VF_AND_I( m, a )	_mm_and_ps( _mm_castsi128_ps( m ), a )
+#define VF_FROM_I	_mm_cvtepi32_ps
+#define VF_TO_I	_mm_cvttps_epi32
+#define VI_SET1	_mm_set1_epi32
+#define VI_LOAD( p )	_mm_loadu_si128( (const __m128i*)(p) )
+#define VI_STORE( p, v )	_mm_storeu_si128( (__m128i*)(p), v )
+#define VI_ADD	_mm_add_epi32
+#define VI_SUB	_mm_sub_epi32
+#define VI_AND	_mm_and_si128
+#define VI_OR	_mm_or_si128
+#define VI_XOR	_mm_xor_si128
+#define VI_ANDNOT	_mm_andnot_si128
+#define VI_SRLI	_mm_srli_epi32
+#define VI_SLLI	_mm_slli_epi32
+#define VI_SLL( a, n )	_mm_sll_epi32( a, _mm_cvtsi32_si128( n ) )
+#define VI_SRL( a, n )	_mm_srl_epi32( a, _mm_cvtsi32_si128( n ) )
+#define VI_GT	_mm_cmpgt_epi32
+#define VI_EQ	_mm_cmpeq_epi32
+#include "image_DXT_kernel.inl"
+#endif
+
+#if DXT_HAS_AVX2
+#define DXT_W	8
+#define DXT_FN( name )	DXT_##name##_avx2
+#define DXT_TARGET	DXT_AVX2_TARGET
+#define DXT_END()	_mm256_zeroupper()
+#define VF	__m256
+#define VI	__m256i
+#define VF_SET1	_mm256_set1_ps
+#define VF_ADD	_mm256_add_ps
+#define VF_SUB	_mm256_sub_ps
+#define VF_MUL	_mm256_mul_ps
+#define VF_DIV	_mm256_div_ps
+#define VF_MIN	_mm256_min_ps
+#define VF_MAX	_mm256_max_ps
+#define VF_GT_MASK( a, b )	_mm256_castps_si256( _mm256_cmp_ps( a, b, _CMP_GT_OQ ) )
+#define VF_AND_I( m, a )	_mm256_and_ps( _mm256_castsi256_ps( m ), a )
+#define VF_FROM_I	_mm256_cvtepi32_ps
+#define VF_TO_I	_mm256_cvttps_epi32
+#define VI_SET1	_mm256_set1_epi32
+#define VI_LOAD( p )	_mm256_loadu_si256( (const __m256i*)(p) )
+#define VI_STORE( p, v )	_mm256_storeu_si256( (__m256i*)(p), v )
+#define VI_ADD	_mm256_add_epi32
+#define VI_SUB	_mm256_sub_epi32
+#define VI_AND	_mm256_and_si256
+#define VI_OR	_mm256_or_si256
+#define VI_XOR	_mm256_xor_si256
+#define VI_ANDNOT	_mm256_andnot_si256
+#define VI_SRLI	_mm256_srli_epi32
+#define VI_SLLI	_mm256_slli_epi32
+#define VI_SLL( a, n )	_mm256_sll_epi32( a, _mm_cvtsi32_si128( n ) )
+#define VI_SRL( a, n )	_mm256_srl_epi32( a, _mm_cvtsi32_si128( n ) )
+#define VI_GT	_mm256_cmpgt_epi32
+#define VI_EQ	_mm256_cmpeq_epi32
+#include "image_DXT_kernel.inl"
+
+static int DXT_cpu_has_avx2( void )
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 0 );
+	if( info[0] < 7 )
+	{
+		return 0;
+	}
+	/*	the OS has to save the YMM registers too (OSXSAVE, AVX, then XCR0)	*/
+	__cpuid( info, 1 );
+	if( ((info[2] & (1 << 27)) == 0) || ((info[2] & (1 << 28)) == 0) )
+	{
+		return 0;
+	}
+	if( (_xgetbv( 0 ) & 6) != 6 )
+	{
+		return 0;
+	}
+	__cpuidex( info, 7, 0 );
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "avx2" );
+#endif
+}
+#endif
+
+static int DXT_simd_level( void )
+{
+	static int level = -1;
+	if( level < 0 )
+	{
+		int found = 0;
+		#if DXT_HAS_SSE2
+		found = 1;
+		#endif
+		#if DXT_HAS_AVX2
+		if( DXT_cpu_has_avx2() )
+		{
+			found = 2;
+		}
+		#endif
+		level = found;
+	}
+	return level;
+}
+
+/********* Scalar encoders for the other modes *********/
+/*
+	Indices of the fast mode: the texels go on the c0..c1 line pre-scaled
+	to [0,3] and three thresholds pick the palette entry, with the float
+	operations of the vector encoder in the same order.
+*/
+static void DXT_fast_indices(
+		int enc_c0, int enc_c1,
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8] )
+{
+	int i, c0[3], c1[3];
+	unsigned int bits = 0;
+	float line[3], len2, off, dot;
+	rgb_888_from_565( enc_c0, &c0[0], &c0[1], &c0[2] );
+	rgb_888_from_565( enc_c1, &c1[0], &c1[1], &c1[2] );
+	for( i = 0; i < 3; ++i )
+	{
+		line[i] = (float)(c1[i] - c0[i]);
+	}
+	len2 = line[0]*line[0] + line[1]*line[1] + line[2]*line[2];
+	len2 = (len2 > 0.0f) ? 1.0f / len2 : 0.0f;
+	for( i = 0; i < 3; ++i )
+	{
+		line[i] *= len2;
+	}
+	off = line[0]*c0[0] + line[1]*c0[1] + line[2]*c0[2];
+	for( i = 0; i < 3; ++i )
+	{
+		line[i] *= 3.0f;
+	}
+	off *= 3.0f;
+	for( i = 0; i < 16; ++i )
+	{
+		dot = line[0]*uncompressed[i*4+0] + line[1]*uncompressed[i*4+1] +
+			line[2]*uncompressed[i*4+2] - off;
+		/*	swizzle4 { 0, 2, 3, 1 } folded into the thresholds	*/
+		bits |= (unsigned int)(((dot > 1.5f) ? 1 : 0) | ((dot > 0.5f && !(dot > 2.5f)) ? 2 : 0)) << (2 * i);
+	}
+	compressed[0] = (enc_c0 >> 0) & 255;
+	compressed[1] = (enc_c0 >> 8) & 255;
+	compressed[2] = (enc_c1 >> 0) & 255;
+	compressed[3] = (enc_c1 >> 8) & 255;
+	compressed[4] = (bits >> 0) & 255;
+	compressed[5] = (bits >> 8) & 255;
+	compressed[6] = (bits >> 16) & 255;
+	compressed[7] = (bits >> 24) & 255;
+}
+
+static void compress_DDS_color_block_fast(
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8] )
+{
+	int i, j, inset, c0, c1, t;
+	int lo[3], hi[3], cov[2] = { 0, 0 };
+	/*	bounding box of the block	*/
+	for( j = 0; j < 3; ++j )
+	{
+		lo[j] = hi[j] = uncompressed[j];
+		for( i = 1; i < 16; ++i )
+		{
+			if( uncompressed[i*4+j] < lo[j] )
+			{
+				lo[j] = uncompressed[i*4+j];
+			} else if( uncompressed[i*4+j] > hi[j] )
+			{
+				hi[j] = uncompressed[i*4+j];
+			}
+		}
+	}
+	/*	which diagonal: red and green against blue, around the center	*/
+	for( i = 0; i < 16; ++i )
+	{
+		int db = 2 * uncompressed[i*4+2] - (hi[2] + lo[2]);
+		cov[0] += (2 * uncompressed[i*4+0] - (hi[0] + lo[0])) * db;
+		cov[1] += (2 * uncompressed[i*4+1] - (hi[1] + lo[1])) * db;
+	}
+	/*	inset by 1/16th of its size	*/
+	for( j = 0; j < 3; ++j )
+	{
+		inset = (hi[j] - lo[j]) >> 4;
+		hi[j] -= inset;
+		lo[j] += inset;
+	}
+	for( j = 0; j < 2; ++j )
+	{
+		if( cov[j] < 0 )
+		{
+			t = hi[j]; hi[j] = lo[j]; lo[j] = t;
+		}
+	}
+	c0 = rgb_to_565( hi[0], hi[1], hi[2] );
+	c1 = rgb_to_565( lo[0], lo[1], lo[2] );
+	if( c0 > c1 )
+	{
+		DXT_fast_indices( c0, c1, uncompressed, compressed );
+	} else
+	{
+		DXT_fast_indices( c1, c0, uncompressed, compressed );
+	}
+}
+
+/*
+	Squared error of the block against the palette of c0, c1 (swapped so
+	that c0 > c1, the 4 color mode), with the best index for every pixel.
+*/
+static int DXT_palette_error(
+		int *c0, int *c1,
+		const unsigned char *const uncompressed,
+		unsigned char indices[16] )
+{
+	int pal[4][3];
+	int i, j, k, err = 0, colors = 4;
+	if( *c0 < *c1 )
+	{
+		k = *c0; *c0 = *c1; *c1 = k;
+	} else if( *c0 == *c1 )
+	{
+		/*	that would be the 3 color mode, so only c0 is usable	*/
+		colors = 1;
+	}
+	rgb_888_from_565( *c0, &pal[0][0], &pal[0][1], &pal[0][2] );
+	rgb_888_from_565( *c1, &pal[1][0], &pal[1][1], &pal[1][2] );
+	for( j = 0; j < 3; ++j )
+	{
+		pal[2][j] = (2 * pal[0][j] + pal[1][j] + 1) / 3;
+		pal[3][j] = (pal[0][j] + 2 * pal[1][j] + 1) / 3;
+	}
+	for( i = 0; i < 16; ++i )
+	{
+		int best = 0, best_d = 0x7FFFFFFF;
+		for( k = 0; k < colors; ++k )
+		{
+			int dr = uncompressed[i*4+0] - pal[k][0];
+			int dg = uncompressed[i*4+1] - pal[k][1];
+			int db = uncompressed[i*4+2] - pal[k][2];
+			int d = dr*dr + dg*dg + db*db;
+			if( d < best_d )
+			{
+				best_d = d;
+				best = k;
+			}
+		}
+		indices[i] = (unsigned char)best;
+		err += best_d;
+	}
+	return err;
+}
+
+static int DXT_quantize_565( const float c[3] )
+{
+	int j, q[3];
+	for( j = 0; j < 3; ++j )
+	{
+		q[j] = (int)(c[j] + 0.5f);
+		if( q[j] < 0 )
+		{
+			q[j] = 0;
+		} else if( q[j] > 255 )
+		{
+			q[j] = 255;
+		}
+	}
+	return rgb_to_565( q[0], q[1], q[2] );
+}
+
+static void compress_DDS_color_block_HQ(
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8] )
+{
+	/*	weight of c0 for each palette index	*/
+	const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	int i, j, iter;
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	float dir[3], x[3], e0[3], e1[3];
+	float len, t, t_min, t_max;
+	int c0, c1, err, best_c0, best_c1, best_err;
+	unsigned char indices[16], best_indices[16];
+	/*	mean and covariance of the block	*/
+	for( i = 0; i < 16; ++i )
+	{
+		for( j = 0; j < 3; ++j )
+		{
+			mean[j] += uncompressed[i*4+j];
+		}
+	}
+	for( j = 0; j < 3; ++j )
+	{
+		mean[j] *= 1.0f / 16.0f;
+	}
+	for( i = 0; i < 16; ++i )
+	{
+		float dr = uncompressed[i*4+0] - mean[0];
+		float dg = uncompressed[i*4+1] - mean[1];
+		float db = uncompressed[i*4+2] - mean[2];
+		cov[0] += dr*dr; cov[1] += dr*dg; cov[2] += dr*db;
+		cov[3] += dg*dg; cov[4] += dg*db; cov[5] += db*db;
+	}
+	/*	power method, normalized every round so it can not blow up	*/
+	dir[0] = 1.0f;
+	dir[1] = 2.718281828f;
+	dir[2] = 3.141592654f;
+	for( iter = 0; iter < 8; ++iter )
+	{
+		x[0] = dir[0]; x[1] = dir[1]; x[2] = dir[2];
+		dir[0] = x[0]*cov[0] + x[1]*cov[1] + x[2]*cov[2];
+		dir[1] = x[0]*cov[1] + x[1]*cov[3] + x[2]*cov[4];
+		dir[2] = x[0]*cov[2] + x[1]*cov[4] + x[2]*cov[5];
+		len = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+		if( len < 1e-12f )
+		{
+			/*	flat block, any axis will do	*/
+			dir[0] = dir[1] = dir[2] = 0.57735027f;
+			break;
+		}
+		len = 1.0f / (float)sqrt( len );
+		dir[0] *= len; dir[1] *= len; dir[2] *= len;
+	}
+	/*	extent of the block along that axis	*/
+	t_min = t_max = 0.0f;
+	for( i = 0; i < 16; ++i )
+	{
+		t = (uncompressed[i*4+0] - mean[0]) * dir[0] +
+			(uncompressed[i*4+1] - mean[1]) * dir[1] +
+			(uncompressed[i*4+2] - mean[2]) * dir[2];
+		if( t < t_min )
+		{
+			t_min = t;
+		} else if( t > t_max )
+		{
+			t_max = t;
+		}
+	}
+	for( j = 0; j < 3; ++j )
+	{
+		e0[j] = mean[j] + t_max * dir[j];
+		e1[j] = mean[j] + t_min * dir[j];
+	}
+	best_c0 = DXT_quantize_565( e0 );
+	best_c1 = DXT_quantize_565( e1 );
+	best_err = DXT_palette_error( &best_c0, &best_c1, uncompressed, best_indices );
+	/*	least squares refit of the master colors to the chosen indices	*/
+	for( iter = 0; (iter < 2) && (best_err > 0); ++iter )
+	{
+		float a = 0.0f, b = 0.0f, c = 0.0f, det;
+		float x0[3] = { 0.0f, 0.0f, 0.0f }, x1[3] = { 0.0f, 0.0f, 0.0f };
+		for( i = 0; i < 16; ++i )
+		{
+			float w = weights[best_indices[i]];
+			a += w * w;
+			b += w * (1.0f - w);
+			c += (1.0f - w) * (1.0f - w);
+			for( j = 0; j < 3; ++j )
+			{
+				x0[j] += w * uncompressed[i*4+j];
+				x1[j] += (1.0f - w) * uncompressed[i*4+j];
+			}
+		}
+		det = a * c - b * b;
+		if( fabs( det ) < 1e-6f )
+		{
+			break;
+		}
+		det = 1.0f / det;
+		for( j = 0; j < 3; ++j )
+		{
+			e0[j] = (c * x0[j] - b * x1[j]) * det;
+			e1[j] = (a * x1[j] - b * x0[j]) * det;
+		}
+		c0 = DXT_quantize_565( e0 );
+		c1 = DXT_quantize_565( e1 );
+		err = DXT_palette_error( &c0, &c1, uncompressed, indices );
+		if( err >= best_err )
+		{
+			break;
+		}
+		best_err = err;
+		best_c0 = c0;
+		best_c1 = c1;
+		memcpy( best_indices, indices, 16 );
+	}
+	compressed[0] = (best_c0 >> 0) & 255;
+	compressed[1] = (best_c0 >> 8) & 255;
+	compressed[2] = (best_c1 >> 0) & 255;
+	compressed[3] = (best_c1 >> 8) & 255;
+	compressed[4] = compressed[5] = compressed[6] = compressed[7] = 0;
+	for( i = 0; i < 16; ++i )
+	{
+		compressed[4 + (i >> 2)] |= best_indices[i] << ((i & 3) * 2);
+	}
+}
+
+static void compress_DDS_alpha_block_HQ(
+		const unsigned char *const uncompressed,
+		unsigned char compressed[8] )
+{
+	int i, k, a0, a1, next_bit;
+	int pal[8];
+	a0 = a1 = uncompressed[3];
+	for( i = 4+3; i < 16*4; i += 4 )
+	{
+		if( uncompressed[i] > a0 )
+		{
+			a0 = uncompressed[i];
+		} else if( uncompressed[i] < a1 )
+		{
+			a1 = uncompressed[i];
+		}
+	}
+	compressed[0] = a0;
+	compressed[1] = a1;
+	memset( compressed + 2, 0, 6 );
+	if( a0 == a1 )
+	{
+		/*	every index 0 is already a0	*/
+		return;
+	}
+	/*	the 8 alpha mode (a0 > a1), rounded like the decoders do	*/
+	pal[0] = a0;
+	pal[1] = a1;
+	for( k = 2; k < 8; ++k )
+	{
+		pal[k] = ((8 - k) * a0 + (k - 1) * a1 + 3) / 7;
+	}
+	next_bit = 8*2;
+	for( i = 3; i < 16*4; i += 4 )
+	{
+		int best = 0, best_d = 256;
+		for( k = 0; k < 8; ++k )
+		{
+			int d = abs( uncompressed[i] - pal[k] );
+			if( d < best_d )
+			{
+				best_d = d;
+				best = k;
+			}
+		}
+		compressed[next_bit >> 3] |= best << (next_bit & 7);
+		if( (next_bit & 7) > 5 )
+		{
+			compressed[1 + (next_bit >> 3)] |= best >> (8 - (next_bit & 7));
+		}
+		next_bit += 3;
+	}
+}
+
+/********* Row-parallel driver *********/
+typedef struct
+{
+	const unsigned char *uncompressed;
+	int width, height, channels;
+	int dxt5, mode, simd;
+	unsigned char *compressed;
+	/*	the rows of blocks this job owns	*/
+	int row_begin, row_end;
+}
+DXT_job;
+
+/*	one 4x4 block as packed RGBA, padded the way the old encoder did it	*/
+static void DXT_fetch_block( const DXT_job *job, int bx, int by, unsigned int block[16] )
+{
+	const int width = job->width, height = job->height, channels = job->channels;
+	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
+	const int chan_step = (channels < 3) ? 0 : 1;
+	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
+	const int has_alpha = 1 - (channels & 1);
+	int i = bx * 4, j = by * 4;
+	int x, y, mx = 4, my = 4;
+	if( j+4 >= height )
+	{
+		my = height - j;
+	}
+	if( i+4 >= width )
+	{
+		mx = width - i;
+	}
+	for( y = 0; y < my; ++y )
+	{
+		const unsigned char *src = job->uncompressed + ((size_t)(j+y) * width + i) * channels;
+		for( x = 0; x < mx; ++x, src += channels )
+		{
+			block[y*4+x] =
+				((unsigned int)src[0]) |
+				((unsigned int)src[chan_step] << 8) |
+				((unsigned int)src[chan_step+chan_step] << 16) |
+				((unsigned int)(has_alpha ? src[channels-1] : 255) << 24);
+		}
+		for( x = mx; x < 4; ++x )
+		{
+			block[y*4+x] = block[0];
+		}
+	}
+	for( y = my; y < 4; ++y )
+	{
+		for( x = 0; x < 4; ++x )
+		{
+			block[y*4+x] = block[0];
+		}
+	}
+}
+
+static void DXT_encode_rows( const DXT_job *job )
+{
+	const int blocks_x = (job->width + 3) >> 2;
+	const int block_bytes = job->dxt5 ? 16 : 8;
+	const int quality = job->mode & ~SOIL_DXT_NO_SIMD;
+	int lanes = 1, bx, by, k, n, p;
+	unsigned int block[16], pixels[16*8];
+	unsigned char ublock[16*4], out[16*8];
+	/*	the high quality encoder is scalar only	*/
+	if( quality != SOIL_DXT_HIGH_QUALITY )
+	{
+		lanes = (job->simd == 2) ? 8 : ((job->simd == 1) ? 4 : 1);
+	}
+	for( by = job->row_begin; by < job->row_end; ++by )
+	{
+		unsigned char *dst = job->compressed + (size_t)by * blocks_x * block_bytes;
+		for( bx = 0; bx < blocks_x; bx += lanes )
+		{
+			if( lanes == 1 )
+			{
+				DXT_fetch_block( job, bx, by, block );
+				for( p = 0; p < 16; ++p )
+				{
+					ublock[p*4+0] = (unsigned char)(block[p] >> 0);
+					ublock[p*4+1] = (unsigned char)(block[p] >> 8);
+					ublock[p*4+2] = (unsigned char)(block[p] >> 16);
+					ublock[p*4+3] = (unsigned char)(block[p] >> 24);
+				}
+				if( job->dxt5 )
+				{
+					if( quality == SOIL_DXT_HIGH_QUALITY )
+					{
+						compress_DDS_alpha_block_HQ( ublock, dst );
+					} else
+					{
+						compress_DDS_alpha_block( ublock, dst );
+					}
+					dst += 8;
+				}
+				if( quality == SOIL_DXT_HIGH_QUALITY )
+				{
+					compress_DDS_color_block_HQ( ublock, dst );
+				} else if( quality == SOIL_DXT_FAST )
+				{
+					compress_DDS_color_block_fast( ublock, dst );
+				} else
+				{
+					compress_DDS_color_block( 4, ublock, dst );
+				}
+				dst += 8;
+				continue;
+			}
+			/*	one block per lane, the spare lanes repeat the first block	*/
+			n = blocks_x - bx;
+			if( n > lanes )
+			{
+				n = lanes;
+			}
+			for( k = 0; k < lanes; ++k )
+			{
+				if( k < n )
+				{
+					DXT_fetch_block( job, bx + k, by, block );
+				}
+				for( p = 0; p < 16; ++p )
+				{
+					pixels[p*lanes+k] = (k < n) ? block[p] : pixels[p*lanes];
+				}
+			}
+			#if DXT_HAS_AVX2
+			if( lanes == 8 )
+			{
+				DXT_encode_blocks_avx2( pixels, quality, job->dxt5, out );
+			} else
+			#endif
+			{
+				#if DXT_HAS_SSE2
+				DXT_encode_blocks_sse2( pixels, quality, job->dxt5, out );
+				#endif
+			}
+			for( k = 0; k < n; ++k )
+			{
+				memcpy( dst, out + k*16 + (job->dxt5 ? 0 : 8), block_bytes );
+				dst += block_bytes;
+			}
+		}
+	}
+}
+
+static void DXT_encode_range( void *job, int begin, int end )
+{
+	DXT_job rows = *(const DXT_job*)job;
+	rows.row_begin = begin;
+	rows.row_end = end;
+	DXT_encode_rows( &rows );
+}
+
+static unsigned char* DXT_encode_image(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int dxt5, int mode, int threads,
+		int *out_size )
+{
+	DXT_job job;
+	unsigned char *compressed;
+	int blocks_x, blocks_y;
+	/*	error check	*/
+	*out_size = 0;
+	if( (width < 1) || (height < 1) ||
+		(NULL == uncompressed) ||
+		(channels < 1) || (channels > 4) )
+	{
+		return NULL;
+	}
+	/*	get the RAM for the compressed image
+		(8 or 16 bytes per 4x4 pixel block)	*/
+	blocks_x = (width + 3) >> 2;
+	blocks_y = (height + 3) >> 2;
+	compressed = (unsigned char*)malloc( (size_t)blocks_x * blocks_y * (dxt5 ? 16 : 8) );
+	if( NULL == compressed )
+	{
+		return NULL;
+	}
+	*out_size = blocks_x * blocks_y * (dxt5 ? 16 : 8);
+	job.uncompressed = uncompressed;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.dxt5 = dxt5;
+	job.mode = mode;
+	job.simd = (mode & SOIL_DXT_NO_SIMD) ? 0 : DXT_simd_level();
+	job.compressed = compressed;
+	job.row_begin = 0;
+	job.row_end = blocks_y;
+	/*	every thread takes whole rows of blocks	*/
+	SOIL_parallel_for( DXT_encode_range, &job, blocks_y, threads,
+			(DXT_MIN_BLOCKS_PER_THREAD + blocks_x - 1) / blocks_x );
+	return compressed;
+}
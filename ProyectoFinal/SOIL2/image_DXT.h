@@ -45,6 +45,53 @@ convert_image_to_DXT5
     int *out_size
 );
 
+/**
+	Encoder modes for convert_image_to_DXT1_ex / convert_image_to_DXT5_ex.
+	SOIL_DXT_COMPATIBLE gives exactly the bits convert_image_to_DXT1/5
+	always gave, SOIL_DXT_FAST takes the diagonal of the bounding box of
+	each block that follows its colors and picks the indices with three
+	thresholds along it, and SOIL_DXT_HIGH_QUALITY refines the master colors (slower, scalar).
+	OR in SOIL_DXT_NO_SIMD to force the scalar encoder.
+**/
+enum
+{
+	SOIL_DXT_COMPATIBLE = 0,
+	SOIL_DXT_FAST = 1,
+	SOIL_DXT_HIGH_QUALITY = 2,
+	SOIL_DXT_NO_SIMD = 16
+};
+
+/**
+	take an image and convert it to DXT1 (no alpha), choosing the mode and
+	the number of threads (0 = one per core, 1 = this thread only)
+**/
+unsigned char*
+convert_image_to_DXT1_ex
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int mode, int threads,
+    int *out_size
+);
+
+/**
+	take an image and convert it to DXT5 (with alpha), choosing the mode and
+	the number of threads (0 = one per core, 1 = this thread only)
+**/
+unsigned char*
+convert_image_to_DXT5_ex
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int mode, int threads,
+    int *out_size
+);
+
+/**
+	the vector instructions the encoder uses on this CPU: "AVX2", "SSE2" or "none"
+**/
+const char* get_DXT_encoder_SIMD( void );
+
 /**	A bunch of DirectDraw Surface structures and flags **/
 typedef struct
 {
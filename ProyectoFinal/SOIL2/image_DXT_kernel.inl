@@ -0,0 +1,341 @@
+/*
+	Vector block encoder shared by the SSE2 and AVX2 paths of image_DXT.c
+
+	Encodes DXT_W blocks at once, one block per vector lane.  The compatible
+	mode performs the float operations of compute_color_line_STDEV,
+	LSE_master_colors_max_min and compress_DDS_color_block in the very same
+	order, so every lane gives the same bits as the scalar encoder.  The
+	fast mode matches compress_DDS_color_block_fast the same way.
+
+	Before including this file define DXT_W, DXT_FN, DXT_TARGET, DXT_END,
+	VF, VI and the VF_* / VI_* primitives; they are undefined at the end.
+*/
+
+#define VI_SEL( m, a, b )	VI_OR( VI_AND( m, a ), VI_ANDNOT( m, b ) )
+#define VI_MAX( a, b )	VI_SEL( VI_GT( a, b ), a, b )
+#define VI_MIN( a, b )	VI_SEL( VI_GT( b, a ), a, b )
+#define VI_CLAMP( x, lo, hi )	VI_MIN( VI_MAX( x, lo ), hi )
+
+/*	convert_bit_range, lane by lane ( c * (2^n - 1) done as a shift )	*/
+DXT_TARGET static VI DXT_FN( range )( VI c, int from_bits, int to_bits )
+{
+	VI b = VI_ADD( VI_SET1( 1 << (from_bits - 1) ), VI_SUB( VI_SLL( c, to_bits ), c ) );
+	return VI_SRL( VI_ADD( b, VI_SRL( b, from_bits ) ), from_bits );
+}
+
+DXT_TARGET static VI DXT_FN( to_565 )( VI r, VI g, VI b )
+{
+	return VI_OR( VI_OR(
+		VI_SLLI( DXT_FN( range )( r, 8, 5 ), 11 ),
+		VI_SLLI( DXT_FN( range )( g, 8, 6 ), 5 ) ),
+		DXT_FN( range )( b, 8, 5 ) );
+}
+
+/*
+	pixels: 16 rows of DXT_W packed RGBA texels (r in the low byte), one
+	column per block.  blocks: 16 bytes per lane, the alpha block first
+	(only written for DXT5) and then the color block.
+*/
+DXT_TARGET static void DXT_FN( encode_blocks )(
+		const unsigned int *pixels, int mode, int dxt5,
+		unsigned char *blocks )
+{
+	VF r[16], g[16], b[16];
+	VI a[16];
+	VI px, byte, zero, c0r, c0g, c0b, c1r, c1g, c1b, i565, j565, mask, cmax, cmin, bits, v;
+	VF d0, d1, d2, dot, dot_min, dot_max, len2, off, half;
+	int p, k;
+	int out_max[DXT_W], out_min[DXT_W], out_bits[DXT_W];
+	int out_a0[DXT_W], out_a1[DXT_W], out_alo[DXT_W], out_ahi[DXT_W];
+
+	byte = VI_SET1( 255 );
+	zero = VI_SET1( 0 );
+	half = VF_SET1( 0.5f );
+	/*	unpack: 0..255 integers are exact as floats, and so are their sums	*/
+	for( p = 0; p < 16; ++p )
+	{
+		px = VI_LOAD( pixels + p * DXT_W );
+		r[p] = VF_FROM_I( VI_AND( px, byte ) );
+		g[p] = VF_FROM_I( VI_AND( VI_SRLI( px, 8 ), byte ) );
+		b[p] = VF_FROM_I( VI_AND( VI_SRLI( px, 16 ), byte ) );
+		a[p] = VI_SRLI( px, 24 );
+	}
+
+	if( mode == SOIL_DXT_FAST )
+	{
+		/*	bounding box of the block, inset by 1/16th of its size, and the
+			sums that give which of its diagonals to take	*/
+		VF max_r = r[0], max_g = g[0], max_b = b[0];
+		VF min_r = r[0], min_g = g[0], min_b = b[0];
+		VF sum_r = r[0], sum_g = g[0], sum_b = b[0];
+		VF sum_rb = VF_MUL( r[0], b[0] ), sum_gb = VF_MUL( g[0], b[0] ), cov_rb, cov_gb;
+		VI ir, ig, ib;
+		for( p = 1; p < 16; ++p )
+		{
+			max_r = VF_MAX( r[p], max_r ); min_r = VF_MIN( r[p], min_r );
+			max_g = VF_MAX( g[p], max_g ); min_g = VF_MIN( g[p], min_g );
+			max_b = VF_MAX( b[p], max_b ); min_b = VF_MIN( b[p], min_b );
+			sum_r = VF_ADD( sum_r, r[p] );
+			sum_g = VF_ADD( sum_g, g[p] );
+			sum_b = VF_ADD( sum_b, b[p] );
+			sum_rb = VF_ADD( sum_rb, VF_MUL( r[p], b[p] ) );
+			sum_gb = VF_ADD( sum_gb, VF_MUL( g[p], b[p] ) );
+		}
+		/*	sum of (2r - R)(2b - B) around the center, R = max + min:
+			4 sum rb - 2 B sum r - 2 R sum b + 16 R B, all exact in float	*/
+		d0 = VF_ADD( max_r, min_r );
+		d1 = VF_ADD( max_g, min_g );
+		d2 = VF_ADD( max_b, min_b );
+		len2 = VF_SET1( 4.0f );
+		sum_rb = VF_MUL( len2, sum_rb );
+		sum_gb = VF_MUL( len2, sum_gb );
+		sum_r = VF_ADD( sum_r, sum_r );
+		sum_g = VF_ADD( sum_g, sum_g );
+		sum_b = VF_ADD( sum_b, sum_b );
+		len2 = VF_MUL( VF_SET1( 16.0f ), d2 );
+		cov_rb = VF_ADD( VF_SUB( sum_rb, VF_ADD( VF_MUL( d2, sum_r ), VF_MUL( d0, sum_b ) ) ), VF_MUL( len2, d0 ) );
+		cov_gb = VF_ADD( VF_SUB( sum_gb, VF_ADD( VF_MUL( d2, sum_g ), VF_MUL( d1, sum_b ) ) ), VF_MUL( len2, d1 ) );
+		c0r = VF_TO_I( max_r ); c1r = VF_TO_I( min_r );
+		c0g = VF_TO_I( max_g ); c1g = VF_TO_I( min_g );
+		c0b = VF_TO_I( max_b ); c1b = VF_TO_I( min_b );
+		ir = VI_SRLI( VI_SUB( c0r, c1r ), 4 );
+		ig = VI_SRLI( VI_SUB( c0g, c1g ), 4 );
+		ib = VI_SRLI( VI_SUB( c0b, c1b ), 4 );
+		c0r = VI_SUB( c0r, ir ); c1r = VI_ADD( c1r, ir );
+		c0g = VI_SUB( c0g, ig ); c1g = VI_ADD( c1g, ig );
+		c0b = VI_SUB( c0b, ib ); c1b = VI_ADD( c1b, ib );
+		/*	a channel that falls while blue rises goes the other way	*/
+		mask = VF_GT_MASK( VF_SET1( 0.0f ), cov_rb );
+		v = VI_SEL( mask, c1r, c0r ); c1r = VI_SEL( mask, c0r, c1r ); c0r = v;
+		mask = VF_GT_MASK( VF_SET1( 0.0f ), cov_gb );
+		v = VI_SEL( mask, c1g, c0g ); c1g = VI_SEL( mask, c0g, c1g ); c0g = v;
+	} else
+	{
+		/*	compute_color_line_STDEV, with USE_COV_MAT	*/
+		VF sum_r = VF_SET1( 0.0f ), sum_g = sum_r, sum_b = sum_r;
+		VF sum_rr = sum_r, sum_gg = sum_r, sum_bb = sum_r;
+		VF sum_rg = sum_r, sum_rb = sum_r, sum_gb = sum_r;
+		VF sixteen = VF_SET1( 16.0f );
+		VF x0, x1, x2;
+		for( p = 0; p < 16; ++p )
+		{
+			sum_r = VF_ADD( sum_r, r[p] );
+			sum_rr = VF_ADD( sum_rr, VF_MUL( r[p], r[p] ) );
+			sum_g = VF_ADD( sum_g, g[p] );
+			sum_gg = VF_ADD( sum_gg, VF_MUL( g[p], g[p] ) );
+			sum_b = VF_ADD( sum_b, b[p] );
+			sum_bb = VF_ADD( sum_bb, VF_MUL( b[p], b[p] ) );
+			sum_rg = VF_ADD( sum_rg, VF_MUL( r[p], g[p] ) );
+			sum_rb = VF_ADD( sum_rb, VF_MUL( r[p], b[p] ) );
+			sum_gb = VF_ADD( sum_gb, VF_MUL( g[p], b[p] ) );
+		}
+		x0 = VF_SET1( 1.0f / 16.0f );
+		sum_r = VF_MUL( sum_r, x0 );
+		sum_g = VF_MUL( sum_g, x0 );
+		sum_b = VF_MUL( sum_b, x0 );
+		sum_rr = VF_SUB( sum_rr, VF_MUL( VF_MUL( sixteen, sum_r ), sum_r ) );
+		sum_gg = VF_SUB( sum_gg, VF_MUL( VF_MUL( sixteen, sum_g ), sum_g ) );
+		sum_bb = VF_SUB( sum_bb, VF_MUL( VF_MUL( sixteen, sum_b ), sum_b ) );
+		sum_rg = VF_SUB( sum_rg, VF_MUL( VF_MUL( sixteen, sum_r ), sum_g ) );
+		sum_rb = VF_SUB( sum_rb, VF_MUL( VF_MUL( sixteen, sum_r ), sum_b ) );
+		sum_gb = VF_SUB( sum_gb, VF_MUL( VF_MUL( sixteen, sum_g ), sum_b ) );
+		/*	three rounds of the power method	*/
+		d0 = VF_SET1( 1.0f );
+		d1 = VF_SET1( 2.718281828f );
+		d2 = VF_SET1( 3.141592654f );
+		for( k = 0; k < 3; ++k )
+		{
+			x0 = d0; x1 = d1; x2 = d2;
+			d0 = VF_ADD( VF_ADD( VF_MUL( x0, sum_rr ), VF_MUL( x1, sum_rg ) ), VF_MUL( x2, sum_rb ) );
+			d1 = VF_ADD( VF_ADD( VF_MUL( x0, sum_rg ), VF_MUL( x1, sum_gg ) ), VF_MUL( x2, sum_gb ) );
+			d2 = VF_ADD( VF_ADD( VF_MUL( x0, sum_rb ), VF_MUL( x1, sum_gb ) ), VF_MUL( x2, sum_bb ) );
+		}
+		/*	LSE_master_colors_max_min	*/
+		len2 = VF_DIV( VF_SET1( 1.0f ), VF_ADD( VF_ADD( VF_ADD( VF_SET1( 0.00001f ),
+				VF_MUL( d0, d0 ) ), VF_MUL( d1, d1 ) ), VF_MUL( d2, d2 ) ) );
+		dot_max = VF_ADD( VF_ADD( VF_MUL( d0, r[0] ), VF_MUL( d1, g[0] ) ), VF_MUL( d2, b[0] ) );
+		dot_min = dot_max;
+		for( p = 1; p < 16; ++p )
+		{
+			/*	min/max keep the current value on ties, like the if/else chain	*/
+			dot = VF_ADD( VF_ADD( VF_MUL( d0, r[p] ), VF_MUL( d1, g[p] ) ), VF_MUL( d2, b[p] ) );
+			dot_min = VF_MIN( dot, dot_min );
+			dot_max = VF_MAX( dot, dot_max );
+		}
+		off = VF_ADD( VF_ADD( VF_MUL( d0, sum_r ), VF_MUL( d1, sum_g ) ), VF_MUL( d2, sum_b ) );
+		dot_min = VF_MUL( VF_SUB( dot_min, off ), len2 );
+		dot_max = VF_MUL( VF_SUB( dot_max, off ), len2 );
+		c0r = VF_TO_I( VF_ADD( VF_ADD( half, sum_r ), VF_MUL( dot_max, d0 ) ) );
+		c0g = VF_TO_I( VF_ADD( VF_ADD( half, sum_g ), VF_MUL( dot_max, d1 ) ) );
+		c0b = VF_TO_I( VF_ADD( VF_ADD( half, sum_b ), VF_MUL( dot_max, d2 ) ) );
+		c1r = VF_TO_I( VF_ADD( VF_ADD( half, sum_r ), VF_MUL( dot_min, d0 ) ) );
+		c1g = VF_TO_I( VF_ADD( VF_ADD( half, sum_g ), VF_MUL( dot_min, d1 ) ) );
+		c1b = VF_TO_I( VF_ADD( VF_ADD( half, sum_b ), VF_MUL( dot_min, d2 ) ) );
+		c0r = VI_CLAMP( c0r, zero, byte ); c1r = VI_CLAMP( c1r, zero, byte );
+		c0g = VI_CLAMP( c0g, zero, byte ); c1g = VI_CLAMP( c1g, zero, byte );
+		c0b = VI_CLAMP( c0b, zero, byte ); c1b = VI_CLAMP( c1b, zero, byte );
+	}
+
+	/*	down sample, color 0 is the larger one	*/
+	i565 = DXT_FN( to_565 )( c0r, c0g, c0b );
+	j565 = DXT_FN( to_565 )( c1r, c1g, c1b );
+	mask = VI_GT( i565, j565 );
+	cmax = VI_SEL( mask, i565, j565 );
+	cmin = VI_SEL( mask, j565, i565 );
+
+	/*	compress_DDS_color_block: project every texel on the 565 line	*/
+	{
+		VF cl_r, cl_g, cl_b, three = VF_SET1( 3.0f );
+		VI three_i = VI_SET1( 3 ), one_i = VI_SET1( 1 );
+		c0r = DXT_FN( range )( VI_AND( VI_SRLI( cmax, 11 ), VI_SET1( 31 ) ), 5, 8 );
+		c0g = DXT_FN( range )( VI_AND( VI_SRLI( cmax, 5 ), VI_SET1( 63 ) ), 6, 8 );
+		c0b = DXT_FN( range )( VI_AND( cmax, VI_SET1( 31 ) ), 5, 8 );
+		c1r = DXT_FN( range )( VI_AND( VI_SRLI( cmin, 11 ), VI_SET1( 31 ) ), 5, 8 );
+		c1g = DXT_FN( range )( VI_AND( VI_SRLI( cmin, 5 ), VI_SET1( 63 ) ), 6, 8 );
+		c1b = DXT_FN( range )( VI_AND( cmin, VI_SET1( 31 ) ), 5, 8 );
+		cl_r = VF_FROM_I( VI_SUB( c1r, c0r ) );
+		cl_g = VF_FROM_I( VI_SUB( c1g, c0g ) );
+		cl_b = VF_FROM_I( VI_SUB( c1b, c0b ) );
+		len2 = VF_ADD( VF_ADD( VF_MUL( cl_r, cl_r ), VF_MUL( cl_g, cl_g ) ), VF_MUL( cl_b, cl_b ) );
+		len2 = VF_AND_I( VF_GT_MASK( len2, VF_SET1( 0.0f ) ), VF_DIV( VF_SET1( 1.0f ), len2 ) );
+		cl_r = VF_MUL( cl_r, len2 );
+		cl_g = VF_MUL( cl_g, len2 );
+		cl_b = VF_MUL( cl_b, len2 );
+		off = VF_ADD( VF_ADD( VF_MUL( cl_r, VF_FROM_I( c0r ) ), VF_MUL( cl_g, VF_FROM_I( c0g ) ) ),
+				VF_MUL( cl_b, VF_FROM_I( c0b ) ) );
+		bits = zero;
+		if( mode == SOIL_DXT_FAST )
+		{
+			/*	the line pre-scaled to [0,3] and three thresholds instead of
+				rounding, clamping and swizzling: above 1.5 sets the low bit,
+				between 0.5 and 2.5 the high one	*/
+			VF lo = VF_SET1( 0.5f ), mid = VF_SET1( 1.5f ), hi = VF_SET1( 2.5f );
+			VI two_i = VI_SET1( 2 );
+			cl_r = VF_MUL( cl_r, three );
+			cl_g = VF_MUL( cl_g, three );
+			cl_b = VF_MUL( cl_b, three );
+			off = VF_MUL( off, three );
+			for( p = 0; p < 16; ++p )
+			{
+				dot = VF_SUB( VF_ADD( VF_ADD( VF_MUL( cl_r, r[p] ), VF_MUL( cl_g, g[p] ) ),
+						VF_MUL( cl_b, b[p] ) ), off );
+				v = VI_OR( VI_AND( VF_GT_MASK( dot, mid ), one_i ),
+						VI_AND( VI_ANDNOT( VF_GT_MASK( dot, hi ), VF_GT_MASK( dot, lo ) ), two_i ) );
+				bits = VI_OR( bits, VI_SLL( v, 2 * p ) );
+			}
+		} else
+		{
+			for( p = 0; p < 16; ++p )
+			{
+				dot = VF_SUB( VF_ADD( VF_ADD( VF_MUL( cl_r, r[p] ), VF_MUL( cl_g, g[p] ) ),
+						VF_MUL( cl_b, b[p] ) ), off );
+				v = VF_TO_I( VF_ADD( VF_MUL( dot, three ), half ) );
+				v = VI_CLAMP( v, zero, three_i );
+				/*	swizzle4 { 0, 2, 3, 1 }: v + 1, 3 wraps to 1, 0 stays 0	*/
+				mask = VI_EQ( v, zero );
+				v = VI_SUB( VI_ADD( v, one_i ), VI_AND( VI_EQ( v, three_i ), three_i ) );
+				v = VI_ANDNOT( mask, v );
+				bits = VI_OR( bits, VI_SLL( v, 2 * p ) );
+			}
+		}
+	}
+	VI_STORE( out_max, cmax );
+	VI_STORE( out_min, cmin );
+	VI_STORE( out_bits, bits );
+
+	/*	compress_DDS_alpha_block	*/
+	if( dxt5 )
+	{
+		VI a0 = a[0], a1 = a[0], seven = VI_SET1( 7 ), eight = VI_SET1( 8 );
+		VI one_i = VI_SET1( 1 ), two_i = VI_SET1( 2 ), lo = zero, hi = zero;
+		VF scale;
+		for( p = 1; p < 16; ++p )
+		{
+			a0 = VI_MAX( a[p], a0 );
+			a1 = VI_MIN( a[p], a1 );
+		}
+		/*	a0 == a1 divides by zero here too: NaN -> 0x80000000 -> index 1	*/
+		scale = VF_DIV( VF_SET1( 7.9999f ), VF_FROM_I( VI_SUB( a0, a1 ) ) );
+		for( p = 0; p < 16; ++p )
+		{
+			v = VF_TO_I( VF_MUL( VF_FROM_I( VI_SUB( a[p], a1 ) ), scale ) );
+			/*	swizzle8 { 1, 7, 6, 5, 4, 3, 2, 0 }: (8 - v) & 7, then 0 and 1 swap	*/
+			v = VI_AND( VI_SUB( eight, VI_AND( v, seven ) ), seven );
+			v = VI_XOR( v, VI_AND( VI_GT( two_i, v ), one_i ) );
+			/*	3 bits per texel, 24 bits for each half of the block	*/
+			if( p < 8 )
+			{
+				lo = VI_OR( lo, VI_SLL( v, 3 * p ) );
+			} else
+			{
+				hi = VI_OR( hi, VI_SLL( v, 3 * (p - 8) ) );
+			}
+		}
+		VI_STORE( out_alo, lo );
+		VI_STORE( out_ahi, hi );
+		VI_STORE( out_a0, a0 );
+		VI_STORE( out_a1, a1 );
+	}
+	DXT_END();
+
+	for( k = 0; k < DXT_W; ++k )
+	{
+		unsigned char *block = blocks + k * 16;
+		if( dxt5 )
+		{
+			block[0] = (unsigned char)out_a0[k];
+			block[1] = (unsigned char)out_a1[k];
+			block[2] = (out_alo[k] >> 0) & 255;
+			block[3] = (out_alo[k] >> 8) & 255;
+			block[4] = (out_alo[k] >> 16) & 255;
+			block[5] = (out_ahi[k] >> 0) & 255;
+			block[6] = (out_ahi[k] >> 8) & 255;
+			block[7] = (out_ahi[k] >> 16) & 255;
+		}
+		block[8] = (out_max[k] >> 0) & 255;
+		block[9] = (out_max[k] >> 8) & 255;
+		block[10] = (out_min[k] >> 0) & 255;
+		block[11] = (out_min[k] >> 8) & 255;
+		block[12] = (out_bits[k] >> 0) & 255;
+		block[13] = (out_bits[k] >> 8) & 255;
+		block[14] = (out_bits[k] >> 16) & 255;
+		block[15] = (out_bits[k] >> 24) & 255;
+	}
+}
+
+#undef VI_SEL
+#undef VI_MAX
+#undef VI_MIN
+#undef VI_CLAMP
+#undef DXT_W
+#undef DXT_FN
+#undef DXT_TARGET
+#undef DXT_END
+#undef VF
+#undef VI
+#undef VF_SET1
+#undef VF_ADD
+#undef VF_SUB
+#undef VF_MUL
+#undef VF_DIV
+#undef VF_MIN
+#undef VF_MAX
+#undef VF_GT_MASK
+#undef VF_AND_I
+#undef VF_FROM_I
+#undef VF_TO_I
+#undef VI_SET1
+#undef VI_LOAD
+#undef VI_STORE
+#undef VI_ADD
+#undef VI_SUB
+#undef VI_AND
+#undef VI_OR
+#undef VI_XOR
+#undef VI_ANDNOT
+#undef VI_SRLI
+#undef VI_SLLI
+#undef VI_SLL
+#undef VI_SRL
+#undef VI_GT
+#undef VI_EQ
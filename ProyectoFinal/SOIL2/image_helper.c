@@ -7,9 +7,39 @@
 */
 
 #include "image_helper.h"
+#include "image_parallel.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+/*	the box filter moves 16 bytes at a time when it can	*/
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#define MIP_HAS_SSE2 1
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define MIP_HAS_NEON 1
+	#include <arm_neon.h>
+#endif
+
+/*	never hand a thread less than this many source pixels	*/
+#define MIP_MIN_PIXELS_PER_THREAD	65536
+
+typedef struct
+{
+	const unsigned char *orig;
+	int width, height, channels;
+	unsigned char *resampled;
+	int block_size_x, block_size_y;
+	int mip_width, mip_height;
+	int flags;
+}
+MIP_job;
+
+static void MIP_box_rows_scalar( void *job, int j_begin, int j_end );
+static void MIP_box_rows( void *job, int j_begin, int j_end );
+static void MIP_gamma_rows( void *job, int j_begin, int j_end );
+static void MIP_init_gamma_tables( void );
+
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -90,8 +120,22 @@ int
 		int block_size_x, int block_size_y
 	)
 {
-	int mip_width, mip_height;
-	int i, j, c;
+	return mipmap_image_ex( orig, width, height, channels, resampled,
+			block_size_x, block_size_y, SOIL_MIPMAP_COMPATIBLE, 0 );
+}
+
+int
+	mipmap_image_ex
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y,
+		int flags, int threads
+	)
+{
+	MIP_job job;
+	int min_rows;
 
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
@@ -102,51 +146,36 @@ int
 		/*	nothing to do	*/
 		return 0;
 	}
-	mip_width = width / block_size_x;
-	mip_height = height / block_size_y;
-	if( mip_width < 1 )
+	job.orig = orig;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.resampled = resampled;
+	job.block_size_x = block_size_x;
+	job.block_size_y = block_size_y;
+	job.mip_width = width / block_size_x;
+	job.mip_height = height / block_size_y;
+	job.flags = flags;
+	if( job.mip_width < 1 )
 	{
-		mip_width = 1;
+		job.mip_width = 1;
 	}
-	if( mip_height < 1 )
+	if( job.mip_height < 1 )
 	{
-		mip_height = 1;
+		job.mip_height = 1;
 	}
-	for( j = 0; j < mip_height; ++j )
+	/*	each thread takes whole rows of the mipmap	*/
+	min_rows = MIP_MIN_PIXELS_PER_THREAD / (width * block_size_y);
+	if( flags & SOIL_MIPMAP_GAMMA_CORRECT )
 	{
-		for( i = 0; i < mip_width; ++i )
-		{
-			for( c = 0; c < channels; ++c )
-			{
-				const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
-				int sum_value;
-				int u,v;
-				int u_block = block_size_x;
-				int v_block = block_size_y;
-				int block_area;
-				/*	do a bit of checking so we don't over-run the boundaries
-					(necessary for non-square textures!)	*/
-				if( block_size_x * (i+1) > width )
-				{
-					u_block = width - i*block_size_y;
-				}
-				if( block_size_y * (j+1) > height )
-				{
-					v_block = height - j*block_size_y;
-				}
-				block_area = u_block*v_block;
-				/*	for this pixel, see what the average
-					of all the values in the block are.
-					note: start the sum at the rounding value, not at 0	*/
-				sum_value = block_area >> 1;
-				for( v = 0; v < v_block; ++v )
-				for( u = 0; u < u_block; ++u )
-				{
-					sum_value += orig[index + v*width*channels + u*channels];
-				}
-				resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
-			}
-		}
+		MIP_init_gamma_tables();
+		SOIL_parallel_for( MIP_gamma_rows, &job, job.mip_height, threads, min_rows );
+	} else if( flags & SOIL_MIPMAP_NO_SIMD )
+	{
+		SOIL_parallel_for( MIP_box_rows_scalar, &job, job.mip_height, threads, min_rows );
+	} else
+	{
+		SOIL_parallel_for( MIP_box_rows, &job, job.mip_height, threads, min_rows );
 	}
 	return 1;
 }
@@ -433,3 +462,345 @@ RGBE_to_RGBdivA2
 	}
 	return 1;
 }
+
+/********* Box filter workers for mipmap_image_ex *********/
+
+/*	the original per-channel loop, over mipmap rows [j_begin, j_end)	*/
+static void MIP_box_rows_scalar( void *arg, int j_begin, int j_end )
+{
+	const MIP_job *job = (const MIP_job*)arg;
+	const unsigned char* const orig = job->orig;
+	const int width = job->width, height = job->height, channels = job->channels;
+	const int block_size_x = job->block_size_x, block_size_y = job->block_size_y;
+	const int mip_width = job->mip_width;
+	unsigned char* resampled = job->resampled;
+	int i, j, c;
+	for( j = j_begin; j < j_end; ++j )
+	{
+		for( i = 0; i < mip_width; ++i )
+		{
+			for( c = 0; c < channels; ++c )
+			{
+				const int index = (j*block_size_y)*width*channels + (i*block_size_x)*channels + c;
+				int sum_value;
+				int u,v;
+				int u_block = block_size_x;
+				int v_block = block_size_y;
+				int block_area;
+				/*	do a bit of checking so we don't over-run the boundaries
+					(necessary for non-square textures!)	*/
+				if( block_size_x * (i+1) > width )
+				{
+					u_block = width - i*block_size_y;
+				}
+				if( block_size_y * (j+1) > height )
+				{
+					v_block = height - j*block_size_y;
+				}
+				block_area = u_block*v_block;
+				/*	for this pixel, see what the average
+					of all the values in the block are.
+					note: start the sum at the rounding value, not at 0	*/
+				sum_value = block_area >> 1;
+				for( v = 0; v < v_block; ++v )
+				for( u = 0; u < u_block; ++u )
+				{
+					sum_value += orig[index + v*width*channels + u*channels];
+				}
+				resampled[j*mip_width*channels + i*channels + c] = sum_value / block_area;
+			}
+		}
+	}
+}
+
+/*
+	sums[x] (+)= row[x] + next[x], all channels at once; next may be NULL.
+	Two rows fit in 16 bits, so they are added before widening to 32.
+*/
+static void MIP_add_rows( unsigned int *sums, const unsigned char *row, const unsigned char *next, int n, int first )
+{
+	int x = 0;
+#if MIP_HAS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for( ; x + 16 <= n; x += 16 )
+	{
+		__m128i px = _mm_loadu_si128( (const __m128i*)(row + x) );
+		__m128i lo = _mm_unpacklo_epi8( px, zero );
+		__m128i hi = _mm_unpackhi_epi8( px, zero );
+		__m128i s0, s1, s2, s3;
+		if( next )
+		{
+			px = _mm_loadu_si128( (const __m128i*)(next + x) );
+			lo = _mm_add_epi16( lo, _mm_unpacklo_epi8( px, zero ) );
+			hi = _mm_add_epi16( hi, _mm_unpackhi_epi8( px, zero ) );
+		}
+		s0 = _mm_unpacklo_epi16( lo, zero );
+		s1 = _mm_unpackhi_epi16( lo, zero );
+		s2 = _mm_unpacklo_epi16( hi, zero );
+		s3 = _mm_unpackhi_epi16( hi, zero );
+		if( !first )
+		{
+			s0 = _mm_add_epi32( s0, _mm_loadu_si128( (const __m128i*)(sums + x) ) );
+			s1 = _mm_add_epi32( s1, _mm_loadu_si128( (const __m128i*)(sums + x + 4) ) );
+			s2 = _mm_add_epi32( s2, _mm_loadu_si128( (const __m128i*)(sums + x + 8) ) );
+			s3 = _mm_add_epi32( s3, _mm_loadu_si128( (const __m128i*)(sums + x + 12) ) );
+		}
+		_mm_storeu_si128( (__m128i*)(sums + x), s0 );
+		_mm_storeu_si128( (__m128i*)(sums + x + 4), s1 );
+		_mm_storeu_si128( (__m128i*)(sums + x + 8), s2 );
+		_mm_storeu_si128( (__m128i*)(sums + x + 12), s3 );
+	}
+#elif MIP_HAS_NEON
+	for( ; x + 16 <= n; x += 16 )
+	{
+		uint8x16_t px = vld1q_u8( row + x );
+		uint16x8_t lo = vmovl_u8( vget_low_u8( px ) );
+		uint16x8_t hi = vmovl_u8( vget_high_u8( px ) );
+		uint32x4_t s0, s1, s2, s3;
+		if( next )
+		{
+			px = vld1q_u8( next + x );
+			lo = vaddw_u8( lo, vget_low_u8( px ) );
+			hi = vaddw_u8( hi, vget_high_u8( px ) );
+		}
+		s0 = vmovl_u16( vget_low_u16( lo ) );
+		s1 = vmovl_u16( vget_high_u16( lo ) );
+		s2 = vmovl_u16( vget_low_u16( hi ) );
+		s3 = vmovl_u16( vget_high_u16( hi ) );
+		if( !first )
+		{
+			s0 = vaddq_u32( s0, vld1q_u32( sums + x ) );
+			s1 = vaddq_u32( s1, vld1q_u32( sums + x + 4 ) );
+			s2 = vaddq_u32( s2, vld1q_u32( sums + x + 8 ) );
+			s3 = vaddq_u32( s3, vld1q_u32( sums + x + 12 ) );
+		}
+		vst1q_u32( sums + x, s0 );
+		vst1q_u32( sums + x + 4, s1 );
+		vst1q_u32( sums + x + 8, s2 );
+		vst1q_u32( sums + x + 12, s3 );
+	}
+#endif
+	for( ; x < n; ++x )
+	{
+		sums[x] = (first ? 0 : sums[x]) + row[x] + (next ? next[x] : 0);
+	}
+}
+
+/*
+	Same result as MIP_box_rows_scalar (the sums are exact integers, only
+	the order changes): add up the block's rows, then the block's columns.
+*/
+static void MIP_box_rows( void *arg, int j_begin, int j_end )
+{
+	const MIP_job *job = (const MIP_job*)arg;
+	const int width = job->width, channels = job->channels;
+	const int block_size_x = job->block_size_x, block_size_y = job->block_size_y;
+	const size_t row_bytes = (size_t)width * channels;
+	unsigned int *sums = (unsigned int*)malloc( sizeof(unsigned int) * row_bytes );
+	int i, j, c, u, v;
+	if( NULL == sums )
+	{
+		MIP_box_rows_scalar( arg, j_begin, j_end );
+		return;
+	}
+	for( j = j_begin; j < j_end; ++j )
+	{
+		const unsigned char *src = job->orig + (size_t)j * block_size_y * row_bytes;
+		unsigned char *dst = job->resampled + (size_t)j * job->mip_width * channels;
+		int v_block = block_size_y;
+		if( block_size_y * (j+1) > job->height )
+		{
+			v_block = job->height - j*block_size_y;
+		}
+		for( v = 0; v < v_block; v += 2 )
+		{
+			MIP_add_rows( sums, src + v * row_bytes,
+					(v + 1 < v_block) ? src + (v + 1) * row_bytes : NULL,
+					(int)row_bytes, v == 0 );
+		}
+		for( i = 0; i < job->mip_width; ++i, dst += channels )
+		{
+			const unsigned int *s = sums + (size_t)i * block_size_x * channels;
+			unsigned int area, half, shift = 0;
+			int u_block = block_size_x;
+			/*	only when the image is narrower than one block, and then i == 0	*/
+			if( block_size_x * (i+1) > width )
+			{
+				u_block = width - i*block_size_x;
+			}
+			area = (unsigned int)(u_block * v_block);
+			half = area >> 1;
+			/*	power of two areas divide with a shift	*/
+			if( (area & (area - 1)) == 0 )
+			{
+				while( (1u << shift) < area )
+				{
+					++shift;
+				}
+			}
+#if MIP_HAS_SSE2
+			if( (channels == 4) && ((1u << shift) == area) )
+			{
+				int packed;
+				__m128i acc = _mm_set1_epi32( (int)half );
+				for( u = 0; u < u_block; ++u )
+				{
+					acc = _mm_add_epi32( acc, _mm_loadu_si128( (const __m128i*)(s + u * 4) ) );
+				}
+				acc = _mm_srl_epi32( acc, _mm_cvtsi32_si128( (int)shift ) );
+				acc = _mm_packs_epi32( acc, acc );
+				acc = _mm_packus_epi16( acc, acc );
+				packed = _mm_cvtsi128_si32( acc );
+				memcpy( dst, &packed, 4 );
+				continue;
+			}
+#elif MIP_HAS_NEON
+			if( (channels == 4) && ((1u << shift) == area) )
+			{
+				unsigned int total[4];
+				uint32x4_t acc = vdupq_n_u32( half );
+				for( u = 0; u < u_block; ++u )
+				{
+					acc = vaddq_u32( acc, vld1q_u32( s + u * 4 ) );
+				}
+				acc = vshlq_u32( acc, vdupq_n_s32( -(int)shift ) );
+				vst1q_u32( total, acc );
+				for( c = 0; c < 4; ++c )
+				{
+					dst[c] = (unsigned char)total[c];
+				}
+				continue;
+			}
+#endif
+			for( c = 0; c < channels; ++c )
+			{
+				unsigned int sum_value = half;
+				for( u = 0; u < u_block; ++u )
+				{
+					sum_value += s[u * channels + c];
+				}
+				dst[c] = (unsigned char)(((1u << shift) == area) ? (sum_value >> shift) : (sum_value / area));
+			}
+		}
+	}
+	free( sums );
+}
+
+/*	sRGB <-> linear tables for the gamma correct filter	*/
+static float MIP_srgb_to_linear[256];
+static float MIP_alpha_to_linear[256];
+static float MIP_srgb_midpoints[255];
+static int MIP_gamma_ready = 0;
+
+static void MIP_init_gamma_tables( void )
+{
+	int k;
+	if( MIP_gamma_ready )
+	{
+		return;
+	}
+	for( k = 0; k < 256; ++k )
+	{
+		float c = k / 255.0f;
+		MIP_srgb_to_linear[k] = (c <= 0.04045f) ? c / 12.92f : (float)pow( (c + 0.055f) / 1.055f, 2.4f );
+		MIP_alpha_to_linear[k] = c;
+	}
+	/*	a linear value goes back to the sRGB byte whose linear value is closest	*/
+	for( k = 0; k < 255; ++k )
+	{
+		MIP_srgb_midpoints[k] = 0.5f * (MIP_srgb_to_linear[k] + MIP_srgb_to_linear[k+1]);
+	}
+	MIP_gamma_ready = 1;
+}
+
+static unsigned char MIP_linear_to_srgb( float value )
+{
+	int lo = 0, hi = 255;
+	while( lo < hi )
+	{
+		int mid = (lo + hi) >> 1;
+		if( value >= MIP_srgb_midpoints[mid] )
+		{
+			lo = mid + 1;
+		} else
+		{
+			hi = mid;
+		}
+	}
+	return (unsigned char)lo;
+}
+
+/*
+	Averages in linear light: color channels are decoded from sRGB first
+	and encoded back after, alpha (channels 2 and 4) is averaged as is.
+*/
+static void MIP_gamma_rows( void *arg, int j_begin, int j_end )
+{
+	const MIP_job *job = (const MIP_job*)arg;
+	const int width = job->width, channels = job->channels;
+	const int block_size_x = job->block_size_x, block_size_y = job->block_size_y;
+	const int alpha = ((channels & 1) == 0) ? channels - 1 : -1;
+	const size_t row_bytes = (size_t)width * channels;
+	const float *lut[4];
+	float *sums = (float*)malloc( sizeof(float) * row_bytes );
+	int i, j, c, u, v, x;
+	if( NULL == sums )
+	{
+		return;
+	}
+	for( c = 0; c < 4; ++c )
+	{
+		lut[c] = (c == alpha) ? MIP_alpha_to_linear : MIP_srgb_to_linear;
+	}
+	for( j = j_begin; j < j_end; ++j )
+	{
+		const unsigned char *src = job->orig + (size_t)j * block_size_y * row_bytes;
+		unsigned char *dst = job->resampled + (size_t)j * job->mip_width * channels;
+		int v_block = block_size_y;
+		if( block_size_y * (j+1) > job->height )
+		{
+			v_block = job->height - j*block_size_y;
+		}
+		memset( sums, 0, sizeof(float) * row_bytes );
+		for( v = 0; v < v_block; ++v, src += row_bytes )
+		{
+			for( x = 0; x < width; ++x )
+			{
+				for( c = 0; c < channels; ++c )
+				{
+					sums[x*channels + c] += lut[c][src[x*channels + c]];
+				}
+			}
+		}
+		for( i = 0; i < job->mip_width; ++i, dst += channels )
+		{
+			const float *s = sums + (size_t)i * block_size_x * channels;
+			int u_block = block_size_x;
+			double inv_area;
+			if( block_size_x * (i+1) > width )
+			{
+				u_block = width - i*block_size_x;
+			}
+			inv_area = 1.0 / ((double)u_block * v_block);
+			for( c = 0; c < channels; ++c )
+			{
+				double sum_value = 0.0;
+				float value;
+				for( u = 0; u < u_block; ++u )
+				{
+					sum_value += s[u * channels + c];
+				}
+				value = (float)(sum_value * inv_area);
+				if( c == alpha )
+				{
+					int a = (int)(value * 255.0f + 0.5f);
+					dst[c] = (unsigned char)((a > 255) ? 255 : ((a < 0) ? 0 : a));
+				} else
+				{
+					dst[c] = MIP_linear_to_srgb( value );
+				}
+			}
+		}
+	}
+	free( sums );
+}
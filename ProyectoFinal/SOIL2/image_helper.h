@@ -43,6 +43,34 @@ int
 		int block_size_x, int block_size_y
 	);
 
+/**
+	Flags for mipmap_image_ex.  SOIL_MIPMAP_COMPATIBLE gives the same
+	bytes as the original per-channel loop (which SOIL_MIPMAP_NO_SIMD
+	forces), except for blocks over 8M pixels where its int sum used to
+	overflow.  SOIL_MIPMAP_GAMMA_CORRECT averages the color channels in
+	linear light, for sRGB images.
+**/
+enum
+{
+	SOIL_MIPMAP_COMPATIBLE = 0,
+	SOIL_MIPMAP_GAMMA_CORRECT = 1,
+	SOIL_MIPMAP_NO_SIMD = 16
+};
+
+/**
+	mipmap_image with flags and a number of threads
+	(0 = one per core, 1 = this thread only)
+**/
+int
+	mipmap_image_ex
+	(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int block_size_x, int block_size_y,
+		int flags, int threads
+	);
+
 /**
 	This function takes the RGB components of the image
 	and scales each channel from [0,255] to [16,235].
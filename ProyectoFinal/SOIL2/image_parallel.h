@@ -0,0 +1,137 @@
+/*
+	Fork/join helper for the image encoders (image_DXT.c, image_helper.c)
+
+	SOIL_parallel_for splits [0, count) in contiguous ranges and runs them
+	on worker threads, the calling thread taking the first range.  Only
+	meant to be included by the .c files, everything here is static.
+
+	public domain
+*/
+
+#ifndef HEADER_IMAGE_PARALLEL
+#define HEADER_IMAGE_PARALLEL
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+#define SOIL_MAX_THREADS	32
+
+typedef void (*SOIL_range_func)( void *arg, int begin, int end );
+
+typedef struct
+{
+	SOIL_range_func func;
+	void *arg;
+	int begin, end;
+}
+SOIL_range;
+
+static int SOIL_cpu_count( void )
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+	return (n > 0) ? (int)n : 1;
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI SOIL_range_thread( LPVOID range )
+{
+	SOIL_range *r = (SOIL_range*)range;
+	r->func( r->arg, r->begin, r->end );
+	return 0;
+}
+#else
+static void* SOIL_range_thread( void *range )
+{
+	SOIL_range *r = (SOIL_range*)range;
+	r->func( r->arg, r->begin, r->end );
+	return NULL;
+}
+#endif
+
+/*
+	threads: 0 = one per core, 1 = only the calling thread.  No range is
+	made smaller than min_per_thread items; a thread that can not be
+	started has its range done by the caller.
+*/
+static void SOIL_parallel_for(
+		SOIL_range_func func, void *arg,
+		int count, int threads, int min_per_thread )
+{
+	SOIL_range ranges[SOIL_MAX_THREADS];
+#ifdef _WIN32
+	HANDLE handles[SOIL_MAX_THREADS];
+#else
+	pthread_t handles[SOIL_MAX_THREADS];
+#endif
+	int started[SOIL_MAX_THREADS];
+	int n, i;
+	if( count < 1 )
+	{
+		return;
+	}
+	n = (threads > 0) ? threads : SOIL_cpu_count();
+	if( min_per_thread < 1 )
+	{
+		min_per_thread = 1;
+	}
+	if( n > count / min_per_thread )
+	{
+		n = count / min_per_thread;
+	}
+	if( n > SOIL_MAX_THREADS )
+	{
+		n = SOIL_MAX_THREADS;
+	}
+	if( n < 1 )
+	{
+		n = 1;
+	}
+	for( i = 0; i < n; ++i )
+	{
+		ranges[i].func = func;
+		ranges[i].arg = arg;
+		ranges[i].begin = (int)((double)count * i / n);
+		ranges[i].end = (int)((double)count * (i + 1) / n);
+	}
+	for( i = 1; i < n; ++i )
+	{
+#ifdef _WIN32
+		handles[i] = CreateThread( NULL, 0, SOIL_range_thread, &ranges[i], 0, NULL );
+		started[i] = (handles[i] != NULL);
+#else
+		started[i] = (pthread_create( &handles[i], NULL, SOIL_range_thread, &ranges[i] ) == 0);
+#endif
+		if( !started[i] )
+		{
+			func( arg, ranges[i].begin, ranges[i].end );
+		}
+	}
+	func( arg, ranges[0].begin, ranges[0].end );
+	for( i = 1; i < n; ++i )
+	{
+		if( started[i] )
+		{
+#ifdef _WIN32
+			WaitForSingleObject( handles[i], INFINITE );
+			CloseHandle( handles[i] );
+#else
+			pthread_join( handles[i], NULL );
+#endif
+		}
+	}
+}
+
+#endif /* HEADER_IMAGE_PARALLEL	*/
@@ -0,0 +1,753 @@
+#pragma once
+// Escena declarada en un archivo de texto (Scene/galeria.scene): que modelo va donde, con que
+// shader, emision y animacion. Se compila a <escena>.bin (llave: hash del texto) para no volver
+// a interpretarla en cada arranque. Las matrices de mundo y las normales quedan precalculadas en
+// arreglos planos; solo las colocaciones marcadas dyn se recalculan, cuando main las mueve.
+// Enqueue descarta antes de tocar la cola las mallas cuya esfera queda fuera del frustum y,
+// si la escena declara salas y puertas, las de salas que no se ven desde la camara (Portals.h).
+// Con la oclusion activa tambien las que las consultas del cuadro anterior dieron por tapadas.
+// Las colocaciones static se hornean en lotes (StaticBatch.h) con BakeStatic. Las luces de la
+// escena van a ClusteredLights.h; los focos con shadow, ademas, al atlas de sombras (ShadowAtlas.h),
+// que pide a la escena sus casters con MovingCasters y EnqueueCasters.
+//
+// Formato, una instruccion por linea (# comenta):
+//   set NOMBRE expr
+//   place nombre modelo shader [t x y z] [r grados ax ay az] [s x [y z]] [dyn] [emissive r g b fuerza] [anim] [occluder] [static]
+//   room nombre x0 y0 z0 x1 y1 z1          caja de una sala
+//   portal salaA salaB x0 y0 z0 x1 y1 z1   puerta plana entre dos salas (o una sala y "exterior")
+//   spot x y z tx ty tz r g b interior exterior alcance [ambient r g b] [shadow]   foco de (x,y,z) hacia (tx,ty,tz)
+//   point x y z r g b alcance [ambient r g b]                             luz puntual
+// Las transformaciones se aplican en orden, como glm::translate/rotate/scale sobre la misma
+// matriz. dyn marca donde entra la matriz que da main: mundo = antes * dinamica * despues.
+// occluder marca lo grande que tapa (el edificio): no gasta consultas de oclusion.
+// static marca lo que no se mueve nunca: se une con lo parecido en un lote ya en mundo (no va con dyn ni anim).
+// shadow da al foco una casilla del atlas de sombras (hasta LIGHT_SHADOW_TILES, exterior de hasta 75 grados).
+// Los valores aceptan sumas y restas de numeros y variables sin espacios (FLOOR_Y+LIFT+0.5).
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "ClusteredLights.h"
+#include "Culling.h"
+#include "MappedFile.h"
+#include "Occlusion.h"
+#include "Portals.h"
+#include "MeshCache.h"
+#include "Model.h"
+#include "ModelLoader.h"
+#include "RenderQueue.h"
+#include "StaticBatch.h"
+
+// Subir si cambia ScenePlacement, Light o el formato del .bin
+#define SCENE_BIN_VERSION 4u
+
+enum ScenePlacementFlags : uint32_t {
+    SCENE_DYNAMIC = 1,      // main le pasa una matriz cada cuadro (SetDynamic)
+    SCENE_ANIMATED = 2,     // animacion esqueletica: se actualiza en Animate y se dibuja con huesos
+    SCENE_OCCLUDER = 4,     // tapa a otros: no se prueba su oclusion
+    SCENE_STATIC = 8,       // no se mueve: se hornea en un lote estatico
+};
+
+struct ScenePlacement {
+    std::string name, model, shader;
+    glm::mat4 before{ 1.0f }, after{ 1.0f };   // after es identidad salvo en las dinamicas
+    glm::vec4 emissive{ 0.0f };                 // rgb + intensidad
+    uint32_t flags = 0;
+};
+
+class Scene {
+public:
+    // Usa el .bin si corresponde al texto actual; si no, interpreta el texto y regenera el .bin.
+    // Sin variables predefinidas: main pasa las que use el archivo (FLOOR_Y, LIFT, ...).
+    bool Load(const std::string& path, const std::unordered_map<std::string, float>& vars = {}) {
+        MappedFile src;
+        if (!src.Open(path)) { std::cout << "No se pudo abrir la escena " << path << std::endl; return false; }
+        uint64_t hash = HashBytes(src.Data(), src.Size());
+        for (auto& v : vars) { hash = HashBytes(v.first.data(), v.first.size(), hash); hash = HashBytes(&v.second, sizeof(float), hash); }
+
+        placements.clear();
+        lights.clear();
+        cells = PortalVisibility();
+        batches.clear();
+        batched.clear();
+        restoreSources();
+        boundsReady = false;
+        scenePath = path;
+        sourceHash = hash;
+        if (loadBinary(path + ".bin", hash)) compiled = true;
+        else {
+            compiled = false;
+            variables = vars;
+            if (!parse(std::string((const char*)src.Data(), src.Size()), path)) { placements.clear(); return false; }
+            storeBinary(path + ".bin", hash);
+        }
+
+        world.resize(placements.size());
+        normal.resize(placements.size());
+        motion.assign(placements.size(), 0);
+        shaders.assign(placements.size(), nullptr);
+        for (size_t i = 0; i < placements.size(); i++) setWorld(i, placements[i].before * placements[i].after);
+        return true;
+    }
+
+    bool FromBinary() const { return compiled; }
+
+    // Un Model por colocacion; los que comparten archivo comparten asset en ModelRegistry
+    void CreateModels(ModelLoader& loader) {
+        releasedSources.clear();
+        models.clear();
+        boundsReady = false;
+        for (auto& p : placements) models.emplace_back(new Model(loader, p.model.c_str()));
+    }
+
+    void BindShader(const std::string& name, const Shader& s) {
+        for (size_t i = 0; i < placements.size(); i++) if (placements[i].shader == name) shaders[i] = &s;
+    }
+
+    // Une las mallas de las colocaciones static por shader, texturas, emision y sala, ya en
+    // mundo, o las lee de <escena>.batch si la escena y los modelos no cambiaron. Los modelos
+    // que solo aparecen horneados sueltan sus mallas de la GPU para no tenerlas dos veces.
+    // Despues de ModelLoader::Finish: necesita los assets subidos.
+    void BakeStatic() {
+        auto t0 = std::chrono::steady_clock::now();
+        batches.clear();
+        restoreSources();
+        batched.assign(placements.size(), 0);
+        batchStats = StaticBatchStats();
+        boundsReady = false;
+
+        uint64_t key = HashBytes(&sourceHash, sizeof(sourceHash));
+        uint32_t version = STATIC_BATCH_VERSION ^ (MESH_CACHE_VERSION << 16);
+        key = HashBytes(&version, sizeof(version), key);
+        for (size_t i = 0; i < placements.size(); i++) {
+            const ModelAsset* a = bakeable(i);
+            uint64_t h = a ? a->hash : 0;
+            key = HashBytes(&h, sizeof(h), key);
+        }
+
+        std::vector<StaticBatchData> data;
+        std::vector<uint32_t> baked;
+        batchStats.cached = StaticBatchCache::Load(scenePath, key, data, baked);
+        if (!batchStats.cached) {
+            bake(data, baked);
+            StaticBatchCache::Store(scenePath, key, data, baked);
+        }
+        for (uint32_t i : baked) if (i < placements.size()) batched[i] = 1;
+        // Antes de crear los lotes, para que ocupen los huecos que dejan en la arena
+        if (staticOn) releaseSources();
+        for (auto& d : data) {
+            const ModelAsset* a = d.placement < placements.size() ? bakeable(d.placement) : nullptr;
+            if (!a || d.mesh >= a->meshes.size()) continue;
+            StaticBatch b;
+            b.mesh.reset(new Mesh(d.vertices.data(), d.vertices.size(), d.indices.data(), d.indices.size(),
+                nullptr, 0, a->meshes[d.mesh].textures, d.bounds));
+            b.placement = d.placement;
+            b.cell = d.cell;
+            b.occluder = d.occluder != 0;
+            b.sources = d.sources;
+            batches.push_back(std::move(b));
+            batchStats.batches++;
+            batchStats.sources += (int)d.sources;
+            batchStats.vertices += d.vertices.size();
+            batchStats.triangles += d.indices.size() / 3;
+        }
+        MeshArena::Instance().Trim();
+        batchStats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    // false: las colocaciones static se dibujan sueltas, como las demas; sus mallas se vuelven a
+    // subir desde la cache de mallas y se sueltan otra vez al prender los lotes
+    void SetStaticBatching(bool on) {
+        if (on == staticOn) return;
+        staticOn = on;
+        if (on) {
+            releaseSources();
+            MeshArena::Instance().Trim();
+        }
+        else restoreSources();
+        for (size_t e = 0; e < testable.size(); e++) { occlusion.Reset(e); testable[e] = 0; }
+    }
+    const StaticBatchStats& StaticStats() const { return batchStats; }
+
+    // -1 si no existe
+    int Find(const std::string& name) const {
+        for (size_t i = 0; i < placements.size(); i++) if (placements[i].name == name) return (int)i;
+        return -1;
+    }
+
+    // Solo tiene efecto en colocaciones dyn; la misma matriz del cuadro anterior no cuenta como movimiento
+    void SetDynamic(int i, const glm::mat4& m) {
+        if (i < 0 || i >= (int)placements.size() || !(placements[i].flags & SCENE_DYNAMIC)) return;
+        glm::mat4 w = placements[i].before * m * placements[i].after;
+        if (w == world[i]) return;
+        setWorld(i, w);
+        motion[i]++;
+    }
+
+    void Animate(double seconds) {
+        for (size_t i = 0; i < placements.size(); i++)
+            if ((placements[i].flags & SCENE_ANIMATED) && i < models.size()) {
+                models[i]->UpdateAnimation(seconds);
+                motion[i]++;
+            }
+    }
+
+    // Luces declaradas con spot y point, en el orden del archivo
+    const std::vector<Light>& Lights() const { return lights; }
+
+    // Salas y puertas de la escena; main llama Update con la camara antes de Enqueue
+    PortalVisibility& Cells() { return cells; }
+
+    // Con oclusion, Enqueue salta lo que las consultas del cuadro anterior dieron por tapado
+    void SetOcclusion(bool on) {
+        if (on == occlusionOn) return;
+        occlusionOn = on;
+        for (size_t e = 0; e < testable.size(); e++) { occlusion.Reset(e); testable[e] = 0; }
+    }
+    const OcclusionStats& Occlusion() const { return occlusion.Stats(); }
+
+    // Despues de dibujar los opacos: cajas de lo que paso el frustum y las salas, para el proximo
+    // cuadro. boxShader solo necesita el uniform model y el bloque Frame.
+    void TestOcclusion(const Shader& boxShader, const glm::vec3& eye) {
+        if (!occlusionOn || !boundsReady) return;
+        occlusion.Begin(boxShader, eye);
+        for (size_t e = 0; e < testable.size(); e++)
+            if (testable[e]) occlusion.Test(e, boxMin[e], boxMax[e]);
+        occlusion.End();
+    }
+
+    // Agrega las colocaciones con shader; palette es memoria de paso para los huesos.
+    // Con frustum solo entran las mallas que lo tocan (y sin ninguna visible no se calculan huesos);
+    // con portals, ademas, solo las de celdas alcanzadas y que asomen por sus puertas.
+    void Enqueue(RenderQueue& queue, std::vector<glm::mat4>& palette, const Frustum* frustum = nullptr,
+        const PortalVisibility* portals = nullptr) {
+        if (!boundsReady) buildBounds();
+        for (size_t i = 0; i < placements.size(); i++)
+            if (placements[i].flags & SCENE_ANIMATED) updatePoseSpheres(i);
+        if (frustum) culler.Cull(*frustum, visible.data());
+        else std::fill(visible.begin(), visible.end(), (uint8_t)1);
+        if (occlusionOn) occlusion.Collect();
+
+        cullStats = CullStats();
+        if (portals && !portals->Empty()) {
+            cullStats.cells = portals->Cells();
+            cullStats.visibleCells = portals->VisibleCells();
+        }
+        else portals = nullptr;
+        for (size_t i = 0; i < placements.size() && i < models.size(); i++) {
+            const ModelAsset* a = models[i]->Asset();
+            if (!shaders[i] || !a || (staticOn && i < batched.size() && batched[i])) continue;
+            uint8_t* vis = visible.data() + firstEntry[i];
+            bool occluder = (placements[i].flags & SCENE_OCCLUDER) != 0;
+            bool any = false;
+            for (size_t k = 0; k < a->meshes.size(); k++)
+                any |= filter(firstEntry[i] + (uint32_t)k, (size_t)a->meshes[k].Triangles(), occluder, portals);
+            if (!any) continue;
+            int bones = -1;
+            if (placements[i].flags & SCENE_ANIMATED) {
+                models[i]->GetBoneMatrices(palette, 100);
+                bones = queue.AddBones(palette);
+            }
+            queue.Add(*models[i], *shaders[i], world[i], placements[i].emissive, bones, RENDER_PASS_OPAQUE, &normal[i], vis);
+        }
+        // Lotes estaticos: ya estan en mundo, una entrada de culling cada uno
+        for (size_t b = 0; staticOn && b < batches.size(); b++) {
+            const StaticBatch& sb = batches[b];
+            const Shader* s = shaders[sb.placement];
+            if (!s || !filter(firstEntry[placements.size()] + (uint32_t)b, (size_t)sb.mesh->Triangles(), sb.occluder, portals)) continue;
+            queue.AddMesh(*sb.mesh, *s, glm::mat4(1.0f), placements[sb.placement].emissive, RENDER_PASS_OPAQUE, &identityNormal);
+        }
+    }
+
+    // Lo que entro y lo que se descarto en el ultimo Enqueue
+    const CullStats& LastCull() const { return cullStats; }
+
+    // Sombras de un foco en light (ShadowAtlas.h). Firma de lo dyn y anim que toca frustum: 0 si no
+    // hay nada; cambia cuando algo entra, sale o se mueve. Despues de Enqueue (poses al dia).
+    uint64_t MovingCasters(const Frustum& frustum, const glm::vec3& light) {
+        if (!boundsReady) buildBounds();
+        uint64_t h = 0;
+        bool found = false;
+        for (size_t i = 0; i < placements.size() && i < models.size(); i++) {
+            const ModelAsset* a = models[i]->Asset();
+            if (!shaders[i] || !a || !(placements[i].flags & (SCENE_DYNAMIC | SCENE_ANIMATED))) continue;
+            bool any = false;
+            for (size_t k = 0; k < a->meshes.size() && !any; k++) any = caster(firstEntry[i] + (uint32_t)k, frustum, light);
+            if (!any) continue;
+            uint32_t key[2] = { (uint32_t)i, motion[i] };
+            h = found ? HashBytes(key, sizeof(key), h) : HashBytes(key, sizeof(key));
+            found = true;
+        }
+        return h;
+    }
+
+    // Mallas que hacen sombra al foco, con depth (skinnedDepth las de huesos). moving: solo lo dyn
+    // y anim; si no, todo lo demas, con los lotes estaticos si estan activos. Lo que envuelve a la
+    // luz (su lampara, el logo que la emite) no le hace sombra.
+    void EnqueueCasters(RenderQueue& queue, std::vector<glm::mat4>& palette, const Shader& depth, const Shader& skinnedDepth,
+        const Frustum& frustum, const glm::vec3& light, bool moving) {
+        if (!boundsReady) buildBounds();
+        for (size_t i = 0; i < placements.size() && i < models.size(); i++) {
+            const ModelAsset* a = models[i]->Asset();
+            bool dynamic = (placements[i].flags & (SCENE_DYNAMIC | SCENE_ANIMATED)) != 0;
+            if (!shaders[i] || !a || dynamic != moving || (staticOn && i < batched.size() && batched[i])) continue;
+            casters.resize(a->meshes.size());
+            bool any = false;
+            for (size_t k = 0; k < a->meshes.size(); k++) {
+                casters[k] = caster(firstEntry[i] + (uint32_t)k, frustum, light) ? 1 : 0;
+                any |= casters[k] != 0;
+            }
+            if (!any) continue;
+            int bones = -1;
+            bool skinned = (placements[i].flags & SCENE_ANIMATED) != 0;
+            if (skinned) {
+                models[i]->GetBoneMatrices(palette, 100);
+                bones = queue.AddBones(palette);
+            }
+            queue.Add(*models[i], skinned ? skinnedDepth : depth, world[i], glm::vec4(0.0f), bones, RENDER_PASS_OPAQUE, &normal[i], casters.data());
+        }
+        for (size_t b = 0; !moving && staticOn && b < batches.size(); b++)
+            if (shaders[batches[b].placement] && caster(firstEntry[placements.size()] + (uint32_t)b, frustum, light))
+                queue.AddMesh(*batches[b].mesh, depth, glm::mat4(1.0f), glm::vec4(0.0f), RENDER_PASS_OPAQUE, &identityNormal);
+    }
+
+    size_t Size() const { return placements.size(); }
+    const ScenePlacement& Placement(int i) const { return placements[i]; }
+    const glm::mat4& World(int i) const { return world[i]; }
+
+private:
+    std::vector<ScenePlacement> placements;
+    std::vector<Light> lights;
+    std::vector<glm::mat4> world;
+    std::vector<glm::mat3> normal;
+    std::vector<uint32_t> motion;       // cambia cada vez que la colocacion se mueve o se anima
+    std::vector<const Shader*> shaders;
+    std::vector<std::unique_ptr<Model>> models;
+    std::unordered_map<std::string, float> variables;
+    bool compiled = false;
+    std::string scenePath;
+    uint64_t sourceHash = 0;
+
+    // Lotes estaticos; batched[i] = la colocacion i esta dentro de alguno
+    std::vector<StaticBatch> batches;
+    std::vector<uint8_t> batched;
+    std::vector<size_t> releasedSources;     // una colocacion por asset que solto sus mallas
+    bool staticOn = true;
+    StaticBatchStats batchStats;
+    glm::mat3 identityNormal{ 1.0f };
+
+    // Una esfera por malla de cada colocacion; las de la colocacion i empiezan en firstEntry[i] y
+    // las de los lotes estaticos, una por lote, en firstEntry[placements.size()]
+    std::vector<uint32_t> firstEntry;
+    std::vector<glm::vec4> localSpheres;
+    std::vector<uint8_t> visible;
+    std::vector<int> cellOf;            // celda de cada malla; -1 si cruza paredes
+    std::vector<glm::vec3> localMin, localMax, boxMin, boxMax;   // caja de cada malla, local y en mundo
+    std::vector<uint8_t> testable;      // las que se prueban por oclusion este cuadro
+    std::vector<uint8_t> casters;       // mallas de una colocacion que le hacen sombra a un foco
+    SphereCuller culler;
+    PortalVisibility cells;
+    OcclusionCuller occlusion;
+    bool occlusionOn = false;
+    bool boundsReady = false;
+    CullStats cullStats;
+
+    void setWorld(size_t i, const glm::mat4& m) {
+        world[i] = m;
+        normal[i] = glm::transpose(glm::inverse(glm::mat3(m)));
+        if (boundsReady) updateSpheres(i);
+    }
+
+    // Las mallas existen recien despues de ModelLoader::Finish: se arma en el primer Enqueue
+    void buildBounds() {
+        firstEntry.assign(placements.size() + 1, 0);
+        localSpheres.clear(); localMin.clear(); localMax.clear();
+        for (size_t i = 0; i < placements.size(); i++) {
+            firstEntry[i] = (uint32_t)localSpheres.size();
+            const ModelAsset* a = i < models.size() ? models[i]->Asset() : nullptr;
+            if (a) for (auto& m : a->meshes) {
+                localSpheres.push_back(m.Bounds().sphere);
+                localMin.push_back(m.Bounds().min);
+                localMax.push_back(m.Bounds().max);
+            }
+        }
+        firstEntry[placements.size()] = (uint32_t)localSpheres.size();
+        for (auto& b : batches) {
+            localSpheres.push_back(b.mesh->Bounds().sphere);
+            localMin.push_back(b.mesh->Bounds().min);
+            localMax.push_back(b.mesh->Bounds().max);
+        }
+        culler.Resize(localSpheres.size());
+        visible.assign(localSpheres.size(), 1);
+        cellOf.assign(localSpheres.size(), -1);
+        boxMin.assign(localSpheres.size(), glm::vec3(0.0f));
+        boxMax.assign(localSpheres.size(), glm::vec3(0.0f));
+        testable.assign(localSpheres.size(), 0);
+        occlusion.Resize(localSpheres.size());
+        boundsReady = true;
+        for (size_t i = 0; i < placements.size(); i++) updateSpheres(i);
+        for (uint32_t e = firstEntry[placements.size()]; e < localSpheres.size(); e++) {
+            setSphere(e, localSpheres[e]);
+            boxMin[e] = localMin[e]; boxMax[e] = localMax[e];
+        }
+    }
+
+    // Frustum, salas y oclusion de la entrada e; true si se dibuja
+    bool filter(uint32_t e, size_t tris, bool occluder, const PortalVisibility* portals) {
+        int cell = cellOf[e];
+        if (visible[e] && portals && cell >= 0 &&
+            (!portals->Visible(cell) || !SphereInFrustum(portals->CellFrustum(cell), culler.Get(e)))) {
+            visible[e] = 0;
+            cullStats.portalDraws++; cullStats.portalTriangles += tris;
+        }
+        // Solo se prueba lo que paso los otros filtros; lo demas vuelve a entrar como visible
+        testable[e] = 0;
+        if (occlusionOn && !occluder) {
+            if (!visible[e]) occlusion.Reset(e);
+            else {
+                testable[e] = 1;
+                if (occlusion.Occluded(e)) {
+                    visible[e] = 0;
+                    cullStats.occludedDraws++; cullStats.occludedTriangles += tris;
+                }
+            }
+        }
+        if (visible[e]) { cullStats.draws++; cullStats.triangles += tris; return true; }
+        cullStats.culledDraws++; cullStats.culledTriangles += tris;
+        return false;
+    }
+
+    // La entrada e toca el frustum del foco y su caja no envuelve a la luz
+    bool caster(uint32_t e, const Frustum& frustum, const glm::vec3& light) const {
+        if (glm::all(glm::greaterThanEqual(light, boxMin[e])) && glm::all(glm::lessThanEqual(light, boxMax[e]))) return false;
+        return SphereInFrustum(frustum, culler.Get(e));
+    }
+
+    // Asset de la colocacion i si se puede hornear: static, sin dyn ni anim y ya cargado
+    const ModelAsset* bakeable(size_t i) const {
+        if (!(placements[i].flags & SCENE_STATIC) || (placements[i].flags & (SCENE_DYNAMIC | SCENE_ANIMATED)) || i >= models.size())
+            return nullptr;
+        return models[i]->Asset();
+    }
+
+    // Suelta las mallas de los assets cuyas instancias estan todas horneadas; si alguna se dibuja
+    // suelta (dyn, anim, sin static o fuera de la escena) el asset se queda en la GPU
+    void releaseSources() {
+        std::unordered_map<const ModelAsset*, long> uses;
+        for (size_t i = 0; i < placements.size() && i < models.size(); i++)
+            if (batched[i] && models[i]->Asset()) uses[models[i]->Asset()]++;
+        batchStats.releasedBytes = 0;
+        for (size_t i = 0; i < placements.size() && i < models.size(); i++) {
+            auto it = batched[i] ? uses.find(models[i]->Asset()) : uses.end();
+            if (it == uses.end() || it->second != models[i]->AssetUsers()) continue;
+            batchStats.releasedBytes += it->first->memory.Bytes();
+            models[i]->ReleaseGeometry();
+            releasedSources.push_back(i);
+            uses.erase(it);
+        }
+    }
+
+    void restoreSources() {
+        for (size_t i : releasedSources) if (i < models.size()) models[i]->RestoreGeometry();
+        releasedSources.clear();
+    }
+
+    // Agrupa por shader, texturas, emision, sala y occluder; cada grupo es un lote
+    void bake(std::vector<StaticBatchData>& out, std::vector<uint32_t>& baked) {
+        std::vector<uint64_t> groups;
+        for (size_t i = 0; i < placements.size(); i++) {
+            const ModelAsset* a = bakeable(i);
+            if (!a) continue;
+            MappedFile f;
+            ModelData d;
+            if (!Model::ReadCpuData(*a, f, d) || d.views.size() != a->meshes.size()) {
+                std::cout << "No se pudo hornear " << placements[i].name << " (" << a->path << ")" << std::endl;
+                continue;
+            }
+            const ScenePlacement& p = placements[i];
+            baked.push_back((uint32_t)i);
+            uint32_t occluder = (p.flags & SCENE_OCCLUDER) ? 1 : 0;
+            for (size_t k = 0; k < a->meshes.size(); k++) {
+                const Mesh& m = a->meshes[k];
+                int cell = cells.Classify(TransformSphere(m.Bounds().sphere, world[i]));
+                uint64_t g = HashBytes(p.shader.data(), p.shader.size());
+                for (auto& t : m.textures) g = HashBytes(&t.id, sizeof(t.id), g);
+                g = HashBytes(&p.emissive, sizeof(p.emissive), g);
+                g = HashBytes(&cell, sizeof(cell), g);
+                g = HashBytes(&occluder, sizeof(occluder), g);
+                size_t j = std::find(groups.begin(), groups.end(), g) - groups.begin();
+                if (j == groups.size()) {
+                    groups.push_back(g);
+                    out.emplace_back();
+                    out[j].placement = (uint32_t)i;
+                    out[j].mesh = (uint32_t)k;
+                    out[j].cell = cell;
+                    out[j].occluder = occluder;
+                }
+                BakeStaticMesh(d.views[k], world[i], out[j]);
+            }
+        }
+        for (auto& b : out) b.bounds = MeshBounds::FromVertices(b.vertices.data(), b.vertices.size());
+    }
+
+    void updateSpheres(size_t i) {
+        for (uint32_t e = firstEntry[i]; e < firstEntry[i + 1]; e++) {
+            setSphere(e, TransformSphere(localSpheres[e], world[i]));
+            TransformBox(localMin[e], localMax[e], world[i], boxMin[e], boxMax[e]);
+        }
+    }
+
+    void setSphere(uint32_t e, const glm::vec4& s) {
+        culler.Set(e, s);
+        cellOf[e] = cells.Classify(s);
+    }
+
+    // Con esqueleto la malla en reposo no sirve: todas sus mallas usan la esfera de la pose actual
+    void updatePoseSpheres(size_t i) {
+        glm::vec3 lo, hi;
+        if (i >= models.size() || !models[i]->PoseBounds(lo, hi)) return;
+        glm::vec4 s = TransformSphere(glm::vec4((lo + hi) * 0.5f, glm::length(hi - lo) * 0.5f), world[i]);
+        glm::vec3 wlo, whi;
+        TransformBox(lo, hi, world[i], wlo, whi);
+        for (uint32_t e = firstEntry[i]; e < firstEntry[i + 1]; e++) { setSphere(e, s); boxMin[e] = wlo; boxMax[e] = whi; }
+    }
+
+    // ---- Texto ----
+    bool parse(const std::string& text, const std::string& path) {
+        std::istringstream in(text);
+        std::string line;
+        int lineNo = 0;
+        while (std::getline(in, line)) {
+            lineNo++;
+            size_t hash = line.find('#');
+            if (hash != std::string::npos) line.erase(hash);
+            std::istringstream ls(line);
+            std::vector<std::string> tok;
+            for (std::string t; ls >> t; ) tok.push_back(t);
+            if (tok.empty()) continue;
+            if (!parseLine(tok)) {
+                std::cout << "Escena " << path << ":" << lineNo << ": no se entiende '" << line << "'" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool parseLine(const std::vector<std::string>& tok) {
+        if (tok[0] == "set") {
+            float v;
+            if (tok.size() != 3 || !eval(tok[2], v)) return false;
+            variables[tok[1]] = v;
+            return true;
+        }
+        if (tok[0] == "room" || tok[0] == "portal") {
+            float v[6];
+            size_t i = tok[0] == "room" ? 2 : 3;
+            if (tok.size() != i + 6 || !values(tok, i, v, 6)) return false;
+            glm::vec3 a(v[0], v[1], v[2]), b(v[3], v[4], v[5]);
+            if (tok[0] == "room") {
+                // Las salas van antes que las puertas: el indice del exterior es la cantidad de salas
+                if (cells.FindCell(tok[1]) >= 0 || !cells.Portals().empty()) return false;
+                cells.AddRoom(tok[1], a, b);
+                return true;
+            }
+            int ca = cells.FindCell(tok[1]), cb = cells.FindCell(tok[2]);
+            return ca >= 0 && cb >= 0 && ca != cb && cells.AddPortal(ca, cb, a, b);
+        }
+        if (tok[0] == "spot" || tok[0] == "point") return parseLight(tok);
+        if (tok[0] != "place" || tok.size() < 4) return false;
+
+        ScenePlacement p;
+        p.name = tok[1]; p.model = tok[2]; p.shader = tok[3];
+        glm::mat4* m = &p.before;
+        for (size_t i = 4; i < tok.size(); ) {
+            const std::string& op = tok[i++];
+            float v[4];
+            if (op == "t") {
+                if (!values(tok, i, v, 3)) return false;
+                *m = glm::translate(*m, glm::vec3(v[0], v[1], v[2]));
+            }
+            else if (op == "r") {
+                if (!values(tok, i, v, 4)) return false;
+                *m = glm::rotate(*m, glm::radians(v[0]), glm::vec3(v[1], v[2], v[3]));
+            }
+            else if (op == "s") {
+                // uno (uniforme) o tres valores
+                if (!values(tok, i, v, 1)) return false;
+                if (i + 1 < tok.size() && !isKeyword(tok[i]) && !isKeyword(tok[i + 1])) {
+                    if (!values(tok, i, v + 1, 2)) return false;
+                    *m = glm::scale(*m, glm::vec3(v[0], v[1], v[2]));
+                }
+                else *m = glm::scale(*m, glm::vec3(v[0]));
+            }
+            else if (op == "dyn") {
+                if (p.flags & SCENE_DYNAMIC) return false;
+                p.flags |= SCENE_DYNAMIC;
+                m = &p.after;
+            }
+            else if (op == "emissive") {
+                if (!values(tok, i, v, 4)) return false;
+                p.emissive = glm::vec4(v[0], v[1], v[2], v[3]);
+            }
+            else if (op == "anim") p.flags |= SCENE_ANIMATED;
+            else if (op == "occluder") p.flags |= SCENE_OCCLUDER;
+            else if (op == "static") p.flags |= SCENE_STATIC;
+            else return false;
+        }
+        if ((p.flags & SCENE_STATIC) && (p.flags & (SCENE_DYNAMIC | SCENE_ANIMATED))) return false;
+        placements.push_back(p);
+        return true;
+    }
+
+    // Valores fijos y, opcionales al final, ambient r g b y (solo focos) shadow
+    bool parseLight(const std::vector<std::string>& tok) {
+        bool spot = tok[0] == "spot", shadow = false;
+        float v[12], ambient[3] = { 0.0f, 0.0f, 0.0f };
+        size_t i = 1;
+        if (!values(tok, i, v, spot ? 12 : 7)) return false;
+        if (i < tok.size() && tok[i] == "ambient" && !values(tok, ++i, ambient, 3)) return false;
+        if (i < tok.size() && tok[i] == "shadow" && spot) { shadow = true; i++; }
+        if (i != tok.size()) return false;
+        glm::vec3 amb(ambient[0], ambient[1], ambient[2]);
+        if (spot) {
+            glm::vec3 from(v[0], v[1], v[2]), to(v[3], v[4], v[5]);
+            if (from == to || v[9] > v[10] || v[11] <= 0.0f) return false;
+            Light l = MakeSpotLight(from, to, amb, glm::vec3(v[6], v[7], v[8]), v[9], v[10], v[11]);
+            if (shadow) {
+                int used = 0;
+                for (auto& o : lights) if (o.shadow >= 0) used++;
+                if (used >= LIGHT_SHADOW_TILES || v[10] > 75.0f) return false;
+                l.shadow = used;
+            }
+            lights.push_back(l);
+        }
+        else {
+            if (v[6] <= 0.0f) return false;
+            lights.push_back(MakePointLight(glm::vec3(v[0], v[1], v[2]), amb, glm::vec3(v[3], v[4], v[5]), v[6]));
+        }
+        return true;
+    }
+
+    static bool isKeyword(const std::string& t) {
+        return t == "t" || t == "r" || t == "s" || t == "dyn" || t == "emissive" || t == "anim" || t == "occluder" || t == "static";
+    }
+
+    bool values(const std::vector<std::string>& tok, size_t& i, float* out, int n) const {
+        for (int k = 0; k < n; k++, i++)
+            if (i >= tok.size() || isKeyword(tok[i]) || !eval(tok[i], out[k])) return false;
+        return true;
+    }
+
+    // Suma de terminos: numeros o variables con set previo
+    bool eval(const std::string& expr, float& out) const {
+        out = 0.0f;
+        size_t i = 0;
+        while (i < expr.size()) {
+            float sign = 1.0f;
+            if (expr[i] == '+' || expr[i] == '-') { sign = expr[i] == '-' ? -1.0f : 1.0f; i++; }
+            size_t j = i;
+            while (j < expr.size() && expr[j] != '+' && expr[j] != '-') j++;
+            std::string term = expr.substr(i, j - i);
+            if (term.empty()) return false;
+            char* end = nullptr;
+            float v = std::strtof(term.c_str(), &end);
+            if (*end) {
+                auto it = variables.find(term);
+                if (it == variables.end()) return false;
+                v = it->second;
+            }
+            out += sign * v;
+            i = j;
+        }
+        return !expr.empty();
+    }
+
+    // ---- Binario ----
+    struct BinHeader {
+        char magic[8];
+        uint32_t version, count, rooms, portals, lights;
+        uint64_t sourceHash;
+    };
+
+    bool loadBinary(const std::string& bin, uint64_t hash) {
+        MappedFile f;
+        if (!f.Open(bin)) return false;
+        CacheReader r{ f.Data(), f.Size(), 0, true };
+        BinHeader h{};
+        r.Raw(&h, sizeof(h));
+        if (!r.ok || std::memcmp(h.magic, "PFSCENE", 8) != 0 || h.version != SCENE_BIN_VERSION || h.sourceHash != hash) return false;
+        // Los conteos del encabezado contra lo que queda del archivo: si alguno esta corrupto se
+        // vuelve al texto sin reservar nada (registro minimo: strings vacios)
+        size_t placementBytes = 3 * sizeof(uint32_t) + 2 * sizeof(glm::mat4) + sizeof(glm::vec4) + sizeof(uint32_t);
+        size_t roomBytes = sizeof(uint32_t) + 2 * sizeof(glm::vec3);
+        size_t portalBytes = 2 * sizeof(uint32_t) + sizeof(Portal::corners);
+        uint64_t minBytes = (uint64_t)h.count * placementBytes + (uint64_t)h.rooms * roomBytes +
+            (uint64_t)h.portals * portalBytes + (uint64_t)h.lights * sizeof(Light);
+        if (minBytes > f.Size() - r.pos) return false;
+        placements.resize(h.count);
+        for (auto& p : placements) {
+            p.name = r.Str(); p.model = r.Str(); p.shader = r.Str();
+            r.Raw(&p.before, sizeof(glm::mat4));
+            r.Raw(&p.after, sizeof(glm::mat4));
+            r.Raw(&p.emissive, sizeof(glm::vec4));
+            p.flags = r.U32();
+        }
+        for (uint32_t i = 0; i < h.rooms && r.ok; i++) {
+            std::string name = r.Str();
+            glm::vec3 b[2];
+            r.Raw(b, sizeof(b));
+            cells.AddRoom(name, b[0], b[1]);
+        }
+        for (uint32_t i = 0; i < h.portals && r.ok; i++) {
+            Portal p;
+            p.a = (int)r.U32(); p.b = (int)r.U32();
+            r.Raw(p.corners, sizeof(p.corners));
+            // Celdas: las salas y la del exterior, que va despues de ellas
+            if (p.a < 0 || p.b < 0 || p.a > (int)h.rooms || p.b > (int)h.rooms) r.ok = false;
+            else cells.AddPortal(p);
+        }
+        if (h.lights && r.ok) { lights.resize(h.lights); r.Raw(lights.data(), h.lights * sizeof(Light)); }
+        if (!r.ok) { placements.clear(); lights.clear(); cells = PortalVisibility(); }
+        return r.ok;
+    }
+
+    void storeBinary(const std::string& bin, uint64_t hash) const {
+        CacheWriter w;
+        BinHeader h{};
+        std::memcpy(h.magic, "PFSCENE", 8);
+        h.version = SCENE_BIN_VERSION; h.count = (uint32_t)placements.size(); h.sourceHash = hash;
+        h.rooms = (uint32_t)cells.Rooms().size(); h.portals = (uint32_t)cells.Portals().size();
+        h.lights = (uint32_t)lights.size();
+        w.Raw(&h, sizeof(h));
+        for (auto& p : placements) {
+            w.Str(p.name); w.Str(p.model); w.Str(p.shader);
+            w.Raw(&p.before, sizeof(glm::mat4));
+            w.Raw(&p.after, sizeof(glm::mat4));
+            w.Raw(&p.emissive, sizeof(glm::vec4));
+            w.U32(p.flags);
+        }
+        for (auto& room : cells.Rooms()) {
+            w.Str(room.name);
+            w.Raw(&room.min, sizeof(glm::vec3));
+            w.Raw(&room.max, sizeof(glm::vec3));
+        }
+        for (auto& p : cells.Portals()) {
+            w.U32((uint32_t)p.a); w.U32((uint32_t)p.b);
+            w.Raw(p.corners, sizeof(p.corners));
+        }
+        if (!lights.empty()) w.Raw(lights.data(), lights.size() * sizeof(Light));
+        std::ofstream out(bin, std::ios::binary | std::ios::trunc);
+        if (out) out.write(w.buf.data(), (std::streamsize)w.buf.size());
+        if (!out) std::cout << "No se pudo escribir " << bin << std::endl;
+    }
+};
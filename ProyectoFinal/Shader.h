@@ -5,8 +5,21 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// FNV-1a hash of a uniform name. constexpr so names can be hashed by the compiler.
+constexpr uint32_t UniformHash(const char *name, uint32_t h = 2166136261u)
+{
+	return *name ? UniformHash(name + 1, (h ^ (uint8_t)*name) * 16777619u) : h;
+}
+
+// Hash forced at compile time: shader.SetMat4(UNIFORM("model"), m)
+#define UNIFORM(name) (std::integral_constant<uint32_t, UniformHash(name)>::value)
 
 class Shader
 {
@@ -79,6 +92,7 @@ public:
 		glLinkProgram(this->Program);
 		// Print linking errors if any
 		glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
+		linked = success != 0;
 		if (!success)
 		{
 			glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
@@ -86,6 +100,8 @@ public:
 		}
 		//le damos la localidad de color
 		uniformColor = glGetUniformLocation(this->Program, "color");
+		// Cache every active uniform so drawing never has to ask GL for a location
+		reflectUniforms();
 		// Delete the shaders as they're linked into our program now and no longer necessery
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
@@ -97,10 +113,88 @@ public:
 		glUseProgram(this->Program);
 	}
 
+	// False if the program failed to link (e.g. a #version the context does not support)
+	bool Linked() const
+	{
+		return linked;
+	}
+
 	GLuint getColorLocation()
 	{
 		return uniformColor;
 	}
+
+	// Location from the table built at link time; -1 (ignored by glUniform*) if the uniform is not active
+	GLint Location(uint32_t name) const
+	{
+		auto it = uniforms.find(name);
+		return it != uniforms.end() ? it->second : -1;
+	}
+
+	// Connects a uniform block to a fixed binding point; ignored if the program does not declare it
+	void BindUniformBlock(const char *name, GLuint binding) const
+	{
+		GLuint index = glGetUniformBlockIndex(this->Program, name);
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(this->Program, index, binding);
+	}
+
+	// Typed setters for the program currently in use
+	void SetInt(uint32_t name, GLint v) const { glUniform1i(Location(name), v); }
+	void SetFloat(uint32_t name, GLfloat v) const { glUniform1f(Location(name), v); }
+	void SetVec2(uint32_t name, const glm::vec2 &v) const { glUniform2fv(Location(name), 1, &v[0]); }
+	void SetVec3(uint32_t name, const glm::vec3 &v) const { glUniform3fv(Location(name), 1, &v[0]); }
+	void SetVec3(uint32_t name, GLfloat x, GLfloat y, GLfloat z) const { glUniform3f(Location(name), x, y, z); }
+	void SetVec4(uint32_t name, const glm::vec4 &v) const { glUniform4fv(Location(name), 1, &v[0]); }
+	void SetMat3(uint32_t name, const glm::mat3 &m) const { glUniformMatrix3fv(Location(name), 1, GL_FALSE, &m[0][0]); }
+	void SetMat4(uint32_t name, const glm::mat4 &m) const { glUniformMatrix4fv(Location(name), 1, GL_FALSE, &m[0][0]); }
+	void SetMat4Array(uint32_t name, const glm::mat4 *m, GLsizei count) const
+	{
+		if (count > 0)
+			glUniformMatrix4fv(Location(name), count, GL_FALSE, &m[0][0][0]);
+	}
+
+private:
+	std::unordered_map<uint32_t, GLint> uniforms;
+	bool linked = false;
+
+	void addUniform(const std::string &name, GLint location)
+	{
+		auto it = uniforms.emplace(UniformHash(name.c_str()), location).first;
+		if (it->second != location)
+			std::cout << "WARNING::SHADER::UNIFORM_HASH_COLLISION " << name << std::endl;
+	}
+
+	// Arrays are listed once as "name[0]": register "name" and every "name[i]" as well
+	void reflectUniforms()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::string buffer(maxLength > 0 ? maxLength : 1, '\0');
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(this->Program, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, &buffer[0]);
+			std::string name(buffer.c_str(), length);
+			GLint location = glGetUniformLocation(this->Program, name.c_str());
+			if (location < 0)
+				continue;	// uniform block member
+			addUniform(name, location);
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			{
+				std::string base = name.substr(0, name.size() - 3);
+				addUniform(base, location);
+				for (GLint e = 1; e < size; e++)
+				{
+					std::string element = base + "[" + std::to_string(e) + "]";
+					addUniform(element, glGetUniformLocation(this->Program, element.c_str()));
+				}
+			}
+		}
+	}
 };
 
 #endif
\ No newline at end of file
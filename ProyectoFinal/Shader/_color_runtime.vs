@@ -1,7 +1,13 @@
 #version 330 core
 layout (location=0) in vec3 aPos;
 layout (location=1) in vec3 aNormal;
-uniform mat4 model, view, projection;
+uniform mat4 model;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 out vec3 NormalWS;
 void main(){
     mat3 nrmMat = mat3(transpose(inverse(model)));
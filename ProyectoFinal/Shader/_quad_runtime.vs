@@ -2,7 +2,13 @@
 layout (location=0) in vec3 aPos;
 layout (location=1) in vec3 aNormal;
 layout (location=2) in vec2 aTex;
-uniform mat4 model, view, projection;
+uniform mat4 model;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 out vec2 vUV;
 void main(){
     vUV = aTex;
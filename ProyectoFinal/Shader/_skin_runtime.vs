@@ -4,8 +4,16 @@ layout (location=1) in vec3 aNormal;
 layout (location=2) in vec2 aTex;
 layout (location=5) in ivec4 aBoneIDs;
 layout (location=6) in vec4  aWeights;
-uniform mat4 model, view, projection;
+uniform mat4 model;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 uniform mat4 bones[100];
+uniform vec3 uPosScale = vec3(1.0);
+uniform vec3 uPosBias  = vec3(0.0);
 out vec2 TexCoords;
 out vec3 NormalWS;
 out vec3 PosWS;
@@ -18,7 +26,7 @@ void main(){
                aWeights.z*bones[aBoneIDs.z] +
                aWeights.w*bones[aBoneIDs.w];
     }
-    vec4 worldPos = model * (skin * vec4(aPos,1.0));
+    vec4 worldPos = model * (skin * vec4(aPos*uPosScale + uPosBias,1.0));
     PosWS = worldPos.xyz;
     mat3 nrmMat = mat3(transpose(inverse(model))) * mat3(skin);
     NormalWS = normalize(nrmMat * aNormal);
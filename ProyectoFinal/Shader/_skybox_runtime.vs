@@ -1,8 +1,12 @@
 #version 330 core
 layout (location=0) in vec3 aPos;
 out vec3 TexDir;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 void main(){
     mat4 viewNoT = mat4(mat3(view));
     vec4 pos = projection * viewNoT * vec4(aPos,1.0);
@@ -3,11 +3,14 @@ out vec4 FragColor;
 in vec2 TexCoords;
 in vec3 NormalWS;
 uniform sampler2D texture_diffuse1;
+uniform sampler2DArray texture_diffuse_array;
+uniform int uDiffuseLayer = -1;
 uniform vec3 dirLight_direction = vec3(-0.2,-1.0,-0.3);
 uniform vec3 dirLight_ambient   = vec3(0.6,0.6,0.6);
 uniform vec3 dirLight_diffuse   = vec3(0.6,0.6,0.6);
 void main(){
-    vec3 base = texture(texture_diffuse1, TexCoords).rgb;
+    vec3 base = uDiffuseLayer >= 0 ? texture(texture_diffuse_array, vec3(TexCoords, float(uDiffuseLayer))).rgb
+                                   : texture(texture_diffuse1, TexCoords).rgb;
     if(base == vec3(0.0)) base = vec3(0.6);
     vec3 n = normalize(NormalWS);
     float ndl = max(dot(n, normalize(-dirLight_direction)), 0.0);
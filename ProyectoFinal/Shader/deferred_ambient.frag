@@ -0,0 +1,34 @@
+#version 330 core
+// Primer pase de luz del camino diferido: luz direccional y emision sobre todo el G-buffer.
+// Los pixeles sin geometria se quedan con el fondo.
+out vec4 FragColor;
+
+uniform sampler2D gAlbedo;      // rgb: difusa, a: 1 si emite
+uniform sampler2D gNormal;      // rg: normal octaedrica
+uniform sampler2D gEmission;
+uniform sampler2D gDepth;
+
+// Igual que en lighting.frag
+uniform vec3 dirLight_direction = vec3(-0.2,-1.0,-0.3);
+uniform vec3 dirLight_ambient   = vec3(0.6,0.6,0.6);
+uniform vec3 dirLight_diffuse   = vec3(0.6,0.6,0.6);
+
+vec3 OctDecode(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    if (texelFetch(gDepth, p, 0).r >= 1.0) discard;
+    vec4 albedo = texelFetch(gAlbedo, p, 0);
+    vec3 N = OctDecode(texelFetch(gNormal, p, 0).rg);
+    float ndl = max(dot(N, normalize(-dirLight_direction)), 0.0);
+    vec3 color = albedo.rgb * (dirLight_ambient + dirLight_diffuse * ndl);
+    // La emision solo se lee donde la marca dice que hay
+    if (albedo.a > 0.5) color += texelFetch(gEmission, p, 0).rgb;
+    FragColor = vec4(color, 1.0);
+}
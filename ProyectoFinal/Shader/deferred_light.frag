@@ -0,0 +1,92 @@
+#version 330 core
+// Una luz del camino diferido, dibujada con su volumen y sumada con blending. La luz sale del
+// mismo texture buffer que usa lighting.frag (ClusteredLights.h) y la posicion de la profundidad.
+out vec4 FragColor;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform samplerBuffer uLights;
+uniform int uLight;
+uniform mat4 uInvViewProj;
+uniform vec2 uScreenSize;
+
+#define LIGHT_TEXELS 5
+
+// Sombras de los focos, igual que en lighting.frag
+#define SHADOW_TILES 16
+#define SHADOW_LIVE_LAYER 1.0
+layout(std140) uniform Shadows {
+    mat4 shadowMatrix[SHADOW_TILES];
+    vec4 shadowRect[SHADOW_TILES];
+    vec4 shadowParams;
+};
+uniform sampler2DArrayShadow uShadowAtlas;
+
+float Shadow(int tile, vec3 normal, vec3 fragPos, float distance)
+{
+    vec4 p = shadowMatrix[tile] * vec4(fragPos + normal * (shadowParams.y * distance), 1.0);
+    p.xyz /= p.w;
+    vec4 rect = shadowRect[tile];
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++) {
+            vec2 uv = clamp(p.xy + vec2(x, y) * shadowParams.x, rect.xy, rect.zw);
+            lit += texture(uShadowAtlas, vec4(uv, SHADOW_LIVE_LAYER, p.z - shadowParams.z));
+        }
+    return lit / 9.0;
+}
+
+vec3 OctDecode(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+// Igual que CalcLight en lighting.frag
+vec3 CalcLight(int i, vec3 normal, vec3 fragPos, vec3 baseColor)
+{
+    int t = i * LIGHT_TEXELS;
+    vec4 position = texelFetch(uLights, t);
+    vec4 direction = texelFetch(uLights, t + 1);
+    vec4 diffuseColor = texelFetch(uLights, t + 2);
+
+    vec3 toLight = position.xyz - fragPos;
+    float distance = length(toLight);
+    if (distance >= position.w) return vec3(0.0);
+    vec3 lightDir = toLight / distance;
+
+    float intensity = 1.0;
+    if (direction.w > -1.0) {
+        float theta = dot(lightDir, -direction.xyz);
+        float epsilon = diffuseColor.w - direction.w;
+        intensity = clamp((theta - direction.w) / epsilon, 0.0, 1.0);
+        if (intensity <= 0.0) return vec3(0.0);
+    }
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec4 ambientColor = texelFetch(uLights, t + 3);
+    if (diff > 0.0 && ambientColor.w >= 0.0 && shadowParams.w > 0.0) diff *= Shadow(int(ambientColor.w), normal, fragPos, distance);
+
+    vec3 k = texelFetch(uLights, t + 4).xyz;
+    float attenuation = 1.0 / (k.x + k.y * distance + k.z * (distance * distance));
+    float f = distance / position.w;
+    float window = clamp(1.0 - f * f * f * f, 0.0, 1.0);
+    attenuation *= window * window;
+
+    vec3 ambient = ambientColor.rgb * baseColor;
+    vec3 diffuse = diffuseColor.rgb * diff * baseColor;
+
+    return (ambient + diffuse) * attenuation * intensity;
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, p, 0).r;
+    vec4 ndc = vec4(gl_FragCoord.xy / uScreenSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = uInvViewProj * ndc;
+    vec3 N = OctDecode(texelFetch(gNormal, p, 0).rg);
+    FragColor = vec4(CalcLight(uLight, N, world.xyz / world.w, texelFetch(gAlbedo, p, 0).rgb), 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+// Volumen de una luz (cono o esfera) ya llevado a mundo con model (DeferredRenderer.h)
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
+
+void main() {
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,4 @@
+#version 330 core
+// Solo profundidad: atlas de sombras (ShadowAtlas.h) y prepase de profundidad (RenderQueue::DepthPrepass)
+void main() {
+}
@@ -0,0 +1,27 @@
+#version 330 core
+// lighting.vs sin nada mas que la posicion, para los pases de solo profundidad. gl_Position se
+// calcula igual que alli y es invariant en los dos: el color puede dibujarse con GL_EQUAL.
+layout (location=0) in vec3 aPos;
+// Por instancia (Mesh::UploadInstances); solo se leen con uInstanced
+layout (location=7)  in mat4 aInstanceModel;
+
+uniform mat4 model;
+uniform bool uInstanced = false;
+// Compartido por todos los programas (UniformBuffers.h)
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
+// Mallas con posiciones cuantizadas (Mesh::Format().quantizePositions); identidad si no
+uniform vec3 uPosScale = vec3(1.0);
+uniform vec3 uPosBias  = vec3(0.0);
+
+invariant gl_Position;
+
+void main() {
+    mat4 M = uInstanced ? aInstanceModel : model;
+    vec4 worldPos = M * vec4(aPos * uPosScale + uPosBias, 1.0);
+    gl_Position = projection * view * worldPos;
+}
@@ -0,0 +1,35 @@
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+// depth.vs para glMultiDrawElementsIndirect: la misma posicion que lighting_indirect.vs, del
+// mismo SSBO (IndirectDraw.h), para el prepase de profundidad.
+layout (location=0) in vec3 aPos;
+
+// Compartido por todos los programas (UniformBuffers.h)
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
+
+// Igual que IndirectDrawData
+struct DrawData {
+    mat4 model;
+    vec4 normal[3];     // columnas de la matriz normal
+    vec4 emissive;      // rgb ya multiplicado por la intensidad
+    vec4 posScale;      // posiciones cuantizadas: aPos * posScale + posBias
+    vec4 posBias;
+    ivec4 material;     // x: capa de la difusa o -1
+};
+layout(std430, binding = 0) readonly buffer Draws {
+    DrawData draws[];
+};
+uniform int uDrawBase = 0;
+
+invariant gl_Position;
+
+void main() {
+    DrawData d = draws[uDrawBase + gl_DrawIDARB];
+    vec4 worldPos = d.model * vec4(aPos * d.posScale.xyz + d.posBias.xyz, 1.0);
+    gl_Position = projection * view * worldPos;
+}
@@ -0,0 +1,35 @@
+#version 330 core
+// Geometria del camino diferido (DeferredRenderer.h): va con lighting.vs o lighting_indirect.vs y
+// en vez de iluminar guarda difusa, normal y emision. La posicion sale despues de la profundidad.
+layout (location = 0) out vec4 gAlbedo;     // rgb: difusa, a: 1 si la malla emite
+layout (location = 1) out vec4 gNormal;     // rg: normal octaedrica en [0, 1]
+layout (location = 2) out vec3 gEmission;
+
+in vec2 TexCoords;
+in vec3 NormalWS;
+in vec3 PosWS;
+flat in int DiffuseLayer;
+flat in vec3 Emission;
+
+uniform sampler2D texture_diffuse1;
+uniform sampler2DArray texture_diffuse_array;
+
+// Normal unitaria a dos componentes en [-1, 1]
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0) e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e;
+}
+
+void main() {
+    vec3 base = DiffuseLayer >= 0 ? texture(texture_diffuse_array, vec3(TexCoords, float(DiffuseLayer))).rgb
+                                  : texture(texture_diffuse1, TexCoords).rgb;
+    // igual que lighting.frag: sin UV/tex, gris en vez de negro
+    if (base == vec3(0.0)) base = vec3(0.7);
+
+    gAlbedo = vec4(base, any(greaterThan(Emission, vec3(0.0))) ? 1.0 : 0.0);
+    gNormal = vec4(OctEncode(normalize(NormalWS)) * 0.5 + 0.5, 0.0, 0.0);
+    gEmission = Emission;
+}
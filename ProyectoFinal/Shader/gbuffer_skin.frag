@@ -0,0 +1,31 @@
+#version 330 core
+// Geometria del camino diferido para los personajes con esqueleto (va con _skin_runtime.vs)
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec3 gEmission;
+
+in vec2 TexCoords;
+in vec3 NormalWS;
+
+uniform sampler2D texture_diffuse1;
+uniform sampler2DArray texture_diffuse_array;
+uniform int uDiffuseLayer = -1;
+
+// Igual que en gbuffer.frag
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0) e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e;
+}
+
+void main() {
+    vec3 base = uDiffuseLayer >= 0 ? texture(texture_diffuse_array, vec3(TexCoords, float(uDiffuseLayer))).rgb
+                                   : texture(texture_diffuse1, TexCoords).rgb;
+    if (base == vec3(0.0)) base = vec3(0.6);
+
+    gAlbedo = vec4(base, 0.0);
+    gNormal = vec4(OctEncode(normalize(NormalWS)) * 0.5 + 0.5, 0.0, 0.0);
+    gEmission = vec3(0.0);
+}
@@ -4,8 +4,12 @@ layout (location = 0) in vec3 position;
 
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 
 void main()
 {
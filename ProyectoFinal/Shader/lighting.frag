@@ -4,67 +4,114 @@ out vec4 FragColor;
 in vec2 TexCoords;
 in vec3 NormalWS;
 in vec3 PosWS;
+flat in int DiffuseLayer;   // capa de la difusa en texture_diffuse_array o -1 (lighting.vs)
+flat in vec3 Emission;      // emision ya multiplicada por su intensidad
 
 uniform sampler2D texture_diffuse1;
+// Difusa en un arreglo de texturas de su tamano (TextureArrays.h)
+uniform sampler2DArray texture_diffuse_array;
 
 // Luz direccional sencilla
 uniform vec3 dirLight_direction = vec3(-0.2,-1.0,-0.3);
 uniform vec3 dirLight_ambient   = vec3(0.6,0.6,0.6);
 uniform vec3 dirLight_diffuse   = vec3(0.6,0.6,0.6);
 
-// Emisin para objetos que brillan
-uniform vec3 emissiveColor = vec3(0.0, 0.0, 0.0);
-uniform float emissiveStrength = 0.0;
+// Uniforms compartidos (UniformBuffers.h); aqui solo se usa view para la profundidad del cluster
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
 
-// Spotlights
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    
-    float cutOff;
-    float outerCutOff;
-    
-    float constant;
-    float linear;
-    float quadratic;
+// Luces por clusters (ClusteredLights.h). Cada luz ocupa LIGHT_TEXELS vec4 en uLights:
+// posicion y alcance, direccion y coseno exterior (-1: puntual), difusa y coseno interior,
+// ambiente, atenuacion constante/lineal/cuadratica
+#define LIGHT_TEXELS 5
+const ivec3 CLUSTERS = ivec3(16, 9, 24);    // CLUSTER_X, CLUSTER_Y, CLUSTER_Z
+uniform samplerBuffer uLights;
+uniform usamplerBuffer uClusters;           // x: inicio en uLightIndices, y: cuantas
+uniform usamplerBuffer uLightIndices;
+uniform vec4 uClusterScale;                 // xy: clusters por pixel; corte = log(z) * z + w
+uniform bool uLightDebug = false;           // colorea por luces en el cluster
+
+// Sombras de los focos (ShadowAtlas.h): la casilla de cada foco va en el cuarto texel de su luz
+// (-1 sin sombra). Se lee la capa viva del atlas.
+#define SHADOW_TILES 16                     // LIGHT_SHADOW_TILES
+#define SHADOW_LIVE_LAYER 1.0
+layout(std140) uniform Shadows {
+    mat4 shadowMatrix[SHADOW_TILES];        // mundo -> uv del atlas y profundidad
+    vec4 shadowRect[SHADOW_TILES];          // casilla menos medio texel: min xy, max zw
+    vec4 shadowParams;                      // x: texel, y: empuje por normal por metro, z: sesgo, w: 1 si hay sombras
 };
+uniform sampler2DArrayShadow uShadowAtlas;
 
-#define NR_SPOT_LIGHTS 3
-uniform SpotLight spotLights[NR_SPOT_LIGHTS];
+// PCF 3x3 sobre la comparacion filtrada del sampler: 1 iluminado, 0 en sombra
+float Shadow(int tile, vec3 normal, vec3 fragPos, float distance)
+{
+    vec4 p = shadowMatrix[tile] * vec4(fragPos + normal * (shadowParams.y * distance), 1.0);
+    p.xyz /= p.w;
+    vec4 rect = shadowRect[tile];
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++) {
+            vec2 uv = clamp(p.xy + vec2(x, y) * shadowParams.x, rect.xy, rect.zw);
+            lit += texture(uShadowAtlas, vec4(uv, SHADOW_LIVE_LAYER, p.z - shadowParams.z));
+        }
+    return lit / 9.0;
+}
 
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 baseColor)
+vec3 CalcLight(int i, vec3 normal, vec3 fragPos, vec3 baseColor)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
+    int t = i * LIGHT_TEXELS;
+    vec4 position = texelFetch(uLights, t);
+    vec4 direction = texelFetch(uLights, t + 1);
+    vec4 diffuseColor = texelFetch(uLights, t + 2);
     
-    // Spotlight intensity
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    vec3 toLight = position.xyz - fragPos;
+    float distance = length(toLight);
+    if (distance >= position.w) return vec3(0.0);
+    vec3 lightDir = toLight / distance;
     
-    if (intensity <= 0.0) return vec3(0.0);
+    // Spotlight intensity (las puntuales traen coseno exterior -1)
+    float intensity = 1.0;
+    if (direction.w > -1.0) {
+        float theta = dot(lightDir, -direction.xyz);
+        float epsilon = diffuseColor.w - direction.w;
+        intensity = clamp((theta - direction.w) / epsilon, 0.0, 1.0);
+        if (intensity <= 0.0) return vec3(0.0);
+    }
     
-    // Diffuse shading
+    // Diffuse shading; la sombra solo apaga la difusa
     float diff = max(dot(normal, lightDir), 0.0);
+    vec4 ambientColor = texelFetch(uLights, t + 3);
+    if (diff > 0.0 && ambientColor.w >= 0.0 && shadowParams.w > 0.0) diff *= Shadow(int(ambientColor.w), normal, fragPos, distance);
     
-    // Attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    // Attenuation, llevada suave a cero al llegar al alcance
+    vec3 k = texelFetch(uLights, t + 4).xyz;
+    float attenuation = 1.0 / (k.x + k.y * distance + k.z * (distance * distance));
+    float f = distance / position.w;
+    float window = clamp(1.0 - f * f * f * f, 0.0, 1.0);
+    attenuation *= window * window;
     
     // Combine results
-    vec3 ambient = light.ambient * baseColor;
-    vec3 diffuse = light.diffuse * diff * baseColor;
+    vec3 ambient = ambientColor.rgb * baseColor;
+    vec3 diffuse = diffuseColor.rgb * diff * baseColor;
     
-    ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    
-    return (ambient + diffuse);
+    return (ambient + diffuse) * attenuation * intensity;
+}
+
+// Azul (pocas) a rojo (16 o mas)
+vec3 Heat(float t)
+{
+    t = clamp(t, 0.0, 1.0);
+    return t < 0.5 ? mix(vec3(0.0, 0.2, 1.0), vec3(0.0, 1.0, 0.2), t * 2.0)
+                   : mix(vec3(0.0, 1.0, 0.2), vec3(1.0, 0.1, 0.0), t * 2.0 - 1.0);
 }
 
 void main() {
-    vec3 base = texture(texture_diffuse1, TexCoords).rgb;
+    vec3 base = DiffuseLayer >= 0 ? texture(texture_diffuse_array, vec3(TexCoords, float(DiffuseLayer))).rgb
+                                  : texture(texture_diffuse1, TexCoords).rgb;
     // si el modelo no trae UV/tex, evita negro absoluto
     if (base == vec3(0.0)) base = vec3(0.7);
 
@@ -74,14 +121,21 @@ void main() {
 
     vec3 color = base * (dirLight_ambient + dirLight_diffuse * ndl);
     
-    // Agregar spotlights
-    for(int i = 0; i < NR_SPOT_LIGHTS; i++) {
-        color += CalcSpotLight(spotLights[i], N, PosWS, base);
+    // Solo las luces del cluster de este fragmento
+    float depth = -(view * vec4(PosWS, 1.0)).z;
+    ivec3 c = ivec3(ivec2(gl_FragCoord.xy * uClusterScale.xy), int(floor(log(max(depth, 1e-4)) * uClusterScale.z + uClusterScale.w)));
+    c = clamp(c, ivec3(0), CLUSTERS - 1);
+    uvec2 range = texelFetch(uClusters, (c.z * CLUSTERS.y + c.y) * CLUSTERS.x + c.x).xy;
+    for (uint n = 0u; n < range.y; n++) {
+        color += CalcLight(int(texelFetch(uLightIndices, int(range.x + n)).x), N, PosWS, base);
     }
     
     // Agregar emisin (luz propia del objeto)
-    vec3 emission = emissiveColor * emissiveStrength;
-    color += emission;
+    color += Emission;
+    
+    if (uLightDebug) {
+        color = range.y == 0u ? color * 0.25 : mix(color * 0.25, Heat(float(range.y) / 16.0), 0.75);
+    }
     
     FragColor = vec4(color, 1.0);
 }
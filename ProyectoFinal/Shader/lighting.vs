@@ -2,17 +2,45 @@
 layout (location=0) in vec3 aPos;
 layout (location=1) in vec3 aNormal;
 layout (location=2) in vec2 aTex;
+// Por instancia (Mesh::UploadInstances); solo se leen con uInstanced
+layout (location=7)  in mat4 aInstanceModel;
+layout (location=11) in mat3 aInstanceNormal;
 
-uniform mat4 model, view, projection;
+uniform mat4 model;
+uniform bool uInstanced = false;
+// Compartido por todos los programas (UniformBuffers.h)
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
+// Mallas con posiciones cuantizadas (Mesh::Format().quantizePositions); identidad si no
+uniform vec3 uPosScale = vec3(1.0);
+uniform vec3 uPosBias  = vec3(0.0);
+
+// Difusa en un arreglo de texturas (TextureArrays.h; -1 si la malla usa la 2D) y emision del
+// draw. Pasan al fragment shader como varyings para que lighting_indirect.vs las lea del SSBO.
+uniform int uDiffuseLayer = -1;
+uniform vec3 emissiveColor = vec3(0.0, 0.0, 0.0);
+uniform float emissiveStrength = 0.0;
 
 out vec2 TexCoords;
 out vec3 NormalWS;
 out vec3 PosWS;
+flat out int DiffuseLayer;
+flat out vec3 Emission;
+
+// Igual que en depth.vs: el prepase de profundidad deja valores que GL_EQUAL acepta
+invariant gl_Position;
 
 void main() {
-    vec4 worldPos = model * vec4(aPos, 1.0);
+    mat4 M = uInstanced ? aInstanceModel : model;
+    vec4 worldPos = M * vec4(aPos * uPosScale + uPosBias, 1.0);
     PosWS     = worldPos.xyz;
-    NormalWS  = mat3(transpose(inverse(model))) * aNormal;
+    NormalWS  = uInstanced ? aInstanceNormal * aNormal : mat3(transpose(inverse(model))) * aNormal;
     TexCoords = aTex;
+    DiffuseLayer = uDiffuseLayer;
+    Emission  = emissiveColor * emissiveStrength;
     gl_Position = projection * view * worldPos;
 }
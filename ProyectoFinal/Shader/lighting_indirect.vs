@@ -0,0 +1,49 @@
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+// lighting.vs para glMultiDrawElementsIndirect (IndirectDraw.h): cada draw del lote lee su
+// matriz, su capa y su emision del SSBO en uDrawBase + gl_DrawIDARB. Va con lighting.frag.
+layout (location=0) in vec3 aPos;
+layout (location=1) in vec3 aNormal;
+layout (location=2) in vec2 aTex;
+
+// Compartido por todos los programas (UniformBuffers.h)
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 time;
+};
+
+// Igual que IndirectDrawData
+struct DrawData {
+    mat4 model;
+    vec4 normal[3];     // columnas de la matriz normal
+    vec4 emissive;      // rgb ya multiplicado por la intensidad
+    vec4 posScale;      // posiciones cuantizadas: aPos * posScale + posBias
+    vec4 posBias;
+    ivec4 material;     // x: capa de la difusa o -1
+};
+layout(std430, binding = 0) readonly buffer Draws {
+    DrawData draws[];
+};
+uniform int uDrawBase = 0;
+
+out vec2 TexCoords;
+out vec3 NormalWS;
+out vec3 PosWS;
+flat out int DiffuseLayer;
+flat out vec3 Emission;
+
+// Igual que en depth_indirect.vs: el prepase de profundidad deja valores que GL_EQUAL acepta
+invariant gl_Position;
+
+void main() {
+    DrawData d = draws[uDrawBase + gl_DrawIDARB];
+    vec4 worldPos = d.model * vec4(aPos * d.posScale.xyz + d.posBias.xyz, 1.0);
+    PosWS     = worldPos.xyz;
+    NormalWS  = mat3(d.normal[0].xyz, d.normal[1].xyz, d.normal[2].xyz) * aNormal;
+    TexCoords = aTex;
+    DiffuseLayer = d.material.x;
+    Emission  = d.emissive.rgb;
+    gl_Position = projection * view * worldPos;
+}
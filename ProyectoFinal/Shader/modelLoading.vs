@@ -8,9 +8,11 @@ out vec2 TexCoords;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform vec3 uPosScale = vec3(1.0);
+uniform vec3 uPosBias = vec3(0.0);
 
 void main()
 {
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(aPos * uPosScale + uPosBias, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,273 @@
+#pragma once
+// Sombras de los focos marcados shadow en la escena, en un atlas compartido: un arreglo de
+// profundidad de dos capas con SHADOW_TILES_X x SHADOW_TILES_X casillas, una por foco
+// (Light::shadow). En SHADOW_STATIC_LAYER se dibuja una sola vez lo que no se mueve; refrescar un
+// foco es copiar su casilla a SHADOW_LIVE_LAYER y dibujar encima solo lo dyn y anim. Un foco se
+// refresca cuando cambia la firma de lo que se mueve en su frustum (algo entra, sale o se mueve),
+// asi que uno sin nada que se mueva no cuesta nada despues del primer cuadro. Por cuadro se
+// refrescan a lo mas SHADOW_UPDATE_BUDGET focos, de los que toca la camara, primero los que mas
+// llevan esperando. lighting.frag y deferred_light.frag leen la capa viva con PCF 3x3.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Camera.h"
+#include "ClusteredLights.h"
+#include "Culling.h"
+#include "GLState.h"
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "Shader.h"
+#include "TextureArrays.h"
+#include "UniformBuffers.h"
+
+#define SHADOW_ATLAS_SIZE 2048
+#define SHADOW_TILES_X 4                // LIGHT_SHADOW_TILES = SHADOW_TILES_X * SHADOW_TILES_X
+#define SHADOW_TILE_SIZE (SHADOW_ATLAS_SIZE / SHADOW_TILES_X)
+#define SHADOW_STATIC_LAYER 0
+#define SHADOW_LIVE_LAYER 1             // igual que en lighting.frag y deferred_light.frag
+#define SHADOW_ATLAS_UNIT (TEXTURE_ARRAY_UNIT + 4)  // sampler2DArrayShadow uShadowAtlas
+#define SHADOW_UBO_BINDING 1            // bloque Shadows (Frame usa el 0)
+#define SHADOW_UPDATE_BUDGET 4          // casillas que se dibujan por cuadro
+#define SHADOW_NEAR 0.05f               // plano cercano, en fraccion del alcance
+#define SHADOW_FOV_MARGIN 2.0f          // grados de mas sobre el cono exterior
+#define SHADOW_NORMAL_OFFSET 0.004f     // el receptor se empuja por su normal, por metro de distancia a la luz
+#define SHADOW_DEPTH_BIAS 0.0005f
+
+static_assert(SHADOW_TILES_X * SHADOW_TILES_X == LIGHT_SHADOW_TILES, "El atlas no tiene una casilla por Light::shadow");
+
+// layout(std140) uniform Shadows
+struct ShadowBlock {
+    glm::mat4 matrix[LIGHT_SHADOW_TILES];   // mundo -> casilla: uv del atlas y profundidad en [0,1]
+    glm::vec4 rect[LIGHT_SHADOW_TILES];     // uv de la casilla menos medio texel: min xy, max zw
+    glm::vec4 params{ 0.0f };               // x: texel en uv, y: SHADOW_NORMAL_OFFSET, z: SHADOW_DEPTH_BIAS, w: 1 si hay sombras
+};
+static_assert(sizeof(ShadowBlock) == LIGHT_SHADOW_TILES * 80 + 16, "ShadowBlock no coincide con std140");
+
+struct ShadowStats {
+    int tiles = 0;          // focos con sombra
+    int baked = 0;          // casillas estaticas dibujadas este cuadro
+    int updated = 0;        // casillas vivas refrescadas
+    int waiting = 0;        // pedian refresco y se quedaron sin presupuesto
+    int idle = 0;           // sin cambios o fuera de camara: no costaron nada
+    int draws = 0;          // draws al atlas
+    double ms = 0.0;        // CPU
+};
+
+class ShadowAtlas {
+public:
+    static ShadowAtlas& Instance() { static ShadowAtlas s; return s; }
+
+    // Programas de profundidad, atlas y UBO. Llamar con el contexto listo y despues de escribir
+    // Shader/_skin_runtime.vs. Si falla, el bloque queda con w = 0 y los shaders no leen el atlas.
+    bool Init() {
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowBlock), &block, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_UBO_BINDING, ubo);
+
+        depth.reset(new Shader("Shader/depth.vs", "Shader/depth.frag"));
+        skinnedDepth.reset(new Shader("Shader/_skin_runtime.vs", "Shader/depth.frag"));
+        UniformBuffers::Attach(*depth);
+        UniformBuffers::Attach(*skinnedDepth);
+
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT16, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE, 2, 0,
+            GL_DEPTH_COMPONENT, GL_UNSIGNED_SHORT, nullptr);
+        // Comparacion en el sampler: el filtro lineal ya promedia 2x2 resultados
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        GLState::Instance().Invalidate();
+
+        bool ok = true;
+        glGenFramebuffers(2, fbo);
+        for (int layer = 0; layer < 2; layer++) {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo[layer]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, atlas, 0, layer);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            ok = ok && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!ok) std::cout << "Atlas de sombras incompleto; los focos quedan sin sombra" << std::endl;
+        ready = ok;
+        block.params = glm::vec4(1.0f / SHADOW_ATLAS_SIZE, SHADOW_NORMAL_OFFSET, SHADOW_DEPTH_BIAS, ready && enabled ? 1.0f : 0.0f);
+        uploadBlock();
+        return ok;
+    }
+
+    // Bloque Shadows y sampler del programa; una vez, despues de compilarlo
+    static void Attach(const Shader& s) {
+        s.BindUniformBlock("Shadows", SHADOW_UBO_BINDING);
+        glUseProgram(s.Program);
+        s.SetInt(UNIFORM("uShadowAtlas"), SHADOW_ATLAS_UNIT);
+        glUseProgram(0);
+    }
+
+    // Focos con casilla; los que cambiaron vuelven a hornear su parte estatica
+    void SetLights(const std::vector<Light>& lights) {
+        for (Tile& t : tiles) t.used = false;
+        for (const Light& l : lights) {
+            if (l.shadow < 0 || l.shadow >= LIGHT_SHADOW_TILES) continue;
+            Tile& t = tiles[l.shadow];
+            glm::vec3 up = std::fabs(l.direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            glm::mat4 view = glm::lookAt(l.position, l.position + l.direction, up);
+            glm::mat4 projection = glm::perspective(2.0f * std::acos(l.cosOuter) + glm::radians(SHADOW_FOV_MARGIN), 1.0f,
+                l.range * SHADOW_NEAR, l.range);
+            if (view != t.view || projection != t.projection) t.baked = false;
+            t.used = true;
+            t.view = view; t.projection = projection;
+            t.position = l.position;
+            t.range = l.range;
+            t.bounds = LightBounds(l);
+            t.frustum = Camera::ExtractFrustum(projection * view);
+
+            // Del NDC de la luz a la casilla (x, y) y a [0,1] (z)
+            float s = 0.5f / SHADOW_TILES_X, texel = 1.0f / SHADOW_ATLAS_SIZE;
+            glm::vec2 lo = glm::vec2((float)(l.shadow % SHADOW_TILES_X), (float)(l.shadow / SHADOW_TILES_X)) / (float)SHADOW_TILES_X;
+            glm::mat4 bias(1.0f);
+            bias[0][0] = bias[1][1] = s;
+            bias[2][2] = 0.5f;
+            bias[3] = glm::vec4(lo + s, 0.5f, 1.0f);
+            block.matrix[l.shadow] = bias * projection * view;
+            block.rect[l.shadow] = glm::vec4(lo + 0.5f * texel, lo + 2.0f * s - 0.5f * texel);
+        }
+        uploadBlock();
+    }
+
+    // false: los shaders dejan de leer el atlas y Update no dibuja nada
+    void SetEnabled(bool on) {
+        enabled = on;
+        block.params.w = ready && enabled ? 1.0f : 0.0f;
+        uploadBlock();
+    }
+
+    // Con la escena ya movida y despues de Scene::Enqueue (deja al dia las esferas de las poses),
+    // antes de limpiar la pantalla. Deja el framebuffer 0, el viewport de antes, el bloque Frame
+    // de la camara y la capa viva en SHADOW_ATLAS_UNIT.
+    void Update(Scene& scene, const Frustum& camera, std::vector<glm::mat4>& palette) {
+        auto t0 = std::chrono::steady_clock::now();
+        GLState& gl = GLState::Instance();
+        stats = ShadowStats();
+        for (const Tile& t : tiles) if (t.used) stats.tiles++;
+        if (!ready || !enabled) return;
+        int drawsBefore = gl.Stats().draws;
+
+        // Pendientes: sin hornear o con otra firma; las que la camara no ve esperan sin costo
+        candidates.clear();
+        for (int i = 0; i < LIGHT_SHADOW_TILES; i++) {
+            Tile& t = tiles[i];
+            if (!t.used) continue;
+            t.moving = scene.MovingCasters(t.frustum, t.position);
+            if ((t.baked && t.moving == t.signature) || !SphereInFrustum(camera, t.bounds)) { stats.idle++; continue; }
+            candidates.push_back(i);
+        }
+        std::stable_sort(candidates.begin(), candidates.end(), [this](int a, int b) { return tiles[a].age > tiles[b].age; });
+        if (candidates.size() > SHADOW_UPDATE_BUDGET) {
+            for (size_t k = SHADOW_UPDATE_BUDGET; k < candidates.size(); k++) tiles[candidates[k]].age++;
+            stats.waiting = (int)candidates.size() - SHADOW_UPDATE_BUDGET;
+            candidates.resize(SHADOW_UPDATE_BUDGET);
+        }
+
+        if (!candidates.empty()) {
+            FrameBlock saved = UniformBuffers::Instance().Frame();
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glEnable(GL_SCISSOR_TEST);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(1.5f, 2.0f);
+            for (int i : candidates) {
+                Tile& t = tiles[i];
+                GLint x = (i % SHADOW_TILES_X) * SHADOW_TILE_SIZE, y = (i / SHADOW_TILES_X) * SHADOW_TILE_SIZE;
+                glViewport(x, y, SHADOW_TILE_SIZE, SHADOW_TILE_SIZE);
+                glScissor(x, y, SHADOW_TILE_SIZE, SHADOW_TILE_SIZE);
+                UniformBuffers::Instance().SetFrame(t.view, t.projection, t.position, saved.time.x);
+                if (!t.baked) {
+                    glBindFramebuffer(GL_FRAMEBUFFER, fbo[SHADOW_STATIC_LAYER]);
+                    glClear(GL_DEPTH_BUFFER_BIT);
+                    draw(scene, t, false, palette);
+                    t.baked = true;
+                    stats.baked++;
+                }
+                // Lo estatico de fondo y encima lo que se mueve
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[SHADOW_STATIC_LAYER]);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo[SHADOW_LIVE_LAYER]);
+                glBlitFramebuffer(x, y, x + SHADOW_TILE_SIZE, y + SHADOW_TILE_SIZE, x, y, x + SHADOW_TILE_SIZE, y + SHADOW_TILE_SIZE,
+                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, fbo[SHADOW_LIVE_LAYER]);
+                if (t.moving) draw(scene, t, true, palette);
+                t.signature = t.moving;
+                t.age = 0;
+                stats.updated++;
+            }
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glDisable(GL_SCISSOR_TEST);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            UniformBuffers::Instance().SetFrame(saved.view, saved.projection, glm::vec3(saved.cameraPos), saved.time.x);
+        }
+        gl.BindTexture2DArray(SHADOW_ATLAS_UNIT, atlas);
+        stats.draws = gl.Stats().draws - drawsBefore;
+        stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    const ShadowStats& Stats() const { return stats; }
+
+    void Shutdown() {
+        glDeleteFramebuffers(2, fbo);
+        glDeleteTextures(1, &atlas);
+        glDeleteBuffers(1, &ubo);
+        fbo[0] = fbo[1] = atlas = ubo = 0;
+        ready = false;
+        for (Tile& t : tiles) t.baked = false;
+        depth.reset();
+        skinnedDepth.reset();
+    }
+
+private:
+    struct Tile {
+        bool used = false, baked = false;
+        glm::mat4 view{ 1.0f }, projection{ 1.0f };
+        glm::vec3 position{ 0.0f };
+        float range = 1.0f;
+        glm::vec4 bounds{ 0.0f };
+        Frustum frustum{};
+        uint64_t moving = 0, signature = 0;    // firma de lo que se mueve: este cuadro y en la capa viva
+        int age = 0;                            // cuadros que lleva esperando presupuesto
+    };
+
+    Tile tiles[LIGHT_SHADOW_TILES];
+    ShadowBlock block;
+    std::unique_ptr<Shader> depth, skinnedDepth;
+    GLuint atlas = 0, fbo[2] = { 0, 0 }, ubo = 0;
+    bool ready = false, enabled = true;
+    RenderQueue queue;
+    std::vector<int> candidates;
+    ShadowStats stats;
+
+    // Los casters de la casilla con la vista de la luz (ya en el bloque Frame)
+    void draw(Scene& scene, const Tile& t, bool moving, std::vector<glm::mat4>& palette) {
+        queue.Begin(t.view, t.range);
+        scene.EnqueueCasters(queue, palette, *depth, *skinnedDepth, t.frustum, t.position, moving);
+        queue.Flush();
+    }
+
+    void uploadBlock() {
+        if (!ubo) return;
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShadowBlock), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
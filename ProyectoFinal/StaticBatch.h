@@ -0,0 +1,129 @@
+#pragma once
+// Lotes estaticos: las mallas de colocaciones que nunca se mueven se llevan a espacio mundo al
+// cargar y se unen en una sola malla por shader, texturas, emision y sala, que se dibuja con una
+// llamada. El resultado se guarda en <escena>.batch (llave: hash de la escena y de los modelos)
+// para no volver a hornear en cada arranque.
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "MeshCache.h"
+
+// Subir si cambia StaticBatchData, Vertex o el horneado
+#define STATIC_BATCH_VERSION 1u
+
+// Una malla unida, en mundo. placement/mesh es la primera malla que aporto: da shader, emision y
+// texturas (todas las del lote las comparten).
+struct StaticBatchData {
+    uint32_t placement = 0, mesh = 0;
+    int32_t cell = -1;              // sala de todas sus mallas; -1 si cruzan paredes
+    uint32_t occluder = 0;
+    uint32_t sources = 0;           // mallas unidas
+    MeshBounds bounds;
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+};
+
+// Ya subido: lo que dibuja la escena
+struct StaticBatch {
+    std::unique_ptr<Mesh> mesh;
+    uint32_t placement = 0;
+    int cell = -1;
+    bool occluder = false;
+    uint32_t sources = 0;
+};
+
+struct StaticBatchStats {
+    int batches = 0, sources = 0;   // lotes y mallas que se unieron en ellos
+    size_t vertices = 0, triangles = 0;
+    size_t releasedBytes = 0;       // mallas de origen que se sacaron de la GPU (Scene::BakeStatic)
+    bool cached = false;            // leido de <escena>.batch
+    double ms = 0.0;
+};
+
+// Agrega src llevada a mundo con world. Las normales van con la inversa transpuesta, que tambien
+// vale con escalas negativas; si el determinante es negativo (espejo) se invierte el orden de
+// cada triangulo para que las caras frontales sigan siendo las mismas.
+static inline void BakeStaticMesh(const MeshView& src, const glm::mat4& world, StaticBatchData& dst) {
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+    bool mirrored = glm::determinant(glm::mat3(world)) < 0.0f;
+    GLuint base = (GLuint)dst.vertices.size();
+    dst.vertices.reserve(dst.vertices.size() + src.numVertices);
+    for (size_t i = 0; i < src.numVertices; i++) {
+        Vertex v = src.vertices[i];
+        v.Position = glm::vec3(world * glm::vec4(v.Position, 1.0f));
+        glm::vec3 n = normalMatrix * v.Normal;
+        float len = glm::length(n);
+        if (len > 0.0f) v.Normal = n / len;
+        dst.vertices.push_back(v);
+    }
+    dst.indices.reserve(dst.indices.size() + src.numIndices);
+    for (size_t i = 0; i + 2 < src.numIndices; i += 3) {
+        dst.indices.push_back(base + src.indices[i]);
+        dst.indices.push_back(base + src.indices[i + (mirrored ? 2 : 1)]);
+        dst.indices.push_back(base + src.indices[i + (mirrored ? 1 : 2)]);
+    }
+    dst.sources++;
+}
+
+class StaticBatchCache {
+public:
+    static std::string CachePath(const std::string& scene) { return scene + ".batch"; }
+
+    // baked: colocaciones que quedaron dentro de algun lote
+    static bool Load(const std::string& scene, uint64_t key, std::vector<StaticBatchData>& out, std::vector<uint32_t>& baked) {
+        MappedFile f;
+        if (!f.Open(CachePath(scene))) return false;
+        CacheReader r{ f.Data(), f.Size(), 0, true };
+        Header h{};
+        r.Raw(&h, sizeof(h));
+        if (!r.ok || std::memcmp(h.magic, "PFBATCH", 8) != 0 || h.version != STATIC_BATCH_VERSION || h.key != key) return false;
+        r.Vec(baked);
+        // Cada lote ocupa al menos sus campos fijos y los dos conteos; un conteo corrupto vuelve a hornear
+        if (!r.Fits(h.count, 7 * sizeof(uint32_t) + sizeof(MeshBounds))) { baked.clear(); return false; }
+        out.resize(h.count);
+        for (auto& b : out) {
+            b.placement = r.U32(); b.mesh = r.U32(); b.cell = (int32_t)r.U32();
+            b.occluder = r.U32(); b.sources = r.U32();
+            r.Raw(&b.bounds, sizeof(MeshBounds));
+            r.Vec(b.vertices);
+            r.Vec(b.indices);
+            for (GLuint i : b.indices) if (i >= b.vertices.size()) { r.ok = false; break; }
+            if (!r.ok) break;
+        }
+        if (!r.ok) { out.clear(); baked.clear(); }
+        return r.ok;
+    }
+
+    static void Store(const std::string& scene, uint64_t key, const std::vector<StaticBatchData>& batches, const std::vector<uint32_t>& baked) {
+        CacheWriter w;
+        Header h{};
+        std::memcpy(h.magic, "PFBATCH", 8);
+        h.version = STATIC_BATCH_VERSION; h.count = (uint32_t)batches.size(); h.key = key;
+        w.Raw(&h, sizeof(h));
+        w.Vec(baked);
+        for (auto& b : batches) {
+            w.U32(b.placement); w.U32(b.mesh); w.U32((uint32_t)b.cell);
+            w.U32(b.occluder); w.U32(b.sources);
+            w.Raw(&b.bounds, sizeof(MeshBounds));
+            w.Vec(b.vertices);
+            w.Vec(b.indices);
+        }
+        std::string path = CachePath(scene);
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (out) out.write(w.buf.data(), (std::streamsize)w.buf.size());
+        if (!out) std::cout << "No se pudo escribir " << path << std::endl;
+    }
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version, count;
+        uint64_t key;
+    };
+};
@@ -0,0 +1,334 @@
+#pragma once
+// Arreglos de texturas por tamano y formato. Las texturas difusas de los modelos con el mismo
+// ancho, alto y formato (RGBA8, o BC1/BC3 si vienen cocinadas) comparten un GL_TEXTURE_2D_ARRAY
+// y cada una ocupa una capa; la malla pasa su capa al shader (uDiffuseLayer) y muchas mallas se
+// dibujan con la misma textura enlazada. La capa se aparta al pedir la textura (el tamano sale
+// del encabezado, sin decodificar) y los arreglos se crean en Commit, al terminar la carga;
+// TextureStreamer sube luego la imagen a su capa y la textura 2D se queda con el marcador de 1x1.
+// Lo que no se puede agrupar (otros formatos, un tamano que nadie mas tiene o lo pedido
+// despues de Commit) sigue como GL_TEXTURE_2D. Las capas de texturas borradas quedan libres para
+// el siguiente Commit y un arreglo sin capas vivas se borra.
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+#include "CookedTexture.h"
+
+#define TEXTURE_ARRAY_UNIT 8                    // unidad del sampler2DArray; las 2D usan de la 0 en adelante
+#define TEXTURE_ARRAY_MIN_LAYERS 2              // grupos mas chicos se quedan en 2D
+#define TEXTURE_ARRAY_MAX_BYTES (256u << 20)    // tope por arreglo; un grupo mas grande se parte en varios
+
+// Lo que hay que saber de una imagen para apartarle una capa
+struct TextureLayerFormat {
+    int width = 0, height = 0;
+    GLenum format = 0;      // GL_RGBA8 o el formato BC del .dds; 0 si no se puede agrupar
+    int levels = 1;
+
+    bool Valid() const { return format != 0 && width > 0 && height > 0; }
+    bool Compressed() const { return format != 0 && format != GL_RGBA8; }
+    bool operator==(const TextureLayerFormat& o) const {
+        return width == o.width && height == o.height && format == o.format && levels == o.levels;
+    }
+
+    // RGB o RGBA de 8 bits: se guarda como RGBA8 con la cadena completa de mipmaps
+    static TextureLayerFormat Raw(int w, int h) {
+        TextureLayerFormat f;
+        f.width = w; f.height = h; f.format = GL_RGBA8;
+        for (int s = std::max(w, h); s > 1; s /= 2) f.levels++;
+        return f;
+    }
+
+    static TextureLayerFormat Cooked(const CookedTextureInfo& info) {
+        TextureLayerFormat f;
+        f.width = info.levels[0].width; f.height = info.levels[0].height;
+        f.format = info.alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        f.levels = (int)info.levels.size();
+        return f;
+    }
+};
+
+static inline int ReadBigEndian(const unsigned char* p, int bytes) {
+    int v = 0;
+    for (int i = 0; i < bytes; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+// Tamano de un png (RGB/RGBA de 8 bits o con paleta) o jpg (3 componentes) leyendo solo el encabezado.
+// Otro formato o numero de canales deja `out` invalido.
+static inline bool ReadImageHeader(const unsigned char* d, size_t n, TextureLayerFormat& out) {
+    out = TextureLayerFormat();
+    static const unsigned char png[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (n >= 26 && std::equal(png, png + 8, d) && std::equal(d + 12, d + 16, "IHDR")) {
+        int bits = d[24], color = d[25];
+        if ((bits == 8 && (color == 2 || color == 6)) || color == 3) out = TextureLayerFormat::Raw(ReadBigEndian(d + 16, 4), ReadBigEndian(d + 20, 4));
+        return out.Valid();
+    }
+    if (n < 4 || d[0] != 0xFF || d[1] != 0xD8) return false;
+    size_t i = 2;
+    while (i + 4 <= n) {
+        if (d[i] != 0xFF) return false;
+        unsigned char m = d[i + 1];
+        if (m == 0xFF) { i++; continue; }
+        if (m == 0x01 || (m >= 0xD0 && m <= 0xD9)) { i += 2; continue; }
+        size_t len = (size_t)ReadBigEndian(d + i + 2, 2);
+        // SOF0..SOF15 salvo DHT (C4), JPG (C8) y DAC (CC)
+        if (m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+            if (i + 10 > n) return false;
+            if (d[i + 4] == 8 && d[i + 9] == 3) out = TextureLayerFormat::Raw(ReadBigEndian(d + i + 7, 2), ReadBigEndian(d + i + 5, 2));
+            return out.Valid();
+        }
+        i += 2 + len;
+    }
+    return false;
+}
+
+struct TextureArrayStats {
+    int arrays = 0, layers = 0, resident = 0;
+    int freeLayers = 0;         // de layers, las que se soltaron y esperan otra textura
+    int standalone = 0;         // apartadas que terminaron como 2D
+    size_t bytes = 0;
+};
+
+class TextureArrays {
+public:
+    static TextureArrays& Instance() { static TextureArrays t; return t; }
+
+    // Etapa GL, al crear la textura 2D `id`: aparta una capa si el formato se puede agrupar
+    void Reserve(GLuint id, const TextureLayerFormat& f) {
+        if (!f.Valid() || slots.count(id)) return;
+        Slot s; s.format = f;
+        slots[id] = s;
+        uncommitted.push_back(id);
+    }
+
+    // Ubica lo apartado desde el ultimo Commit, agrupado por tamano y formato: primero en capas
+    // libres de arreglos del mismo formato y lo que sobre en arreglos nuevos
+    void Commit() {
+        std::map<std::tuple<int, int, GLenum, int>, std::vector<GLuint>> groups;
+        for (GLuint id : uncommitted) {
+            auto it = slots.find(id);
+            if (it == slots.end()) continue;
+            const TextureLayerFormat& f = it->second.format;
+            groups[std::make_tuple(f.width, f.height, f.format, f.levels)].push_back(id);
+        }
+        uncommitted.clear();
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        for (auto& g : groups) {
+            std::vector<GLuint>& ids = g.second;
+            ids.erase(ids.begin(), ids.begin() + reuse(ids));
+            if (ids.empty()) continue;
+            if (ids.size() < TEXTURE_ARRAY_MIN_LAYERS) {
+                for (GLuint id : ids) slots.erase(id);
+                stats.standalone += (int)ids.size();
+                continue;
+            }
+            const TextureLayerFormat& f = slots[ids[0]].format;
+            size_t perArray = std::max<size_t>(1, TEXTURE_ARRAY_MAX_BYTES / layerBytes(f));
+            perArray = std::min(perArray, (size_t)std::max(1, maxLayers));
+            for (size_t first = 0; first < ids.size(); first += perArray) {
+                int count = (int)std::min(perArray, ids.size() - first);
+                int page = allocate(f, count);
+                for (int k = 0; k < count; k++) {
+                    Slot& s = slots[ids[first + k]];
+                    s.page = page; s.layer = k;
+                }
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    // Donde debe subir TextureStreamer la imagen de `id`; false si va a la textura 2D. Lo que
+    // empieza a subir sin Commit, o no coincide con lo que se aparto, se queda en 2D.
+    bool Destination(GLuint id, const TextureLayerFormat& decoded, GLuint& array, int& layer) {
+        auto it = slots.find(id);
+        if (it == slots.end()) return false;
+        Slot& s = it->second;
+        if (s.page < 0) {
+            uncommitted.erase(std::remove(uncommitted.begin(), uncommitted.end(), id), uncommitted.end());
+            slots.erase(it);
+            stats.standalone++;
+            return false;
+        }
+        if (!(decoded == s.format)) {
+            std::cout << "Textura de " << decoded.width << "x" << decoded.height << " no coincide con su capa; queda en 2D\n";
+            Forget(id);
+            stats.standalone++;
+            return false;
+        }
+        array = pages[s.page].id;
+        layer = s.layer;
+        return true;
+    }
+
+    // La imagen de la capa termino de subir (ok) o ya no va a llegar. Con todas las capas vivas de
+    // un arreglo RGBA8 listas se generan sus mipmaps; mientras tanto se muestrea solo el nivel 0.
+    void Finished(GLuint id, bool ok) {
+        auto it = slots.find(id);
+        if (it == slots.end() || it->second.page < 0 || it->second.done) return;
+        Slot& s = it->second;
+        s.done = true;
+        s.resident = ok;
+        Page& p = pages[s.page];
+        p.finished++;
+        if (ok) { stats.resident++; generation++; }
+        if (p.finished == p.live) generateMipmaps(p);
+    }
+
+    // Para dibujar: arreglo y capa de `id` si su imagen ya esta en la capa
+    bool Resident(GLuint id, GLuint& array, int& layer) const {
+        auto it = slots.find(id);
+        if (it == slots.end() || !it->second.resident) return false;
+        array = pages[it->second.page].id;
+        layer = it->second.layer;
+        return true;
+    }
+
+    // Cambia cada vez que una capa queda lista o se suelta: las mallas vuelven a buscar la suya
+    uint32_t Generation() const { return generation; }
+
+    // VRAM de la capa de `id` (0 si va como 2D)
+    size_t LayerBytes(GLuint id) const {
+        auto it = slots.find(id);
+        return it != slots.end() && it->second.page >= 0 ? pages[it->second.page].layerBytes : 0;
+    }
+
+    // La textura 2D `id` se borro (su id puede volver a salir): la capa queda libre para otra
+    // textura del mismo formato y el arreglo se borra cuando ya no le queda ninguna viva
+    void Forget(GLuint id) {
+        auto it = slots.find(id);
+        if (it == slots.end()) return;
+        const Slot s = it->second;
+        slots.erase(it);
+        if (s.page >= 0) {
+            Page& p = pages[s.page];
+            if (s.done) p.finished--;
+            if (s.resident) stats.resident--;
+            p.freeLayers.push_back(s.layer);
+            stats.freeLayers++;
+            if (--p.live == 0) release(p);
+            else if (!s.done && p.finished == p.live) generateMipmaps(p);
+        }
+        else uncommitted.erase(std::remove(uncommitted.begin(), uncommitted.end(), id), uncommitted.end());
+        generation++;
+    }
+
+    const TextureArrayStats& Stats() const { return stats; }
+
+    void PrintStats() const {
+        std::cout << "Arreglos de texturas: " << stats.arrays << " con " << stats.layers << " capas (" << stats.resident
+            << " listas, " << stats.freeLayers << " libres), " << stats.bytes / (1024 * 1024) << " MB; " << stats.standalone
+            << " texturas quedaron en 2D\n";
+    }
+
+private:
+    struct Slot {
+        TextureLayerFormat format;
+        int page = -1, layer = -1;      // -1 hasta Commit
+        bool done = false, resident = false;
+    };
+    struct Page {
+        GLuint id = 0;                  // 0: borrado, su lugar en pages se reutiliza
+        TextureLayerFormat format;
+        int layers = 0, finished = 0;
+        int live = 0;                   // capas con textura (layers menos las libres)
+        std::vector<int> freeLayers;
+        size_t layerBytes = 0;
+    };
+
+    std::unordered_map<GLuint, Slot> slots;     // llave: id de la textura 2D
+    std::vector<GLuint> uncommitted;
+    std::vector<Page> pages;
+    uint32_t generation = 0;
+    TextureArrayStats stats;
+
+    // Bytes de una capa con todos sus niveles
+    static size_t layerBytes(const TextureLayerFormat& f) {
+        size_t n = 0;
+        int w = f.width, h = f.height;
+        for (int l = 0; l < f.levels; l++) {
+            n += f.Compressed() ? CookedLevelSize(w, h, f.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) : (size_t)w * h * 4;
+            w = std::max(1, w / 2); h = std::max(1, h / 2);
+        }
+        return n;
+    }
+
+    // Pone al frente de ids las que entran en capas libres de arreglos con formato f; devuelve cuantas
+    size_t reuse(const std::vector<GLuint>& ids) {
+        size_t n = 0;
+        const TextureLayerFormat f = slots[ids[0]].format;
+        for (size_t i = 0; i < pages.size() && n < ids.size(); i++) {
+            Page& p = pages[i];
+            if (!p.id || !(p.format == f)) continue;
+            while (!p.freeLayers.empty() && n < ids.size()) {
+                Slot& s = slots[ids[n++]];
+                s.page = (int)i;
+                s.layer = p.freeLayers.back();
+                p.freeLayers.pop_back();
+                p.live++;
+                stats.freeLayers--;
+            }
+        }
+        return n;
+    }
+
+    // RGBA8 con niveles: los mipmaps salen del nivel 0 de todas las capas
+    static void generateMipmaps(const Page& p) {
+        if (p.format.Compressed() || p.format.levels <= 1 || !p.live) return;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, p.id);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, p.format.levels - 1);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    void release(Page& p) {
+        glDeleteTextures(1, &p.id);
+        stats.arrays--;
+        stats.layers -= p.layers;
+        stats.freeLayers -= (int)p.freeLayers.size();
+        stats.bytes -= p.layerBytes * p.layers;
+        p = Page();
+    }
+
+    // Reserva todos los niveles sin datos; las capas llegan despues por TextureStreamer
+    int allocate(const TextureLayerFormat& f, int count) {
+        Page p;
+        p.format = f;
+        p.layers = count;
+        p.live = count;
+        p.layerBytes = layerBytes(f);
+        glGenTextures(1, &p.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, p.id);
+        int w = f.width, h = f.height;
+        for (int l = 0; l < f.levels; l++) {
+            if (f.Compressed()) {
+                GLsizei size = (GLsizei)(CookedLevelSize(w, h, f.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) * count);
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, f.format, w, h, count, 0, size, nullptr);
+            }
+            else glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGBA8, w, h, count, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            w = std::max(1, w / 2); h = std::max(1, h / 2);
+        }
+        // RGBA8: solo el nivel 0 hasta que esten todas las capas (ver Finished)
+        bool mipmapped = f.Compressed() && f.levels > 1;
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mipmapped ? f.levels - 1 : 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        stats.arrays++;
+        stats.layers += count;
+        stats.bytes += p.layerBytes * count;
+        for (size_t i = 0; i < pages.size(); i++) {
+            if (pages[i].id) continue;
+            pages[i] = std::move(p);
+            return (int)i;
+        }
+        pages.push_back(std::move(p));
+        return (int)pages.size() - 1;
+    }
+};
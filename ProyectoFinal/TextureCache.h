@@ -0,0 +1,340 @@
+#pragma once
+// Cache global de texturas direccionada por contenido. Una misma imagen (por ruta o por
+// bytes identicos) se sube a GL una sola vez y se comparte con conteo de referencias
+// entre todos los Model y las texturas que carga main. Las difusas de los modelos pueden
+// terminar en una capa de TextureArrays; su id 2D se sigue usando como llave.
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <iostream>
+#include <GL/glew.h>
+#include "SOIL2/SOIL2.h"
+#include "MappedFile.h"
+#include "CookedTexture.h"
+#include "TextureArrays.h"
+
+// Imagen decodificada en CPU; se puede producir en cualquier hilo y se sube despues en el de GL
+struct DecodedImage {
+    int width = 0, height = 0, channels = 0;
+    GLenum format = GL_RGB;
+    unsigned char* pixels = nullptr;        // memoria de SOIL
+    const unsigned char* raw = nullptr;     // BGRA crudo de una textura embebida (no se libera)
+    // .dds precocinado: niveles BC1/BC3 que se suben tal cual desde el archivo mapeado
+    GLenum compressed = 0;
+    std::vector<CookedLevel> levels;
+    std::unique_ptr<MappedFile> cooked;
+
+    DecodedImage() = default;
+    DecodedImage(const DecodedImage&) = delete;
+    DecodedImage& operator=(const DecodedImage&) = delete;
+    DecodedImage(DecodedImage&& o) noexcept { *this = std::move(o); }
+    DecodedImage& operator=(DecodedImage&& o) noexcept {
+        if (this != &o) {
+            if (pixels) SOIL_free_image_data(pixels);
+            width = o.width; height = o.height; channels = o.channels; format = o.format;
+            pixels = o.pixels; raw = o.raw; o.pixels = nullptr; o.raw = nullptr;
+            compressed = o.compressed; levels = std::move(o.levels); cooked = std::move(o.cooked);
+        }
+        return *this;
+    }
+    ~DecodedImage() { if (pixels) SOIL_free_image_data(pixels); }
+
+    const unsigned char* Data() const { return pixels ? pixels : raw; }
+};
+
+// Sube los niveles de un .dds cocinado a `target` (GL_TEXTURE_2D o una cara de cubemap ya
+// enlazada). Con `flipY` los voltea en una copia; falla si algun nivel no se puede voltear.
+static bool UploadCookedLevels(GLenum target, const unsigned char* file, const CookedTextureInfo& info, bool flipY) {
+    GLenum fmt = info.alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    std::vector<unsigned char> copy;
+    for (size_t i = 0; i < info.levels.size(); i++) {
+        const CookedLevel& l = info.levels[i];
+        const unsigned char* src = file + l.offset;
+        if (flipY) {
+            copy.assign(src, src + l.size);
+            if (!FlipCookedLevelY(copy.data(), l.width, l.height, info.alpha)) return false;
+            src = copy.data();
+        }
+        glCompressedTexImage2D(target, (GLint)i, fmt, l.width, l.height, 0, (GLsizei)l.size, src);
+    }
+    return true;
+}
+
+// Origen de una imagen ya identificada por su hash; los pixeles se decodifican despues
+struct ImageSource {
+    uint64_t hash = 0;
+    bool cooked = false;                    // `file` es el .dds de TextureCooker
+    std::string file;                       // archivo en disco (vacio si es embebida)
+    std::vector<unsigned char> bytes;       // embebida: png/jpg comprimido o BGRA crudo
+    unsigned width = 0, height = 0;         // embebida: height == 0 -> comprimida
+    TextureLayerFormat layer;               // del encabezado; invalido si no puede ir a un arreglo
+};
+
+struct TextureCacheStats {
+    int pathHits = 0, decodes = 0;
+    int hits = 0, misses = 0;
+    size_t bytesSaved = 0;      // VRAM que se habria duplicado
+    size_t bytesResident = 0;
+};
+
+class TextureCache {
+public:
+    static TextureCache& Instance() { static TextureCache c; return c; }
+
+    // Normaliza separadores, "//", "." y ".." para que dos rutas al mismo archivo coincidan
+    static std::string NormalizePath(const std::string& path) {
+        std::vector<std::string> parts;
+        std::string cur;
+        bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+        for (size_t i = 0; i <= path.size(); i++) {
+            char c = i < path.size() ? path[i] : '/';
+            if (c == '/' || c == '\\') {
+                if (cur == "..") { if (!parts.empty() && parts.back() != "..") parts.pop_back(); else parts.push_back(cur); }
+                else if (!cur.empty() && cur != ".") parts.push_back(cur);
+                cur.clear();
+            }
+            else cur += c;
+        }
+        std::string out = absolute ? "/" : "";
+        for (size_t i = 0; i < parts.size(); i++) { if (i) out += '/'; out += parts[i]; }
+        return out;
+    }
+
+    // ---- Etapa CPU (segura para hilos) ----
+    // Solo identifica el contenido (hash del archivo); no decodifica. Si hay un .dds
+    // cocinado al dia se usa ese y el hash de la fuente sale de su encabezado.
+    std::shared_ptr<const ImageSource> LocateFile(const std::string& path) {
+        auto src = std::make_shared<ImageSource>();
+        std::string key = NormalizePath(path);
+        src->file = key;
+        if (CookedTextureFresh(key)) { src->cooked = true; src->file = CookedTexturePath(key); }
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            auto it = pathToHash.find(key);
+            if (it != pathToHash.end()) { stats.pathHits++; src->hash = it->second.hash; src->layer = it->second.layer; return src; }
+        }
+        MappedFile f;
+        if (!f.Open(src->file)) { std::cout << "SOIL fail: " << src->file << "\n"; return nullptr; }
+        CookedTextureInfo info;
+        bool parsed = src->cooked && ParseCookedTexture(f.Data(), f.Size(), info);
+        if (parsed && info.sourceHash) src->hash = info.sourceHash;
+        else src->hash = HashBytes(f.Data(), f.Size());
+        if (parsed) src->layer = TextureLayerFormat::Cooked(info);
+        else if (!src->cooked) ReadImageHeader(f.Data(), f.Size(), src->layer);
+        std::lock_guard<std::mutex> lk(mtx);
+        pathToHash[key] = PathEntry{ src->hash, src->layer };
+        return src;
+    }
+
+    // Textura embebida: `height == 0` indica png/jpg comprimido de `len` bytes, si no es BGRA crudo
+    std::shared_ptr<const ImageSource> LocateEmbedded(const unsigned char* bytes, size_t len, unsigned width, unsigned height) {
+        if (!bytes || !len) return nullptr;
+        auto src = std::make_shared<ImageSource>();
+        src->hash = HashBytes(bytes, len, HashBytes(&height, sizeof(height)));
+        src->bytes.assign(bytes, bytes + len);
+        src->width = width; src->height = height;
+        if (height == 0) ReadImageHeader(bytes, len, src->layer);
+        else src->layer = TextureLayerFormat::Raw((int)width, (int)height);
+        return src;
+    }
+
+    // Decodifica los pixeles de `src` (cualquier hilo). Un BGRA crudo apunta dentro de `src`.
+    bool Decode(const ImageSource& src, DecodedImage& out) {
+        if (src.cooked) {
+            CookedTextureInfo info;
+            out.cooked.reset(new MappedFile());
+            if (out.cooked->Open(src.file) && ParseCookedTexture(out.cooked->Data(), out.cooked->Size(), info)) {
+                out.width = info.levels[0].width; out.height = info.levels[0].height; out.channels = info.alpha ? 4 : 3;
+                out.compressed = info.alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+                out.levels = info.levels;
+                out.raw = out.cooked->Data();
+            }
+        }
+        else if (!src.file.empty()) {
+            MappedFile f;
+            if (f.Open(src.file)) decodeMemory(f.Data(), f.Size(), out);
+        }
+        else if (src.height == 0) decodeMemory(src.bytes.data(), src.bytes.size(), out);
+        else {
+            out.width = (int)src.width; out.height = (int)src.height; out.channels = 4;
+            out.format = GL_BGRA; out.raw = src.bytes.data();
+        }
+        if (!out.Data()) { std::cout << "SOIL fail: " << (src.file.empty() ? "<embebida>" : src.file) << "\n"; return false; }
+        std::lock_guard<std::mutex> lk(mtx);
+        stats.decodes++;
+        return true;
+    }
+
+    // ---- Etapa GL (hilo del contexto) ----
+    // Textura GL para ese contenido. Si aun no estaba residente se crea con un marcador
+    // de 1x1 y `created` avisa que hay que llenarla (ver TextureStreamer).
+    GLuint Acquire(uint64_t hash, bool& created) {
+        std::lock_guard<std::mutex> lk(mtx);
+        created = false;
+        auto it = gpu.find(hash);
+        if (it != gpu.end()) {
+            it->second.refs++;
+            stats.hits++; stats.bytesSaved += it->second.bytes;
+            return it->second.id;
+        }
+        GLuint id = placeholder();
+        addLocked(hash, id);
+        created = true;
+        return id;
+    }
+
+    // La textura ya tiene su imagen final: actualiza los bytes residentes
+    void Uploaded(GLuint id) {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto h = idToHash.find(id);
+        if (h == idToHash.end()) return;
+        GpuEntry& e = gpu[h->second];
+        stats.bytesResident -= e.bytes;
+        e.bytes = gpuBytes(id);
+        stats.bytesResident += e.bytes;
+    }
+
+    // VRAM estimada de una textura de la cache (0 si no es suya), con su capa si la tiene
+    size_t Bytes(GLuint id) {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto h = idToHash.find(id);
+        if (h == idToHash.end()) return 0;
+        auto it = gpu.find(h->second);
+        return it != gpu.end() ? it->second.bytes + TextureArrays::Instance().LayerBytes(id) : 0;
+    }
+
+    // Sigue viva la textura `id` con ese contenido (no se libero mientras se decodificaba)
+    bool IsLive(GLuint id, uint64_t hash) {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto h = idToHash.find(id);
+        return h != idToHash.end() && h->second == hash;
+    }
+
+    // Reemplazo de SOIL_load_OGL_texture para las texturas sueltas de main. Con un .dds
+    // cocinado al dia se sube directo (sin decodificar, mipmapear ni comprimir).
+    GLuint LoadSOIL(const std::string& path, unsigned soilFlags) {
+        std::string key = NormalizePath(path);
+        MappedFile f;
+        CookedTextureInfo info;
+        bool cooked = CookedTextureFresh(key) && f.Open(CookedTexturePath(key)) && ParseCookedTexture(f.Data(), f.Size(), info);
+        if (!cooked && !f.Open(key)) return 0;
+        uint64_t content = (cooked && info.sourceHash) ? info.sourceHash : HashBytes(f.Data(), f.Size());
+        uint64_t h = HashBytes(&soilFlags, sizeof(soilFlags), content);
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = gpu.find(h);
+        if (it != gpu.end()) {
+            it->second.refs++;
+            stats.hits++; stats.bytesSaved += it->second.bytes;
+            return it->second.id;
+        }
+        GLuint id = cooked ? loadCooked(f.Data(), info, (soilFlags & SOIL_FLAG_INVERT_Y) != 0) : 0;
+        if (!id) {
+            // Sin .dds (o no se pudo voltear): camino original de SOIL
+            if (cooked && !f.Open(key)) return 0;
+            id = SOIL_load_OGL_texture_from_memory(f.Data(), (int)f.Size(), SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, soilFlags);
+        }
+        if (!id) return 0;
+        addLocked(h, id);
+        return id;
+    }
+
+    void Release(GLuint id) {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (shutDown) return;
+        auto h = idToHash.find(id);
+        if (h == idToHash.end()) return;
+        auto it = gpu.find(h->second);
+        if (it != gpu.end() && --it->second.refs == 0) {
+            stats.bytesResident -= it->second.bytes;
+            TextureArrays::Instance().Forget(it->second.id);
+            glDeleteTextures(1, &it->second.id);
+            gpu.erase(it);
+            idToHash.erase(h);
+        }
+    }
+
+    // Llamar antes de destruir el contexto: los Release posteriores ya no tocan GL
+    void Shutdown() {
+        std::lock_guard<std::mutex> lk(mtx);
+        shutDown = true;
+    }
+
+    TextureCacheStats Stats() {
+        std::lock_guard<std::mutex> lk(mtx);
+        return stats;
+    }
+
+    void PrintStats() {
+        TextureCacheStats s = Stats();
+        std::cout << "Texturas: " << s.misses << " subidas, " << s.hits << " reutilizadas, "
+            << s.bytesSaved / (1024 * 1024) << " MB ahorrados, " << s.bytesResident / (1024 * 1024) << " MB residentes"
+            << " (" << s.decodes << " decodificadas, " << s.pathHits << " rutas repetidas)\n";
+    }
+
+private:
+    struct GpuEntry { GLuint id = 0; int refs = 0; size_t bytes = 0; };
+    struct PathEntry { uint64_t hash; TextureLayerFormat layer; };
+
+    std::mutex mtx;
+    std::unordered_map<std::string, PathEntry> pathToHash;
+    std::unordered_map<uint64_t, GpuEntry> gpu;
+    std::unordered_map<GLuint, uint64_t> idToHash;
+    TextureCacheStats stats;
+    bool shutDown = false;
+
+    static void decodeMemory(const unsigned char* bytes, size_t len, DecodedImage& out) {
+        out.pixels = SOIL_load_image_from_memory(bytes, (int)len, &out.width, &out.height, &out.channels, SOIL_LOAD_AUTO);
+        static const GLenum formats[] = { GL_RGB, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+        out.format = (out.channels >= 1 && out.channels <= 4) ? formats[out.channels] : GL_RGB;
+    }
+
+    static GLuint loadCooked(const unsigned char* file, const CookedTextureInfo& info, bool flipY) {
+        GLuint id; glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)info.levels.size() - 1);
+        if (!UploadCookedLevels(GL_TEXTURE_2D, file, info, flipY)) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glDeleteTextures(1, &id);
+            return 0;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, info.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return id;
+    }
+
+    // Gris medio mientras llega la imagen real; sin mipmaps para que la textura este completa
+    static GLuint placeholder() {
+        static const unsigned char gray[4] = { 128, 128, 128, 255 };
+        GLuint id; glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return id;
+    }
+
+    void addLocked(uint64_t h, GLuint id) {
+        GpuEntry e; e.id = id; e.refs = 1; e.bytes = gpuBytes(id);
+        gpu[h] = e; idToHash[id] = h;
+        stats.misses++; stats.bytesResident += e.bytes;
+    }
+
+    // Tamano del nivel 0 mas ~1/3 por la cadena de mipmaps
+    static size_t gpuBytes(GLuint id) {
+        GLint w = 0, h = 0, compressed = 0, size = 0;
+        glBindTexture(GL_TEXTURE_2D, id);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        size_t base = compressed ? (size_t)size : (size_t)w * h * 4;
+        return base + base / 3;
+    }
+};
@@ -0,0 +1,254 @@
+#pragma once
+// Streaming de texturas: Acquire devuelve al instante una textura marcador, la imagen se
+// decodifica en hilos de trabajo y Pump() la sube por un anillo de PBOs unas cuantas
+// bandas de filas por cuadro (o niveles, si es un .dds cocinado), sin pasarse del
+// presupuesto de tiempo y bytes. Si la textura tiene capa en TextureArrays la imagen va a esa
+// capa y no a la textura 2D.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <GL/glew.h>
+
+#include "ThreadPool.h"
+#include "TextureCache.h"
+
+#define TEXTURE_STREAM_PBOS 3
+
+struct TextureStreamStats {
+    int requested = 0, uploaded = 0, failed = 0;
+    size_t bytesUploaded = 0;
+    double worstPumpMs = 0.0;   // el cuadro mas caro gastado en subidas
+    double totalMs = 0.0;       // desde la primera peticion hasta que todo quedo residente
+};
+
+class TextureStreamer {
+public:
+    static TextureStreamer& Instance() { static TextureStreamer s; return s; }
+
+    // Presupuesto por cuadro para Pump()
+    void SetBudget(double ms, size_t bytes) { budgetMs = ms; budgetBytes = bytes; }
+
+    // Etapa GL: textura GL para `src`. Si el contenido es nuevo devuelve un marcador y
+    // encola la decodificacion; la misma id pasa a tener la imagen real cuando llegue.
+    // Con layered (difusas de los modelos) se le aparta una capa en un arreglo de su tamano.
+    GLuint Acquire(const std::shared_ptr<const ImageSource>& src, bool layered = false) {
+        if (!src) return 0;
+        bool created = false;
+        GLuint id = TextureCache::Instance().Acquire(src->hash, created);
+        if (created && layered) TextureArrays::Instance().Reserve(id, src->layer);
+        if (created) request(id, src);
+        return id;
+    }
+
+    // Llamar una vez por cuadro en el hilo del contexto
+    void Pump() {
+        if (!pending) return;
+        auto t0 = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (;;) {
+            if (!current) {
+                {
+                    std::lock_guard<std::mutex> lk(mtx);
+                    if (ready.empty()) break;
+                    current = ready.front(); ready.pop_front();
+                }
+                // La textura se libero mientras tanto o fallo la decodificacion
+                if (!TextureCache::Instance().IsLive(current->id, current->hash)) { finishJob(false); continue; }
+                if (!current->image.Data()) { TextureArrays::Instance().Finished(current->id, false); finishJob(false); continue; }
+                begin(*current);
+            }
+
+            Job& j = *current;
+            bool done;
+            if (j.image.compressed) {
+                // .dds cocinado: un nivel de mipmap por paso, ya comprimido
+                bytes += uploadLevel(j);
+                done = j.row == (int)j.image.levels.size();
+            }
+            else {
+                // Banda de filas que cabe en lo que queda del presupuesto (al menos una fila)
+                size_t rowBytes = (size_t)j.image.width * j.image.channels;
+                size_t left = bytes < budgetBytes ? budgetBytes - bytes : 0;
+                int rows = (int)std::min<size_t>(j.image.height - j.row, std::max<size_t>(1, left / rowBytes));
+                uploadRows(j, rows, rowBytes);
+                bytes += rows * rowBytes;
+                done = j.row == j.image.height;
+            }
+
+            if (done) {
+                end(j);
+                finishJob(true);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            if (ms >= budgetMs || bytes >= budgetBytes) break;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        stats.bytesUploaded += bytes;
+        stats.worstPumpMs = std::max(stats.worstPumpMs, ms);
+        if (!pending) {
+            stats.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Streaming de texturas completo: " << stats.uploaded << " en " << stats.totalMs
+                << " ms, peor cuadro " << stats.worstPumpMs << " ms (" << stats.failed << " fallidas)\n";
+            TextureCache::Instance().PrintStats();
+            TextureArrays::Instance().PrintStats();
+        }
+    }
+
+    int Pending() const { return pending; }
+    const TextureStreamStats& Stats() const { return stats; }
+
+    // Antes de destruir el contexto: corta las decodificaciones pendientes y borra los PBOs
+    void Shutdown() {
+        cancel = true;
+        pool.reset();
+        { std::lock_guard<std::mutex> lk(mtx); ready.clear(); }
+        current.reset();
+        if (pbos[0]) glDeleteBuffers(TEXTURE_STREAM_PBOS, pbos);
+        pbos[0] = 0;
+    }
+
+private:
+    struct Job {
+        GLuint id = 0;
+        uint64_t hash = 0;
+        std::shared_ptr<const ImageSource> src;     // mantiene vivo un BGRA crudo
+        DecodedImage image;
+        int row = 0;
+        GLuint array = 0;                           // arreglo y capa de destino; 0 si va a la 2D
+        int layer = 0;
+    };
+
+    double budgetMs = 2.0;
+    size_t budgetBytes = 4 * 1024 * 1024;
+
+    std::unique_ptr<ThreadPool> pool;
+    std::atomic<bool> cancel{ false };
+    std::mutex mtx;
+    std::deque<std::shared_ptr<Job>> ready;     // decodificadas, esperando subida
+    std::shared_ptr<Job> current;               // a medio subir
+    int pending = 0;                            // pedidas y aun no residentes (solo hilo GL)
+    GLuint pbos[TEXTURE_STREAM_PBOS] = {};
+    int nextPbo = 0;
+    std::chrono::steady_clock::time_point start;
+    TextureStreamStats stats;
+
+    void request(GLuint id, const std::shared_ptr<const ImageSource>& src) {
+        if (!pool) pool.reset(new ThreadPool(std::max(2u, std::thread::hardware_concurrency()) - 1));
+        if (!pending && !current) start = std::chrono::steady_clock::now();
+        auto job = std::make_shared<Job>();
+        job->id = id; job->hash = src->hash; job->src = src;
+        pending++; stats.requested++;
+        pool->Submit([this, job] {
+            if (cancel) return;
+            TextureCache::Instance().Decode(*job->src, job->image);
+            std::lock_guard<std::mutex> lk(mtx);
+            ready.push_back(job);
+        });
+    }
+
+    // Reserva el nivel 0 y deja la textura sin mipmaps mientras llegan las bandas. Con capa
+    // en un arreglo no hay nada que reservar: ya existe desde TextureArrays::Commit.
+    void begin(Job& j) {
+        if (TextureArrays::Instance().Destination(j.id, layerFormat(j.image), j.array, j.layer)) return;
+        glBindTexture(GL_TEXTURE_2D, j.id);
+        if (!j.image.compressed) {
+            GLenum internalFmt = (j.image.format == GL_BGRA) ? GL_RGBA : j.image.format;
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFmt, j.image.width, j.image.height, 0, j.image.format, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    }
+
+    // Copia a un PBO del anillo y deja que el driver lo lea sin bloquear este hilo
+    void* mapPbo(size_t n) {
+        if (!pbos[0]) glGenBuffers(TEXTURE_STREAM_PBOS, pbos);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextPbo]);
+        nextPbo = (nextPbo + 1) % TEXTURE_STREAM_PBOS;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, n, nullptr, GL_STREAM_DRAW);   // huerfano: no espera al uso anterior
+        return glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, n, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+
+    size_t uploadLevel(Job& j) {
+        const CookedLevel& l = j.image.levels[j.row];
+        void* dst = mapPbo(l.size);
+        if (dst) {
+            std::memcpy(dst, j.image.Data() + l.offset, l.size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            if (j.array) {
+                glBindTexture(GL_TEXTURE_2D_ARRAY, j.array);
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, j.row, 0, 0, j.layer, l.width, l.height, 1, j.image.compressed, (GLsizei)l.size, (void*)0);
+            }
+            else {
+                glBindTexture(GL_TEXTURE_2D, j.id);
+                glCompressedTexImage2D(GL_TEXTURE_2D, j.row, j.image.compressed, l.width, l.height, 0, (GLsizei)l.size, (void*)0);
+            }
+        }
+        j.row++;
+        return l.size;
+    }
+
+    void uploadRows(Job& j, int rows, size_t rowBytes) {
+        size_t n = rows * rowBytes;
+        void* dst = mapPbo(n);
+        if (dst) {
+            std::memcpy(dst, j.image.Data() + j.row * rowBytes, n);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            if (j.array) {
+                glBindTexture(GL_TEXTURE_2D_ARRAY, j.array);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, j.row, j.layer, j.image.width, rows, 1, j.image.format, GL_UNSIGNED_BYTE, (void*)0);
+            }
+            else {
+                glBindTexture(GL_TEXTURE_2D, j.id);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, j.row, j.image.width, rows, j.image.format, GL_UNSIGNED_BYTE, (void*)0);
+            }
+        }
+        j.row += rows;
+    }
+
+    void end(Job& j) {
+        if (j.array) { TextureArrays::Instance().Finished(j.id, true); return; }
+        glBindTexture(GL_TEXTURE_2D, j.id);
+        if (j.image.compressed) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)j.image.levels.size() - 1);
+        }
+        else {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        TextureCache::Instance().Uploaded(j.id);
+    }
+
+    // Formato de lo que se decodifico, para comparar con lo que se aparto por el encabezado
+    static TextureLayerFormat layerFormat(const DecodedImage& img) {
+        if (img.compressed) {
+            TextureLayerFormat f;
+            f.width = img.width; f.height = img.height; f.format = img.compressed; f.levels = (int)img.levels.size();
+            return f;
+        }
+        if (img.format != GL_RGB && img.format != GL_RGBA && img.format != GL_BGRA) return TextureLayerFormat();
+        return TextureLayerFormat::Raw(img.width, img.height);
+    }
+
+    void finishJob(bool ok) {
+        if (ok) stats.uploaded++;
+        else stats.failed++;
+        current.reset();
+        pending--;
+    }
+};
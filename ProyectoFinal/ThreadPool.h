@@ -0,0 +1,50 @@
+#pragma once
+// Pool de hilos minimo para el trabajo de CPU en segundo plano (carga de modelos y texturas)
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned n) {
+        if (n == 0) n = 1;
+        for (unsigned i = 0; i < n; i++) workers.emplace_back([this] { Run(); });
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool() {
+        { std::lock_guard<std::mutex> lk(mtx); stopping = true; }
+        cv.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    void Submit(std::function<void()> job) {
+        { std::lock_guard<std::mutex> lk(mtx); jobs.push_back(std::move(job)); }
+        cv.notify_one();
+    }
+
+    unsigned Size() const { return (unsigned)workers.size(); }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void Run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lk(mtx);
+                cv.wait(lk, [&] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty()) return;
+                job = std::move(jobs.front()); jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
@@ -0,0 +1,60 @@
+#pragma once
+// UBO std140 compartido por todos los programas con los datos del cuadro (bloque Frame). Queda
+// enlazado a un binding point fijo durante toda la ejecucion; cada shader que declara el bloque
+// lo conecta con UniformBuffers::Attach. Las luces van aparte, en ClusteredLights.h.
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+#define FRAME_UBO_BINDING   0
+
+// layout(std140) uniform Frame
+struct FrameBlock {
+    glm::mat4 view{ 1.0f };
+    glm::mat4 projection{ 1.0f };
+    glm::vec4 cameraPos{ 0.0f };    // xyz
+    glm::vec4 time{ 0.0f };         // x = segundos desde el arranque
+};
+static_assert(sizeof(FrameBlock) == 160, "FrameBlock no coincide con std140");
+
+class UniformBuffers {
+public:
+    static UniformBuffers& Instance() { static UniformBuffers u; return u; }
+
+    // Crea el buffer y lo enlaza a su binding point. Llamar con el contexto listo.
+    void Init() {
+        glGenBuffers(1, &frameUbo);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), &frame, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, frameUbo);
+    }
+
+    // Conecta el bloque Frame del programa con su binding point
+    static void Attach(const Shader& s) {
+        s.BindUniformBlock("Frame", FRAME_UBO_BINDING);
+    }
+
+    // Una vez por cuadro, antes de dibujar
+    void SetFrame(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos, float seconds) {
+        frame.view = view;
+        frame.projection = projection;
+        frame.cameraPos = glm::vec4(cameraPos, 1.0f);
+        frame.time = glm::vec4(seconds, 0.0f, 0.0f, 0.0f);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameBlock), &frame);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // Lo ultimo que se subio; ShadowAtlas lo guarda para volver a la camara
+    const FrameBlock& Frame() const { return frame; }
+
+    void Shutdown() {
+        if (frameUbo) glDeleteBuffers(1, &frameUbo);
+        frameUbo = 0;
+    }
+
+private:
+    GLuint frameUbo = 0;
+    FrameBlock frame;
+};
@@ -0,0 +1,276 @@
+// TextureCooker: convierte las texturas de Models/ y Textures/ a .dds BC1 (opacas) o BC3
+// (con alfa) con la cadena completa de mipmaps, junto a cada imagen original. El juego
+// los carga directo si estan al dia (ver CookedTexture.h). Se ejecuta desde ProyectoFinal:
+//
+//     TextureCooker [--force] [--fast | --hq] [--gamma] [carpeta...]
+//     TextureCooker --bench [imagen]
+//
+// Sin carpetas cocina Models y Textures. Sin --force salta las que ya estan al dia.
+// --fast y --hq cambian el modo del codificador DXT (por omision el compatible, que da
+// los mismos bits que siempre). --gamma promedia los mipmaps en espacio lineal en vez
+// de sobre los valores sRGB. --bench mide el codificador y los mipmaps en megapixeles
+// por segundo y los compara con el camino escalar de siempre.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SOIL2/SOIL2.h"
+#include "SOIL2/image_helper.h"
+#include "CookedTexture.h"
+
+namespace fs = std::filesystem;
+
+static bool IsImage(const fs::path& p) {
+    std::string ext = p.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" || ext == ".bmp";
+}
+
+struct CookStats {
+    int cooked = 0, skipped = 0, failed = 0;
+    size_t rawBytes = 0;        // lo que ocuparia en VRAM como RGBA8 con mipmaps
+    size_t cookedBytes = 0;
+};
+
+// Cadena de mipmaps con el filtro de caja de SOIL, comprimida nivel por nivel
+static bool CookTexture(const std::string& src, int mode, int mipFlags, CookStats& stats) {
+    MappedFile f;
+    if (!f.Open(src)) return false;
+    uint64_t hash = HashBytes(f.Data(), f.Size());
+
+    int w = 0, h = 0, channels = 0;
+    unsigned char* img = SOIL_load_image_from_memory(f.Data(), (int)f.Size(), &w, &h, &channels, SOIL_LOAD_RGBA);
+    if (!img) { std::cout << "  no se pudo leer: " << SOIL_last_result() << "\n"; return false; }
+
+    bool alpha = false;
+    for (size_t i = 3; i < (size_t)w * h * 4 && !alpha; i += 4) alpha = img[i] < 255;
+
+    std::vector<std::vector<unsigned char>> levels;
+    std::vector<unsigned char> mip((size_t)std::max(1, w / 2) * std::max(1, h / 2) * 4);
+    size_t raw = 0, cooked = 0;
+    for (int level = 0; ; level++) {
+        int lw = std::max(1, w >> level), lh = std::max(1, h >> level);
+        const unsigned char* pixels = img;
+        if (level > 0) {
+            mipmap_image_ex(img, w, h, 4, mip.data(), 1 << level, 1 << level, mipFlags, 0);
+            pixels = mip.data();
+        }
+        int size = 0;
+        unsigned char* dxt = alpha ? convert_image_to_DXT5_ex(pixels, lw, lh, 4, mode, 0, &size)
+            : convert_image_to_DXT1_ex(pixels, lw, lh, 4, mode, 0, &size);
+        if (!dxt) { SOIL_free_image_data(img); return false; }
+        levels.emplace_back(dxt, dxt + size);
+        free(dxt);
+        raw += (size_t)lw * lh * 4;
+        cooked += (size_t)size;
+        if (lw == 1 && lh == 1) break;
+    }
+    SOIL_free_image_data(img);
+
+    if (!WriteCookedTexture(CookedTexturePath(src), w, h, alpha, hash, levels)) return false;
+    stats.rawBytes += raw;
+    stats.cookedBytes += cooked;
+    std::cout << "  " << w << "x" << h << (alpha ? " BC3 " : " BC1 ") << levels.size() << " niveles, "
+        << raw / 1024 << " KB -> " << cooked / 1024 << " KB\n";
+    return true;
+}
+
+// Descomprime BC1/BC3 como lo haria la GPU, para medir el error de cada modo
+static std::vector<unsigned char> DecodeDXT(const unsigned char* blocks, int w, int h, bool alpha) {
+    std::vector<unsigned char> out((size_t)w * h * 4);
+    int bw = (w + 3) / 4, bh = (h + 3) / 4;
+    for (int by = 0; by < bh; by++) for (int bx = 0; bx < bw; bx++) {
+        const unsigned char* b = blocks + ((size_t)by * bw + bx) * (alpha ? 16 : 8);
+        int a[8] = { 255, 255, 255, 255, 255, 255, 255, 255 };
+        uint64_t abits = 0;
+        if (alpha) {
+            a[0] = b[0]; a[1] = b[1];
+            for (int k = 2; k < 8; k++) {
+                if (a[0] > a[1]) a[k] = ((8 - k) * a[0] + (k - 1) * a[1]) / 7;
+                else a[k] = k < 6 ? ((6 - k) * a[0] + (k - 1) * a[1]) / 5 : (k == 6 ? 0 : 255);
+            }
+            for (int k = 0; k < 6; k++) abits |= (uint64_t)b[2 + k] << (8 * k);
+            b += 8;
+        }
+        int c0 = b[0] | (b[1] << 8), c1 = b[2] | (b[3] << 8), pal[4][3];
+        for (int k = 0; k < 2; k++) {
+            int c = k ? c1 : c0, r = (c >> 11) & 31, g = (c >> 5) & 63, bl = c & 31;
+            pal[k][0] = (r << 3) | (r >> 2); pal[k][1] = (g << 2) | (g >> 4); pal[k][2] = (bl << 3) | (bl >> 2);
+        }
+        for (int j = 0; j < 3; j++) {
+            if (c0 > c1 || alpha) { pal[2][j] = (2 * pal[0][j] + pal[1][j]) / 3; pal[3][j] = (pal[0][j] + 2 * pal[1][j]) / 3; }
+            else { pal[2][j] = (pal[0][j] + pal[1][j]) / 2; pal[3][j] = 0; }
+        }
+        unsigned bits = b[4] | (b[5] << 8) | (b[6] << 16) | ((unsigned)b[7] << 24);
+        for (int p = 0; p < 16; p++) {
+            int x = bx * 4 + p % 4, y = by * 4 + p / 4;
+            if (x >= w || y >= h) continue;
+            unsigned char* o = &out[((size_t)y * w + x) * 4];
+            int idx = (bits >> (2 * p)) & 3;
+            o[0] = (unsigned char)pal[idx][0]; o[1] = (unsigned char)pal[idx][1]; o[2] = (unsigned char)pal[idx][2];
+            o[3] = (unsigned char)a[(abits >> (3 * p)) & 7];
+        }
+    }
+    return out;
+}
+
+// Megapixeles por segundo de cada modo del codificador, y si el compatible sigue dando
+// los mismos bits que el escalar de siempre. Sin imagen usa una sintetica de 2048x2048.
+static int Bench(const std::string& path) {
+    int w = 2048, h = 2048, channels = 4;
+    unsigned char* img = nullptr;
+    std::vector<unsigned char> synthetic;
+    if (!path.empty()) {
+        img = SOIL_load_image(path.c_str(), &w, &h, &channels, SOIL_LOAD_RGBA);
+        if (!img) { std::cout << "No se pudo leer " << path << ": " << SOIL_last_result() << "\n"; return 1; }
+    }
+    else {
+        // Degradados con ruido y bordes duros: ni todo plano ni todo ruido
+        synthetic.resize((size_t)w * h * 4);
+        unsigned seed = 1;
+        for (int y = 0; y < h; y++) for (int x = 0; x < w; x++) {
+            unsigned char* p = &synthetic[((size_t)y * w + x) * 4];
+            seed = seed * 1664525u + 1013904223u;
+            int n = (seed >> 24) & 31;
+            p[0] = (unsigned char)std::min(255, x * 255 / w + n);
+            p[1] = (unsigned char)std::min(255, ((x / 64 + y / 64) & 1 ? 200 : 40) + n);
+            p[2] = (unsigned char)std::min(255, y * 255 / h + n);
+            p[3] = (unsigned char)((x * 7 + y * 3) & 255);
+        }
+        img = synthetic.data();
+    }
+
+    struct Variant { const char* name; int mode, threads; };
+    const Variant variants[] = {
+        { "escalar, 1 hilo (referencia)", SOIL_DXT_COMPATIBLE | SOIL_DXT_NO_SIMD, 1 },
+        { "compatible, 1 hilo", SOIL_DXT_COMPATIBLE, 1 },
+        { "compatible, todos los hilos", SOIL_DXT_COMPATIBLE, 0 },
+        { "rapido, todos los hilos", SOIL_DXT_FAST, 0 },
+        { "alta calidad, todos los hilos", SOIL_DXT_HIGH_QUALITY, 0 },
+    };
+    std::cout << w << "x" << h << ", SIMD: " << get_DXT_encoder_SIMD() << ", " << std::thread::hardware_concurrency() << " hilos\n";
+    int failed = 0;
+    for (int alpha = 0; alpha < 2; alpha++) {
+        std::cout << (alpha ? "BC3\n" : "BC1\n");
+        std::vector<unsigned char> reference;
+        for (auto& v : variants) {
+            // Repite hasta medio segundo para que la medida no sea ruido
+            int size = 0, runs = 0;
+            unsigned char* dxt = nullptr;
+            auto t0 = std::chrono::steady_clock::now();
+            double s = 0.0;
+            do {
+                free(dxt);
+                dxt = alpha ? convert_image_to_DXT5_ex(img, w, h, 4, v.mode, v.threads, &size)
+                    : convert_image_to_DXT1_ex(img, w, h, 4, v.mode, v.threads, &size);
+                runs++;
+                s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            } while (s < 0.5);
+            std::vector<unsigned char> bytes(dxt, dxt + size);
+            free(dxt);
+
+            std::vector<unsigned char> decoded = DecodeDXT(bytes.data(), w, h, alpha != 0);
+            double err = 0.0;
+            for (size_t i = 0; i < decoded.size(); i++) {
+                if (!alpha && i % 4 == 3) continue;
+                double d = (double)decoded[i] - img[i];
+                err += d * d;
+            }
+            double rmse = std::sqrt(err / ((double)w * h * (alpha ? 4 : 3)));
+
+            std::string same;
+            if (reference.empty()) reference = bytes;
+            else if ((v.mode & ~SOIL_DXT_NO_SIMD) == SOIL_DXT_COMPATIBLE) {
+                same = bytes == reference ? ", identico a la referencia" : ", DISTINTO de la referencia";
+                if (bytes != reference) failed++;
+            }
+            std::cout << "  " << v.name << ": " << (double)w * h * runs / s / 1e6 << " MP/s, RMSE " << rmse << same << "\n";
+        }
+    }
+
+    // La cadena completa como la arma el cooker: cada nivel desde la imagen original
+    struct MipVariant { const char* name; int flags, threads; };
+    const MipVariant mipVariants[] = {
+        { "escalar, 1 hilo (referencia)", SOIL_MIPMAP_NO_SIMD, 1 },
+        { "SIMD, 1 hilo", SOIL_MIPMAP_COMPATIBLE, 1 },
+        { "SIMD, todos los hilos", SOIL_MIPMAP_COMPATIBLE, 0 },
+        { "gamma correcta, todos los hilos", SOIL_MIPMAP_GAMMA_CORRECT, 0 },
+    };
+    std::cout << "Mipmaps\n";
+    std::vector<unsigned char> mip((size_t)std::max(1, w / 2) * std::max(1, h / 2) * 4), reference;
+    for (auto& v : mipVariants) {
+        std::vector<unsigned char> chain;
+        int runs = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        double s = 0.0;
+        do {
+            chain.clear();
+            for (int level = 1; (1 << level) <= std::max(w, h); level++) {
+                int lw = std::max(1, w >> level), lh = std::max(1, h >> level);
+                mipmap_image_ex(img, w, h, 4, mip.data(), 1 << level, 1 << level, v.flags, v.threads);
+                chain.insert(chain.end(), mip.begin(), mip.begin() + (size_t)lw * lh * 4);
+            }
+            runs++;
+            s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        } while (s < 0.5);
+
+        // Cada nivel lee la imagen entera: los megapixeles son los de entrada
+        int levels = 0;
+        while ((1 << (levels + 1)) <= std::max(w, h)) levels++;
+        std::string same;
+        if (reference.empty()) reference = chain;
+        else if (!(v.flags & SOIL_MIPMAP_GAMMA_CORRECT)) {
+            same = chain == reference ? ", identico a la referencia" : ", DISTINTO de la referencia";
+            if (chain != reference) failed++;
+        }
+        std::cout << "  " << v.name << ": " << (double)w * h * levels * runs / s / 1e6 << " MP/s, "
+            << s * 1000.0 / runs << " ms la cadena" << same << "\n";
+    }
+
+    if (!synthetic.size()) SOIL_free_image_data(img);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    bool force = false;
+    int mode = SOIL_DXT_COMPATIBLE, mipFlags = SOIL_MIPMAP_COMPATIBLE;
+    std::vector<std::string> roots;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "--force") force = true;
+        else if (a == "--fast") mode = SOIL_DXT_FAST;
+        else if (a == "--hq") mode = SOIL_DXT_HIGH_QUALITY;
+        else if (a == "--gamma") mipFlags = SOIL_MIPMAP_GAMMA_CORRECT;
+        else if (a == "--bench") return Bench(i + 1 < argc ? argv[i + 1] : "");
+        else roots.push_back(a);
+    }
+    if (roots.empty()) roots = { "Models", "Textures" };
+
+    auto t0 = std::chrono::steady_clock::now();
+    CookStats stats;
+    for (auto& root : roots) {
+        std::error_code ec;
+        if (!fs::is_directory(root, ec)) { std::cout << "No existe la carpeta " << root << "\n"; continue; }
+        for (auto it = fs::recursive_directory_iterator(root, ec); it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec || !it->is_regular_file() || !IsImage(it->path())) continue;
+            std::string src = it->path().generic_string();
+            if (!force && CookedTextureFresh(src)) { stats.skipped++; continue; }
+            std::cout << src << "\n";
+            if (CookTexture(src, mode, mipFlags, stats)) stats.cooked++;
+            else { stats.failed++; std::cout << "  FALLO\n"; }
+        }
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << stats.cooked << " cocinadas, " << stats.skipped << " al dia, " << stats.failed << " fallidas en " << ms << " ms\n";
+    if (stats.cookedBytes)
+        std::cout << "VRAM: " << stats.rawBytes / (1024 * 1024) << " MB (RGBA) -> " << stats.cookedBytes / (1024 * 1024)
+            << " MB (" << (double)stats.rawBytes / stats.cookedBytes << "x menos)\n";
+    return stats.failed ? 1 : 0;
+}